@@ -0,0 +1,24 @@
+#pragma once
+
+#include <chrono>
+
+/*
+ * 离线基准测试，和视频程序分开编译成 yolo_test_mp4_bench，每个领域一个源文件：
+ *   bench_decode.cpp  decode、decode-parallel
+ *   bench_nms.cpp     nms、nms-batch
+ * 参数从子命令之后开始数，用法见 main.cpp
+ */
+
+using bench_clock = std::chrono::steady_clock;
+using micros = std::chrono::duration<double, std::micro>;
+
+/*随机语料的输入尺寸、原图尺寸和分数阈值，两边的基准测试共用*/
+inline constexpr int BENCH_INPUT = 640;
+inline constexpr int BENCH_ORIG_W = 1920;
+inline constexpr int BENCH_ORIG_H = 1080;
+inline constexpr float BENCH_THRESH = 0.55f;
+
+int bench_decode(int argc, char *argv[]);
+int bench_decode_parallel();
+int bench_nms();
+int bench_nms_batch(int argc, char *argv[]);
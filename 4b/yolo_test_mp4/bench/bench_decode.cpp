@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "bench.hpp"
+#include "parallel_decode.hpp"
+#include "yolo_decode.hpp"
+#include "yolo_nms.hpp"
+
+/*YOLOv8 输出头解码：逐锚点的旧写法、按行解码、按锚点分块并行*/
+
+/*改造前的 decode()：逐锚点跨行读类别分数，并且把第 4 行当成 objectness（YOLOv8 没有这一项）*/
+static void legacy_decode(const float *data, int N, int C, std::vector<Detection> &dets)
+{
+    dets.clear();
+    for (int i = 0; i < N; ++i) {
+        float cx = data[0 * N + i];
+        float cy = data[1 * N + i];
+        float w = data[2 * N + i];
+        float h = data[3 * N + i];
+        float obj = data[4 * N + i];
+        if (obj < BENCH_THRESH)
+            continue;
+
+        int best_cls_id = -1;
+        float best_cls_score = 0.0f;
+        for (int c = 5; c < C; ++c) {
+            float cls_score = data[c * N + i];
+            if (cls_score > best_cls_score) {
+                best_cls_score = cls_score;
+                best_cls_id = c - 5;
+            }
+        }
+        float x1 = (cx - w / 2.0f) * BENCH_ORIG_W / BENCH_INPUT;
+        float y1 = (cy - h / 2.0f) * BENCH_ORIG_H / BENCH_INPUT;
+        float x2 = (cx + w / 2.0f) * BENCH_ORIG_W / BENCH_INPUT;
+        float y2 = (cy + h / 2.0f) * BENCH_ORIG_H / BENCH_INPUT;
+        cv::Rect box(
+            cv::Point(std::max(int(x1), 0), std::max(int(y1), 0)),
+            cv::Point(std::min(int(x2), BENCH_ORIG_W - 1), std::min(int(y2), BENCH_ORIG_H - 1)));
+        dets.push_back({ box, best_cls_score, best_cls_id });
+    }
+}
+
+/*语义正确的逐锚点写法（类别从第 4 行开始），用来校验 decode_yolov8 的结果*/
+static void reference_decode(const float *data, int N, const class_filter &filter, std::vector<Detection> &dets)
+{
+    dets.clear();
+    for (int i = 0; i < N; ++i) {
+        int best = filter.classes[0];
+        float score = data[(4 + best) * N + i];
+        for (std::size_t k = 1; k < filter.classes.size(); ++k) {
+            int c = filter.classes[k];
+            if (data[(4 + c) * N + i] > score) {
+                score = data[(4 + c) * N + i];
+                best = c;
+            }
+        }
+        if (score < filter.thresholds[best])
+            continue;
+        yolo_detail::push_detection(data, N, i, best, score, static_cast<float>(BENCH_ORIG_W) / BENCH_INPUT,
+                                    static_cast<float>(BENCH_ORIG_H) / BENCH_INPUT, BENCH_ORIG_W, BENCH_ORIG_H, dets);
+    }
+}
+
+static bool same_detections(const std::vector<Detection> &a, const std::vector<Detection> &b)
+{
+    bool same = a.size() == b.size();
+    for (std::size_t i = 0; same && i < a.size(); ++i) {
+        same = a[i].class_id == b[i].class_id && a[i].score == b[i].score
+               && a[i].box.x == b[i].box.x && a[i].box.y == b[i].box.y
+               && a[i].box.width == b[i].box.width && a[i].box.height == b[i].box.height;
+    }
+    return same;
+}
+
+static bool load_tensor(const char *path, int &C, int &N, std::vector<float> &data)
+{
+    std::ifstream file(path, std::ios::binary);
+    int32_t dims[2] = {};
+    if (!file.read(reinterpret_cast<char *>(dims), sizeof(dims)) || dims[0] <= 4 || dims[1] <= 0) {
+        std::cerr << "无法读取张量 " << path << std::endl;
+        return false;
+    }
+    C = dims[0];
+    N = dims[1];
+    data.resize(static_cast<std::size_t>(C) * N);
+    return static_cast<bool>(file.read(reinterpret_cast<char *>(data.data()), sizeof(float) * data.size()));
+}
+
+static void random_tensor(int C, int N, std::vector<float> &data)
+{
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> coord(0.0f, 640.0f);
+    std::exponential_distribution<float> score(40.0f);
+    std::uniform_int_distribution<int> anchor(0, N - 1);
+    std::uniform_int_distribution<int> class_id(4, C - 1);
+    std::uniform_real_distribution<float> high(0.5f, 1.0f);
+    data.resize(static_cast<std::size_t>(C) * N);
+    for (int c = 0; c < C; ++c) {
+        for (int i = 0; i < N; ++i)
+            data[c * N + i] = c < 4 ? coord(rng) : std::min(score(rng), 1.0f);
+    }
+    // 一帧里通常只有几十个锚点有高分
+    for (int k = 0; k < 60; ++k)
+        data[class_id(rng) * N + anchor(rng)] = high(rng);
+}
+
+int bench_decode(int argc, char *argv[])
+{
+    constexpr int ITERATIONS = 200;
+
+    int C = 84, N = 8400;
+    std::vector<float> tensor;
+    if (argc >= 1) {
+        if (!load_tensor(argv[0], C, N, tensor))
+            return -1;
+    } else {
+        random_tensor(C, N, tensor);
+    }
+
+    std::vector<Detection> legacy, reference, decoded;
+    legacy.reserve(N);
+    reference.reserve(N);
+    decoded.reserve(N);
+
+    auto start = bench_clock::now();
+    for (int i = 0; i < ITERATIONS; ++i)
+        legacy_decode(tensor.data(), N, C, legacy);
+    auto legacy_time = micros(bench_clock::now() - start) / ITERATIONS;
+    std::cout << "张量 (" << C << ", " << N << ")，阈值 " << BENCH_THRESH << std::endl;
+    std::cout << "旧 decode（第4行当 objectness）: " << legacy_time.count() << "us/帧，" << legacy.size() << "个框" << std::endl;
+
+    // 80 类全开，和只看人（0）、车（2）两类，后者给人一个更低的阈值
+    const class_filter filters[] = {
+        class_filter(C - 4, BENCH_THRESH),
+        class_filter(C - 4, BENCH_THRESH, { { 0, BENCH_THRESH - 0.05f }, { 2, BENCH_THRESH } }),
+    };
+    bool all_same = true;
+    for (auto &filter : filters) {
+        start = bench_clock::now();
+        for (int i = 0; i < ITERATIONS; ++i)
+            reference_decode(tensor.data(), N, filter, reference);
+        auto reference_time = micros(bench_clock::now() - start) / ITERATIONS;
+
+        start = bench_clock::now();
+        for (int i = 0; i < ITERATIONS; ++i)
+            decode_yolov8(tensor.data(), N, C, filter, BENCH_INPUT, BENCH_INPUT, BENCH_ORIG_W, BENCH_ORIG_H, decoded);
+        auto decode_time = micros(bench_clock::now() - start) / ITERATIONS;
+
+        bool same = same_detections(reference, decoded);
+        all_same = all_same && same;
+        std::cout << "[" << filter.classes.size() << "类] 逐锚点跨行读取: " << reference_time.count() << "us/帧，" << reference.size() << "个框" << std::endl;
+        std::cout << "[" << filter.classes.size() << "类] 按行扫描 + SIMD: " << decode_time.count() << "us/帧，" << decoded.size() << "个框，"
+                  << (same ? "结果与逐锚点一致" : "结果不一致！") << std::endl;
+    }
+    return all_same ? 0 : -1;
+}
+
+static bool same_detections(const detection_soa &a, const detection_soa &b)
+{
+    return a.x1 == b.x1 && a.y1 == b.y1 && a.x2 == b.x2 && a.y2 == b.y2 && a.score == b.score && a.class_id == b.class_id;
+}
+
+int bench_decode_parallel()
+{
+    constexpr int C = 84;
+    constexpr int ITERATIONS = 100;
+
+    bool all_same = true;
+    for (int input : { 640, 1280 }) {
+        // 三个尺度的特征图：stride 8 / 16 / 32
+        const int N = (input / 8) * (input / 8) + (input / 16) * (input / 16) + (input / 32) * (input / 32);
+        std::vector<float> tensor;
+        random_tensor(C, N, tensor);
+        const class_filter filter(C - 4, BENCH_THRESH);
+
+        detection_soa serial, parallel;
+        serial.reserve(N);
+        parallel.reserve(N);
+        auto start = bench_clock::now();
+        for (int i = 0; i < ITERATIONS; ++i)
+            decode_yolov8(tensor.data(), N, C, filter, input, input, BENCH_ORIG_W, BENCH_ORIG_H, serial);
+        auto serial_time = micros(bench_clock::now() - start) / ITERATIONS;
+        std::cout << "[" << input << " 输入，" << N << " 个锚点] 单线程: " << serial_time.count() << "us，" << serial.size() << "个框" << std::endl;
+
+        for (int threads : { 2, 4 }) {
+            task_executor executor("解码", threads - 1);
+            parallel_decoder decoder(&executor);
+            decoder.decode(tensor.data(), N, C, filter, input, input, BENCH_ORIG_W, BENCH_ORIG_H, parallel);
+            start = bench_clock::now();
+            for (int i = 0; i < ITERATIONS; ++i)
+                decoder.decode(tensor.data(), N, C, filter, input, input, BENCH_ORIG_W, BENCH_ORIG_H, parallel);
+            auto parallel_time = micros(bench_clock::now() - start) / ITERATIONS;
+            bool same = same_detections(serial, parallel);
+            all_same = all_same && same;
+            std::cout << "  最多 " << threads << " 线程（实际 " << decoder.threads_for(N) << "）: " << parallel_time.count() << "us，"
+                      << (same ? "结果一致" : "结果不一致！") << std::endl;
+        }
+    }
+    return all_same ? 0 : -1;
+}
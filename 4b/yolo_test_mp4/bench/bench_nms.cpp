@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "bench.hpp"
+#include "yolo_decode.hpp"
+#include "yolo_nms.hpp"
+
+/*NMS：nms_engine 对照 cv::dnn::NMSBoxes，多路候选框一次批量处理*/
+
+/*
+ * 成簇的随机框：一个目标周围有很多高度重叠、类别大多相同的框，和 YOLO 的候选很像
+ * 分数量化到 1/256 制造同分，另有少量零面积的框（两个零面积框在 OpenCV 里算完全重叠）
+ */
+static void random_candidates(int count, unsigned seed, std::vector<Detection> &dets)
+{
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> center_x(0, BENCH_ORIG_W - 1), center_y(0, BENCH_ORIG_H - 1);
+    std::uniform_int_distribution<int> size(8, 400), jitter(-24, 24), class_id(0, 5), percent(0, 99);
+    std::uniform_int_distribution<int> score(64, 255);
+    dets.clear();
+    const int clusters = std::max(1, count / 12);
+    std::vector<Detection> centers;
+    for (int c = 0; c < clusters; ++c)
+        centers.push_back({ cv::Rect(center_x(rng), center_y(rng), size(rng), size(rng)), 0.0f, class_id(rng) });
+    for (int i = 0; i < count; ++i) {
+        auto &center = centers[i % clusters];
+        cv::Rect box(center.box.x + jitter(rng), center.box.y + jitter(rng),
+                     std::max(0, center.box.width + jitter(rng)), std::max(0, center.box.height + jitter(rng)));
+        if (percent(rng) < 2)
+            box.width = 0;
+        int cls = percent(rng) < 85 ? center.class_id : class_id(rng);
+        dets.push_back({ box, score(rng) / 256.0f, cls });
+    }
+}
+
+/*改造前 main.cpp 里的 nms()：拷贝成 boxes / scores 再交给 NMSBoxes；class_aware 时按类别平移，和 nms_engine 对照*/
+static void opencv_nms(const std::vector<Detection> &dets, const nms_params &params, std::vector<int> &keep)
+{
+    std::vector<cv::Rect> boxes;
+    std::vector<float> scores;
+    for (auto &d : dets) {
+        cv::Rect box = d.box;
+        if (params.class_aware)
+            box.x += d.class_id * 4 * BENCH_ORIG_W;
+        boxes.push_back(box);
+        scores.push_back(d.score);
+    }
+    cv::dnn::NMSBoxes(boxes, scores, params.score_threshold, params.iou_threshold, keep, 1.0f, params.top_k);
+}
+
+int bench_nms()
+{
+    constexpr int SEEDS = 20;
+    constexpr int SIZES[] = { 100, 1000, 8000 };
+
+    std::vector<Detection> aos;
+    detection_soa soa;
+    std::vector<int> expected, actual;
+    nms_engine engine;
+
+    // 语料：各种规模 x 类别无关 / 按类别 x 是否限制 top_k / max_keep，下标序列必须完全相同
+    int cases = 0, mismatches = 0;
+    for (int size : SIZES) {
+        for (unsigned seed = 0; seed < SEEDS; ++seed) {
+            random_candidates(size, seed, aos);
+            soa.clear();
+            for (auto &d : aos)
+                soa.push_back(d);
+            for (float iou : { 0.3f, 0.45f, 0.7f }) {
+                for (bool class_aware : { false, true }) {
+                    for (int top_k : { 0, size / 4 }) {
+                        nms_params params{ iou, 0.3f, top_k, 0, class_aware };
+                        opencv_nms(aos, params, expected);
+                        engine.run(soa, params, actual);
+                        cases++;
+                        mismatches += expected != actual;
+
+                        // max_keep 只截断，结果必须是完整结果的前缀
+                        params.max_keep = 10;
+                        engine.run(soa, params, actual);
+                        cases++;
+                        mismatches += !(actual.size() == std::min<std::size_t>(10, expected.size())
+                                        && std::equal(actual.begin(), actual.end(), expected.begin()));
+                    }
+                }
+            }
+        }
+    }
+    std::cout << "一致性: " << cases - mismatches << "/" << cases << " 组与 NMSBoxes 相同" << std::endl;
+
+    for (int size : SIZES) {
+        const int iterations = size >= 8000 ? 20 : (size >= 1000 ? 200 : 2000);
+        random_candidates(size, 1234, aos);
+        soa.clear();
+        for (auto &d : aos)
+            soa.push_back(d);
+        for (bool class_aware : { false, true }) {
+            nms_params params{ 0.45f, 0.0f, 0, 0, class_aware };
+            auto start = bench_clock::now();
+            for (int i = 0; i < iterations; ++i)
+                opencv_nms(aos, params, expected);
+            auto opencv_time = micros(bench_clock::now() - start) / iterations;
+
+            start = bench_clock::now();
+            for (int i = 0; i < iterations; ++i)
+                engine.run(soa, params, actual);
+            auto engine_time = micros(bench_clock::now() - start) / iterations;
+
+            params.max_keep = 300;
+            start = bench_clock::now();
+            for (int i = 0; i < iterations; ++i)
+                engine.run(soa, params, actual);
+            auto capped_time = micros(bench_clock::now() - start) / iterations;
+
+            std::cout << "[" << size << "个候选，" << (class_aware ? "按类别" : "类别无关") << "] NMSBoxes: " << opencv_time.count()
+                      << "us，nms_engine: " << engine_time.count() << "us，max_keep=300: " << capped_time.count()
+                      << "us，保留 " << expected.size() << " 个" << std::endl;
+        }
+    }
+    return mismatches == 0 ? 0 : -1;
+}
+
+int bench_nms_batch(int argc, char *argv[])
+{
+    constexpr int FRAMES = 200;
+    const int streams = argc >= 1 ? std::max(1, std::atoi(argv[0])) : 8;
+
+    nms_engine engine;
+    const nms_params params{ 0.45f, 0.0f, 0, 300, true };
+    std::vector<Detection> aos;
+    std::vector<int> keep, batch_keep;
+    std::vector<uint32_t> offsets, keep_offsets;
+
+    bool all_same = true;
+    for (int size : { 30, 100, 1000 }) {
+        // 每路一个独立的 detection_soa（逐帧调用时的样子），同时依次追加到一个扁平的 batch 里
+        std::vector<detection_soa> frames(streams);
+        detection_soa batch;
+        offsets.assign(1, 0);
+        for (int s = 0; s < streams; ++s) {
+            random_candidates(size, 100 + s, aos);
+            for (auto &d : aos) {
+                frames[s].push_back(d);
+                batch.push_back(d);
+            }
+            offsets.push_back(static_cast<uint32_t>(batch.size()));
+        }
+
+        engine.run_batched(batch, offsets, params, batch_keep, keep_offsets);
+        bool same = true;
+        for (int s = 0; s < streams; ++s) {
+            engine.run(frames[s], params, keep);
+            for (auto &index : keep)
+                index += static_cast<int>(offsets[s]);
+            same = same && std::equal(keep.begin(), keep.end(), batch_keep.begin() + keep_offsets[s], batch_keep.begin() + keep_offsets[s + 1]);
+        }
+        all_same = all_same && same;
+
+        auto start = bench_clock::now();
+        for (int i = 0; i < FRAMES; ++i) {
+            for (auto &frame : frames)
+                engine.run(frame, params, keep);
+        }
+        auto per_frame_time = micros(bench_clock::now() - start) / FRAMES;
+
+        start = bench_clock::now();
+        for (int i = 0; i < FRAMES; ++i)
+            engine.run_batched(batch, offsets, params, batch_keep, keep_offsets);
+        auto batched_time = micros(bench_clock::now() - start) / FRAMES;
+
+        std::cout << "[" << streams << "路 x " << size << "个候选] 逐帧 run: " << per_frame_time.count() << "us，run_batched: "
+                  << batched_time.count() << "us，保留 " << batch_keep.size() << " 个，" << (same ? "结果一致" : "结果不一致！") << std::endl;
+    }
+    return all_same ? 0 : -1;
+}
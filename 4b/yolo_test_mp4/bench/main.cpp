@@ -0,0 +1,38 @@
+#include <iostream>
+#include <string_view>
+
+#include "bench.hpp"
+
+/*
+ * 离线对比解码器，用法：
+ *   yolo_test_mp4_bench decode [张量文件]
+ * 张量文件由 main.cpp 在 RECORD_OUTPUT_PATH 非空时录下：int32 C、int32 N，然后是 C * N 个 float
+ * 不给文件时用随机数据（大部分分数很低，少量锚点过阈值），只能看耗时
+ *
+ *   yolo_test_mp4_bench nms
+ * 在 100 / 1000 / 8000 个候选框的随机语料上对比 nms_engine 和 cv::dnn::NMSBoxes，结果必须逐个下标一致
+ *
+ *   yolo_test_mp4_bench decode-parallel
+ * 640 / 1280 输入（8400 / 33600 个锚点）下对比单线程 decode_yolov8 和按锚点分块的 parallel_decoder，结果必须一致
+ *
+ *   yolo_test_mp4_bench nms-batch [路数]
+ * 多路摄像头的候选框放进一个扁平缓冲区一次做 NMS（run_batched），和逐帧调用 run 对比，结果必须一致
+ */
+
+int main(int argc, char *argv[])
+{
+    // 跳过程序名，argv[0] 是子命令
+    argc--;
+    argv++;
+    if (argc >= 1 && std::string_view(argv[0]) == "decode")
+        return bench_decode(argc - 1, argv + 1);
+    if (argc >= 1 && std::string_view(argv[0]) == "decode-parallel")
+        return bench_decode_parallel();
+    if (argc >= 1 && std::string_view(argv[0]) == "nms")
+        return bench_nms();
+    if (argc >= 1 && std::string_view(argv[0]) == "nms-batch")
+        return bench_nms_batch(argc - 1, argv + 1);
+
+    std::cerr << "用法: yolo_test_mp4_bench decode [张量文件] | decode-parallel | nms | nms-batch [路数]" << std::endl;
+    return 1;
+}
@@ -2,34 +2,46 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <fstream>
+#include <optional>
 #include <opencv2/opencv.hpp>
 #include <onnxruntime_cxx_api.h>
 
+#include "yolo_decode.hpp"
+#include "yolo_nms.hpp"
+#include "parallel_decode.hpp"
+#include "tracker.hpp"
+
 static const int INPUT_W = 640;
 static const int INPUT_H = 640;
 static const float CONF_THRESH = 0.55f; // 和你 Python 一样
 static const float NMS_THRESH = 0.45f;
+static const int NUM_CLASSES = 80;
+// 解码最多用几个线程（含主线程），实际线程数按锚点数定：640 输入单线程，1280 输入才会并行
+static const int DECODE_MAX_THREADS = 4;
+// 跟踪稳定时最多每几帧推理一次，跳过的帧画跟踪器外推的框；1 = 每帧都推理
+static const int TRACKER_MAX_STRIDE = 4;
+
+// 只解码这些类别，每类一个阈值，例如只看人和车：{ { 0, 0.5f }, { 2, 0.45f }, { 5, 0.45f }, { 7, 0.45f } }
+// 为空则 80 类全部解码，统一用 CONF_THRESH；没启用的类别行完全不读
+static const std::vector<std::pair<int, float> > CLASSES_OF_INTEREST = {};
 
-struct Detection {
-    cv::Rect box;
-    float score;
-    int class_id;
-};
+// 按类别做 NMS（和 Python 端 ultralytics 默认的 agnostic=False 一致），最多保留 300 个框
+// 这里只做几何上的 NMS，分数阈值设为 0，置信度过滤已经在 decode 阶段完成
+static const nms_params NMS_PARAMS = { NMS_THRESH, 0.0f, 0, 300, true };
 
-std::vector<int> nms(const std::vector<Detection> &dets)
+static nms_engine g_nms_engine;
+
+void nms(const detection_soa &dets, std::vector<int> &keep)
 {
-    std::vector<int> keep;
-    std::vector<cv::Rect> boxes;
-    std::vector<float> scores;
-    for (auto &d : dets) {
-        boxes.push_back(d.box);
-        scores.push_back(d.score);
-    }
+    g_nms_engine.run(dets, NMS_PARAMS, keep);
+}
 
-    // 这里只做几何上的 NMS，分数阈值设为 0，
-    // 置信度过滤已经在 decode 阶段完成
-    cv::dnn::NMSBoxes(boxes, scores, 0.0f, NMS_THRESH, keep);
-    return keep;
+// 多路摄像头 / batch 输出共用一个后处理线程时用：各帧用 decode_yolov8_append 依次追加到同一个 dets，
+// offsets 记下每帧的起止（帧数 + 1 个），第 s 帧保留的下标是 keep[keep_offsets[s] .. keep_offsets[s + 1])
+void nms_batched(const detection_soa &dets, std::span<const uint32_t> offsets, std::vector<int> &keep, std::vector<uint32_t> &keep_offsets)
+{
+    g_nms_engine.run_batched(dets, offsets, NMS_PARAMS, keep, keep_offsets);
 }
 
 // 🔁 和 Python 完全对齐的预处理：resize -> RGB -> /255 -> CHW
@@ -56,75 +68,8 @@ void preprocess(const cv::Mat &frame, std::vector<float> &input_tensor_values)
     std::cout << float_img.at<cv::Vec3f>(0, 0) << std::endl;
 }
 
-// 解析 YOLOv8 输出 (1,84,8400)，不转置，按通道优先方式直接访问
-std::vector<Detection> decode(
-    const float *data,
-    int num_rows, // 8400
-    int num_cols, // 84
-    int orig_w,
-    int orig_h)
-{
-    std::vector<Detection> dets;
-    float max_obj = 0.0f, max_cls = 0.0f;
-
-    // data layout: [1, C=84, N=8400]
-    // 索引: data[c * N + i]
-    int C = num_cols;
-    int N = num_rows;
-
-    for (int i = 0; i < N; ++i) {
-        float cx = data[0 * N + i];
-        float cy = data[1 * N + i];
-        float w = data[2 * N + i];
-        float h = data[3 * N + i];
-        float obj = data[4 * N + i];
-
-        if (obj < CONF_THRESH)
-            continue;
-
-        // 找最大类别分数
-        int best_cls_id = -1;
-        float best_cls_score = 0.0f;
-
-        for (int c = 5; c < C; ++c) {
-            // 模型已经输出的是概率（和 Python 一样），不需要再 sigmoid
-            float cls_score = data[c * N + i];
-
-            if (cls_score > best_cls_score) {
-                best_cls_score = cls_score;
-                best_cls_id = c - 5; // 类别索引
-            }
-        }
-
-        max_obj = std::max(max_obj, obj);
-        max_cls = std::max(max_cls, best_cls_score);
-
-        // 只用 obj 做一次阈值过滤，与 Python 对齐
-        float final_score = best_cls_score;
-
-        // cxcywh -> xyxy（坐标在 0~640）
-        float x1 = cx - w / 2.0f;
-        float y1 = cy - h / 2.0f;
-        float x2 = cx + w / 2.0f;
-        float y2 = cy + h / 2.0f;
-
-        // 映射回原图尺寸（和你 Python 完全一致）
-        x1 = x1 * orig_w / INPUT_W;
-        y1 = y1 * orig_h / INPUT_H;
-        x2 = x2 * orig_w / INPUT_W;
-        y2 = y2 * orig_h / INPUT_H;
-
-        cv::Rect box(
-            cv::Point(std::max(int(x1), 0), std::max(int(y1), 0)),
-            cv::Point(std::min(int(x2), orig_w - 1), std::min(int(y2), orig_h - 1)));
-
-        dets.push_back({ box, final_score, best_cls_id });
-    }
-
-    std::cout << "max obj=" << max_obj << " max cls=" << max_cls << std::endl;
-
-    return dets;
-}
+// 录下第一帧的原始输出张量（float，(1,84,8400)），供 yolo_test_mp4_bench decode 对比解码器；为空则不录
+static const char *RECORD_OUTPUT_PATH = "";
 
 int main()
 {
@@ -159,9 +104,39 @@ int main()
     // cv::namedWindow("YOLOv8", cv::WINDOW_NORMAL);
 
     cv::Mat frame;
+    detection_soa dets;
+    std::vector<int> keep;
+    const class_filter filter(NUM_CLASSES, CONF_THRESH, CLASSES_OF_INTEREST);
+    // 拿到第一帧的输出形状后再按锚点数创建：解码的工作线程不含主线程，只用一个线程（640 输入）时不创建执行器
+    std::optional<task_executor> decode_executor;
+    std::optional<parallel_decoder> decoder;
+    tracker_params track_params;
+    track_params.high_score = CONF_THRESH;
+    track_params.max_stride = TRACKER_MAX_STRIDE;
+    multi_tracker tracker(track_params);
+    std::vector<track_box> track_input;
+    // 跟踪器的时间轴用帧号 / 帧率，读不到帧率时按 30fps
+    const double video_fps = cap.get(cv::CAP_PROP_FPS) > 0 ? cap.get(cv::CAP_PROP_FPS) : 30.0;
+    long frame_index = 0;
+    bool recorded = false;
     while (cap.read(frame)) {
         int orig_w = frame.cols;
         int orig_h = frame.rows;
+        const double frame_time = frame_index++ / video_fps;
+
+        if (!tracker.should_infer()) {
+            tracker.for_each_visible(frame_time, [&frame](const multi_tracker::track &t, const track_box &box) {
+                cv::Rect rect(cv::Point(static_cast<int>(box.x1), static_cast<int>(box.y1)), cv::Point(static_cast<int>(box.x2), static_cast<int>(box.y2)));
+                cv::rectangle(frame, rect, cv::Scalar(0, 255, 0), 2);
+                char text[64];
+                sprintf(text, "%d: %.2f #%u", box.class_id, box.score, t.id);
+                cv::putText(frame, text, rect.tl(), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0, 255, 0), 1);
+            });
+            cv::imshow("YOLOv8", frame);
+            if (cv::waitKey(1) == 'q')
+                break;
+            continue;
+        }
 
         std::vector<float> input_tensor;
         preprocess(frame, input_tensor);
@@ -212,12 +187,36 @@ int main()
 		std::cout << std::endl;
 		*/
 
-        auto dets = decode(data, N, C, orig_w, orig_h);
-        auto keep = nms(dets);
+        if (RECORD_OUTPUT_PATH[0] != '\0' && !recorded) {
+            std::ofstream file(RECORD_OUTPUT_PATH, std::ios::binary);
+            int32_t dims[2] = { C, N };
+            file.write(reinterpret_cast<const char *>(dims), sizeof(dims));
+            file.write(reinterpret_cast<const char *>(data), sizeof(float) * C * N);
+            recorded = true;
+        }
+
+        if (!decoder) {
+            const int decode_threads = decode_threads_for(N, DECODE_MAX_THREADS);
+            if (decode_threads > 1)
+                decode_executor.emplace("解码", decode_threads - 1);
+            decoder.emplace(decode_executor ? &*decode_executor : nullptr);
+        }
+        auto decode_start = cv::getTickCount();
+        decoder->decode(data, N, C, filter, INPUT_W, INPUT_H, orig_w, orig_h, dets);
+        std::cout << "解码耗时: " << (cv::getTickCount() - decode_start) * 1000.0f / cv::getTickFrequency() << " ms" << std::endl;
+        auto nms_start = cv::getTickCount();
+        nms(dets, keep);
+        std::cout << "NMS耗时: " << (cv::getTickCount() - nms_start) * 1000.0f / cv::getTickFrequency() << " ms，" << dets.size() << " -> " << keep.size() << std::endl;
+
+        track_input.clear();
+        for (int idx : keep)
+            track_input.push_back({ dets.x1[idx], dets.y1[idx], dets.x2[idx], dets.y2[idx], dets.score[idx], dets.class_id[idx] });
+        tracker.update(frame_time, track_input);
+        std::cout << "跟踪步长: " << tracker.stride() << std::endl;
 
         // 画框
         for (int idx : keep) {
-            auto &d = dets[idx];
+            auto d = dets[idx];
             cv::rectangle(frame, d.box, cv::Scalar(0, 255, 0), 2);
             char text[64];
             sprintf(text, "%d: %.2f", d.class_id, d.score);
@@ -234,5 +233,7 @@ int main()
             break;
     }
 
+    auto &stats = tracker.statistics();
+    std::cout << "共" << stats.frames << "帧，推理" << stats.inferences << "帧" << std::endl;
     return 0;
 }
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "work_stealing.hpp"
+#include "yolo_decode.hpp"
+
+/*每个线程至少分到这么多个锚点才值得并行；640 输入（8400 个锚点）保持单线程，1280 输入（33600 个）用 4 个线程*/
+inline constexpr int DECODE_ANCHORS_PER_THREAD = 8192;
+
+inline int decode_threads_for(int num_anchors, int max_threads)
+{
+    return std::clamp(num_anchors / DECODE_ANCHORS_PER_THREAD, 1, std::max(1, max_threads));
+}
+
+/*
+ * 大输入分辨率下按锚点分块并行解码：锚点区间按线程数切成若干块（边界对齐到 DECODE_TILE），
+ * 每块写自己的候选缓冲区，按锚点顺序合并，结果和单线程 decode_yolov8 完全相同
+ * 候选缓冲区按块的锚点数预留，稳态下不分配内存
+ * 分块交给和 5/ 下的程序共用的 task_executor 执行，调用线程自己做第一块；executor 为空时只用调用线程
+ */
+class parallel_decoder {
+public:
+    /*最多用 executor 的工作线程数 + 1（调用线程）个线程；executor 由调用方持有，要比 parallel_decoder 活得久*/
+    explicit parallel_decoder(task_executor *executor)
+        : executor_(executor), tiles_(executor != nullptr ? executor->worker_count() + 1 : 1)
+    {
+    }
+
+    /*本次解码用的线程数，只由锚点数决定*/
+    int threads_for(int num_anchors) const
+    {
+        return decode_threads_for(num_anchors, static_cast<int>(tiles_.size()));
+    }
+
+    void decode(const float *data, int num_anchors, int num_channels, const class_filter &filter,
+                int input_w, int input_h, int orig_w, int orig_h, detection_soa &dets)
+    {
+        dets.clear();
+        const int threads = threads_for(num_anchors);
+        if (threads == 1) {
+            decode_yolov8_append(data, num_anchors, num_channels, filter, input_w, input_h, orig_w, orig_h, dets);
+            return;
+        }
+
+        const int per_tile = (num_anchors / threads + DECODE_TILE - 1) / DECODE_TILE * DECODE_TILE;
+        auto decode_tile = [&](std::size_t index) {
+            const int tile = static_cast<int>(index);
+            int begin = std::min(num_anchors, tile * per_tile);
+            int end = tile == threads - 1 ? num_anchors : std::min(num_anchors, begin + per_tile);
+            auto &out = tiles_[tile];
+            out.clear();
+            out.reserve(static_cast<std::size_t>(end - begin));
+            yolo_detail::decode_range(data, num_anchors, num_channels, filter, input_w, input_h, orig_w, orig_h, begin, end, out);
+        };
+        parallel_for(executor_, static_cast<std::size_t>(threads), decode_tile);
+
+        std::size_t total = 0;
+        for (int tile = 0; tile < threads; ++tile)
+            total += tiles_[tile].size();
+        dets.reserve(total);
+        for (int tile = 0; tile < threads; ++tile)
+            dets.append(tiles_[tile]);
+    }
+
+private:
+    task_executor *executor_;
+    std::vector<detection_soa> tiles_;
+};
@@ -0,0 +1,282 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+struct Detection {
+    cv::Rect box;
+    float score;
+    int class_id;
+};
+
+/*
+ * 结构体数组形式的检测结果，decode_yolov8 可以直接写进来，NMS 按列读取不用再拷一遍
+ * x2/y2 是不含的右下角（x + width），和 cv::Rect::br() 一致；坐标都是整数像素，用 float 存不丢精度
+ */
+struct detection_soa {
+    std::vector<float> x1, y1, x2, y2;
+    std::vector<float> score;
+    std::vector<int32_t> class_id;
+
+    std::size_t size() const
+    {
+        return score.size();
+    }
+    void clear()
+    {
+        x1.clear();
+        y1.clear();
+        x2.clear();
+        y2.clear();
+        score.clear();
+        class_id.clear();
+    }
+    void reserve(std::size_t n)
+    {
+        x1.reserve(n);
+        y1.reserve(n);
+        x2.reserve(n);
+        y2.reserve(n);
+        score.reserve(n);
+        class_id.reserve(n);
+    }
+    void append(const detection_soa &other)
+    {
+        x1.insert(x1.end(), other.x1.begin(), other.x1.end());
+        y1.insert(y1.end(), other.y1.begin(), other.y1.end());
+        x2.insert(x2.end(), other.x2.begin(), other.x2.end());
+        y2.insert(y2.end(), other.y2.begin(), other.y2.end());
+        score.insert(score.end(), other.score.begin(), other.score.end());
+        class_id.insert(class_id.end(), other.class_id.begin(), other.class_id.end());
+    }
+    void push_back(const Detection &d)
+    {
+        x1.push_back(static_cast<float>(d.box.x));
+        y1.push_back(static_cast<float>(d.box.y));
+        x2.push_back(static_cast<float>(d.box.x + d.box.width));
+        y2.push_back(static_cast<float>(d.box.y + d.box.height));
+        score.push_back(d.score);
+        class_id.push_back(d.class_id);
+    }
+
+    cv::Rect box(std::size_t i) const
+    {
+        return cv::Rect(static_cast<int>(x1[i]), static_cast<int>(y1[i]),
+                        static_cast<int>(x2[i] - x1[i]), static_cast<int>(y2[i] - y1[i]));
+    }
+    Detection operator[](std::size_t i) const
+    {
+        return { box(i), score[i], class_id[i] };
+    }
+};
+
+/*
+ * 解析 YOLOv8 输出 (1, 4 + 类别数, N)，通道优先：data[c * N + i]
+ * 前 4 行是 cx/cy/w/h（输入像素坐标），之后每行是一个类别的概率；YOLOv8 没有 objectness，分数就是最大类别概率
+ *
+ * 逐锚点去跨 80 行取类别分数，每次读都落在不同的 cache line 上。这里改成按 DECODE_TILE 个锚点一组，
+ * 逐行扫过启用的类别：每行只读连续的 DECODE_TILE 个 float（正好一条 cache line），
+ * 每个锚点的当前最大值和 argmax 一直留在 SIMD 寄存器里，扫完全部启用的类别才写回
+ * 只有最大分数过阈值的锚点才做坐标换算
+ */
+inline constexpr int DECODE_TILE = 16;
+
+/*
+ * 感兴趣的类别和各自的置信度阈值。只扫 classes 里的类别行，没启用的类别一个字节都不读
+ * argmax 也只在启用的类别之间取，再和该类自己的阈值比较
+ */
+struct class_filter {
+    std::vector<int32_t> classes;  // 启用的类别 id，升序
+    std::vector<float> thresholds; // 下标为类别 id
+
+    /*enabled 为空时启用全部 num_classes 个类别，阈值都是 default_threshold；超出 num_classes 的类别忽略*/
+    class_filter(int num_classes, float default_threshold, const std::vector<std::pair<int, float> > &enabled = {})
+        : thresholds(num_classes, default_threshold)
+    {
+        for (auto [class_id, threshold] : enabled) {
+            if (class_id < 0 || class_id >= num_classes)
+                continue;
+            classes.push_back(class_id);
+            thresholds[class_id] = threshold;
+        }
+        if (classes.empty()) {
+            for (int class_id = 0; class_id < num_classes; ++class_id)
+                classes.push_back(class_id);
+        }
+        std::sort(classes.begin(), classes.end());
+        classes.erase(std::unique(classes.begin(), classes.end()), classes.end());
+    }
+};
+
+namespace yolo_detail {
+
+template <typename Output>
+inline void push_detection(const float *data, int N, int i, int class_id, float score,
+                           float scale_x, float scale_y, int orig_w, int orig_h, Output &dets)
+{
+    float cx = data[0 * N + i];
+    float cy = data[1 * N + i];
+    float w = data[2 * N + i];
+    float h = data[3 * N + i];
+
+    // cxcywh -> xyxy，再映射回原图尺寸
+    float x1 = (cx - w / 2.0f) * scale_x;
+    float y1 = (cy - h / 2.0f) * scale_y;
+    float x2 = (cx + w / 2.0f) * scale_x;
+    float y2 = (cy + h / 2.0f) * scale_y;
+
+    cv::Rect box(
+        cv::Point(std::max(int(x1), 0), std::max(int(y1), 0)),
+        cv::Point(std::min(int(x2), orig_w - 1), std::min(int(y2), orig_h - 1)));
+    dets.push_back(Detection{ box, score, class_id });
+}
+
+/*一组 DECODE_TILE 个锚点在 classes 这些类别行上的扫描，结果写到 best_score / best_class*/
+inline void tile_argmax(const float *class_rows, int N, const int32_t *classes, int class_count, int first, float *best_score, int32_t *best_class)
+{
+#if defined(__ARM_NEON)
+    const float *row = class_rows + static_cast<std::size_t>(classes[0]) * N + first;
+    float32x4_t m0 = vld1q_f32(row + 0), m1 = vld1q_f32(row + 4), m2 = vld1q_f32(row + 8), m3 = vld1q_f32(row + 12);
+    uint32x4_t a0 = vdupq_n_u32(static_cast<uint32_t>(classes[0])), a1 = a0, a2 = a0, a3 = a0;
+    for (int k = 1; k < class_count; ++k) {
+        row = class_rows + static_cast<std::size_t>(classes[k]) * N + first;
+        uint32x4_t id = vdupq_n_u32(static_cast<uint32_t>(classes[k]));
+        float32x4_t s0 = vld1q_f32(row + 0), s1 = vld1q_f32(row + 4), s2 = vld1q_f32(row + 8), s3 = vld1q_f32(row + 12);
+        // 严格大于才替换，和逐个比较时取第一个最大值的行为一致
+        a0 = vbslq_u32(vcgtq_f32(s0, m0), id, a0);
+        a1 = vbslq_u32(vcgtq_f32(s1, m1), id, a1);
+        a2 = vbslq_u32(vcgtq_f32(s2, m2), id, a2);
+        a3 = vbslq_u32(vcgtq_f32(s3, m3), id, a3);
+        m0 = vmaxq_f32(s0, m0);
+        m1 = vmaxq_f32(s1, m1);
+        m2 = vmaxq_f32(s2, m2);
+        m3 = vmaxq_f32(s3, m3);
+    }
+    vst1q_f32(best_score + 0, m0);
+    vst1q_f32(best_score + 4, m1);
+    vst1q_f32(best_score + 8, m2);
+    vst1q_f32(best_score + 12, m3);
+    auto cls = reinterpret_cast<uint32_t *>(best_class);
+    vst1q_u32(cls + 0, a0);
+    vst1q_u32(cls + 4, a1);
+    vst1q_u32(cls + 8, a2);
+    vst1q_u32(cls + 12, a3);
+#elif defined(__SSE2__)
+    // PC 上调试用，和 NEON 版本一一对应；SSE2 没有 blend，用 and/andnot 选择
+    const float *row = class_rows + static_cast<std::size_t>(classes[0]) * N + first;
+    __m128 m[4];
+    __m128i a[4];
+    for (int q = 0; q < 4; ++q) {
+        m[q] = _mm_loadu_ps(row + 4 * q);
+        a[q] = _mm_set1_epi32(classes[0]);
+    }
+    for (int k = 1; k < class_count; ++k) {
+        row = class_rows + static_cast<std::size_t>(classes[k]) * N + first;
+        __m128i id = _mm_set1_epi32(classes[k]);
+        for (int q = 0; q < 4; ++q) {
+            __m128 s = _mm_loadu_ps(row + 4 * q);
+            __m128i greater = _mm_castps_si128(_mm_cmpgt_ps(s, m[q]));
+            a[q] = _mm_or_si128(_mm_and_si128(greater, id), _mm_andnot_si128(greater, a[q]));
+            m[q] = _mm_max_ps(s, m[q]);
+        }
+    }
+    for (int q = 0; q < 4; ++q) {
+        _mm_storeu_ps(best_score + 4 * q, m[q]);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(best_class + 4 * q), a[q]);
+    }
+#else
+    const float *row = class_rows + static_cast<std::size_t>(classes[0]) * N + first;
+    float m[DECODE_TILE];
+    int32_t a[DECODE_TILE];
+    for (int j = 0; j < DECODE_TILE; ++j) {
+        m[j] = row[j];
+        a[j] = classes[0];
+    }
+    for (int k = 1; k < class_count; ++k) {
+        row = class_rows + static_cast<std::size_t>(classes[k]) * N + first;
+        for (int j = 0; j < DECODE_TILE; ++j) {
+            bool greater = row[j] > m[j];
+            a[j] = greater ? classes[k] : a[j];
+            m[j] = greater ? row[j] : m[j];
+        }
+    }
+    std::copy(m, m + DECODE_TILE, best_score);
+    std::copy(a, a + DECODE_TILE, best_class);
+#endif
+}
+
+/*只解码锚点 [begin, end)，结果追加到 dets；begin 是 DECODE_TILE 的倍数时每组读的都是整条 cache line*/
+template <typename Output>
+inline void decode_range(const float *data, int num_anchors, int num_channels, const class_filter &filter,
+                         int input_w, int input_h, int orig_w, int orig_h, int begin, int end, Output &dets)
+{
+    const int N = num_anchors;
+    const int num_classes = num_channels - 4;
+    // filter 可能按更多类别构造，只保留模型实际输出的类别
+    const int32_t *classes = filter.classes.data();
+    const int class_count = static_cast<int>(std::lower_bound(filter.classes.begin(), filter.classes.end(), num_classes) - filter.classes.begin());
+    if (num_classes <= 0 || class_count == 0)
+        return;
+
+    const float *class_rows = data + 4 * N;
+    const float *thresholds = filter.thresholds.data();
+    const float scale_x = static_cast<float>(orig_w) / input_w;
+    const float scale_y = static_cast<float>(orig_h) / input_h;
+
+    alignas(16) float best_score[DECODE_TILE];
+    alignas(16) int32_t best_class[DECODE_TILE];
+    int i = begin;
+    for (; i + DECODE_TILE <= end; i += DECODE_TILE) {
+        tile_argmax(class_rows, N, classes, class_count, i, best_score, best_class);
+        for (int k = 0; k < DECODE_TILE; ++k) {
+            if (best_score[k] >= thresholds[best_class[k]])
+                push_detection(data, N, i + k, best_class[k], best_score[k], scale_x, scale_y, orig_w, orig_h, dets);
+        }
+    }
+
+    // 不足一组的尾部锚点（8400 正好是 16 的倍数，其它输入尺寸才会走到这里）
+    for (; i < end; ++i) {
+        int best = classes[0];
+        float score = class_rows[best * N + i];
+        for (int k = 1; k < class_count; ++k) {
+            float s = class_rows[classes[k] * N + i];
+            if (s > score) {
+                score = s;
+                best = classes[k];
+            }
+        }
+        if (score >= thresholds[best])
+            push_detection(data, N, i, best, score, scale_x, scale_y, orig_w, orig_h, dets);
+    }
+}
+
+} // namespace yolo_detail
+
+/*
+ * 把 filter 启用的类别里分数不低于该类阈值的框追加到 dets，坐标在原图尺寸下；input_w/input_h 是模型输入尺寸（直接 resize，没有 letterbox）
+ * dets 可以是 std::vector<Detection> 或 detection_soa；多帧依次追加到同一个 detection_soa 就是 nms_engine::run_batched 的输入
+ */
+template <typename Output>
+inline void decode_yolov8_append(const float *data, int num_anchors, int num_channels, const class_filter &filter,
+                                 int input_w, int input_h, int orig_w, int orig_h, Output &dets)
+{
+    yolo_detail::decode_range(data, num_anchors, num_channels, filter, input_w, input_h, orig_w, orig_h, 0, num_anchors, dets);
+}
+
+/*同 decode_yolov8_append，先清空 dets*/
+template <typename Output>
+inline void decode_yolov8(const float *data, int num_anchors, int num_channels, const class_filter &filter,
+                          int input_w, int input_h, int orig_w, int orig_h, Output &dets)
+{
+    dets.clear();
+    decode_yolov8_append(data, num_anchors, num_channels, filter, input_w, input_h, orig_w, orig_h, dets);
+}
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <climits>
+#include <cstring>
+#include <span>
+#include <vector>
+
+#include "yolo_decode.hpp"
+
+/*
+ * 贪心 NMS，结果和 cv::dnn::NMSBoxes（eta = 1）逐个下标一致：
+ * 分数严格大于 score_threshold 的框按分数降序处理（同分时下标小的在前，等价于 NMSBoxes 里的 stable_sort），
+ * 和任何一个已保留的框重叠度大于 iou_threshold 就丢掉
+ */
+struct nms_params {
+    float iou_threshold = 0.45f;
+    float score_threshold = 0.0f;
+    int top_k = 0;           // 只考虑分数最高的 top_k 个候选，0 表示全部（即 NMSBoxes 的 top_k）
+    int max_keep = 0;        // 保留够这么多个框就停，0 表示不限
+    bool class_aware = true; // 不同类别的框互不抑制，等价于按类别平移后再做 NMSBoxes
+};
+
+/*
+ * 输入是 detection_soa，不再拷贝成 cv::Rect / score 两个 vector
+ * 排序只对 64 位 key（分数在高 32 位、下标在低 32 位）做部分排序：先排出前一段候选，
+ * NMS 用完这一段还没保留够 max_keep 才接着排下一段；key 互不相等，所以分段排序和整体排序的顺序完全一样
+ * 已保留的框按列存一份，新候选和它们的 IoU 每次算 4 个（NEON / SSE2），
+ * 只有落在阈值附近的才用和 OpenCV 一样的双精度公式复核，保证边界上的取舍也一致
+ * 中间缓冲区都是成员，同一个实例反复调用不再分配内存
+ */
+class nms_engine {
+public:
+    /*keep 会被清空后填入保留下来的框在 dets 里的下标，按分数降序*/
+    void run(const detection_soa &dets, const nms_params &params, std::vector<int> &keep);
+
+    /*
+     * 多帧 / 多路摄像头一次做完：dets 里依次放着各段的框，第 s 段是 [offsets[s], offsets[s + 1])，段与段之间互不抑制
+     * 结果同样是扁平的：第 s 段保留的下标（dets 里的全局下标）是 keep[keep_offsets[s] .. keep_offsets[s + 1])，
+     * 每段的结果和对该段单独调用 run 完全相同；params 对每段分别生效（top_k、max_keep 都是每段的上限）
+     */
+    void run_batched(const detection_soa &dets, std::span<const uint32_t> offsets, const nms_params &params,
+                     std::vector<int> &keep, std::vector<uint32_t> &keep_offsets);
+
+private:
+    // 第一段至少排这么多个候选，之后每段翻倍
+    static constexpr std::size_t MIN_WINDOW = 64;
+    // SIMD 单精度 IoU 离阈值这么近时改用双精度复核
+    static constexpr float BORDER = 1e-5f;
+    // 已保留的框按 4 个一组比较，不满一组的位置填这个类别，永远不会和候选同类
+    static constexpr int32_t PAD_CLASS = INT32_MIN;
+
+    std::vector<uint64_t> keys_;
+    std::vector<std::size_t> key_offsets_;
+    std::vector<float> kx1_, ky1_, kx2_, ky2_, karea_;
+    std::vector<int32_t> kclass_;
+    int kept_ = 0;
+
+    static uint64_t sort_key(float score, uint32_t index)
+    {
+        // float 的位模式变换成无符号数后大小顺序和浮点数一致，再取反得到降序
+        uint32_t bits;
+        std::memcpy(&bits, &score, sizeof(bits));
+        bits = (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+        return (static_cast<uint64_t>(~bits) << 32) | index;
+    }
+
+    /*和 OpenCV rectOverlap 的算法相同：1 - (1 - 交 / 并)，交并面积都是整数，用 double 计算*/
+    static float exact_overlap(float ax1, float ay1, float ax2, float ay2, float bx1, float by1, float bx2, float by2)
+    {
+        double area_a = static_cast<double>(ax2 - ax1) * (ay2 - ay1);
+        double area_b = static_cast<double>(bx2 - bx1) * (by2 - by1);
+        if (area_a + area_b <= 0.0)
+            return 1.0f;
+        double w = std::min(ax2, bx2) - std::max(ax1, bx1);
+        double h = std::min(ay2, by2) - std::max(ay1, by1);
+        double inter = (w > 0.0 && h > 0.0) ? w * h : 0.0;
+        return 1.0f - static_cast<float>(1.0 - inter / (area_a + area_b - inter));
+    }
+
+    bool exact_suppressed(int k, float x1, float y1, float x2, float y2, int32_t cls, float threshold) const
+    {
+        // 两个框面积都是 0 时 OpenCV 不看位置直接当成完全重叠，按类别平移后也是如此，所以这种情况不比较类别
+        if (karea_[k] + (x2 - x1) * (y2 - y1) <= 0.0f)
+            return 1.0f > threshold;
+        return kclass_[k] == cls && exact_overlap(x1, y1, x2, y2, kx1_[k], ky1_[k], kx2_[k], ky2_[k]) > threshold;
+    }
+
+    bool suppressed(float x1, float y1, float x2, float y2, int32_t cls, float threshold) const;
+
+    /*把 [begin, end) 里分数过阈值的框的 key 追加到 keys_*/
+    void collect(const detection_soa &dets, std::size_t begin, std::size_t end, float score_threshold);
+
+    /*对 keys_[key_begin, key_end) 这些候选做 NMS，保留的下标追加到 keep*/
+    void suppress(const detection_soa &dets, std::size_t key_begin, std::size_t key_end, const nms_params &params, std::vector<int> &keep);
+};
+
+inline bool nms_engine::suppressed(float x1, float y1, float x2, float y2, int32_t cls, float threshold) const
+{
+    int k = 0;
+    // 每帧保留的框通常只有几个到几十个，按整组比较，不满一组的部分是填充，不走标量尾巴
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    const float area = (x2 - x1) * (y2 - y1);
+    const float32x4_t bx1 = vdupq_n_f32(x1), by1 = vdupq_n_f32(y1), bx2 = vdupq_n_f32(x2), by2 = vdupq_n_f32(y2);
+    const float32x4_t barea = vdupq_n_f32(area), zero = vdupq_n_f32(0.0f);
+    const float32x4_t high = vdupq_n_f32(threshold + BORDER), low = vdupq_n_f32(threshold - BORDER);
+    const uint32x4_t bcls = vdupq_n_u32(static_cast<uint32_t>(cls));
+    for (; k < kept_; k += 4) {
+        float32x4_t w = vmaxq_f32(vsubq_f32(vminq_f32(bx2, vld1q_f32(&kx2_[k])), vmaxq_f32(bx1, vld1q_f32(&kx1_[k]))), zero);
+        float32x4_t h = vmaxq_f32(vsubq_f32(vminq_f32(by2, vld1q_f32(&ky2_[k])), vmaxq_f32(by1, vld1q_f32(&ky1_[k]))), zero);
+        float32x4_t inter = vmulq_f32(w, h);
+        float32x4_t sum = vaddq_f32(barea, vld1q_f32(&karea_[k]));
+        float32x4_t iou = vdivq_f32(inter, vsubq_f32(sum, inter));
+        uint32x4_t same = vceqq_u32(vld1q_u32(reinterpret_cast<const uint32_t *>(&kclass_[k])), bcls);
+        uint32x4_t over = vandq_u32(vcgtq_f32(iou, high), same);
+        if (vmaxvq_u32(over))
+            return true;
+        // 阈值附近的，以及两个框面积都是 0 的（iou 是 NaN），交给 exact_suppressed
+        uint32x4_t near = vorrq_u32(vandq_u32(vcgeq_f32(iou, low), same), vcleq_f32(sum, zero));
+        if (vmaxvq_u32(near)) {
+            for (int j = k; j < k + 4; ++j) {
+                if (exact_suppressed(j, x1, y1, x2, y2, cls, threshold))
+                    return true;
+            }
+        }
+    }
+#elif defined(__SSE2__)
+    // PC 上调试用，和 NEON 版本一一对应
+    const float area = (x2 - x1) * (y2 - y1);
+    const __m128 bx1 = _mm_set1_ps(x1), by1 = _mm_set1_ps(y1), bx2 = _mm_set1_ps(x2), by2 = _mm_set1_ps(y2);
+    const __m128 barea = _mm_set1_ps(area), zero = _mm_setzero_ps();
+    const __m128 high = _mm_set1_ps(threshold + BORDER), low = _mm_set1_ps(threshold - BORDER);
+    const __m128i bcls = _mm_set1_epi32(cls);
+    for (; k < kept_; k += 4) {
+        __m128 w = _mm_max_ps(_mm_sub_ps(_mm_min_ps(bx2, _mm_loadu_ps(&kx2_[k])), _mm_max_ps(bx1, _mm_loadu_ps(&kx1_[k]))), zero);
+        __m128 h = _mm_max_ps(_mm_sub_ps(_mm_min_ps(by2, _mm_loadu_ps(&ky2_[k])), _mm_max_ps(by1, _mm_loadu_ps(&ky1_[k]))), zero);
+        __m128 inter = _mm_mul_ps(w, h);
+        __m128 sum = _mm_add_ps(barea, _mm_loadu_ps(&karea_[k]));
+        __m128 iou = _mm_div_ps(inter, _mm_sub_ps(sum, inter));
+        __m128 same = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(&kclass_[k])), bcls));
+        if (_mm_movemask_ps(_mm_and_ps(_mm_cmpgt_ps(iou, high), same)))
+            return true;
+        if (_mm_movemask_ps(_mm_or_ps(_mm_and_ps(_mm_cmpge_ps(iou, low), same), _mm_cmple_ps(sum, zero)))) {
+            for (int j = k; j < k + 4; ++j) {
+                if (exact_suppressed(j, x1, y1, x2, y2, cls, threshold))
+                    return true;
+            }
+        }
+    }
+#endif
+    for (; k < kept_; ++k) {
+        if (exact_suppressed(k, x1, y1, x2, y2, cls, threshold))
+            return true;
+    }
+    return false;
+}
+
+inline void nms_engine::collect(const detection_soa &dets, std::size_t begin, std::size_t end, float score_threshold)
+{
+    for (std::size_t i = begin; i < end; ++i) {
+        if (dets.score[i] > score_threshold)
+            keys_.push_back(sort_key(dets.score[i], static_cast<uint32_t>(i)));
+    }
+}
+
+inline void nms_engine::suppress(const detection_soa &dets, std::size_t key_begin, std::size_t key_end, const nms_params &params, std::vector<int> &keep)
+{
+    std::size_t limit = key_end - key_begin;
+    if (params.top_k > 0)
+        limit = std::min(limit, static_cast<std::size_t>(params.top_k));
+    const std::size_t max_keep = params.max_keep > 0 ? static_cast<std::size_t>(params.max_keep) : limit;
+    const std::size_t capacity = (limit + 3) / 4 * 4;
+    if (kx1_.size() < capacity) {
+        kx1_.resize(capacity);
+        ky1_.resize(capacity);
+        kx2_.resize(capacity);
+        ky2_.resize(capacity);
+        karea_.resize(capacity);
+        kclass_.resize(capacity);
+    }
+    kept_ = 0;
+
+    // 不限 max_keep 时一次排完；否则先排 max_keep 的几倍，大多数帧第一段就够了
+    const auto first = keys_.begin() + key_begin, last = keys_.begin() + key_end;
+    std::size_t window = params.max_keep > 0 ? std::max(MIN_WINDOW, 4 * max_keep) : limit;
+    for (std::size_t begin = 0; begin < limit && static_cast<std::size_t>(kept_) < max_keep; window *= 2) {
+        std::size_t end = std::min(limit, begin + window);
+        if (first + end == last)
+            std::sort(first + begin, last);
+        else
+            std::partial_sort(first + begin, first + end, last);
+        for (; begin < end && static_cast<std::size_t>(kept_) < max_keep; ++begin) {
+            auto index = static_cast<int>(first[begin] & 0xffffffffu);
+            float x1 = dets.x1[index], y1 = dets.y1[index], x2 = dets.x2[index], y2 = dets.y2[index];
+            int32_t cls = params.class_aware ? dets.class_id[index] : 0;
+            if (suppressed(x1, y1, x2, y2, cls, params.iou_threshold))
+                continue;
+            if (kept_ % 4 == 0) {
+                // 开始新的一组，先把整组填成不会抑制任何框的占位（面积为 1，两个框面积都为 0 的特殊情况不会误触发）
+                std::fill_n(kx1_.begin() + kept_, 4, 0.0f);
+                std::fill_n(ky1_.begin() + kept_, 4, 0.0f);
+                std::fill_n(kx2_.begin() + kept_, 4, 1.0f);
+                std::fill_n(ky2_.begin() + kept_, 4, 1.0f);
+                std::fill_n(karea_.begin() + kept_, 4, 1.0f);
+                std::fill_n(kclass_.begin() + kept_, 4, PAD_CLASS);
+            }
+            kx1_[kept_] = x1;
+            ky1_[kept_] = y1;
+            kx2_[kept_] = x2;
+            ky2_[kept_] = y2;
+            karea_[kept_] = (x2 - x1) * (y2 - y1);
+            kclass_[kept_] = cls;
+            kept_++;
+            keep.push_back(index);
+        }
+    }
+}
+
+inline void nms_engine::run(const detection_soa &dets, const nms_params &params, std::vector<int> &keep)
+{
+    keep.clear();
+    keys_.clear();
+    collect(dets, 0, dets.size(), params.score_threshold);
+    suppress(dets, 0, keys_.size(), params, keep);
+}
+
+inline void nms_engine::run_batched(const detection_soa &dets, std::span<const uint32_t> offsets, const nms_params &params,
+                                    std::vector<int> &keep, std::vector<uint32_t> &keep_offsets)
+{
+    keep.clear();
+    keep_offsets.clear();
+    keys_.clear();
+    key_offsets_.clear();
+    if (offsets.empty())
+        return;
+
+    // 先一遍扫完整个扁平缓冲区做分数过滤，各段的 key 在 keys_ 里天然是连续的
+    key_offsets_.push_back(0);
+    for (std::size_t s = 0; s + 1 < offsets.size(); ++s) {
+        collect(dets, offsets[s], offsets[s + 1], params.score_threshold);
+        key_offsets_.push_back(keys_.size());
+    }
+
+    keep_offsets.push_back(0);
+    for (std::size_t s = 0; s + 1 < key_offsets_.size(); ++s) {
+        suppress(dets, key_offsets_[s], key_offsets_[s + 1], params, keep);
+        keep_offsets.push_back(static_cast<uint32_t>(keep.size()));
+    }
+}
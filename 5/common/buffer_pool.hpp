@@ -0,0 +1,122 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+/*
+ * 定长缓冲区池：启动时一次性分配 count 块 buffer_size 字节的内存（64 字节对齐），之后只借还不分配
+ * acquire() 在池空时阻塞等待，handle 析构时自动归还
+ */
+class buffer_pool {
+    struct aligned_delete {
+        void operator()(uint8_t *p) const
+        {
+            ::operator delete[](p, std::align_val_t{ 64 });
+        }
+    };
+
+    std::size_t buffer_size_;
+    std::size_t stride_;
+    std::unique_ptr<uint8_t[], aligned_delete> storage_;
+    std::vector<uint8_t *> free_;
+    std::mutex mutex_;
+    std::condition_variable condition_variable_;
+
+    void release(uint8_t *data)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            free_.push_back(data);
+        }
+        condition_variable_.notify_one();
+    }
+
+public:
+    class handle {
+        buffer_pool *pool_ = nullptr;
+        uint8_t *data_ = nullptr;
+
+    public:
+        handle() = default;
+        handle(buffer_pool *pool, uint8_t *data)
+            : pool_(pool), data_(data)
+        {
+        }
+        handle(handle &&other) noexcept
+            : pool_(other.pool_), data_(other.data_)
+        {
+            other.pool_ = nullptr;
+            other.data_ = nullptr;
+        }
+        handle &operator=(handle &&other) noexcept
+        {
+            if (this != &other) {
+                reset();
+                pool_ = other.pool_;
+                data_ = other.data_;
+                other.pool_ = nullptr;
+                other.data_ = nullptr;
+            }
+            return *this;
+        }
+        handle(const handle &) = delete;
+        handle &operator=(const handle &) = delete;
+        ~handle()
+        {
+            reset();
+        }
+
+        void reset()
+        {
+            if (pool_ != nullptr) {
+                pool_->release(data_);
+                pool_ = nullptr;
+                data_ = nullptr;
+            }
+        }
+        uint8_t *data() const
+        {
+            return data_;
+        }
+        std::size_t size() const
+        {
+            return pool_ != nullptr ? pool_->buffer_size() : 0;
+        }
+        explicit operator bool() const
+        {
+            return data_ != nullptr;
+        }
+    };
+
+    buffer_pool(std::size_t buffer_size, std::size_t count)
+        : buffer_size_(buffer_size),
+          stride_((buffer_size + 63) / 64 * 64),
+          storage_(static_cast<uint8_t *>(::operator new[](stride_ * count, std::align_val_t{ 64 })))
+    {
+        free_.reserve(count);
+        for (std::size_t i = 0; i < count; i++) {
+            free_.push_back(storage_.get() + i * stride_);
+        }
+    }
+    buffer_pool(const buffer_pool &) = delete;
+    buffer_pool &operator=(const buffer_pool &) = delete;
+
+    std::size_t buffer_size() const
+    {
+        return buffer_size_;
+    }
+
+    handle acquire()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_variable_.wait(lock, [this] { return !free_.empty(); });
+        auto data = free_.back();
+        free_.pop_back();
+        return handle(this, data);
+    }
+};
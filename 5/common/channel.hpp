@@ -0,0 +1,504 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "spsc_ring.hpp"
+
+/*通道满了之后新元素怎么处理，每条边按自己的需要选*/
+enum class overflow_policy {
+    block,       // 生产者等消费者腾位置，一帧都不丢（文件回放）
+    drop_oldest, // 挤掉最旧的一个，消费者总是拿到最新的（实时摄像头、预览）
+    drop_newest, // 丢掉新来的，已经排队的不受影响
+    sample,      // 积压过半后每 sample_every 个只收一个，满了丢掉新来的；过载时均匀抽帧，而不是成段地丢
+};
+
+struct channel_stats {
+    std::size_t pushed = 0;         // 进入通道的元素
+    std::size_t popped = 0;         // 被消费者取走的元素
+    std::size_t dropped = 0;        // 被挤掉、被拒绝或被抽掉的元素
+    std::size_t overflows = 0;      // push 时通道已满的次数（block 策略下就是生产者等待的次数）
+    std::size_t high_watermark = 0; // 通道里同时排队的最多元素个数
+};
+
+/*异步消费者（协程等）：通道空的时候登记，之后有元素进来或者通道关闭时 notify() 一次，被叫醒后要重新 try_pop_or_wait*/
+struct channel_waiter {
+    virtual void notify() = 0;
+
+protected:
+    ~channel_waiter() = default;
+};
+
+enum class pop_result {
+    popped,
+    closed,  // 已关闭并且取空
+    waiting, // 空的，已经登记了 waiter
+};
+
+/*
+ * 有界通道：容量固定，内存和排队延迟都有上限，满了按 Policy 处理；close() 之后 push 失败，pop 取完剩下的元素后失败
+ * 槽位在构造时一次分配，push / pop 都是和槽位交换元素：push 返回后 item 里是槽位原来的内容（被挤掉的旧元素，
+ * 或者消费者换进来的空壳），pop 把调用方原来的 item 留在槽位里，所以 vector 等的容量可以在两端之间循环使用
+ * 这个模板是 drop_oldest / sample 的实现：drop_oldest 要生产者从队头拿走元素，sample 要看着积压决定收不收，
+ * 生产者和消费者都会动同一端，统一用一把锁；临界区只有一次交换和计数，帧率下的开销可以忽略（refactor_hailo_cam_optimized_bench queue）
+ * block / drop_newest 的生产者只碰队尾、消费者只碰队头，特化成下面的 spsc_channel，不用这把锁
+ * 消费者可以是阻塞的线程（pop），也可以是不占线程的协程（try_pop_or_wait，见 coro.hpp 的 async_pop）；
+ * 协程生产者不要用 block 策略，push 在通道满的时候会阻塞调度器线程
+ */
+template <typename T, overflow_policy Policy>
+class bounded_channel {
+public:
+    bounded_channel(std::string name, std::size_t capacity, std::size_t sample_every = 2)
+        : name_(std::move(name)), slots_(std::max<std::size_t>(capacity, 1)), sample_every_(std::max<std::size_t>(sample_every, 1))
+    {
+    }
+    bounded_channel(const bounded_channel &) = delete;
+    bounded_channel &operator=(const bounded_channel &) = delete;
+
+    std::size_t capacity() const
+    {
+        return slots_.size();
+    }
+
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return count_;
+    }
+
+    /*声明有几个线程 push / pop，只有 spsc_channel 用得上，这里两端本来就共用一把锁*/
+    void add_producers(unsigned)
+    {
+    }
+    void add_consumers(unsigned)
+    {
+    }
+
+    /*返回 false 只表示通道已关闭；被丢掉的元素只记在 dropped 里*/
+    bool push(T &item)
+    {
+        channel_waiter *waiter = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (closed_)
+                return false;
+            if (count_ == slots_.size()) {
+                stats_.overflows++;
+                if constexpr (Policy == overflow_policy::drop_oldest) {
+                    // 满的时候队头就是新的队尾：新元素直接换进去，最旧的元素换到 item 里，由调用方在锁外释放
+                    using std::swap;
+                    swap(slots_[head_], item);
+                    head_ = next(head_);
+                    stats_.dropped++;
+                    stats_.pushed++;
+                    auto *waiter = take_waiter();
+                    lock.unlock();
+                    not_empty_.notify_one();
+                    if (waiter != nullptr)
+                        waiter->notify();
+                    return true;
+                } else {
+                    // sample：满了丢掉新来的
+                    stats_.dropped++;
+                    return true;
+                }
+            }
+            if constexpr (Policy == overflow_policy::sample) {
+                if (count_ * 2 < slots_.size()) {
+                    sample_phase_ = 0;
+                } else if (sample_phase_++ % sample_every_ != 0) {
+                    stats_.dropped++;
+                    return true;
+                }
+            }
+            stats_.pushed++;
+            put(item);
+            waiter = take_waiter();
+        }
+        not_empty_.notify_one();
+        if (waiter != nullptr)
+            waiter->notify();
+        return true;
+    }
+
+    /*空了返回 false*/
+    bool try_pop(T &item)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (count_ == 0)
+            return false;
+        take(item);
+        return true;
+    }
+
+    /*不阻塞：有元素就取走；空的时候登记 waiter，有元素进来或者关闭时 notify 它一次*/
+    pop_result try_pop_or_wait(T &item, channel_waiter &waiter)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (count_ == 0) {
+            if (closed_)
+                return pop_result::closed;
+            waiters_.push_back(&waiter);
+            return pop_result::waiting;
+        }
+        take(item);
+        return pop_result::popped;
+    }
+
+    /*撤销还没被叫醒的登记，waiter 析构前调用*/
+    void cancel_wait(channel_waiter &waiter)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::erase(waiters_, &waiter);
+    }
+
+    /*空了就等；关闭并且取空后返回 false*/
+    bool pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this] { return closed_ || count_ > 0; });
+        if (count_ == 0)
+            return false;
+        take(item);
+        return true;
+    }
+
+    /*最多等 timeout，超时或关闭并且取空后返回 false*/
+    template <typename Rep, typename Period>
+    bool pop_for(T &item, std::chrono::duration<Rep, Period> timeout)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!not_empty_.wait_for(lock, timeout, [this] { return closed_ || count_ > 0; }) || count_ == 0)
+            return false;
+        take(item);
+        return true;
+    }
+
+    /*两端都可以调用，可以重复调用*/
+    void close()
+    {
+        std::vector<channel_waiter *> waiters;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+            waiters.swap(waiters_);
+        }
+        not_empty_.notify_all();
+        for (auto *waiter : waiters)
+            waiter->notify();
+    }
+
+    bool closed() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return closed_;
+    }
+
+    channel_stats statistics() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+    void report() const
+    {
+        auto stats = statistics();
+        std::cout << "通道 " << name_ << ": 进入" << stats.pushed << "个，取走" << stats.popped << "个，丢弃" << stats.dropped << "个，满了"
+                  << stats.overflows << "次，最多积压" << stats.high_watermark << "/" << slots_.size() << std::endl;
+    }
+
+private:
+    const std::string name_;
+    mutable std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::vector<T> slots_;
+    std::size_t head_ = 0;
+    std::size_t count_ = 0;
+    const std::size_t sample_every_;
+    std::size_t sample_phase_ = 0;
+    bool closed_ = false;
+    channel_stats stats_{};
+    std::vector<channel_waiter *> waiters_; // 等元素的异步消费者，先登记的先叫醒
+
+    std::size_t next(std::size_t index) const
+    {
+        return index + 1 == slots_.size() ? 0 : index + 1;
+    }
+
+    void put(T &item)
+    {
+        std::size_t tail = head_ + count_;
+        if (tail >= slots_.size())
+            tail -= slots_.size();
+        using std::swap;
+        swap(slots_[tail], item);
+        count_++;
+        stats_.high_watermark = std::max(stats_.high_watermark, count_);
+    }
+
+    /*进来一个元素叫醒一个异步消费者；调用方在锁外 notify*/
+    channel_waiter *take_waiter()
+    {
+        if (waiters_.empty())
+            return nullptr;
+        auto *waiter = waiters_.front();
+        waiters_.erase(waiters_.begin());
+        return waiter;
+    }
+
+    void take(T &item)
+    {
+        using std::swap;
+        swap(slots_[head_], item);
+        head_ = next(head_);
+        count_--;
+        stats_.popped++;
+    }
+};
+
+/*
+ * block / drop_newest 的通道：生产者只往队尾放、消费者只从队头拿，直接建在 spsc_ring 上，push / pop 不加锁
+ * 环只允许一个线程 push、一个线程 pop：add_producers / add_consumers 声明的线程数正好是 1 的一端不加锁，
+ * 多于 1 个或者没声明的一端，这一端的线程之间用一把锁排队，另一端不受影响
+ * pipeline 按各阶段的并行度声明；其它地方建的通道不声明时两端都加锁，和原来一样安全
+ * 统计计数也按端分开，各自只由这一端的线程写；异步消费者的登记表另有一把锁，生产者只在有人登记时才碰它
+ */
+template <typename T, overflow_policy Policy>
+class spsc_channel {
+    static_assert(Policy == overflow_policy::block || Policy == overflow_policy::drop_newest, "spsc_channel only takes from the head");
+
+public:
+    spsc_channel(std::string name, std::size_t capacity, std::size_t = 2)
+        : name_(std::move(name)), ring_(capacity)
+    {
+    }
+    spsc_channel(const spsc_channel &) = delete;
+    spsc_channel &operator=(const spsc_channel &) = delete;
+
+    std::size_t capacity() const
+    {
+        return ring_.capacity();
+    }
+
+    /*近似值，只用于打印和统计*/
+    std::size_t size() const
+    {
+        return ring_.size();
+    }
+
+    /*在第一次 push / pop 之前调用，可以调用多次，数目累加*/
+    void add_producers(unsigned count)
+    {
+        producers_ += count;
+    }
+    void add_consumers(unsigned count)
+    {
+        consumers_ += count;
+    }
+
+    /*返回 false 只表示通道已关闭；被丢掉的元素只记在 dropped 里*/
+    bool push(T &item)
+    {
+        auto lock = side_lock(producer_mutex_, producers_);
+        if (ring_.closed())
+            return false;
+        if (!ring_.try_push(item)) {
+            bump(overflows_);
+            if constexpr (Policy == overflow_policy::drop_newest) {
+                bump(dropped_);
+                return true;
+            } else if (!ring_.push(item)) {
+                return false;
+            }
+        }
+        bump(pushed_);
+        const auto depth = ring_.size();
+        if (depth > high_watermark_.load(std::memory_order_relaxed))
+            high_watermark_.store(depth, std::memory_order_relaxed);
+        if (lock.owns_lock())
+            lock.unlock();
+        wake_waiter();
+        return true;
+    }
+
+    /*空了返回 false*/
+    bool try_pop(T &item)
+    {
+        auto lock = side_lock(consumer_mutex_, consumers_);
+        if (!ring_.try_pop(item))
+            return false;
+        bump(popped_);
+        return true;
+    }
+
+    /*不阻塞：有元素就取走；空的时候登记 waiter，有元素进来或者关闭时 notify 它一次*/
+    pop_result try_pop_or_wait(T &item, channel_waiter &waiter)
+    {
+        auto lock = side_lock(consumer_mutex_, consumers_);
+        while (true) {
+            if (ring_.try_pop(item)) {
+                bump(popped_);
+                return pop_result::popped;
+            }
+            if (ring_.closed()) {
+                // 关闭前刚放进来的元素
+                if (!ring_.try_pop(item))
+                    return pop_result::closed;
+                bump(popped_);
+                return pop_result::popped;
+            }
+            {
+                std::lock_guard<std::mutex> waiters_lock(waiters_mutex_);
+                waiters_.push_back(&waiter);
+                has_waiters_.store(true, std::memory_order_relaxed);
+            }
+            // 和 wake_waiter 的“先放元素，再看有没有人登记”配对：登记之后再看一次队列，两边至少有一边能看到对方
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (ring_.size() == 0 && !ring_.closed())
+                return pop_result::waiting;
+            std::lock_guard<std::mutex> waiters_lock(waiters_mutex_);
+            // 登记已经被生产者拿走了，它马上会 notify，不能再自己取
+            if (std::erase(waiters_, &waiter) == 0)
+                return pop_result::waiting;
+            has_waiters_.store(!waiters_.empty(), std::memory_order_relaxed);
+        }
+    }
+
+    /*撤销还没被叫醒的登记，waiter 析构前调用*/
+    void cancel_wait(channel_waiter &waiter)
+    {
+        std::lock_guard<std::mutex> lock(waiters_mutex_);
+        std::erase(waiters_, &waiter);
+        has_waiters_.store(!waiters_.empty(), std::memory_order_relaxed);
+    }
+
+    /*空了就等；关闭并且取空后返回 false*/
+    bool pop(T &item)
+    {
+        auto lock = side_lock(consumer_mutex_, consumers_);
+        if (!ring_.pop(item))
+            return false;
+        bump(popped_);
+        return true;
+    }
+
+    /*最多等 timeout，超时或关闭并且取空后返回 false；多个消费者时排队等锁的时间不算在 timeout 里*/
+    template <typename Rep, typename Period>
+    bool pop_for(T &item, std::chrono::duration<Rep, Period> timeout)
+    {
+        auto lock = side_lock(consumer_mutex_, consumers_);
+        if (!ring_.pop_for(item, timeout))
+            return false;
+        bump(popped_);
+        return true;
+    }
+
+    /*两端都可以调用，可以重复调用*/
+    void close()
+    {
+        ring_.close();
+        std::vector<channel_waiter *> waiters;
+        {
+            std::lock_guard<std::mutex> lock(waiters_mutex_);
+            waiters.swap(waiters_);
+            has_waiters_.store(false, std::memory_order_relaxed);
+        }
+        for (auto *waiter : waiters)
+            waiter->notify();
+    }
+
+    bool closed() const
+    {
+        return ring_.closed();
+    }
+
+    channel_stats statistics() const
+    {
+        channel_stats stats{};
+        stats.pushed = pushed_.load(std::memory_order_relaxed);
+        stats.popped = popped_.load(std::memory_order_relaxed);
+        stats.dropped = dropped_.load(std::memory_order_relaxed);
+        stats.overflows = overflows_.load(std::memory_order_relaxed);
+        stats.high_watermark = high_watermark_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    void report() const
+    {
+        auto stats = statistics();
+        std::cout << "通道 " << name_ << ": 进入" << stats.pushed << "个，取走" << stats.popped << "个，丢弃" << stats.dropped << "个，满了"
+                  << stats.overflows << "次，最多积压" << stats.high_watermark << "/" << ring_.capacity() << std::endl;
+    }
+
+private:
+    static constexpr std::size_t CACHE_LINE = 64;
+
+    const std::string name_;
+    spsc_ring<T> ring_;
+    unsigned producers_ = 0;
+    unsigned consumers_ = 0;
+    // 生产者这一端
+    alignas(CACHE_LINE) std::mutex producer_mutex_;
+    std::atomic<std::size_t> pushed_{ 0 };
+    std::atomic<std::size_t> dropped_{ 0 };
+    std::atomic<std::size_t> overflows_{ 0 };
+    std::atomic<std::size_t> high_watermark_{ 0 };
+    // 消费者这一端
+    alignas(CACHE_LINE) std::mutex consumer_mutex_;
+    std::atomic<std::size_t> popped_{ 0 };
+    // 等元素的异步消费者，先登记的先叫醒
+    alignas(CACHE_LINE) std::atomic<bool> has_waiters_{ false };
+    std::mutex waiters_mutex_;
+    std::vector<channel_waiter *> waiters_;
+
+    /*声明了正好一个线程的一端不加锁，返回的 unique_lock 不持有锁*/
+    static std::unique_lock<std::mutex> side_lock(std::mutex &mutex, unsigned endpoints)
+    {
+        return endpoints == 1 ? std::unique_lock<std::mutex>(mutex, std::defer_lock) : std::unique_lock<std::mutex>(mutex);
+    }
+
+    /*计数只由这一端的线程写（多个线程时在这一端的锁里），不用原子加；读的一方只拿来打印*/
+    static void bump(std::atomic<std::size_t> &counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    /*进来一个元素叫醒一个异步消费者*/
+    void wake_waiter()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!has_waiters_.load(std::memory_order_relaxed))
+            return;
+        channel_waiter *waiter = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(waiters_mutex_);
+            if (!waiters_.empty()) {
+                waiter = waiters_.front();
+                waiters_.erase(waiters_.begin());
+            }
+            has_waiters_.store(!waiters_.empty(), std::memory_order_relaxed);
+        }
+        if (waiter != nullptr)
+            waiter->notify();
+    }
+};
+
+template <typename T>
+class bounded_channel<T, overflow_policy::block> : public spsc_channel<T, overflow_policy::block> {
+public:
+    using spsc_channel<T, overflow_policy::block>::spsc_channel;
+};
+
+template <typename T>
+class bounded_channel<T, overflow_policy::drop_newest> : public spsc_channel<T, overflow_policy::drop_newest> {
+public:
+    using spsc_channel<T, overflow_policy::drop_newest>::spsc_channel;
+};
@@ -0,0 +1,656 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "channel.hpp"
+#include "thread_placement.hpp"
+
+/*
+ * 协程版的流水线阶段：几个调度器线程服务任意多路摄像头，等 fd 就绪、等通道、等回调时不占线程
+ * - task<T>：惰性启动的协程，co_await 它才开始执行，结束时直接切回等它的协程（对称转移，不经过队列）
+ * - coro_scheduler：每个线程一个循环，先跑就绪队列里的协程，没有就 epoll_wait（fd 就绪、定时器、跨线程唤醒都在这里）
+ * - 可等待对象：schedule()（切到调度器线程）、sleep_for、readable / writable（fd 就绪，可带超时，V4L2 的 poll 就是这个）、
+ *   completion<T>（任意线程里的回调，例如 HailoRT ConfiguredInferModel::run_async 的完成回调、GStreamer appsink 的
+ *   new-sample 信号）、async_pop（bounded_channel 取元素）
+ * 协程被恢复的线程不固定，协程里不要用 thread_local 状态；协程不能抛异常
+ * 析构调度器之前先关掉通道、等 spawn 的协程全部结束（wait_idle），还挂起着的协程会被泄漏而不是销毁
+ */
+
+template <typename T = void>
+class task;
+
+namespace coro_detail {
+
+struct promise_base {
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+
+    std::suspend_always initial_suspend() noexcept
+    {
+        return {};
+    }
+    struct final_awaiter {
+        bool await_ready() noexcept
+        {
+            return false;
+        }
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            return handle.promise().continuation;
+        }
+        void await_resume() noexcept
+        {
+        }
+    };
+    final_awaiter final_suspend() noexcept
+    {
+        return {};
+    }
+    void unhandled_exception() noexcept
+    {
+        std::terminate();
+    }
+};
+
+template <typename T>
+struct promise : promise_base {
+    std::optional<T> value;
+
+    void return_value(T result)
+    {
+        value = std::move(result);
+    }
+    T result()
+    {
+        return std::move(*value);
+    }
+};
+
+template <>
+struct promise<void> : promise_base {
+    void return_void()
+    {
+    }
+    void result()
+    {
+    }
+};
+
+/*spawn 用的顶层协程：立即开始，结束时自己销毁*/
+struct detached {
+    struct promise_type {
+        detached get_return_object()
+        {
+            return {};
+        }
+        std::suspend_never initial_suspend() noexcept
+        {
+            return {};
+        }
+        std::suspend_never final_suspend() noexcept
+        {
+            return {};
+        }
+        void return_void()
+        {
+        }
+        void unhandled_exception() noexcept
+        {
+            std::terminate();
+        }
+    };
+};
+
+} // namespace coro_detail
+
+template <typename T>
+class task {
+public:
+    struct promise_type : coro_detail::promise<T> {
+        task get_return_object()
+        {
+            return task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+    };
+
+    task(task &&other) noexcept
+        : handle_(std::exchange(other.handle_, {}))
+    {
+    }
+    task &operator=(task &&other) noexcept
+    {
+        if (this != &other) {
+            if (handle_)
+                handle_.destroy();
+            handle_ = std::exchange(other.handle_, {});
+        }
+        return *this;
+    }
+    ~task()
+    {
+        if (handle_)
+            handle_.destroy();
+    }
+
+    auto operator co_await() && noexcept
+    {
+        struct awaiter {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() noexcept
+            {
+                return !handle || handle.done();
+            }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> waiting) noexcept
+            {
+                handle.promise().continuation = waiting;
+                return handle;
+            }
+            T await_resume()
+            {
+                return handle.promise().result();
+            }
+        };
+        return awaiter{ handle_ };
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+
+    explicit task(std::coroutine_handle<promise_type> handle)
+        : handle_(handle)
+    {
+    }
+};
+
+class coro_scheduler {
+public:
+    struct scheduler_stats {
+        std::size_t spawned;
+        std::size_t resumed;     // 从就绪队列、fd 事件或定时器恢复协程的次数
+        std::size_t fd_ready;    // 等 fd 等到就绪
+        std::size_t fd_timeouts; // 等 fd 超时
+        std::size_t epoll_waits; // 线程没活干进入 epoll_wait 的次数
+    };
+
+    coro_scheduler(std::string name, unsigned threads, const thread_placement &placement = {})
+        : name_(std::move(name)), epoll_fd_(epoll_create1(EPOLL_CLOEXEC)), wake_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+    {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr; // nullptr 表示唤醒用的 eventfd
+        if (epoll_fd_ < 0 || wake_fd_ < 0 || epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event) < 0)
+            std::cerr << "协程调度器 " << name_ << " 初始化 epoll 失败: " << std::strerror(errno) << std::endl;
+        for (unsigned i = 0; i < std::max(threads, 1u); i++) {
+            threads_.emplace_back([this, i, placement] {
+                apply_thread_placement(name_ + std::to_string(i), placement);
+                run();
+            });
+        }
+    }
+    ~coro_scheduler()
+    {
+        stopping_.store(true, std::memory_order_release);
+        wake();
+        for (auto &thread : threads_)
+            thread.join();
+        if (wake_fd_ >= 0)
+            ::close(wake_fd_);
+        if (epoll_fd_ >= 0)
+            ::close(epoll_fd_);
+    }
+    coro_scheduler(const coro_scheduler &) = delete;
+    coro_scheduler &operator=(const coro_scheduler &) = delete;
+
+    unsigned thread_count() const
+    {
+        return static_cast<unsigned>(threads_.size());
+    }
+
+    /*在调度器线程上开始执行 t，不等它结束*/
+    void spawn(task<void> t)
+    {
+        live_.fetch_add(1, std::memory_order_relaxed);
+        spawned_.fetch_add(1, std::memory_order_relaxed);
+        [](coro_scheduler &scheduler, task<void> body) -> coro_detail::detached {
+            co_await scheduler.schedule();
+            co_await std::move(body);
+            if (scheduler.live_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                scheduler.live_.notify_all();
+        }(*this, std::move(t));
+    }
+
+    /*等 spawn 的协程全部结束*/
+    void wait_idle()
+    {
+        for (auto live = live_.load(std::memory_order_acquire); live != 0; live = live_.load(std::memory_order_acquire))
+            live_.wait(live, std::memory_order_acquire);
+    }
+
+    /*任何线程都可以调用*/
+    void post(std::coroutine_handle<> handle)
+    {
+        bool sleeping;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ready_.push_back(handle);
+            sleeping = sleeping_ > 0;
+        }
+        if (sleeping)
+            wake();
+    }
+
+    struct schedule_awaiter {
+        coro_scheduler &scheduler;
+
+        bool await_ready() noexcept
+        {
+            return false;
+        }
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            scheduler.post(handle);
+        }
+        void await_resume() noexcept
+        {
+        }
+    };
+    /*co_await schedule() 之后在调度器线程上继续*/
+    schedule_awaiter schedule()
+    {
+        return { *this };
+    }
+
+    template <typename Rep, typename Period>
+    auto sleep_for(std::chrono::duration<Rep, Period> duration)
+    {
+        struct awaiter {
+            coro_scheduler &scheduler;
+            clock::time_point deadline;
+
+            bool await_ready() noexcept
+            {
+                return deadline <= clock::now();
+            }
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                scheduler.add_timer(deadline, { nullptr, 0, handle });
+            }
+            void await_resume() noexcept
+            {
+            }
+        };
+        return awaiter{ *this, clock::now() + std::chrono::duration_cast<clock::duration>(duration) };
+    }
+
+    /*
+     * co_await 返回 true 表示 fd 可读，false 表示超时（timeout 为负时不超时）
+     * 同一个 fd 同时只能有一个协程在等；fd 最好设成非阻塞，极少数情况下会有多余的就绪通知
+     */
+    auto readable(int fd, std::chrono::milliseconds timeout = std::chrono::milliseconds(-1))
+    {
+        return fd_awaiter{ *this, watch(fd), EPOLLIN, timeout };
+    }
+    auto writable(int fd, std::chrono::milliseconds timeout = std::chrono::milliseconds(-1))
+    {
+        return fd_awaiter{ *this, watch(fd), EPOLLOUT, timeout };
+    }
+
+    /*close(fd) 之前调用*/
+    void forget(int fd)
+    {
+        std::lock_guard<std::mutex> lock(watches_mutex_);
+        auto it = watches_.find(fd);
+        if (it == watches_.end())
+            return;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+        // 定时器里可能还引用着它，留到调度器析构再释放
+        retired_.push_back(std::move(it->second));
+        watches_.erase(it);
+    }
+
+    scheduler_stats statistics() const
+    {
+        return { spawned_.load(std::memory_order_relaxed), resumed_.load(std::memory_order_relaxed), fd_ready_.load(std::memory_order_relaxed),
+                 fd_timeouts_.load(std::memory_order_relaxed), epoll_waits_.load(std::memory_order_relaxed) };
+    }
+
+    void report() const
+    {
+        auto stats = statistics();
+        std::cout << "协程调度器 " << name_ << ": " << threads_.size() << "个线程，启动协程" << stats.spawned << "个，恢复" << stats.resumed << "次，fd就绪"
+                  << stats.fd_ready << "次，超时" << stats.fd_timeouts << "次，epoll_wait " << stats.epoll_waits << "次" << std::endl;
+    }
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    /*每个 fd 一个，由调度器持有；epoll 事件和定时器都通过它找到正在等的协程*/
+    struct fd_watch {
+        int fd;
+        bool registered = false;
+        std::mutex mutex;
+        std::coroutine_handle<> waiting; // 空表示没有协程在等
+        bool *ready = nullptr;           // 指向等待者里的结果
+        uint64_t generation = 0;         // 每次等待加一，过期的超时定时器靠它识别
+    };
+    struct timer_entry {
+        fd_watch *watch; // 为空表示 sleep_for
+        uint64_t generation;
+        std::coroutine_handle<> handle;
+    };
+
+    struct fd_awaiter {
+        coro_scheduler &scheduler;
+        fd_watch *watch;
+        uint32_t events;
+        std::chrono::milliseconds timeout;
+        bool ready = false;
+
+        bool await_ready() noexcept
+        {
+            return false;
+        }
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            return scheduler.arm(*watch, events, timeout, handle, ready);
+        }
+        bool await_resume() noexcept
+        {
+            return ready;
+        }
+    };
+
+    const std::string name_;
+    const int epoll_fd_;
+    const int wake_fd_;
+    std::vector<std::thread> threads_;
+    std::atomic<bool> stopping_{ false };
+
+    std::mutex mutex_; // 就绪队列和 sleeping_
+    std::deque<std::coroutine_handle<> > ready_;
+    unsigned sleeping_ = 0;
+
+    std::mutex timers_mutex_;
+    std::multimap<clock::time_point, timer_entry> timers_;
+
+    std::mutex watches_mutex_;
+    std::unordered_map<int, std::unique_ptr<fd_watch> > watches_;
+    std::vector<std::unique_ptr<fd_watch> > retired_;
+
+    std::atomic<std::size_t> live_{ 0 };
+    std::atomic<std::size_t> spawned_{ 0 };
+    std::atomic<std::size_t> resumed_{ 0 };
+    std::atomic<std::size_t> fd_ready_{ 0 };
+    std::atomic<std::size_t> fd_timeouts_{ 0 };
+    std::atomic<std::size_t> epoll_waits_{ 0 };
+
+    void wake()
+    {
+        uint64_t one = 1;
+        [[maybe_unused]] auto written = ::write(wake_fd_, &one, sizeof(one));
+    }
+
+    fd_watch *watch(int fd)
+    {
+        std::lock_guard<std::mutex> lock(watches_mutex_);
+        auto &entry = watches_[fd];
+        if (!entry) {
+            entry = std::make_unique<fd_watch>();
+            entry->fd = fd;
+        }
+        return entry.get();
+    }
+
+    /*返回 false 表示没能挂起（epoll_ctl 失败），协程直接继续，结果是 false*/
+    bool arm(fd_watch &watch, uint32_t events, std::chrono::milliseconds timeout, std::coroutine_handle<> handle, bool &ready)
+    {
+        std::lock_guard<std::mutex> lock(watch.mutex);
+        epoll_event event{};
+        event.events = events | EPOLLONESHOT;
+        event.data.ptr = &watch;
+        watch.waiting = handle;
+        watch.ready = &ready;
+        watch.generation++;
+        if (epoll_ctl(epoll_fd_, watch.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, watch.fd, &event) < 0) {
+            std::cerr << "协程调度器 " << name_ << " 监听 fd " << watch.fd << " 失败: " << std::strerror(errno) << std::endl;
+            watch.waiting = {};
+            return false;
+        }
+        watch.registered = true;
+        if (timeout.count() >= 0)
+            add_timer(clock::now() + timeout, { &watch, watch.generation, {} });
+        // 解锁之后协程可能马上在别的线程上恢复，这里之后不能再碰等待者
+        return true;
+    }
+
+    void add_timer(clock::time_point deadline, timer_entry entry)
+    {
+        bool earliest;
+        {
+            std::lock_guard<std::mutex> lock(timers_mutex_);
+            auto it = timers_.emplace(deadline, entry);
+            earliest = it == timers_.begin();
+        }
+        // 睡着的线程按原来最早的定时器算的超时，新的更早就叫醒它们重新算
+        if (earliest) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (sleeping_ > 0)
+                wake();
+        }
+    }
+
+    /*取出 watch 上正在等的协程，没有或者代数不对返回空*/
+    std::coroutine_handle<> claim(fd_watch &watch, bool ready, uint64_t generation = 0)
+    {
+        std::lock_guard<std::mutex> lock(watch.mutex);
+        if (!watch.waiting || (generation != 0 && generation != watch.generation))
+            return {};
+        if (!ready) {
+            // 超时：把还没触发的 EPOLLONESHOT 关掉
+            epoll_event event{};
+            event.data.ptr = &watch;
+            epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, watch.fd, &event);
+        }
+        *watch.ready = ready;
+        return std::exchange(watch.waiting, {});
+    }
+
+    /*到期的定时器恢复协程，返回到下一个定时器的毫秒数，没有定时器返回 -1*/
+    int expire_timers()
+    {
+        std::vector<timer_entry> expired;
+        int next_ms = -1;
+        {
+            std::lock_guard<std::mutex> lock(timers_mutex_);
+            const auto now = clock::now();
+            while (!timers_.empty() && timers_.begin()->first <= now) {
+                expired.push_back(timers_.begin()->second);
+                timers_.erase(timers_.begin());
+            }
+            if (!timers_.empty()) {
+                auto wait = std::chrono::ceil<std::chrono::milliseconds>(timers_.begin()->first - now).count();
+                next_ms = static_cast<int>(std::min<int64_t>(wait, 1000));
+            }
+        }
+        for (auto &entry : expired) {
+            std::coroutine_handle<> handle = entry.handle;
+            if (entry.watch != nullptr) {
+                handle = claim(*entry.watch, false, entry.generation);
+                if (handle)
+                    fd_timeouts_.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (handle) {
+                resumed_.fetch_add(1, std::memory_order_relaxed);
+                handle.resume();
+            }
+        }
+        return expired.empty() ? next_ms : 0;
+    }
+
+    void run()
+    {
+        epoll_event events[16];
+        while (!stopping_.load(std::memory_order_acquire)) {
+            std::coroutine_handle<> handle;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!ready_.empty()) {
+                    handle = ready_.front();
+                    ready_.pop_front();
+                } else {
+                    // 在同一把锁里登记睡眠，post 看到 sleeping_ 就会写 eventfd，不会丢唤醒
+                    sleeping_++;
+                }
+            }
+            if (handle) {
+                resumed_.fetch_add(1, std::memory_order_relaxed);
+                handle.resume();
+                continue;
+            }
+
+            int timeout = expire_timers();
+            int n = 0;
+            if (timeout != 0) {
+                epoll_waits_.fetch_add(1, std::memory_order_relaxed);
+                n = epoll_wait(epoll_fd_, events, 16, timeout);
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                sleeping_--;
+            }
+            for (int i = 0; i < n; i++) {
+                if (events[i].data.ptr == nullptr) {
+                    uint64_t count;
+                    [[maybe_unused]] auto consumed = ::read(wake_fd_, &count, sizeof(count));
+                    continue;
+                }
+                auto resumed = claim(*static_cast<fd_watch *>(events[i].data.ptr), true);
+                if (resumed) {
+                    fd_ready_.fetch_add(1, std::memory_order_relaxed);
+                    resumed_.fetch_add(1, std::memory_order_relaxed);
+                    resumed.resume();
+                }
+            }
+        }
+    }
+};
+
+/*
+ * 任意线程里的一次性回调变成 co_await：回调里调用 set(value)，等的协程在调度器上恢复，拿到 value
+ * 例如 HailoRT 的异步推理：
+ *   completion<hailo_status> done(scheduler);
+ *   auto job = infer_model.run_async(bindings, [&done](const AsyncInferCompletionInfo &info) { done.set(info.status); });
+ *   job->detach();
+ *   auto status = co_await done;
+ * set 之后回调不能再碰 completion，它所在的协程帧可能已经恢复并销毁
+ */
+template <typename T>
+class completion {
+public:
+    explicit completion(coro_scheduler &scheduler)
+        : scheduler_(scheduler)
+    {
+    }
+    completion(const completion &) = delete;
+    completion &operator=(const completion &) = delete;
+
+    void set(T value)
+    {
+        value_ = std::move(value);
+        // 交换出 WAITING 说明协程已经挂起（waiting_ 在它的 CAS 之前写好），要由这里交给调度器；在那之前协程帧不会被销毁
+        if (state_.exchange(DONE, std::memory_order_acq_rel) == WAITING)
+            scheduler_.post(waiting_);
+    }
+
+    bool await_ready() const noexcept
+    {
+        return state_.load(std::memory_order_acquire) == DONE;
+    }
+    bool await_suspend(std::coroutine_handle<> handle) noexcept
+    {
+        waiting_ = handle;
+        int expected = EMPTY;
+        // 失败说明回调已经先完成了，不用挂起
+        return state_.compare_exchange_strong(expected, WAITING, std::memory_order_acq_rel);
+    }
+    T await_resume()
+    {
+        return std::move(value_);
+    }
+
+private:
+    static constexpr int EMPTY = 0;
+    static constexpr int WAITING = 1;
+    static constexpr int DONE = 2;
+
+    coro_scheduler &scheduler_;
+    std::atomic<int> state_{ EMPTY };
+    std::coroutine_handle<> waiting_;
+    T value_{};
+};
+
+/*co_await async_pop(...) 返回 false 表示通道已关闭并且取空；等的时候不占线程*/
+template <typename T, overflow_policy Policy>
+task<bool> async_pop(coro_scheduler &scheduler, bounded_channel<T, Policy> &channel, T &item)
+{
+    struct awaiter : channel_waiter {
+        coro_scheduler &scheduler;
+        bounded_channel<T, Policy> &channel;
+        T &item;
+        std::coroutine_handle<> handle;
+        pop_result result = pop_result::waiting;
+
+        awaiter(coro_scheduler &s, bounded_channel<T, Policy> &c, T &i)
+            : scheduler(s), channel(c), item(i)
+        {
+        }
+        void notify() override
+        {
+            scheduler.post(handle);
+        }
+        bool await_ready() noexcept
+        {
+            return false;
+        }
+        bool await_suspend(std::coroutine_handle<> waiting)
+        {
+            // 先写好 handle 再登记，登记之后 push 可能马上在别的线程里 notify
+            handle = waiting;
+            result = channel.try_pop_or_wait(item, *this);
+            return result == pop_result::waiting;
+        }
+        pop_result await_resume() noexcept
+        {
+            return result;
+        }
+    };
+
+    while (true) {
+        // 被叫醒时元素可能已经被别的消费者取走，重新试
+        awaiter wait(scheduler, channel, item);
+        auto result = co_await wait;
+        if (result != pop_result::waiting)
+            co_return result == pop_result::popped;
+    }
+}
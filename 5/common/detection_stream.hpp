@@ -0,0 +1,331 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "hailo_nms.hpp"
+
+/*
+ * 检测结果的二进制记录流，给下游服务直接消费，不用再解析日志或重新检测
+ * 每帧一条记录 = detection_record_header + count 个 detection_record_box，全部小端、定长、自然对齐，
+ * 记录之间没有分隔符；下游按 record_size 跳到下一条，version 不认识时也能跳过
+ * 每条记录都以 magic 开头，连接中途断开重连后从新的记录开始，不需要流头
+ */
+inline constexpr uint32_t DETECTION_RECORD_MAGIC = 0x54454448; // "HDET"
+inline constexpr uint16_t DETECTION_RECORD_VERSION = 1;
+/*一条记录最多的框数，和 NMS 输出的上限相同*/
+inline constexpr std::size_t DETECTION_RECORD_MAX_BOXES = NMS_NUM_CLASSES * NMS_MAX_BOXES_PER_CLASS;
+
+struct detection_record_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t box_size;       // sizeof(detection_record_box)，以后加字段时旧的读取方按它跳
+    uint32_t record_size;    // 整条记录的字节数，包括头
+    uint32_t camera_id;
+    uint64_t sequence;       // 该路摄像头内的帧序号
+    int64_t capture_time_ns; // system_clock，Unix 纪元起的纳秒
+};
+
+/*坐标是归一化坐标 * 32767（Q15），分数是 score * 65535*/
+struct detection_record_box {
+    uint16_t class_id;
+    uint16_t score;
+    int16_t x_min, y_min, x_max, y_max;
+};
+
+static_assert(sizeof(detection_record_header) == 32);
+static_assert(sizeof(detection_record_box) == 12);
+static_assert(std::endian::native == std::endian::little, "detection records are little-endian");
+
+inline constexpr std::size_t detection_record_size(std::size_t boxes)
+{
+    return sizeof(detection_record_header) + boxes * sizeof(detection_record_box);
+}
+
+namespace detection_record_detail {
+inline int16_t to_q15(float v)
+{
+    return static_cast<int16_t>(std::lround(std::clamp(v, 0.0f, 1.0f) * 32767.0f));
+}
+inline float from_q15(int16_t v)
+{
+    return static_cast<float>(v) * (1.0f / 32767.0f);
+}
+} // namespace detection_record_detail
+
+/*把一帧的检测结果编码到 out，out 至少要有 detection_record_size(dets.size()) 字节；超过上限的框截掉。返回写入的字节数*/
+inline std::size_t encode_detection_record(uint32_t camera_id, uint64_t sequence, std::chrono::system_clock::time_point captured,
+                                           std::span<const nms_detection> dets, std::byte *out)
+{
+    using namespace detection_record_detail;
+    const std::size_t count = std::min(dets.size(), DETECTION_RECORD_MAX_BOXES);
+    detection_record_header header{};
+    header.magic = DETECTION_RECORD_MAGIC;
+    header.version = DETECTION_RECORD_VERSION;
+    header.box_size = sizeof(detection_record_box);
+    header.record_size = static_cast<uint32_t>(detection_record_size(count));
+    header.camera_id = camera_id;
+    header.sequence = sequence;
+    header.capture_time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(captured.time_since_epoch()).count();
+    std::memcpy(out, &header, sizeof(header));
+
+    std::byte *p = out + sizeof(header);
+    for (std::size_t i = 0; i < count; i++, p += sizeof(detection_record_box)) {
+        const auto &det = dets[i];
+        detection_record_box box{
+            static_cast<uint16_t>(det.class_id),
+            static_cast<uint16_t>(std::lround(std::clamp(det.score, 0.0f, 1.0f) * 65535.0f)),
+            to_q15(det.x_min),
+            to_q15(det.y_min),
+            to_q15(det.x_max),
+            to_q15(det.y_max),
+        };
+        std::memcpy(p, &box, sizeof(box));
+    }
+    return header.record_size;
+}
+
+/*
+ * 从 data 开头解析一条记录，data 不完整或 magic 不对时返回 0，否则返回这条记录的字节数
+ * 版本号比 DETECTION_RECORD_VERSION 新时 dets 为空，调用方按返回值跳过
+ */
+inline std::size_t decode_detection_record(std::span<const std::byte> data, detection_record_header &header, std::vector<nms_detection> &dets)
+{
+    using namespace detection_record_detail;
+    dets.clear();
+    if (data.size() < sizeof(header))
+        return 0;
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (header.magic != DETECTION_RECORD_MAGIC || header.record_size < sizeof(header) || data.size() < header.record_size)
+        return 0;
+    if (header.version > DETECTION_RECORD_VERSION || header.box_size < sizeof(detection_record_box))
+        return header.record_size;
+
+    const std::size_t count = (header.record_size - sizeof(header)) / header.box_size;
+    const std::byte *p = data.data() + sizeof(header);
+    for (std::size_t i = 0; i < count; i++, p += header.box_size) {
+        detection_record_box box;
+        std::memcpy(&box, p, sizeof(box));
+        dets.push_back({ box.class_id, box.score * (1.0f / 65535.0f), from_q15(box.x_min), from_q15(box.y_min), from_q15(box.x_max),
+                         from_q15(box.y_max) });
+    }
+    return header.record_size;
+}
+
+/*
+ * 把记录成批写到文件、管道或 Unix 域套接字：
+ *   "unix:/run/hailo_det.sock"  连接下游监听的 SOCK_STREAM 套接字
+ *   已存在的 FIFO               当管道写
+ *   其它路径                    追加到普通文件
+ * 记录直接编码进构造时分配好的批缓冲区，攒够 batch_records 条或最早一条等了 max_delay 就一次 write 出去，稳态下不分配内存
+ * 管道和套接字是非阻塞的，下游读得慢时缓冲区满了就丢新记录，不会卡住推理；
+ * 下游断开后丢掉没发完的数据，之后最多每秒重连一次，期间的记录计入丢弃
+ * 不是线程安全的，由调用方串行调用
+ */
+class detection_stream_writer {
+public:
+    struct stats {
+        std::size_t records = 0;
+        std::size_t batches = 0;
+        std::size_t bytes = 0;
+        std::size_t dropped = 0;
+        std::size_t reconnects = 0;
+    };
+
+    detection_stream_writer(std::string_view target, std::size_t batch_records, std::chrono::milliseconds max_delay)
+        : batch_records_(std::max<std::size_t>(batch_records, 1)), max_delay_(max_delay),
+          // 至少放得下攒满的一批普通记录和一条最大的记录
+          capacity_(std::max(detection_record_size(DETECTION_RECORD_MAX_BOXES), batch_records_ * detection_record_size(32)) * 2),
+          buffer_(std::make_unique<std::byte[]>(capacity_))
+    {
+        if (target.starts_with("unix:")) {
+            kind_ = sink_kind::unix_socket;
+            path_ = target.substr(5);
+        } else {
+            path_ = target;
+            struct stat st {};
+            kind_ = ::stat(path_.c_str(), &st) == 0 && S_ISFIFO(st.st_mode) ? sink_kind::fifo : sink_kind::file;
+        }
+        open_sink();
+    }
+    ~detection_stream_writer()
+    {
+        flush();
+        if (fd_ >= 0)
+            ::close(fd_);
+    }
+    detection_stream_writer(const detection_stream_writer &) = delete;
+    detection_stream_writer &operator=(const detection_stream_writer &) = delete;
+
+    bool connected() const
+    {
+        return fd_ >= 0;
+    }
+
+    /*编码一帧并按批次策略决定是否写出；返回 false 表示这条记录被丢弃*/
+    bool write(uint32_t camera_id, uint64_t sequence, std::chrono::system_clock::time_point captured, std::span<const nms_detection> dets)
+    {
+        auto now = clock::now();
+        if (fd_ < 0 && !reconnect(now)) {
+            stats_.dropped++;
+            return false;
+        }
+
+        const std::size_t size = detection_record_size(std::min(dets.size(), DETECTION_RECORD_MAX_BOXES));
+        if (capacity_ - end_ < size) {
+            flush();
+            compact();
+            if (fd_ < 0 || capacity_ - end_ < size) {
+                stats_.dropped++;
+                return false;
+            }
+        }
+
+        if (pending_records_ == 0)
+            first_pending_ = now;
+        end_ += encode_detection_record(camera_id, sequence, captured, dets, buffer_.get() + end_);
+        pending_records_++;
+        stats_.records++;
+
+        if (pending_records_ >= batch_records_ || now - first_pending_ >= max_delay_)
+            flush();
+        return true;
+    }
+
+    /*把缓冲区里的记录尽量写出去；非阻塞的下游暂时写不进时留到下次*/
+    void flush()
+    {
+        if (fd_ < 0 || begin_ == end_)
+            return;
+        if (pending_records_ > 0)
+            stats_.batches++;
+        pending_records_ = 0;
+        while (begin_ < end_) {
+            ssize_t n = kind_ == sink_kind::unix_socket ? ::send(fd_, buffer_.get() + begin_, end_ - begin_, MSG_NOSIGNAL)
+                                                        : ::write(fd_, buffer_.get() + begin_, end_ - begin_);
+            if (n > 0) {
+                begin_ += static_cast<std::size_t>(n);
+                stats_.bytes += static_cast<std::size_t>(n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return;
+            // EPIPE、ECONNRESET 等：下游没了，没发完的记录作废，下次重连从完整的记录开始
+            std::cerr << "检测结果输出 " << path_ << " 写入失败: " << std::strerror(errno) << std::endl;
+            close_sink();
+            return;
+        }
+        begin_ = end_ = 0;
+    }
+
+    const stats &statistics() const
+    {
+        return stats_;
+    }
+
+    void report() const
+    {
+        std::cout << "检测结果输出 " << path_ << ": " << stats_.records << "条记录，" << stats_.batches << "批，" << stats_.bytes / 1024
+                  << "KB，平均每条" << (stats_.records == 0 ? 0 : stats_.bytes / stats_.records) << "字节，丢弃" << stats_.dropped
+                  << "条，重连" << stats_.reconnects << "次" << std::endl;
+    }
+
+private:
+    using clock = std::chrono::steady_clock;
+    static constexpr auto RECONNECT_INTERVAL = std::chrono::seconds(1);
+
+    enum class sink_kind {
+        file,
+        fifo,
+        unix_socket,
+    };
+
+    sink_kind kind_ = sink_kind::file;
+    std::string path_;
+    int fd_ = -1;
+    std::size_t batch_records_;
+    std::chrono::milliseconds max_delay_;
+    std::size_t capacity_;
+    std::unique_ptr<std::byte[]> buffer_;
+    std::size_t begin_ = 0; // [begin_, end_) 是还没写出去的字节
+    std::size_t end_ = 0;
+    std::size_t pending_records_ = 0;
+    clock::time_point first_pending_{};
+    clock::time_point last_attempt_{};
+    stats stats_{};
+
+    bool open_sink()
+    {
+        last_attempt_ = clock::now();
+        if (kind_ == sink_kind::unix_socket) {
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            if (path_.size() >= sizeof(addr.sun_path)) {
+                std::cerr << "Unix 套接字路径过长 " << path_ << std::endl;
+                return false;
+            }
+            std::memcpy(addr.sun_path, path_.c_str(), path_.size() + 1);
+            fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd_ >= 0 && ::connect(fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+                ::close(fd_);
+                fd_ = -1;
+            }
+        } else if (kind_ == sink_kind::fifo) {
+            // 没有读端时 open 返回 ENXIO，不会阻塞
+            fd_ = ::open(path_.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+        } else {
+            fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        }
+        if (fd_ < 0) {
+            std::cerr << "检测结果输出 " << path_ << " 打开失败: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    void close_sink()
+    {
+        ::close(fd_);
+        fd_ = -1;
+        begin_ = end_ = 0;
+    }
+
+    bool reconnect(clock::time_point now)
+    {
+        if (now - last_attempt_ < RECONNECT_INTERVAL)
+            return false;
+        if (!open_sink())
+            return false;
+        stats_.reconnects++;
+        return true;
+    }
+
+    /*把没写出去的字节挪到缓冲区开头*/
+    void compact()
+    {
+        if (begin_ == 0)
+            return;
+        std::memmove(buffer_.get(), buffer_.get() + begin_, end_ - begin_);
+        end_ -= begin_;
+        begin_ = 0;
+    }
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <utility>
+
+#include "frame_pool.hpp"
+
+/*
+ * 帧的处理期限（frame_info::deadline = 采集时间 + 延迟预算）：每个阶段在昂贵的工作（解码、推理、二级分类、缩小画框）之前检查一次，
+ * 已经赶不上的帧直接丢掉，把 CPU / NPU 留给新帧；过载时端到端延迟停在预算附近，而不是随着积压越排越长
+ * 每个阶段一个 deadline_gate，各自统计检查过和过期跳过的帧，多个线程可以同时调用
+ */
+class deadline_gate {
+public:
+    using clock = std::chrono::steady_clock;
+
+    explicit deadline_gate(std::string name) : name_(std::move(name))
+    {
+    }
+    deadline_gate(const deadline_gate &) = delete;
+    deadline_gate &operator=(const deadline_gate &) = delete;
+
+    /*
+     * cost 是这个阶段接下来要花的时间（估计值）：现在开始做，做完时会过期的帧也算赶不上
+     * 赶不上返回 true 并计数，调用方丢掉这一帧；没有期限的帧不会过期
+     */
+    bool expired(const frame_info &info, clock::duration cost = {}, clock::time_point now = clock::now())
+    {
+        checked_.fetch_add(1, std::memory_order_relaxed);
+        const auto finish = now + cost;
+        if (!info.past_deadline(finish))
+            return false;
+        skipped_.fetch_add(1, std::memory_order_relaxed);
+        const int64_t overdue = std::chrono::duration_cast<std::chrono::microseconds>(finish - info.deadline).count();
+        int64_t max = max_overdue_us_.load(std::memory_order_relaxed);
+        while (overdue > max && !max_overdue_us_.compare_exchange_weak(max, overdue, std::memory_order_relaxed)) {
+        }
+        return true;
+    }
+
+    std::size_t checked() const
+    {
+        return checked_.load(std::memory_order_relaxed);
+    }
+    std::size_t skipped() const
+    {
+        return skipped_.load(std::memory_order_relaxed);
+    }
+
+    void report() const
+    {
+        const auto checked = this->checked();
+        const auto skipped = this->skipped();
+        std::cout << "过期跳过 " << name_ << ": 检查" << checked << "帧，跳过" << skipped << "帧";
+        if (checked > 0 && skipped > 0)
+            std::cout << "（" << 100.0 * skipped / checked << "%），最多超出期限 " << max_overdue_us_.load(std::memory_order_relaxed) / 1000.0 << "ms";
+        std::cout << std::endl;
+    }
+
+private:
+    std::string name_;
+    std::atomic<std::size_t> checked_{ 0 };
+    std::atomic<std::size_t> skipped_{ 0 };
+    std::atomic<int64_t> max_overdue_us_{ 0 };
+};
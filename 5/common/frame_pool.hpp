@@ -0,0 +1,303 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <sys/mman.h>
+#include "opencv2/opencv.hpp"
+
+/*跟着帧一起走的元数据*/
+struct frame_info {
+    uint32_t camera = 0;
+    uint64_t sequence = 0;                            // 该路摄像头的采集序号
+    std::chrono::system_clock::time_point captured{}; // 从设备取到帧的时间，写进检测记录
+    std::chrono::steady_clock::time_point ready{};    // 解码、颜色转换完成的时间
+    std::chrono::steady_clock::time_point deadline{}; // 过了这个时间不值得再做昂贵的处理（见 frame_deadline.hpp）；默认值表示没有期限
+
+    bool past_deadline(std::chrono::steady_clock::time_point now) const
+    {
+        return deadline != std::chrono::steady_clock::time_point{} && now > deadline;
+    }
+};
+
+class video_frame;
+
+/*
+ * 定长帧缓冲区池：启动时一次 mmap 出 count 块 size x type 的像素缓冲区，之后只借还不分配
+ * 和 buffer_pool 不同，借出的帧是引用计数的（video_frame 可以复制，最后一个副本析构时归还），
+ * 所以同一帧可以同时交给推理、预览和共享内存环
+ * huge_pages 时先试 MAP_HUGETLB（需要预留大页），失败再退回普通页 + MADV_HUGEPAGE（透明大页）
+ * 池借空时 acquire 不阻塞采集线程，退回到普通的 cv::Mat 分配并计数，报告里看得出池是否太小
+ * 池必须比借出的所有帧活得久
+ */
+class frame_pool {
+public:
+    struct stats {
+        std::size_t buffers = 0;     // 池里的缓冲区个数，mmap 失败时为 0
+        bool huge_pages = false;     // 是否用上了 MAP_HUGETLB
+        std::size_t acquired = 0;    // 从池里借出的次数
+        std::size_t fallbacks = 0;   // 池借空后退回 cv::Mat 分配的次数
+        std::size_t in_use = 0;
+        std::size_t peak_in_use = 0;
+        std::size_t copies = 0;      // 整帧深拷贝次数（clone、写共享内存环等），全进程统计
+        std::size_t copy_bytes = 0;
+    };
+
+    frame_pool(cv::Size size, int type, std::size_t count, bool huge_pages = false)
+        : size_(size), type_(type)
+    {
+        const std::size_t frame_bytes = static_cast<std::size_t>(size.area()) * CV_ELEM_SIZE(type);
+        if (frame_bytes == 0 || count == 0)
+            return;
+        constexpr std::size_t PAGE = 4096;
+        constexpr std::size_t HUGE_PAGE = 2 << 20;
+        stride_ = (frame_bytes + PAGE - 1) / PAGE * PAGE;
+        if (huge_pages) {
+            mapped_bytes_ = (stride_ * count + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+            void *p = ::mmap(nullptr, mapped_bytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED) {
+                storage_ = static_cast<uint8_t *>(p);
+                huge_pages_ = true;
+            }
+        }
+        if (storage_ == nullptr) {
+            mapped_bytes_ = stride_ * count;
+            void *p = ::mmap(nullptr, mapped_bytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED) {
+                std::cerr << "帧缓冲区池 mmap 失败，所有帧退回 cv::Mat 分配" << std::endl;
+                mapped_bytes_ = 0;
+                return;
+            }
+            storage_ = static_cast<uint8_t *>(p);
+            if (huge_pages)
+                ::madvise(storage_, mapped_bytes_, MADV_HUGEPAGE);
+        }
+        slots_ = std::vector<slot>(count);
+        free_.reserve(count);
+        for (std::size_t i = 0; i < count; i++) {
+            slots_[i].pool = this;
+            slots_[i].data = storage_ + i * stride_;
+            free_.push_back(&slots_[i]);
+        }
+    }
+    ~frame_pool()
+    {
+        if (storage_ != nullptr)
+            ::munmap(storage_, mapped_bytes_);
+    }
+    frame_pool(const frame_pool &) = delete;
+    frame_pool &operator=(const frame_pool &) = delete;
+
+    cv::Size size() const
+    {
+        return size_;
+    }
+    int type() const
+    {
+        return type_;
+    }
+
+    /*借一帧（像素内容未定义）；池空时最多等 timeout，还借不到就退回 cv::Mat 分配*/
+    video_frame acquire(std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+
+    /*池外发生的整帧拷贝（例如写进共享内存环）也记在这里*/
+    static void count_copy(std::size_t bytes)
+    {
+        copies_.fetch_add(1, std::memory_order_relaxed);
+        copy_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    stats statistics() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats result = stats_;
+        result.buffers = slots_.size();
+        result.huge_pages = huge_pages_;
+        result.in_use = slots_.size() - free_.size();
+        result.copies = copies_.load(std::memory_order_relaxed);
+        result.copy_bytes = copy_bytes_.load(std::memory_order_relaxed);
+        return result;
+    }
+
+    void report() const
+    {
+        auto s = statistics();
+        std::cout << "帧缓冲区池: " << s.buffers << "块" << (s.huge_pages ? "（大页）" : "") << "，借出" << s.acquired << "次，最多同时借出" << s.peak_in_use
+                  << "块，借空后临时分配" << s.fallbacks << "次，整帧拷贝" << s.copies << "次共" << s.copy_bytes / (1024 * 1024) << "MB" << std::endl;
+    }
+
+private:
+    friend class video_frame;
+
+    struct slot {
+        std::atomic<uint32_t> refs{ 0 };
+        frame_pool *pool = nullptr;
+        uint8_t *data = nullptr;
+    };
+
+    const cv::Size size_;
+    const int type_;
+    std::size_t stride_ = 0;
+    std::size_t mapped_bytes_ = 0;
+    uint8_t *storage_ = nullptr;
+    bool huge_pages_ = false;
+    std::vector<slot> slots_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable available_;
+    std::vector<slot *> free_;
+    stats stats_{};
+
+    static inline std::atomic<std::size_t> copies_{ 0 };
+    static inline std::atomic<std::size_t> copy_bytes_{ 0 };
+
+    void release(slot *s)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            free_.push_back(s);
+        }
+        available_.notify_one();
+    }
+};
+
+/*
+ * 一帧图像加元数据。池里借的帧复制时只加引用计数，不复制像素；不在池里的帧（池借空、测试里直接给的 Mat）
+ * 由 cv::Mat 自己的引用计数管理
+ * mat() 对池里的帧是不持有像素的 Mat 头，不要脱离 video_frame 单独保存；
+ * 对它 create / 赋值成别的尺寸时 OpenCV 会另外分配，帧只是不再用池里的缓冲区，仍然是安全的
+ */
+class video_frame {
+public:
+    video_frame() = default;
+    explicit video_frame(cv::Mat mat, const frame_info &info = {})
+        : mat_(std::move(mat)), info_(info)
+    {
+    }
+    video_frame(const video_frame &other)
+        : slot_(other.slot_), mat_(other.mat_), info_(other.info_)
+    {
+        if (slot_ != nullptr)
+            slot_->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    video_frame(video_frame &&other) noexcept
+        : slot_(std::exchange(other.slot_, nullptr)), mat_(std::move(other.mat_)), info_(other.info_)
+    {
+    }
+    video_frame &operator=(const video_frame &other)
+    {
+        if (this != &other) {
+            video_frame copy(other);
+            swap(copy);
+        }
+        return *this;
+    }
+    video_frame &operator=(video_frame &&other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            swap(other);
+        }
+        return *this;
+    }
+    ~video_frame()
+    {
+        reset();
+    }
+
+    void swap(video_frame &other) noexcept
+    {
+        std::swap(slot_, other.slot_);
+        cv::swap(mat_, other.mat_);
+        std::swap(info_, other.info_);
+    }
+    friend void swap(video_frame &a, video_frame &b) noexcept
+    {
+        a.swap(b);
+    }
+
+    /*放掉像素（最后一个引用时归还给池），元数据保留*/
+    void reset()
+    {
+        mat_.release();
+        if (slot_ != nullptr && slot_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            slot_->pool->release(slot_);
+        slot_ = nullptr;
+    }
+
+    bool empty() const
+    {
+        return mat_.empty();
+    }
+    bool pooled() const
+    {
+        return slot_ != nullptr;
+    }
+    cv::Mat &mat()
+    {
+        return mat_;
+    }
+    const cv::Mat &mat() const
+    {
+        return mat_;
+    }
+    frame_info &info()
+    {
+        return info_;
+    }
+    const frame_info &info() const
+    {
+        return info_;
+    }
+
+    /*深拷贝：池里的帧从同一个池再借一块，计入整帧拷贝次数*/
+    video_frame clone() const
+    {
+        if (mat_.empty())
+            return video_frame(cv::Mat(), info_);
+        video_frame copy = slot_ != nullptr ? slot_->pool->acquire() : video_frame();
+        mat_.copyTo(copy.mat_);
+        copy.info_ = info_;
+        frame_pool::count_copy(mat_.total() * mat_.elemSize());
+        return copy;
+    }
+
+private:
+    friend class frame_pool;
+
+    frame_pool::slot *slot_ = nullptr;
+    cv::Mat mat_;
+    frame_info info_{};
+};
+
+inline video_frame frame_pool::acquire(std::chrono::milliseconds timeout)
+{
+    slot *s = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!slots_.empty() && (!free_.empty() || available_.wait_for(lock, timeout, [this] { return !free_.empty(); }))) {
+            s = free_.back();
+            free_.pop_back();
+            stats_.acquired++;
+            stats_.peak_in_use = std::max(stats_.peak_in_use, slots_.size() - free_.size());
+        } else {
+            stats_.fallbacks++;
+        }
+    }
+    video_frame frame;
+    if (s == nullptr) {
+        frame.mat_.create(size_, type_);
+        return frame;
+    }
+    s->refs.store(1, std::memory_order_relaxed);
+    frame.slot_ = s;
+    frame.mat_ = cv::Mat(size_, type_, s->data);
+    return frame;
+}
@@ -0,0 +1,325 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+
+/*
+ * HAILO_NMS_BY_CLASS 输出布局：
+ * 每个类别 = 1个计数器 + MAX_BOXES_PER_CLASS 个框 * 5个数据 (ymin, xmin, ymax, xmax, score)
+ * 计数器和框数据的元素类型相同：FLOAT32 输出是 float，量化输出是 uint16_t（即 hailo_bbox_t）
+ * 计数器本身不做量化，两种格式下都是框的个数
+ */
+inline constexpr int NMS_NUM_CLASSES = 80;
+inline constexpr int NMS_MAX_BOXES_PER_CLASS = 100;
+inline constexpr int NMS_BOX_DIM = 5;
+
+struct nms_detection {
+    int class_id;
+    float score;
+    float x_min, y_min, x_max, y_max; // 归一化坐标 0~1
+};
+
+/*vstream 的量化参数：float = (q - zp) * scale*/
+struct nms_quant {
+    float zp = 0.0f;
+    float scale = 1.0f;
+};
+
+/*
+ * 感兴趣的类别和各自的分数阈值。布局里每个类别的偏移是常量，所以没启用的类别连计数器都不用读
+ * classes 按类别 id 升序，前 class_count 个有效；thresholds 以类别 id 为下标，只有启用的类别有意义
+ */
+template <int NUM_CLASSES = NMS_NUM_CLASSES>
+struct nms_class_filter {
+    std::array<int, NUM_CLASSES> classes{};
+    std::array<float, NUM_CLASSES> thresholds{};
+    int class_count = 0;
+
+    /*全部类别，统一阈值*/
+    static constexpr nms_class_filter all(float threshold)
+    {
+        nms_class_filter filter;
+        for (int class_id = 0; class_id < NUM_CLASSES; class_id++) {
+            filter.classes[class_id] = class_id;
+            filter.thresholds[class_id] = threshold;
+        }
+        filter.class_count = NUM_CLASSES;
+        return filter;
+    }
+
+    /*entries 是 {类别 id, 阈值} 的序列；为空时等价于 all(default_threshold)*/
+    template <typename Range>
+    static constexpr nms_class_filter from(const Range &entries, float default_threshold)
+    {
+        nms_class_filter filter;
+        for (const auto &[class_id, threshold] : entries)
+            filter.enable(class_id, threshold);
+        return filter.class_count == 0 ? all(default_threshold) : filter;
+    }
+
+    /*重复启用同一个类别时只更新阈值，越界的类别忽略*/
+    constexpr void enable(int class_id, float threshold)
+    {
+        if (class_id < 0 || class_id >= NUM_CLASSES)
+            return;
+        int pos = 0;
+        while (pos < class_count && classes[pos] < class_id)
+            pos++;
+        if (pos == class_count || classes[pos] != class_id) {
+            for (int i = class_count; i > pos; i--)
+                classes[i] = classes[i - 1];
+            classes[pos] = class_id;
+            class_count++;
+        }
+        thresholds[class_id] = threshold;
+    }
+
+    constexpr bool enabled(int class_id) const
+    {
+        for (int i = 0; i < class_count; i++) {
+            if (classes[i] == class_id)
+                return true;
+        }
+        return false;
+    }
+};
+
+/*
+ * NMS 输出缓冲区上的只读视图，类别数和每类最大框数在编译期确定，偏移全部是常量
+ * 遍历时只进入启用且计数器非零的类别；量化输出先在量化域里比较分数，只有通过阈值的框才反量化
+ * 视图本身不分配内存，迭代器按值产出 nms_detection
+ */
+template <typename T, int NUM_CLASSES = NMS_NUM_CLASSES, int MAX_BOXES = NMS_MAX_BOXES_PER_CLASS>
+class nms_by_class_view {
+    static_assert(std::is_same_v<T, float> || std::is_same_v<T, uint16_t>, "NMS output must be FLOAT32 or UINT16");
+
+public:
+    static constexpr int CLASS_STRIDE = 1 + (MAX_BOXES * NMS_BOX_DIM);
+    static constexpr std::size_t ELEMENT_COUNT = static_cast<std::size_t>(NUM_CLASSES) * CLASS_STRIDE;
+    static constexpr std::size_t FRAME_SIZE = ELEMENT_COUNT * sizeof(T);
+
+    using filter_type = nms_class_filter<NUM_CLASSES>;
+
+    nms_by_class_view(const T *out, float score_threshold, nms_quant quant = {})
+        : nms_by_class_view(out, filter_type::all(score_threshold), quant)
+    {
+    }
+
+    /*每个类别的阈值在构造时换算到量化域，遍历时只做一次比较*/
+    nms_by_class_view(const T *out, const filter_type &filter, nms_quant quant = {})
+        : out_(out), quant_(quant), filter_(filter)
+    {
+        if constexpr (!std::is_same_v<T, float>) {
+            for (int i = 0; i < filter_.class_count; i++) {
+                auto class_id = filter_.classes[i];
+                filter_.thresholds[class_id] = filter_.thresholds[class_id] / quant.scale + quant.zp;
+            }
+        }
+    }
+
+    int count(int class_id) const
+    {
+        int n = static_cast<int>(out_[class_id * CLASS_STRIDE]);
+        return n < 0 ? 0 : (n > MAX_BOXES ? MAX_BOXES : n);
+    }
+
+    class iterator {
+        const nms_by_class_view *view_ = nullptr;
+        int slot_ = NUM_CLASSES; // 在 filter_.classes 里的下标
+        int class_id_ = 0;
+        int box_ = 0;
+        int count_ = 0;
+        float raw_threshold_ = 0.0f;
+
+        void enter(int slot)
+        {
+            slot_ = slot;
+            box_ = 0;
+            if (slot_ < view_->filter_.class_count) {
+                class_id_ = view_->filter_.classes[slot_];
+                count_ = view_->count(class_id_);
+                raw_threshold_ = view_->filter_.thresholds[class_id_];
+            } else {
+                slot_ = NUM_CLASSES;
+            }
+        }
+
+        /*从当前位置开始找下一个通过阈值的框，空类别只读一次计数器，未启用的类别不读*/
+        void settle()
+        {
+            while (slot_ < NUM_CLASSES) {
+                for (; box_ < count_; box_++) {
+                    if (static_cast<float>(view_->box(class_id_, box_)[4]) >= raw_threshold_)
+                        return;
+                }
+                enter(slot_ + 1);
+            }
+        }
+
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = nms_detection;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+        explicit iterator(const nms_by_class_view *view)
+            : view_(view)
+        {
+            enter(0);
+            settle();
+        }
+
+        nms_detection operator*() const
+        {
+            return view_->make_detection(class_id_, box_);
+        }
+        iterator &operator++()
+        {
+            box_++;
+            settle();
+            return *this;
+        }
+        iterator operator++(int)
+        {
+            auto old = *this;
+            ++*this;
+            return old;
+        }
+        bool operator==(const iterator &other) const
+        {
+            return slot_ == other.slot_ && (slot_ == NUM_CLASSES || box_ == other.box_);
+        }
+    };
+
+    iterator begin() const
+    {
+        return iterator(this);
+    }
+    iterator end() const
+    {
+        return iterator();
+    }
+
+    /*回调版本，对每个通过阈值的框调用 on_detection(const nms_detection &)*/
+    template <typename F>
+    void for_each(F &&on_detection) const
+    {
+        for (int slot = 0; slot < filter_.class_count; slot++) {
+            int class_id = filter_.classes[slot];
+            int n = count(class_id);
+            float raw_threshold = filter_.thresholds[class_id];
+            for (int i = 0; i < n; i++) {
+                if (static_cast<float>(box(class_id, i)[4]) < raw_threshold)
+                    continue;
+                on_detection(make_detection(class_id, i));
+            }
+        }
+    }
+
+private:
+    const T *out_;
+    nms_quant quant_;
+    filter_type filter_; // thresholds 已换算到 T 的数值域
+
+    const T *box(int class_id, int i) const
+    {
+        return out_ + class_id * CLASS_STRIDE + 1 + i * NMS_BOX_DIM;
+    }
+
+    float dequant(T v) const
+    {
+        if constexpr (std::is_same_v<T, float>) {
+            return v;
+        } else {
+            return (static_cast<float>(v) - quant_.zp) * quant_.scale;
+        }
+    }
+
+    nms_detection make_detection(int class_id, int i) const
+    {
+        const T *b = box(class_id, i);
+        return { class_id, dequant(b[4]), dequant(b[1]), dequant(b[0]), dequant(b[3]), dequant(b[2]) };
+    }
+};
+
+/*
+ * 预分配、可复用的 NMS 输出缓冲区，启动时分配一次，之后每帧 read 到同一块内存
+ * 64 字节对齐，和 cache line 对齐
+ */
+template <typename T, int NUM_CLASSES = NMS_NUM_CLASSES, int MAX_BOXES = NMS_MAX_BOXES_PER_CLASS>
+class nms_output_buffer {
+    struct aligned_delete {
+        void operator()(T *p) const
+        {
+            ::operator delete[](p, std::align_val_t{ 64 });
+        }
+    };
+    std::unique_ptr<T[], aligned_delete> data_;
+
+public:
+    using view_type = nms_by_class_view<T, NUM_CLASSES, MAX_BOXES>;
+    static constexpr std::size_t FRAME_SIZE = view_type::FRAME_SIZE;
+
+    nms_output_buffer()
+        : data_(static_cast<T *>(::operator new[](FRAME_SIZE, std::align_val_t{ 64 })))
+    {
+    }
+
+    T *data()
+    {
+        return data_.get();
+    }
+    const T *data() const
+    {
+        return data_.get();
+    }
+    static constexpr std::size_t size()
+    {
+        return FRAME_SIZE;
+    }
+    std::span<const T> elements() const
+    {
+        return { data_.get(), view_type::ELEMENT_COUNT };
+    }
+
+    view_type view(float score_threshold, nms_quant quant = {}) const
+    {
+        return view_type(data_.get(), score_threshold, quant);
+    }
+    view_type view(const typename view_type::filter_type &filter, nms_quant quant = {}) const
+    {
+        return view_type(data_.get(), filter, quant);
+    }
+};
+
+/*整块反量化成 FLOAT32 布局，等价于 libhailort 在 HAILO_FORMAT_TYPE_FLOAT32 下做的事，供基准测试对比*/
+template <int NUM_CLASSES = NMS_NUM_CLASSES, int MAX_BOXES = NMS_MAX_BOXES_PER_CLASS>
+void dequantize_nms_by_class(const uint16_t *in, float *out, nms_quant quant)
+{
+    constexpr int CLASS_STRIDE = nms_by_class_view<uint16_t, NUM_CLASSES, MAX_BOXES>::CLASS_STRIDE;
+    for (int class_id = 0; class_id < NUM_CLASSES; class_id++) {
+        const uint16_t *src = in + class_id * CLASS_STRIDE;
+        float *dst = out + class_id * CLASS_STRIDE;
+        dst[0] = static_cast<float>(src[0]);
+        for (int i = 1; i < CLASS_STRIDE; i++) {
+            dst[i] = (static_cast<float>(src[i]) - quant.zp) * quant.scale;
+        }
+    }
+}
+
+/*
+ * 输出转储文件格式：nms_dump_header + 原始输出字节
+ * 由 infer.cpp 在 OUTPUT_DUMP_DIR 非空时写出，bench/bench_nms.cpp 读取
+ */
+struct nms_dump_header {
+    char magic[4] = { 'H', 'N', 'M', 'S' };
+    uint32_t element_size = 0; // 4 = float，2 = uint16_t
+    nms_quant quant{};
+    uint32_t payload_size = 0;
+};
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <ctime>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "opencv2/opencv.hpp"
+
+#include "hailo_nms.hpp"
+
+struct overlay_style {
+    cv::Scalar color{ 0, 255, 0 }; // BGR
+    int box_thickness = 2;
+    double font_scale = 0.6;
+    int font_thickness = 1;
+};
+
+/*
+ * 检测结果叠加层。标签用到的字形（每个类别的标签、数字和少量符号）在构造时用 cv::putText 光栅化一次，
+ * 存进一张单通道 alpha 图集；之后每帧只是把图集里的小块按 alpha 混合拷到帧上，
+ * 不再每个框走一遍 Hershey 矢量字体，也不再为每个框拼 std::string
+ * 每帧先 add_box / add_text 收集，再 render 一次画到显示分辨率的帧上；框坐标是归一化的，和帧尺寸无关
+ */
+class overlay_renderer {
+public:
+    static constexpr int NO_ATTRIBUTE = -1;
+
+    /*class_names 为空时类别标签就是类别 id*/
+    explicit overlay_renderer(const overlay_style &style = {}, std::span<const std::string_view> class_names = {})
+        : style_(style)
+    {
+        color_ = { static_cast<uint8_t>(style.color[0]), static_cast<uint8_t>(style.color[1]), static_cast<uint8_t>(style.color[2]) };
+        char_glyph_.fill(-1);
+
+        std::vector<std::string> texts;
+        for (int class_id = 0; class_id < NMS_NUM_CLASSES; class_id++) {
+            texts.push_back(static_cast<std::size_t>(class_id) < class_names.size() ? std::string(class_names[class_id]) : std::to_string(class_id));
+        }
+        for (char c : GLYPH_CHARS) {
+            char_glyph_[static_cast<unsigned char>(c)] = static_cast<int16_t>(texts.size());
+            texts.emplace_back(1, c);
+        }
+
+        // 所有字形排成一行，共用同一条基线
+        int width = 0;
+        for (auto &text : texts) {
+            int baseline = 0;
+            auto size = cv::getTextSize(text, cv::FONT_HERSHEY_SIMPLEX, style.font_scale, style.font_thickness, &baseline);
+            glyphs_.push_back({ width, size.width });
+            width += size.width + GLYPH_PADDING;
+            ascent_ = std::max(ascent_, size.height + style.font_thickness);
+            descent_ = std::max(descent_, baseline + style.font_thickness);
+        }
+        atlas_ = cv::Mat::zeros(ascent_ + descent_, width, CV_8UC1);
+        for (std::size_t i = 0; i < texts.size(); i++) {
+            cv::putText(atlas_, texts[i], cv::Point(glyphs_[i].x, ascent_), cv::FONT_HERSHEY_SIMPLEX, style.font_scale,
+                        cv::Scalar(255), style.font_thickness, cv::LINE_AA);
+        }
+
+        boxes_.reserve(NMS_NUM_CLASSES * NMS_MAX_BOXES_PER_CLASS);
+        texts_.reserve(8);
+    }
+
+    void clear()
+    {
+        boxes_.clear();
+        texts_.clear();
+    }
+
+    /*标签是 "类别 分数"，有二级分类结果时再加 " a属性"；分数和原来的 to_string(score).substr(0, 4) 显示一致*/
+    void add_box(const nms_detection &det, int attribute = NO_ATTRIBUTE)
+    {
+        boxes_.push_back({ det, attribute });
+    }
+
+    /*x 是左边，baseline_y 是基线，像素坐标；只支持数字和 GLYPH_CHARS 里的符号，其它字符跳过，超长截断*/
+    void add_text(int x, int baseline_y, std::string_view text)
+    {
+        text_command command{ x, baseline_y, 0, {} };
+        command.length = static_cast<uint8_t>(std::min(text.size(), command.text.size()));
+        std::copy_n(text.begin(), command.length, command.text.begin());
+        texts_.push_back(command);
+    }
+
+    /*"2024-01-01 12:00:00.123"，本地时间*/
+    void add_timestamp(int x, int baseline_y, std::chrono::system_clock::time_point tp)
+    {
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(tp.time_since_epoch()) % 1000;
+        std::time_t t = std::chrono::system_clock::to_time_t(tp);
+        std::tm local{};
+        localtime_r(&t, &local);
+        char text[32];
+        auto length = std::strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &local);
+        text[length++] = '.';
+        text[length++] = static_cast<char>('0' + ms.count() / 100);
+        text[length++] = static_cast<char>('0' + ms.count() / 10 % 10);
+        text[length++] = static_cast<char>('0' + ms.count() % 10);
+        add_text(x, baseline_y, std::string_view(text, length));
+    }
+
+    std::size_t box_count() const
+    {
+        return boxes_.size();
+    }
+
+    /*frame 必须是 CV_8UC3；先画所有框，再画所有文字，文字不会被后面的框压住*/
+    void render(cv::Mat &frame) const
+    {
+        const int width = frame.cols;
+        const int height = frame.rows;
+        for (const auto &box : boxes_) {
+            draw_rect(frame, static_cast<int>(box.det.x_min * width), static_cast<int>(box.det.y_min * height),
+                      static_cast<int>(box.det.x_max * width), static_cast<int>(box.det.y_max * height));
+        }
+        for (const auto &box : boxes_) {
+            int x = static_cast<int>(box.det.x_min * width);
+            int y1 = static_cast<int>(box.det.y_min * height);
+            int y = y1 - 5 < ascent_ ? y1 + ascent_ + 5 : y1 - 5;
+
+            if (box.det.class_id >= 0 && box.det.class_id < NMS_NUM_CLASSES)
+                x = blit(frame, box.det.class_id, x, y);
+            x = blit_char(frame, ' ', x, y);
+            // 按 std::to_string 的 6 位小数取整后截断到 2 位
+            long micros = std::lround(std::clamp(box.det.score, 0.0f, 9.99f) * 1e6);
+            x = blit_char(frame, static_cast<char>('0' + micros / 1000000), x, y);
+            x = blit_char(frame, '.', x, y);
+            x = blit_char(frame, static_cast<char>('0' + micros / 100000 % 10), x, y);
+            x = blit_char(frame, static_cast<char>('0' + micros / 10000 % 10), x, y);
+            if (box.attribute != NO_ATTRIBUTE) {
+                x = blit_char(frame, ' ', x, y);
+                x = blit_char(frame, 'a', x, y);
+                blit_number(frame, box.attribute, x, y);
+            }
+        }
+        for (const auto &text : texts_) {
+            int x = text.x;
+            for (int i = 0; i < text.length; i++)
+                x = blit_char(frame, text.text[i], x, text.y);
+        }
+    }
+
+    const cv::Mat &atlas() const
+    {
+        return atlas_;
+    }
+
+private:
+    static constexpr std::string_view GLYPH_CHARS = "0123456789 .:-a";
+    static constexpr int GLYPH_PADDING = 2;
+
+    struct glyph {
+        int x;
+        int width;
+    };
+    struct box_command {
+        nms_detection det;
+        int attribute;
+    };
+    struct text_command {
+        int x;
+        int y;
+        uint8_t length;
+        std::array<char, 31> text;
+    };
+
+    overlay_style style_;
+    std::array<uint8_t, 3> color_{};
+    cv::Mat atlas_;
+    std::vector<glyph> glyphs_; // 前 NMS_NUM_CLASSES 个是类别标签，之后是 GLYPH_CHARS
+    std::array<int16_t, 128> char_glyph_{};
+    int ascent_ = 0;
+    int descent_ = 0;
+    std::vector<box_command> boxes_;
+    std::vector<text_command> texts_;
+
+    void fill(cv::Mat &frame, int x1, int y1, int x2, int y2) const
+    {
+        x1 = std::max(x1, 0);
+        y1 = std::max(y1, 0);
+        x2 = std::min(x2, frame.cols);
+        y2 = std::min(y2, frame.rows);
+        for (int y = y1; y < y2; y++) {
+            uint8_t *p = frame.ptr<uint8_t>(y) + 3 * x1;
+            for (int x = x1; x < x2; x++, p += 3) {
+                p[0] = color_[0];
+                p[1] = color_[1];
+                p[2] = color_[2];
+            }
+        }
+    }
+
+    /*线宽向框内外各占一半，和 cv::rectangle 一样*/
+    void draw_rect(cv::Mat &frame, int x1, int y1, int x2, int y2) const
+    {
+        const int t = style_.box_thickness;
+        const int outer = t / 2, inner = t - outer;
+        fill(frame, x1 - outer, y1 - outer, x2 + inner, y1 + inner);
+        fill(frame, x1 - outer, y2 - outer, x2 + inner, y2 + inner);
+        fill(frame, x1 - outer, y1 + inner, x1 + inner, y2 - outer);
+        fill(frame, x2 - outer, y1 + inner, x2 + inner, y2 - outer);
+    }
+
+    /*按 alpha 把第 index 个字形混合到 frame 上，返回下一个字形的 x*/
+    int blit(cv::Mat &frame, int index, int x, int baseline_y) const
+    {
+        const auto &g = glyphs_[index];
+        const int top = baseline_y - ascent_;
+        const int col_begin = std::max(0, -x), col_end = std::min(g.width, frame.cols - x);
+        const int row_begin = std::max(0, -top), row_end = std::min(atlas_.rows, frame.rows - top);
+        for (int r = row_begin; r < row_end; r++) {
+            const uint8_t *alpha = atlas_.ptr<uint8_t>(r) + g.x;
+            uint8_t *p = frame.ptr<uint8_t>(top + r) + 3 * x;
+            for (int c = col_begin; c < col_end; c++) {
+                int a = alpha[c];
+                if (a == 0)
+                    continue;
+                for (int ch = 0; ch < 3; ch++) {
+                    int d = p[3 * c + ch];
+                    p[3 * c + ch] = static_cast<uint8_t>(d + ((color_[ch] - d) * a + 127) / 255);
+                }
+            }
+        }
+        return x + g.width;
+    }
+
+    int blit_char(cv::Mat &frame, char c, int x, int baseline_y) const
+    {
+        int index = static_cast<unsigned char>(c) < char_glyph_.size() ? char_glyph_[static_cast<unsigned char>(c)] : -1;
+        return index < 0 ? x : blit(frame, index, x, baseline_y);
+    }
+
+    int blit_number(cv::Mat &frame, int value, int x, int baseline_y) const
+    {
+        if (value < 0) {
+            x = blit_char(frame, '-', x, baseline_y);
+            value = -value;
+        }
+        char digits[12];
+        int n = 0;
+        do {
+            digits[n++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value > 0);
+        while (n > 0)
+            x = blit_char(frame, digits[--n], x, baseline_y);
+        return x;
+    }
+};
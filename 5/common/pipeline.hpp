@@ -0,0 +1,435 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "channel.hpp"
+#include "thread_placement.hpp"
+
+/*
+ * 流水线运行时：阶段之间用 bounded_channel 连接，每个阶段按配置开若干个线程
+ * - 源阶段 fn(T &out) 产生元素，返回 false 表示没有了；中间阶段 fn(In &, Out &) 返回 false 表示这个元素不往下传；
+ *   汇阶段 fn(In &) 只消费。fn 都在阶段自己的线程里调用，并行度大于 1 时会并发调用，且元素可能乱序
+ * - 一个阶段的全部线程退出后关闭它的输出通道，下游取完剩下的元素后跟着退出，所以源结束时整条流水线自然排空
+ * - drain() 让源不再产生新元素，已经在通道里的元素照常处理完；stop() 关闭全部通道、丢掉还没处理的元素，立即退出
+ *   drain_for() 先排空，超时后改成 stop()；request_stop() 只发出停止请求不等线程退出，阶段里出现致命错误时用它
+ * - fn 可以多接一个 std::stop_token 参数（放在最后）：源拿到的在 drain / stop 时都会触发，中间阶段和汇拿到的只在 stop 时触发
+ *   （drain 要把在途的元素做完）。会阻塞的 fn（等设备出帧等）用 std::stop_callback 把自己唤醒，停止时不会卡在 join 里
+ * - 每个阶段统计处理了多少个元素、fn 本身的耗时（平均、p99、最长）和等输入的时间，report() 和各通道的统计一起打印
+ * - place() 给阶段指定 CPU 亲和性和调度策略，阶段的每个线程启动时先设置好再进循环
+ * - 汇阶段可以带一个 on_idle，输入空了一段时间时在汇自己的线程里调用，用来推进只能在这个线程上做的事（重排超时等）
+ * 通道由 pipeline 持有，元素里引用的缓冲区池（frame_pool 等）要比 pipeline 活得久
+ * add_* 按阶段的并行度声明通道两端各有几个线程，block / drop_newest 通道只有一个线程的一端不加锁；
+ *   通道只能由阶段自己 push / pop，阶段外的代码要用就自己建通道
+ */
+class pipeline {
+public:
+    struct stage_stats {
+        std::string name;
+        unsigned parallelism;
+        std::size_t items;
+        std::chrono::nanoseconds busy; // fn 耗时之和（所有线程）
+        std::chrono::nanoseconds p99;  // 单次 fn 耗时的 p99，按直方图桶的上界估计，误差在 25% 以内
+        std::chrono::nanoseconds max;  // 单次 fn 最长耗时
+        std::chrono::nanoseconds idle; // 等上游元素、等下游腾位置的时间之和
+    };
+
+    explicit pipeline(std::string name)
+        : name_(std::move(name))
+    {
+    }
+    ~pipeline()
+    {
+        stop();
+    }
+    pipeline(const pipeline &) = delete;
+    pipeline &operator=(const pipeline &) = delete;
+
+    /*通道在 start() 之前创建，地址在 pipeline 的生命周期内不变*/
+    template <typename T, overflow_policy Policy = overflow_policy::block>
+    bounded_channel<T, Policy> &make_channel(std::string name, std::size_t capacity)
+    {
+        auto entry = std::make_unique<owned_channel<T, Policy> >(std::move(name), capacity);
+        auto &channel = entry->channel;
+        channels_.push_back(std::move(entry));
+        return channel;
+    }
+
+    template <typename T, overflow_policy Policy, typename F>
+    void add_source(std::string name, bounded_channel<T, Policy> &out, F fn, unsigned parallelism = 1)
+    {
+        auto &s = add_stage_state(std::move(name), parallelism, [&out] { out.close(); });
+        out.add_producers(s.parallelism);
+        s.body = [this, &s, &out, fn = std::move(fn)]() mutable {
+            T item{};
+            const auto token = stop_.get_token();
+            while (!token.stop_requested()) {
+                auto start = clock::now();
+                bool produced = call(fn, token, item);
+                s.record(clock::now() - start);
+                if (!produced)
+                    break;
+                auto push_start = clock::now();
+                bool pushed = out.push(item);
+                s.idle_ns.fetch_add(elapsed_ns(push_start), std::memory_order_relaxed);
+                if (!pushed)
+                    break;
+            }
+        };
+    }
+
+    template <typename In, overflow_policy InPolicy, typename Out, overflow_policy OutPolicy, typename F>
+    void add_stage(std::string name, bounded_channel<In, InPolicy> &in, bounded_channel<Out, OutPolicy> &out, F fn, unsigned parallelism = 1)
+    {
+        auto &s = add_stage_state(std::move(name), parallelism, [&out] { out.close(); });
+        in.add_consumers(s.parallelism);
+        out.add_producers(s.parallelism);
+        s.body = [this, &s, &in, &out, fn = std::move(fn)]() mutable {
+            In input{};
+            Out output{};
+            const auto token = abort_.get_token();
+            while (true) {
+                auto wait_start = clock::now();
+                bool got = !token.stop_requested() && in.pop(input);
+                s.idle_ns.fetch_add(elapsed_ns(wait_start), std::memory_order_relaxed);
+                if (!got || token.stop_requested())
+                    break;
+                auto start = clock::now();
+                bool emit = call(fn, token, input, output);
+                s.record(clock::now() - start);
+                if (!emit)
+                    continue;
+                auto push_start = clock::now();
+                bool pushed = out.push(output);
+                s.idle_ns.fetch_add(elapsed_ns(push_start), std::memory_order_relaxed);
+                if (!pushed)
+                    break;
+            }
+        };
+    }
+
+    template <typename In, overflow_policy InPolicy, typename F>
+    void add_sink(std::string name, bounded_channel<In, InPolicy> &in, F fn, unsigned parallelism = 1)
+    {
+        add_sink(std::move(name), in, std::move(fn), std::chrono::milliseconds::zero(), [] {}, parallelism);
+    }
+
+    /*汇阶段等输入超过 idle 还没有元素时，在阶段自己的线程里调用 on_idle()（检查重排超时等），之后接着等；idle 为 0 时不调用*/
+    template <typename In, overflow_policy InPolicy, typename F, typename G>
+    void add_sink(std::string name, bounded_channel<In, InPolicy> &in, F fn, std::chrono::milliseconds idle, G on_idle, unsigned parallelism = 1)
+    {
+        auto &s = add_stage_state(std::move(name), parallelism, [] {});
+        in.add_consumers(s.parallelism);
+        s.body = [this, &s, &in, fn = std::move(fn), idle, on_idle = std::move(on_idle)]() mutable {
+            In input{};
+            const auto token = abort_.get_token();
+            while (true) {
+                auto wait_start = clock::now();
+                bool got = !token.stop_requested() && pop_or_idle(in, input, idle, on_idle);
+                s.idle_ns.fetch_add(elapsed_ns(wait_start), std::memory_order_relaxed);
+                if (!got || token.stop_requested())
+                    break;
+                auto start = clock::now();
+                call(fn, token, input);
+                s.record(clock::now() - start);
+            }
+        };
+    }
+
+    /*在 start() 之前调用，同名阶段都生效*/
+    void place(std::string_view stage, const thread_placement &placement)
+    {
+        for (auto &s : stages_) {
+            if (s.name == stage)
+                s.placement = placement;
+        }
+    }
+
+    void start()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (started_)
+            return;
+        started_ = true;
+        start_time_ = clock::now();
+        for (auto &s : stages_)
+            running_.fetch_add(s.parallelism, std::memory_order_relaxed);
+        for (auto &s : stages_) {
+            for (unsigned i = 0; i < s.parallelism; i++) {
+                s.threads.emplace_back([this, &s] {
+                    apply_thread_placement(s.name, s.placement);
+                    s.body();
+                    // 最后一个退出的线程关闭输出通道，下游排空后跟着退出
+                    if (s.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                        s.on_finish();
+                    if (running_.fetch_sub(1, std::memory_order_release) == 1) {
+                        std::lock_guard<std::mutex> done(done_mutex_);
+                        done_cv_.notify_all();
+                    }
+                });
+            }
+        }
+    }
+
+    /*还有阶段线程没退出*/
+    bool running() const
+    {
+        return running_.load(std::memory_order_acquire) > 0;
+    }
+
+    /*不等线程退出，阶段内部也可以调用；登记在停止令牌上的 stop_callback 在调用线程里执行*/
+    void request_stop(bool discard = true)
+    {
+        stop_.request_stop();
+        if (discard) {
+            abort_.request_stop();
+            for (auto &channel : channels_)
+                channel->close();
+        }
+    }
+
+    /*源阶段拿到的停止令牌，阶段外的代码（显示循环等）也可以用它登记 stop_callback 或者查询*/
+    std::stop_token stop_token() const
+    {
+        return stop_.get_token();
+    }
+
+    /*源不再产生新元素，等已经在流水线里的元素处理完*/
+    void drain()
+    {
+        request_stop(false);
+        join();
+    }
+
+    /*先按 drain() 排空，timeout 内没排空就改成 stop()；返回 true 表示在途的元素全部处理完了*/
+    bool drain_for(std::chrono::milliseconds timeout)
+    {
+        request_stop(false);
+        bool drained;
+        {
+            std::unique_lock<std::mutex> lock(done_mutex_);
+            drained = done_cv_.wait_for(lock, timeout, [this] { return !running(); });
+        }
+        if (!drained)
+            request_stop(true);
+        join();
+        return drained;
+    }
+
+    /*丢掉还没处理的元素，等所有阶段线程退出*/
+    void stop()
+    {
+        request_stop(true);
+        join();
+    }
+
+    /*源自然结束时等整条流水线排空*/
+    void wait()
+    {
+        join();
+    }
+
+    std::vector<stage_stats> statistics() const
+    {
+        std::vector<stage_stats> result;
+        for (auto &s : stages_) {
+            result.push_back({ s.name, s.parallelism, s.items.load(std::memory_order_relaxed), std::chrono::nanoseconds(s.busy_ns.load(std::memory_order_relaxed)),
+                               s.percentile(0.99), std::chrono::nanoseconds(s.max_ns.load(std::memory_order_relaxed)),
+                               std::chrono::nanoseconds(s.idle_ns.load(std::memory_order_relaxed)) });
+        }
+        return result;
+    }
+
+    void report() const
+    {
+        auto wall = std::chrono::duration<double, std::milli>(clock::now() - start_time_).count();
+        std::cout << "流水线 " << name_ << ":" << std::endl;
+        for (auto &s : statistics()) {
+            auto busy = std::chrono::duration<double, std::milli>(s.busy).count();
+            std::cout << "  阶段 " << s.name << " x" << s.parallelism << ": 处理" << s.items << "个";
+            if (s.items > 0)
+                std::cout << "，平均" << busy / s.items << "ms，p99 " << std::chrono::duration<double, std::milli>(s.p99).count() << "ms，最长"
+                          << std::chrono::duration<double, std::milli>(s.max).count() << "ms";
+            // 占用率：fn 耗时占全部线程运行时间的比例，接近 100% 的阶段就是瓶颈
+            if (wall > 0)
+                std::cout << "，占用" << static_cast<int>(100 * busy / (wall * s.parallelism)) << "%";
+            std::cout << std::endl;
+        }
+        for (auto &channel : channels_) {
+            std::cout << "  ";
+            channel->report();
+        }
+    }
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct channel_entry {
+        virtual ~channel_entry() = default;
+        virtual void close() = 0;
+        virtual void report() const = 0;
+    };
+    template <typename T, overflow_policy Policy>
+    struct owned_channel : channel_entry {
+        bounded_channel<T, Policy> channel;
+
+        owned_channel(std::string name, std::size_t capacity)
+            : channel(std::move(name), capacity)
+        {
+        }
+        void close() override
+        {
+            channel.close();
+        }
+        void report() const override
+        {
+            channel.report();
+        }
+    };
+
+    /*关闭并且取空后返回 false；idle 不为 0 时每等 idle 没有元素就调用一次 on_idle*/
+    template <typename In, overflow_policy InPolicy, typename G>
+    static bool pop_or_idle(bounded_channel<In, InPolicy> &in, In &input, std::chrono::milliseconds idle, G &on_idle)
+    {
+        if (idle <= std::chrono::milliseconds::zero())
+            return in.pop(input);
+        while (!in.pop_for(input, idle)) {
+            // 超时和关闭都返回 false：关闭前刚放进来的元素还要取
+            if (in.closed())
+                return in.try_pop(input);
+            on_idle();
+        }
+        return true;
+    }
+
+    /*
+     * fn 耗时的对数直方图：按 2 的幂分段，每段再等分 4 个桶，桶宽不超过下界的 25%
+     * 只用原子计数，记录时不加锁；2^40ns（约 18 分钟）以上都算进最后一个桶
+     */
+    static constexpr unsigned HISTOGRAM_BUCKETS = 41 * 4;
+
+    static unsigned bucket_of(int64_t ns)
+    {
+        if (ns < 4)
+            return static_cast<unsigned>(std::max<int64_t>(ns, 0));
+        const unsigned exponent = std::bit_width(static_cast<uint64_t>(ns)) - 1;
+        const unsigned sub = static_cast<unsigned>(ns >> (exponent - 2)) & 3;
+        return std::min(exponent * 4 + sub, HISTOGRAM_BUCKETS - 1);
+    }
+    static int64_t bucket_upper(unsigned bucket)
+    {
+        if (bucket < 8)
+            return bucket + 1;
+        const unsigned exponent = bucket / 4;
+        const unsigned sub = bucket % 4;
+        return static_cast<int64_t>(4 + sub + 1) << (exponent - 2);
+    }
+
+    struct stage_state {
+        std::string name;
+        unsigned parallelism;
+        thread_placement placement;
+        std::function<void()> body;
+        std::function<void()> on_finish;
+        std::vector<std::thread> threads;
+        std::atomic<unsigned> remaining{ 0 };
+        std::atomic<std::size_t> items{ 0 };
+        std::atomic<int64_t> busy_ns{ 0 };
+        std::atomic<int64_t> max_ns{ 0 };
+        std::atomic<int64_t> idle_ns{ 0 };
+        std::array<std::atomic<uint32_t>, HISTOGRAM_BUCKETS> histogram{};
+
+        void record(clock::duration elapsed)
+        {
+            const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+            items.fetch_add(1, std::memory_order_relaxed);
+            histogram[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+            busy_ns.fetch_add(ns, std::memory_order_relaxed);
+            int64_t max = max_ns.load(std::memory_order_relaxed);
+            while (ns > max && !max_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+            }
+        }
+
+        std::chrono::nanoseconds percentile(double p) const
+        {
+            uint64_t total = 0;
+            for (auto &count : histogram)
+                total += count.load(std::memory_order_relaxed);
+            if (total == 0)
+                return {};
+            const auto rank = static_cast<uint64_t>(p * static_cast<double>(total - 1)) + 1;
+            uint64_t seen = 0;
+            for (unsigned bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+                seen += histogram[bucket].load(std::memory_order_relaxed);
+                if (seen >= rank)
+                    return std::min(std::chrono::nanoseconds(bucket_upper(bucket)), std::chrono::nanoseconds(max_ns.load(std::memory_order_relaxed)));
+            }
+            return std::chrono::nanoseconds(max_ns.load(std::memory_order_relaxed));
+        }
+    };
+
+    const std::string name_;
+    std::vector<std::unique_ptr<channel_entry> > channels_;
+    std::deque<stage_state> stages_; // deque：添加阶段时已有阶段的地址不变
+    std::mutex mutex_;
+    bool started_ = false;
+    clock::time_point start_time_ = clock::now();
+    std::stop_source stop_;  // 源停止产生元素（drain 和 stop）
+    std::stop_source abort_; // 丢掉在途的元素（只有 stop）
+    std::atomic<unsigned> running_{ 0 };
+    std::mutex done_mutex_;
+    std::condition_variable done_cv_;
+
+    /*fn 最后一个参数接 std::stop_token 时把令牌传进去*/
+    template <typename F, typename... Args>
+    static decltype(auto) call(F &fn, const std::stop_token &token, Args &...args)
+    {
+        if constexpr (std::is_invocable_v<F &, Args &..., std::stop_token>)
+            return fn(args..., token);
+        else
+            return fn(args...);
+    }
+
+    static int64_t elapsed_ns(clock::time_point since)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - since).count();
+    }
+
+    stage_state &add_stage_state(std::string name, unsigned parallelism, std::function<void()> on_finish)
+    {
+        auto &s = stages_.emplace_back();
+        s.name = std::move(name);
+        s.parallelism = std::max(parallelism, 1u);
+        s.remaining.store(s.parallelism, std::memory_order_relaxed);
+        s.on_finish = std::move(on_finish);
+        return s;
+    }
+
+    void join()
+    {
+        for (auto &s : stages_) {
+            for (auto &thread : s.threads) {
+                if (thread.joinable())
+                    thread.join();
+            }
+        }
+    }
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "opencv2/opencv.hpp"
+
+#include "stage_metrics.hpp"
+
+/*
+ * 把 frame 直接缩放进 dst（NHWC，CV_8UC3，size.area() * 3 字节），中间不产生新的 Mat
+ * dst 通常是 buffer_pool 借出的 vstream 输入缓冲区；cv::resize 对尺寸和类型一致的目标 Mat 不会重新分配
+ * 返回写入的字节数，0 表示尺寸不匹配
+ */
+inline std::size_t resize_into(const cv::Mat &frame, uint8_t *dst, std::size_t dst_size, cv::Size size, stage_metrics &metrics)
+{
+    auto bytes = static_cast<std::size_t>(size.area()) * 3;
+    if (frame.type() != CV_8UC3 || bytes != dst_size)
+        return 0;
+
+    cv::Mat target(size, CV_8UC3, dst);
+    if (frame.size() == size) {
+        frame.copyTo(target);
+        metrics.add_copy(bytes);
+    } else {
+        cv::resize(frame, target, size);
+        metrics.add_write(bytes);
+    }
+    return bytes;
+}
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct reorder_stats {
+    std::size_t released = 0;       // 按序号交给下游的元素
+    std::size_t reordered = 0;      // 到的时候前面还缺序号、先在缓冲区里等过的元素
+    std::size_t skipped = 0;        // 上游确定不会来、当场跳过的序号
+    std::size_t skipped_late = 0;   // 等满 max_wait 还没来、被跳过的序号
+    std::size_t skipped_window = 0; // 窗口放不下更新的元素、被迫跳过的序号
+    std::size_t skipped_drain = 0;  // 上游结束时 drain 还缺着、不再等的序号
+    std::size_t late = 0;           // 序号已经跳过之后才到、被丢掉的元素
+    std::size_t max_depth = 0;      // 缓冲区里同时等着的最多元素个数
+};
+
+/*
+ * 按序号重排：并行阶段（多个解码线程、NPU 和 CPU 两个推理后端）完成顺序不固定，这里按序号从小到大交给下游
+ * - 窗口是 window 个槽位的环，序号对窗口取模定位，稳态下不分配内存；push 和槽位交换元素，
+ *   返回后 item 里是槽位原来的内容（空壳），vector 等的容量和 bounded_channel 一样在两端之间循环使用
+ * - 队头缺的序号从后面有元素等着时开始计时，等满 max_wait 还没来就跳过；更新的元素超出窗口时马上跳过最旧的缺口
+ * - 上游确定不会来的序号（通道丢掉的、解码失败的）用 skip() 告诉它，不用等超时
+ * - 被跳过的序号之后才到的元素算迟到，push 返回 false，元素留在 item 里由调用方处理
+ * emit 和 on_skip 在持锁时按序号顺序调用（调用 push / skip / poll / drain 的线程上），所以要快，不能再调用同一个重排缓冲区
+ * 下游要求 emit 只在一个线程上调用时，其它线程用 defer_skip() 只登记跳过，在那个线程下一次 push / poll 时生效
+ * 超时只在 push / skip / poll 时检查，上游完全停下时由调用方 poll 或者 drain
+ */
+template <typename T>
+class reorder_buffer {
+public:
+    using clock = std::chrono::steady_clock;
+    using emit_fn = std::function<void(T &)>;
+    using skip_fn = std::function<void(uint64_t)>;
+
+    reorder_buffer(std::string name, std::size_t window, std::chrono::milliseconds max_wait, emit_fn emit, skip_fn on_skip = {}, uint64_t first_sequence = 0)
+        : name_(std::move(name)), max_wait_(max_wait), emit_(std::move(emit)), on_skip_(std::move(on_skip)),
+          slots_(std::max<std::size_t>(window, 1)), state_(slots_.size(), slot_state::empty), next_(first_sequence)
+    {
+        deferred_.reserve(slots_.size());
+        applying_.reserve(slots_.size());
+    }
+    reorder_buffer(const reorder_buffer &) = delete;
+    reorder_buffer &operator=(const reorder_buffer &) = delete;
+
+    std::size_t window() const
+    {
+        return slots_.size();
+    }
+
+    /*返回 false 表示序号已经输出或跳过过（迟到或重复），item 原样留给调用方*/
+    bool push(uint64_t sequence, T &item)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        apply_deferred();
+        if (sequence < next_ || (sequence < next_ + slots_.size() && state_[index(sequence)] != slot_state::empty)) {
+            stats_.late++;
+            return false;
+        }
+        make_room(sequence);
+        using std::swap;
+        swap(slots_[index(sequence)], item);
+        state_[index(sequence)] = slot_state::present;
+        depth_++;
+        stats_.max_depth = std::max(stats_.max_depth, depth_);
+        if (sequence != next_)
+            stats_.reordered++;
+        release(clock::now());
+        return true;
+    }
+
+    /*序号 sequence 不会来了：在队头时马上跳过，后面的元素不用等它*/
+    void skip(uint64_t sequence)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        apply_deferred();
+        mark_skipped(sequence);
+        release(clock::now());
+    }
+
+    /*和 skip 一样，但这里只登记，不输出也不跳过任何序号；任何线程都可以调用，下一次 push / skip / poll / drain 时生效*/
+    void defer_skip(uint64_t sequence)
+    {
+        std::lock_guard<std::mutex> lock(deferred_mutex_);
+        deferred_.push_back(sequence);
+    }
+
+    /*只检查超时：上游暂时没有新元素时，让等满 max_wait 的缺口跳过去*/
+    void poll()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        apply_deferred();
+        release(clock::now());
+    }
+
+    /*上游结束：不再等缺口，按序号把剩下的元素全部输出*/
+    void drain()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        apply_deferred();
+        while (depth_ > 0)
+            advance(stats_.skipped_drain);
+        blocked_ = false;
+    }
+
+    reorder_stats statistics() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+    void report() const
+    {
+        auto stats = statistics();
+        std::cout << "重排 " << name_ << ": 按序输出" << stats.released << "个，其中乱序到达" << stats.reordered << "个，最多积压" << stats.max_depth << "/"
+                  << slots_.size() << "；上游跳过" << stats.skipped << "个，超时跳过" << stats.skipped_late << "个，窗口满跳过" << stats.skipped_window
+                  << "个，收尾跳过" << stats.skipped_drain << "个，迟到丢弃" << stats.late << "个" << std::endl;
+    }
+
+private:
+    enum class slot_state : uint8_t {
+        empty,
+        present,
+        skipped,
+    };
+
+    std::string name_;
+    std::chrono::milliseconds max_wait_;
+    emit_fn emit_;
+    skip_fn on_skip_;
+
+    mutable std::mutex mutex_;
+    std::vector<T> slots_;
+    std::vector<slot_state> state_;
+    uint64_t next_;          // 下一个该输出的序号
+    std::size_t depth_ = 0;  // 缓冲区里等着的元素个数
+    bool blocked_ = false;   // 队头缺序号、后面有元素在等
+    clock::time_point blocked_since_{};
+    reorder_stats stats_;
+    // defer_skip 登记的序号，只在持有 mutex_ 时换出来处理；两个 vector 来回交换，容量循环使用
+    std::mutex deferred_mutex_;
+    std::vector<uint64_t> deferred_;
+    std::vector<uint64_t> applying_;
+
+    std::size_t index(uint64_t sequence) const
+    {
+        return static_cast<std::size_t>(sequence % slots_.size());
+    }
+
+    /*输出或跳过队头的一个序号；count 是队头缺元素时记到哪个跳过计数上*/
+    void advance(std::size_t &count)
+    {
+        auto &state = state_[index(next_)];
+        if (state == slot_state::present) {
+            emit_(slots_[index(next_)]);
+            depth_--;
+            stats_.released++;
+        } else if (state == slot_state::skipped) {
+            stats_.skipped++;
+            if (on_skip_)
+                on_skip_(next_);
+        } else {
+            count++;
+            if (on_skip_)
+                on_skip_(next_);
+        }
+        state = slot_state::empty;
+        next_++;
+    }
+
+    /*已经输出、跳过或者已经到了的序号不用管*/
+    void mark_skipped(uint64_t sequence)
+    {
+        if (sequence < next_ || (sequence < next_ + slots_.size() && state_[index(sequence)] != slot_state::empty))
+            return;
+        make_room(sequence);
+        state_[index(sequence)] = slot_state::skipped;
+    }
+
+    /*持有 mutex_ 时调用：把 defer_skip 登记的序号标成跳过，由调用方接着 release*/
+    void apply_deferred()
+    {
+        {
+            std::lock_guard<std::mutex> lock(deferred_mutex_);
+            if (deferred_.empty())
+                return;
+            deferred_.swap(applying_);
+        }
+        for (auto sequence : applying_)
+            mark_skipped(sequence);
+        applying_.clear();
+    }
+
+    /*sequence 要落在窗口里：窗口放不下时从队头开始输出已有的元素、跳过缺口*/
+    void make_room(uint64_t sequence)
+    {
+        while (sequence >= next_ + slots_.size())
+            advance(stats_.skipped_window);
+    }
+
+    void release(clock::time_point now)
+    {
+        while (true) {
+            while (state_[index(next_)] != slot_state::empty)
+                advance(stats_.skipped);
+            if (depth_ == 0) {
+                blocked_ = false;
+                return;
+            }
+            // 队头缺序号，后面还有元素在等：从第一次发现开始计时，超时就跳过到下一个在等的元素为止，接着输出
+            if (!blocked_) {
+                blocked_ = true;
+                blocked_since_ = now;
+                return;
+            }
+            if (now - blocked_since_ < max_wait_)
+                return;
+            do
+                advance(stats_.skipped_late);
+            while (state_[index(next_)] == slot_state::empty);
+            blocked_ = false;
+        }
+    }
+};
@@ -0,0 +1,368 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <span>
+#include <string>
+#include <string_view>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "opencv2/opencv.hpp"
+
+#include "detection_stream.hpp"
+
+/*
+ * 跨进程的单生产者多消费者环形缓冲区，放在 shm_open（有名字）或 memfd（传 fd）的共享内存里：
+ * 每个槽位 = 槽位头 + 一条 detection_record（格式见 detection_stream.hpp）+ 一帧像素
+ * 生产者按发布顺序编号 0,1,2...，第 n 帧写进 n % slot_count 号槽位，从不等消费者；
+ * 消费者只读映射，自己记读到哪一帧，落后超过一圈就跳到还没被覆盖的最老一帧
+ * 槽位用 seqlock：写之前 seq = 2n+1，写完 seq = 2n+2；消费者直接在共享内存上读（不复制），用完再 validate 确认期间没被覆盖
+ * 发布后 futex 计数加一并唤醒，消费者没有新帧时在 futex 上睡，不轮询
+ */
+inline constexpr uint32_t SHM_RING_MAGIC = 0x474e5248; // "HRNG"
+inline constexpr uint16_t SHM_RING_VERSION = 1;
+
+struct shm_ring_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t slot_count;
+    uint32_t slot_header_size;
+    uint64_t slot_size;       // 每个槽位占的字节数，页对齐
+    uint64_t record_offset;   // 槽位内 detection_record 的偏移
+    uint64_t record_capacity;
+    uint64_t frame_offset;    // 槽位内像素的偏移，页对齐
+    uint64_t frame_capacity;
+    alignas(64) std::atomic<uint64_t> published; // 已发布的帧数
+    alignas(64) std::atomic<uint32_t> futex;     // 每发布一帧加一，消费者在上面等
+};
+
+struct shm_slot_header {
+    std::atomic<uint64_t> seq; // 0 = 从没写过，2n+1 = 正在写第 n 帧，2n+2 = 第 n 帧写完
+    uint32_t record_size;
+    int32_t frame_rows; // 0 表示这一帧只有检测结果
+    int32_t frame_cols;
+    int32_t frame_type;
+    uint64_t frame_step;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+              "shared-memory ring needs address-free atomics");
+
+namespace shm_ring_detail {
+inline constexpr std::size_t PAGE = 4096;
+inline constexpr std::size_t HEADER_SIZE = (sizeof(shm_ring_header) + PAGE - 1) / PAGE * PAGE;
+
+inline constexpr std::size_t round_up(std::size_t value, std::size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+inline void futex_wake(std::atomic<uint32_t> *word)
+{
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+/*word 还等于 expected 时睡，最多 timeout；共享映射上不能用 FUTEX_PRIVATE_FLAG*/
+inline void futex_wait(const std::atomic<uint32_t> *word, uint32_t expected, std::chrono::nanoseconds timeout)
+{
+    timespec ts{ static_cast<time_t>(timeout.count() / 1000000000), static_cast<long>(timeout.count() % 1000000000) };
+    ::syscall(SYS_futex, reinterpret_cast<const uint32_t *>(word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+}
+
+inline uint8_t *map(int fd, std::size_t size, int prot)
+{
+    void *p = ::mmap(nullptr, size, prot, MAP_SHARED, fd, 0);
+    return p == MAP_FAILED ? nullptr : static_cast<uint8_t *>(p);
+}
+} // namespace shm_ring_detail
+
+/*
+ * 生产者：name 以 '/' 开头时用 shm_open 创建（同名的旧环会被替换），为空时用 memfd，fd() 交给子进程或经 SCM_RIGHTS 传出去
+ * frame_capacity 是一帧像素的最大字节数，更大的帧只发布检测结果
+ */
+class shm_ring_writer {
+public:
+    shm_ring_writer(std::string_view name, uint32_t slot_count, std::size_t frame_capacity)
+        : name_(name)
+    {
+        using namespace shm_ring_detail;
+        const std::size_t record_offset = round_up(sizeof(shm_slot_header), 64);
+        const std::size_t record_capacity = detection_record_size(DETECTION_RECORD_MAX_BOXES);
+        const std::size_t frame_offset = round_up(record_offset + record_capacity, PAGE);
+        const std::size_t slot_size = frame_offset + round_up(frame_capacity, PAGE);
+        size_ = HEADER_SIZE + slot_size * slot_count;
+
+        if (name_.empty()) {
+            fd_ = ::memfd_create("hailo_shm_ring", MFD_CLOEXEC);
+        } else {
+            ::shm_unlink(name_.c_str());
+            fd_ = ::shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+        }
+        if (fd_ < 0 || ::ftruncate(fd_, static_cast<off_t>(size_)) != 0 || (base_ = map(fd_, size_, PROT_READ | PROT_WRITE)) == nullptr) {
+            std::cerr << "共享内存环 " << name_ << " 创建失败: " << std::strerror(errno) << std::endl;
+            return;
+        }
+
+        header_ = new (base_) shm_ring_header{};
+        header_->slot_count = slot_count;
+        header_->slot_header_size = sizeof(shm_slot_header);
+        header_->slot_size = slot_size;
+        header_->record_offset = record_offset;
+        header_->record_capacity = record_capacity;
+        header_->frame_offset = frame_offset;
+        header_->frame_capacity = frame_capacity;
+        for (uint32_t i = 0; i < slot_count; i++)
+            new (slot(i)) shm_slot_header{};
+        // magic 最后写，消费者看到 magic 时布局已经完整
+        header_->version = SHM_RING_VERSION;
+        std::atomic_thread_fence(std::memory_order_release);
+        header_->magic = SHM_RING_MAGIC;
+    }
+    ~shm_ring_writer()
+    {
+        if (base_ != nullptr)
+            ::munmap(base_, size_);
+        if (fd_ >= 0)
+            ::close(fd_);
+        if (!name_.empty())
+            ::shm_unlink(name_.c_str());
+    }
+    shm_ring_writer(const shm_ring_writer &) = delete;
+    shm_ring_writer &operator=(const shm_ring_writer &) = delete;
+
+    bool valid() const
+    {
+        return header_ != nullptr;
+    }
+    int fd() const
+    {
+        return fd_;
+    }
+    uint64_t published() const
+    {
+        return header_->published.load(std::memory_order_relaxed);
+    }
+
+    /*
+     * 两步发布，像素可以直接写进共享内存：begin 返回包住下一个槽位像素区的 cv::Mat（放不下时是空 Mat），
+     * 写好后 commit；begin 之后这个槽位对消费者就失效了
+     */
+    cv::Mat begin(int rows, int cols, int type)
+    {
+        auto *s = slot(next_ % header_->slot_count);
+        s->seq.store(2 * next_ + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        const std::size_t step = static_cast<std::size_t>(cols) * CV_ELEM_SIZE(type);
+        if (rows <= 0 || cols <= 0 || step * rows > header_->frame_capacity) {
+            s->frame_rows = s->frame_cols = 0;
+            s->frame_type = type;
+            s->frame_step = 0;
+            return {};
+        }
+        s->frame_rows = rows;
+        s->frame_cols = cols;
+        s->frame_type = type;
+        s->frame_step = step;
+        return cv::Mat(rows, cols, type, reinterpret_cast<uint8_t *>(s) + header_->frame_offset, step);
+    }
+
+    void commit(uint32_t camera_id, uint64_t sequence, std::chrono::system_clock::time_point captured, std::span<const nms_detection> dets)
+    {
+        auto *s = slot(next_ % header_->slot_count);
+        s->record_size = static_cast<uint32_t>(
+            encode_detection_record(camera_id, sequence, captured, dets, reinterpret_cast<std::byte *>(s) + header_->record_offset));
+        s->seq.store(2 * next_ + 2, std::memory_order_release);
+        header_->published.store(++next_, std::memory_order_release);
+        header_->futex.fetch_add(1, std::memory_order_release);
+        shm_ring_detail::futex_wake(&header_->futex);
+    }
+
+    /*帧复制进共享内存一次（frame 为空时只发布检测结果），之后所有消费者都直接读这一份*/
+    void publish(uint32_t camera_id, uint64_t sequence, std::chrono::system_clock::time_point captured, std::span<const nms_detection> dets,
+                 const cv::Mat &frame)
+    {
+        auto pixels = begin(frame.rows, frame.cols, frame.type());
+        if (!pixels.empty())
+            frame.copyTo(pixels);
+        commit(camera_id, sequence, captured, dets);
+    }
+
+private:
+    std::string name_;
+    int fd_ = -1;
+    std::size_t size_ = 0;
+    uint8_t *base_ = nullptr;
+    shm_ring_header *header_ = nullptr;
+    uint64_t next_ = 0;
+
+    shm_slot_header *slot(uint64_t index)
+    {
+        return reinterpret_cast<shm_slot_header *>(base_ + shm_ring_detail::HEADER_SIZE + index * header_->slot_size);
+    }
+};
+
+/*
+ * 消费者：只读映射，不写共享内存里的任何东西，所以慢消费者不会影响生产者和其它消费者
+ * 典型用法：
+ *   uint64_t next = reader.published();
+ *   shm_ring_reader::view v;
+ *   while (reader.acquire(next, v, 100ms)) { 处理 v; if (!reader.validate(v)) 丢弃结果; next = v.index + 1; }
+ */
+class shm_ring_reader {
+public:
+    struct view {
+        uint64_t index = 0;                // 发布编号
+        std::span<const std::byte> record; // 一条 detection_record，用 decode_detection_record 解析
+        cv::Mat frame;                     // 直接指向共享内存，只读；没有像素时为空
+    };
+    struct stats {
+        std::size_t read = 0;
+        std::size_t lost = 0; // 落后超过一圈被覆盖、跳过的帧
+        std::size_t torn = 0; // 读的过程中被覆盖的帧
+    };
+
+    explicit shm_ring_reader(std::string_view name)
+    {
+        std::string path(name);
+        int fd = ::shm_open(path.c_str(), O_RDONLY | O_CLOEXEC, 0);
+        if (fd < 0) {
+            std::cerr << "共享内存环 " << path << " 打开失败: " << std::strerror(errno) << std::endl;
+            return;
+        }
+        attach(fd);
+        ::close(fd);
+    }
+    /*fd 由调用方关闭，映射建立后就可以关*/
+    explicit shm_ring_reader(int fd)
+    {
+        attach(fd);
+    }
+    ~shm_ring_reader()
+    {
+        if (base_ != nullptr)
+            ::munmap(const_cast<uint8_t *>(base_), size_);
+    }
+    shm_ring_reader(const shm_ring_reader &) = delete;
+    shm_ring_reader &operator=(const shm_ring_reader &) = delete;
+
+    bool valid() const
+    {
+        return header_ != nullptr;
+    }
+    uint64_t published() const
+    {
+        return header_->published.load(std::memory_order_acquire);
+    }
+
+    /*
+     * 取第 index 帧（还没发布就最多等 timeout）；已经被覆盖时跳到仍然有效的最老一帧，out.index 是实际取到的编号
+     * 超时返回 false
+     */
+    bool acquire(uint64_t index, view &out, std::chrono::nanoseconds timeout)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        for (;;) {
+            uint32_t futex = header_->futex.load(std::memory_order_acquire);
+            uint64_t published = header_->published.load(std::memory_order_acquire);
+            if (index >= published) {
+                auto now = std::chrono::steady_clock::now();
+                if (now >= deadline)
+                    return false;
+                shm_ring_detail::futex_wait(&header_->futex, futex, deadline - now);
+                continue;
+            }
+            if (published - index > header_->slot_count) {
+                stats_.lost += published - header_->slot_count - index;
+                index = published - header_->slot_count;
+            }
+
+            const auto *s = slot(index % header_->slot_count);
+            uint64_t seq = s->seq.load(std::memory_order_acquire);
+            if (seq != 2 * index + 2) {
+                // 生产者已经开始写后面那一圈，这一帧没了
+                stats_.lost++;
+                index++;
+                continue;
+            }
+            const auto *slot_bytes = reinterpret_cast<const uint8_t *>(s);
+            out.index = index;
+            out.record = { reinterpret_cast<const std::byte *>(slot_bytes + header_->record_offset),
+                           std::min<std::size_t>(s->record_size, header_->record_capacity) };
+            if (s->frame_rows > 0 && s->frame_step * s->frame_rows <= header_->frame_capacity)
+                out.frame = cv::Mat(s->frame_rows, s->frame_cols, s->frame_type, const_cast<uint8_t *>(slot_bytes + header_->frame_offset),
+                                    s->frame_step);
+            else
+                out.frame = cv::Mat();
+            // 读槽位头的时候生产者可能已经开始重写，重新检查一遍
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (s->seq.load(std::memory_order_relaxed) != seq)
+                continue;
+            stats_.read++;
+            return true;
+        }
+    }
+
+    /*用完 view（或把需要的数据复制出来）之后调用；返回 false 表示期间槽位被生产者重写，读到的内容不可信*/
+    bool validate(const view &v)
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot(v.index % header_->slot_count)->seq.load(std::memory_order_relaxed) == 2 * v.index + 2)
+            return true;
+        stats_.torn++;
+        return false;
+    }
+
+    const stats &statistics() const
+    {
+        return stats_;
+    }
+
+private:
+    const uint8_t *base_ = nullptr;
+    std::size_t size_ = 0;
+    const shm_ring_header *header_ = nullptr;
+    stats stats_{};
+
+    void attach(int fd)
+    {
+        using namespace shm_ring_detail;
+        struct stat st {};
+        if (fd < 0 || ::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < HEADER_SIZE) {
+            std::cerr << "共享内存环无效" << std::endl;
+            return;
+        }
+        size_ = static_cast<std::size_t>(st.st_size);
+        base_ = map(fd, size_, PROT_READ);
+        if (base_ == nullptr) {
+            std::cerr << "共享内存环映射失败: " << std::strerror(errno) << std::endl;
+            return;
+        }
+        const auto *header = reinterpret_cast<const shm_ring_header *>(base_);
+        if (header->magic != SHM_RING_MAGIC || header->version != SHM_RING_VERSION || header->slot_count == 0 ||
+            HEADER_SIZE + header->slot_size * header->slot_count > size_) {
+            std::cerr << "共享内存环格式不对" << std::endl;
+            return;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        header_ = header;
+    }
+
+    const shm_slot_header *slot(uint64_t index) const
+    {
+        return reinterpret_cast<const shm_slot_header *>(base_ + shm_ring_detail::HEADER_SIZE + index * header_->slot_size);
+    }
+};
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace spsc_ring_detail {
+inline void futex_wake(std::atomic<uint32_t> &word, int count)
+{
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+/*word 还等于 expected 时睡；timeout 为空时一直等*/
+inline void futex_wait(std::atomic<uint32_t> &word, uint32_t expected, const std::chrono::nanoseconds *timeout)
+{
+    timespec ts{};
+    if (timeout != nullptr)
+        ts = { static_cast<time_t>(timeout->count() / 1000000000), static_cast<long>(timeout->count() % 1000000000) };
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT_PRIVATE, expected, timeout != nullptr ? &ts : nullptr, nullptr, 0);
+}
+} // namespace spsc_ring_detail
+
+/*
+ * 单生产者单消费者的有界无锁环形队列，bounded_channel 的 block / drop_newest 策略建在它上面
+ * - 槽位数就是容量，不取整：槽位里留着的空壳也可能引用缓冲区池，池的大小按容量算；容量是 2 的幂时下标用 & 取模
+ * - 槽位在构造时一次分配并构造好；tail_ / head_ 只增不减，相减就是元素个数
+ * - push / pop 都是和槽位交换元素（和 bounded_channel 一样）：push 返回后 item 里是消费者换进槽位的空壳，
+ *   pop 把调用方原来的 item 留在槽位里，vector 等的容量在两端之间循环使用
+ * - 生产者只写 tail_、消费者只写 head_，两者和各自缓存的对方下标分别占一条缓存行，互不干扰
+ * - 空了或满了先自旋一小会，再在 futex 上睡（pop_for 要带超时，std::atomic::wait 做不到）；
+ *   对方只在有人睡着时才唤醒，平时 push / pop 不进内核
+ * - close() 之后 push 失败，pop 取完剩下的元素后失败，两边睡着的线程都会被叫醒
+ * 同一时间只能有一个线程 push、一个线程 pop；多个线程共用一端时由调用方在这一端加锁
+ */
+template <typename T>
+class spsc_ring {
+    static_assert(std::is_default_constructible_v<T> && std::is_swappable_v<T>, "spsc_ring elements must be default constructible and swappable");
+
+public:
+    explicit spsc_ring(std::size_t capacity)
+        : capacity_(std::max<std::size_t>(capacity, 1)), power_of_two_(std::has_single_bit(capacity_)), slots_(std::make_unique<T[]>(capacity_))
+    {
+    }
+    spsc_ring(const spsc_ring &) = delete;
+    spsc_ring &operator=(const spsc_ring &) = delete;
+
+    std::size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    /*近似值，只用于打印和统计*/
+    std::size_t size() const
+    {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+    /*生产者：满了返回 false，item 不动*/
+    bool try_push(T &item)
+    {
+        const std::size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cached_head_ == capacity_) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail - cached_head_ == capacity_)
+                return false;
+        }
+        using std::swap;
+        swap(slot(tail), item);
+        tail_.store(tail + 1, std::memory_order_release);
+        wake(consumer_waiting_, not_empty_);
+        return true;
+    }
+
+    /*生产者：满了就等；关闭后返回 false*/
+    bool push(T &item)
+    {
+        for (int spin = 0;; spin++) {
+            if (closed_.load(std::memory_order_acquire))
+                return false;
+            if (try_push(item))
+                return true;
+            if (spin < SPIN_LIMIT)
+                continue;
+            sleep(producer_waiting_, not_full_, nullptr, [this] { return tail_.load(std::memory_order_relaxed) - head_.load(std::memory_order_seq_cst) < capacity_; });
+        }
+    }
+
+    /*消费者：空了返回 false*/
+    bool try_pop(T &item)
+    {
+        const std::size_t head = head_.load(std::memory_order_relaxed);
+        if (head == cached_tail_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_)
+                return false;
+        }
+        using std::swap;
+        swap(slot(head), item);
+        head_.store(head + 1, std::memory_order_release);
+        wake(producer_waiting_, not_full_);
+        return true;
+    }
+
+    /*消费者：空了就等；关闭并且取空后返回 false*/
+    bool pop(T &item)
+    {
+        return pop_until(item, nullptr);
+    }
+
+    /*消费者：最多等 timeout，超时或关闭并且取空后返回 false*/
+    template <typename Rep, typename Period>
+    bool pop_for(T &item, std::chrono::duration<Rep, Period> timeout)
+    {
+        const auto deadline = clock::now() + std::chrono::duration_cast<clock::duration>(timeout);
+        return pop_until(item, &deadline);
+    }
+
+    /*两端都可以调用，可以重复调用*/
+    void close()
+    {
+        closed_.store(true, std::memory_order_release);
+        not_empty_.fetch_add(1, std::memory_order_release);
+        spsc_ring_detail::futex_wake(not_empty_, INT_MAX);
+        not_full_.fetch_add(1, std::memory_order_release);
+        spsc_ring_detail::futex_wake(not_full_, INT_MAX);
+    }
+
+    bool closed() const
+    {
+        return closed_.load(std::memory_order_acquire);
+    }
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr std::size_t CACHE_LINE = 64;
+    static constexpr int SPIN_LIMIT = 64;
+
+    const std::size_t capacity_;
+    const bool power_of_two_;
+    const std::unique_ptr<T[]> slots_;
+
+    // 生产者写
+    alignas(CACHE_LINE) std::atomic<std::size_t> tail_{ 0 };
+    std::size_t cached_head_ = 0;
+    // 消费者写
+    alignas(CACHE_LINE) std::atomic<std::size_t> head_{ 0 };
+    std::size_t cached_tail_ = 0;
+    // 睡眠和唤醒，只在队列空或满时才会碰
+    alignas(CACHE_LINE) std::atomic<uint32_t> not_empty_{ 0 };
+    std::atomic<uint32_t> not_full_{ 0 };
+    std::atomic<bool> consumer_waiting_{ false };
+    std::atomic<bool> producer_waiting_{ false };
+    std::atomic<bool> closed_{ false };
+
+    T &slot(std::size_t index) const
+    {
+        return slots_[power_of_two_ ? index & (capacity_ - 1) : index % capacity_];
+    }
+
+    bool pop_until(T &item, const clock::time_point *deadline)
+    {
+        for (int spin = 0;; spin++) {
+            if (try_pop(item))
+                return true;
+            if (closed_.load(std::memory_order_acquire))
+                return try_pop(item);
+            if (spin < SPIN_LIMIT)
+                continue;
+            if (deadline != nullptr && clock::now() >= *deadline)
+                return false;
+            sleep(consumer_waiting_, not_empty_, deadline, [this] { return tail_.load(std::memory_order_seq_cst) != head_.load(std::memory_order_relaxed); });
+        }
+    }
+
+    /*
+     * 先拿事件计数，再宣布要睡，再检查条件：和 wake 里的“先改下标，再看有没有人睡”配对（都是 seq_cst），
+     * 两边至少有一边能看到对方，不会漏唤醒；deadline 不为空时最多睡到 deadline，由调用方重新检查
+     */
+    template <typename Ready>
+    void sleep(std::atomic<bool> &waiting, std::atomic<uint32_t> &event, const clock::time_point *deadline, Ready ready)
+    {
+        const uint32_t ticket = event.load(std::memory_order_acquire);
+        waiting.store(true, std::memory_order_seq_cst);
+        if (!ready() && !closed_.load(std::memory_order_acquire)) {
+            if (deadline == nullptr) {
+                spsc_ring_detail::futex_wait(event, ticket, nullptr);
+            } else {
+                const auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(*deadline - clock::now());
+                if (remaining.count() > 0)
+                    spsc_ring_detail::futex_wait(event, ticket, &remaining);
+            }
+        }
+        waiting.store(false, std::memory_order_relaxed);
+    }
+
+    static void wake(std::atomic<bool> &waiting, std::atomic<uint32_t> &event)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // 叫醒后对方还没来得及运行时，后面的 push / pop 不再重复进内核
+        if (waiting.load(std::memory_order_relaxed) && waiting.exchange(false, std::memory_order_acq_rel)) {
+            event.fetch_add(1, std::memory_order_release);
+            spsc_ring_detail::futex_wake(event, 1);
+        }
+    }
+};
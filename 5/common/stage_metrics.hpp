@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <iostream>
+#include <string_view>
+
+/*
+ * 单个阶段的搬运统计：
+ * copies      整帧拷贝次数（memcpy、clone、写入 vstream 时 libhailort 的拷贝）
+ * bytes_moved 该阶段写出的全部字节，包括 resize 等生成新像素的操作
+ */
+struct stage_metrics {
+    std::size_t frames = 0;
+    std::size_t copies = 0;
+    std::size_t bytes_moved = 0;
+
+    std::size_t frame_copies = 0;
+    std::size_t frame_bytes = 0;
+
+    void begin_frame()
+    {
+        frame_copies = 0;
+        frame_bytes = 0;
+    }
+    void add_copy(std::size_t bytes)
+    {
+        frame_copies++;
+        frame_bytes += bytes;
+    }
+    void add_write(std::size_t bytes)
+    {
+        frame_bytes += bytes;
+    }
+    void end_frame()
+    {
+        frames++;
+        copies += frame_copies;
+        bytes_moved += frame_bytes;
+    }
+
+    void report_frame(std::string_view stage) const
+    {
+        std::cout << stage << "：拷贝" << frame_copies << "次，搬运" << frame_bytes / 1024 << "KB" << std::endl;
+    }
+    void report(std::string_view stage) const
+    {
+        if (frames == 0)
+            return;
+        std::cout << stage << "平均每帧：拷贝" << static_cast<double>(copies) / frames << "次，搬运"
+                  << bytes_moved / frames / 1024 << "KB" << std::endl;
+    }
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <pthread.h>
+#include <sched.h>
+
+/*
+ * 线程放在哪些核上、用什么调度策略
+ * cpus 是位掩码，第 n 位对应 CPU n，0 表示不限制；policy 是 SCHED_OTHER / SCHED_FIFO / SCHED_RR，
+ * priority 只对实时策略有意义（1..99，越大越优先）
+ */
+struct thread_placement {
+    uint64_t cpus = 0;
+    int policy = SCHED_OTHER;
+    int priority = 0;
+};
+
+inline constexpr uint64_t cpu_mask(std::initializer_list<unsigned> cpus)
+{
+    uint64_t mask = 0;
+    for (auto cpu : cpus)
+        mask |= uint64_t{ 1 } << cpu;
+    return mask;
+}
+
+inline std::string describe(const thread_placement &placement)
+{
+    std::string text = placement.policy == SCHED_FIFO ? "SCHED_FIFO " + std::to_string(placement.priority)
+                       : placement.policy == SCHED_RR ? "SCHED_RR " + std::to_string(placement.priority)
+                                                      : "SCHED_OTHER";
+    if (placement.cpus == 0)
+        return text + "，不限CPU";
+    text += "，CPU";
+    for (unsigned cpu = 0; cpu < 64; cpu++) {
+        if (placement.cpus & (uint64_t{ 1 } << cpu))
+            text += " " + std::to_string(cpu);
+    }
+    return text;
+}
+
+/*
+ * 在调用线程上生效，线程启动后第一件事调用；之后由它创建的线程继承亲和性和调度策略
+ * name 同时设成线程名（top -H、perf 里能看到，超过 15 字节按 UTF-8 字符截断）
+ * 实时策略需要 root、CAP_SYS_NICE 或 RLIMIT_RTPRIO，没有权限时打印警告，亲和性照常设置，返回 false
+ */
+inline bool apply_thread_placement(std::string_view name, const thread_placement &placement)
+{
+    std::size_t length = std::min<std::size_t>(name.size(), 15);
+    while (length > 0 && length < name.size() && (static_cast<unsigned char>(name[length]) & 0xC0) == 0x80)
+        length--;
+    pthread_setname_np(pthread_self(), std::string(name.substr(0, length)).c_str());
+
+    bool ok = true;
+    if (placement.cpus != 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (unsigned cpu = 0; cpu < 64 && cpu < CPU_SETSIZE; cpu++) {
+            if (placement.cpus & (uint64_t{ 1 } << cpu))
+                CPU_SET(cpu, &set);
+        }
+        // 掩码里的核全部不存在时返回 EINVAL
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err != 0) {
+            std::cerr << name << " 设置CPU亲和性失败: " << std::strerror(err) << std::endl;
+            ok = false;
+        }
+    }
+    if (placement.policy != SCHED_OTHER) {
+        sched_param param{};
+        param.sched_priority = placement.priority;
+        int err = pthread_setschedparam(pthread_self(), placement.policy, &param);
+        if (err != 0) {
+            std::cerr << name << " 设置 " << describe(placement) << " 失败: " << std::strerror(err)
+                      << (err == EPERM ? "（需要 CAP_SYS_NICE 或 rtprio 限额），按普通线程运行" : "") << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
@@ -0,0 +1,307 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/*跟踪器的输入和输出框，坐标系由调用方决定（归一化坐标或像素都行，噪声按框的大小取比例）*/
+struct track_box {
+    float x1, y1, x2, y2;
+    float score;
+    int class_id;
+};
+
+inline float track_iou(const track_box &a, const track_box &b)
+{
+    float w = std::min(a.x2, b.x2) - std::max(a.x1, b.x1);
+    float h = std::min(a.y2, b.y2) - std::max(a.y1, b.y1);
+    if (w <= 0.0f || h <= 0.0f)
+        return 0.0f;
+    float inter = w * h;
+    return inter / ((a.x2 - a.x1) * (a.y2 - a.y1) + (b.x2 - b.x1) * (b.y2 - b.y1) - inter);
+}
+
+struct tracker_params {
+    float high_score = 0.5f;            // 高于它的检测参与第一轮关联，没匹配上的新建轨迹
+    float low_score = 0.1f;             // 低分检测只在第二轮续上已有的轨迹（ByteTrack）
+    float match_iou = 0.2f;             // 预测框和检测框至少这么重叠才能关联，且类别相同
+    int min_hits = 2;                   // 匹配上这么多次才输出
+    double max_lost_s = 1.0;            // 这么久没匹配上就删掉
+    double frame_interval_s = 1.0 / 30; // 过程噪声按这个帧间隔标定
+    int max_stride = 4;                 // 最多每几帧推理一次，1 = 每帧都推理
+    float relax_error = 0.15f;          // 预测框和检测框的 1 - IoU 平均小于它，步长加一
+    float tighten_error = 0.35f;        // 有一个大于它，或者出现新目标，步长减半
+};
+
+/*
+ * SORT / ByteTrack 式的多目标跟踪：每条轨迹对 (cx, cy, w, h) 各用一个匀速 Kalman 滤波（状态是位置和每帧速度），
+ * 四个轴互不相关，协方差是 4 个 2x2 块，比完整的 8 维滤波便宜得多；噪声和 ByteTrack 一样按框的大小取比例
+ * 关联用 IoU 贪心匹配：先高分检测对全部轨迹，再低分检测对剩下的轨迹
+ *
+ * 跳帧推理：每个采集帧调一次 should_infer()，步长自适应 ——
+ * 每次 update 比较预测框和检测框：平均误差小时步长加一；有框误差大或出现新目标时减半，有目标连续两次没匹配上时减一；
+ * 跳过的帧用 for_each_visible(time) 把轨迹外推到该帧的时间
+ * 时间用秒，由调用方给（采集时间或帧号 / 帧率），所以检测结果晚到、后端并行时也能对上帧；比当前状态旧的结果直接丢掉
+ * tracks_ 等缓冲区只增不减，稳态下不分配内存
+ */
+class multi_tracker {
+public:
+    /*单个轴的 Kalman 滤波：位置 p，每帧速度 v，协方差 [[p00, p01], [p01, p11]]*/
+    struct kalman_axis {
+        float p = 0, v = 0;
+        float p00 = 0, p01 = 0, p11 = 0;
+
+        void init(float position, float scale)
+        {
+            p = position;
+            v = 0;
+            p00 = (2 * POSITION_STD * scale) * (2 * POSITION_STD * scale);
+            p01 = 0;
+            p11 = (10 * VELOCITY_STD * scale) * (10 * VELOCITY_STD * scale);
+        }
+        /*dt 以帧为单位，过程噪声和 dt 成正比*/
+        void predict(float dt, float scale)
+        {
+            p += v * dt;
+            p00 += dt * (2 * p01 + dt * p11) + dt * (POSITION_STD * scale) * (POSITION_STD * scale);
+            p01 += dt * p11;
+            p11 += dt * (VELOCITY_STD * scale) * (VELOCITY_STD * scale);
+        }
+        void update(float z, float scale)
+        {
+            float s = p00 + (POSITION_STD * scale) * (POSITION_STD * scale);
+            float k0 = p00 / s, k1 = p01 / s;
+            float y = z - p;
+            p += k0 * y;
+            v += k1 * y;
+            p11 -= k1 * p01;
+            p01 *= 1 - k0;
+            p00 *= 1 - k0;
+        }
+    };
+
+    struct track {
+        uint32_t id;
+        int class_id;
+        float score;
+        int hits;
+        int misses;       // 连续几次推理没匹配上；不为 0 时不输出，但还在等着续上
+        double updated_s; // 最近一次匹配上的时间
+        std::array<kalman_axis, 4> axes; // cx, cy, w, h
+
+        /*外推到 dt 帧之后的框，不改变状态*/
+        track_box box_after(float dt) const
+        {
+            float cx = axes[0].p + axes[0].v * dt, cy = axes[1].p + axes[1].v * dt;
+            float w = std::max(axes[2].p + axes[2].v * dt, 0.0f), h = std::max(axes[3].p + axes[3].v * dt, 0.0f);
+            return { cx - w / 2, cy - h / 2, cx + w / 2, cy + h / 2, score, class_id };
+        }
+    };
+
+    struct stats {
+        std::size_t frames = 0;     // should_infer 调用次数
+        std::size_t inferences = 0; // 其中返回 true 的次数
+        std::size_t updates = 0;
+        std::size_t stale = 0;      // 比当前状态旧、被丢掉的检测结果
+        std::size_t created = 0;    // 新建的轨迹
+    };
+
+    explicit multi_tracker(const tracker_params &params = {})
+        : params_(params)
+    {
+        tracks_.reserve(256);
+        predicted_.reserve(256);
+        track_matched_.reserve(256);
+        det_matched_.reserve(256);
+        candidates_.reserve(4096);
+    }
+
+    /*每个采集帧调用一次，返回这一帧要不要推理*/
+    bool should_infer()
+    {
+        stats_.frames++;
+        if (++since_inference_ < stride_)
+            return false;
+        since_inference_ = 0;
+        stats_.inferences++;
+        return true;
+    }
+
+    int stride() const
+    {
+        return stride_;
+    }
+
+    /*time_s 是这批检测对应的帧的时间*/
+    void update(double time_s, std::span<const track_box> dets)
+    {
+        if (initialized_ && time_s < time_s_) {
+            stats_.stale++;
+            return;
+        }
+        const float dt = initialized_ ? static_cast<float>((time_s - time_s_) / params_.frame_interval_s) : 0.0f;
+        time_s_ = time_s;
+        initialized_ = true;
+        stats_.updates++;
+
+        predicted_.clear();
+        for (auto &t : tracks_) {
+            predict(t, dt);
+            predicted_.push_back(t.box_after(0));
+        }
+        track_matched_.assign(tracks_.size(), 0);
+        det_matched_.assign(dets.size(), 0);
+
+        // 两轮关联，误差只统计已经输出过的轨迹
+        float max_error = 0.0f, error_sum = 0.0f;
+        int error_count = 0, born = 0, lost = 0;
+        for (int round = 0; round < 2; round++) {
+            candidates_.clear();
+            for (std::size_t j = 0; j < dets.size(); j++) {
+                const bool high = dets[j].score >= params_.high_score;
+                if (round == 0 ? !high : (high || dets[j].score < params_.low_score))
+                    continue;
+                for (std::size_t i = 0; i < tracks_.size(); i++) {
+                    if (track_matched_[i] || tracks_[i].class_id != dets[j].class_id)
+                        continue;
+                    float iou = track_iou(predicted_[i], dets[j]);
+                    if (iou >= params_.match_iou)
+                        candidates_.push_back({ iou, static_cast<uint32_t>(i), static_cast<uint32_t>(j) });
+                }
+            }
+            std::sort(candidates_.begin(), candidates_.end(), [](const candidate &a, const candidate &b) { return a.iou > b.iou; });
+            for (const auto &c : candidates_) {
+                if (track_matched_[c.track] || det_matched_[c.det])
+                    continue;
+                track_matched_[c.track] = 1;
+                det_matched_[c.det] = 1;
+                auto &t = tracks_[c.track];
+                if (t.hits >= params_.min_hits) {
+                    max_error = std::max(max_error, 1.0f - c.iou);
+                    error_sum += 1.0f - c.iou;
+                    error_count++;
+                }
+                correct(t, dets[c.det], time_s);
+            }
+        }
+
+        // 没匹配上的轨迹：还没输出过的直接删，输出过的等 max_lost_s
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < tracks_.size(); i++) {
+            auto &t = tracks_[i];
+            if (!track_matched_[i]) {
+                if (t.hits < params_.min_hits)
+                    continue;
+                // 漏检一次可能只是检测器抖动，连续两次才算丢了目标
+                if (++t.misses == 2)
+                    lost++;
+                if (time_s - t.updated_s > params_.max_lost_s)
+                    continue;
+            }
+            if (kept != i)
+                tracks_[kept] = tracks_[i];
+            kept++;
+        }
+        tracks_.resize(kept);
+
+        // 没匹配上的高分检测新建轨迹
+        for (std::size_t j = 0; j < dets.size(); j++) {
+            if (det_matched_[j] || dets[j].score < params_.high_score)
+                continue;
+            tracks_.push_back(create(dets[j], time_s));
+            born++;
+        }
+
+        if (born > 0 || max_error > params_.tighten_error)
+            stride_ = std::max(1, stride_ / 2);
+        else if (lost > 0)
+            stride_ = std::max(1, stride_ - 1);
+        else if (error_sum < params_.relax_error * error_count || error_count == 0)
+            stride_ = std::min(params_.max_stride, stride_ + 1);
+    }
+
+    /*time_s 时刻应该显示的轨迹（已确认、最近一次推理匹配上），fn(const track &, const track_box &)*/
+    template <typename F>
+    void for_each_visible(double time_s, F &&fn) const
+    {
+        const float dt = static_cast<float>((time_s - time_s_) / params_.frame_interval_s);
+        for (const auto &t : tracks_) {
+            if (t.hits >= params_.min_hits && t.misses == 0)
+                fn(t, t.box_after(dt));
+        }
+    }
+
+    std::span<const track> tracks() const
+    {
+        return tracks_;
+    }
+
+    const stats &statistics() const
+    {
+        return stats_;
+    }
+
+private:
+    // ByteTrack 的 std_weight_position / std_weight_velocity
+    static constexpr float POSITION_STD = 1.0f / 20;
+    static constexpr float VELOCITY_STD = 1.0f / 160;
+
+    struct candidate {
+        float iou;
+        uint32_t track;
+        uint32_t det;
+    };
+
+    tracker_params params_;
+    std::vector<track> tracks_;
+    std::vector<track_box> predicted_;
+    std::vector<uint8_t> track_matched_;
+    std::vector<uint8_t> det_matched_;
+    std::vector<candidate> candidates_;
+    double time_s_ = 0;
+    bool initialized_ = false;
+    uint32_t next_id_ = 1;
+    int stride_ = 1;
+    int since_inference_ = 0;
+    stats stats_{};
+
+    /*x 方向的轴按宽度取噪声，y 方向按高度*/
+    static void predict(track &t, float dt)
+    {
+        if (dt <= 0.0f)
+            return;
+        const float w = std::max(t.axes[2].p, 1e-6f), h = std::max(t.axes[3].p, 1e-6f);
+        t.axes[0].predict(dt, w);
+        t.axes[1].predict(dt, h);
+        t.axes[2].predict(dt, w);
+        t.axes[3].predict(dt, h);
+    }
+
+    static void correct(track &t, const track_box &det, double time_s)
+    {
+        const float w = det.x2 - det.x1, h = det.y2 - det.y1;
+        t.axes[0].update((det.x1 + det.x2) / 2, w);
+        t.axes[1].update((det.y1 + det.y2) / 2, h);
+        t.axes[2].update(w, w);
+        t.axes[3].update(h, h);
+        t.score = det.score;
+        t.hits++;
+        t.misses = 0;
+        t.updated_s = time_s;
+    }
+
+    track create(const track_box &det, double time_s)
+    {
+        stats_.created++;
+        track t{ next_id_++, det.class_id, det.score, 1, 0, time_s, {} };
+        const float w = det.x2 - det.x1, h = det.y2 - det.y1;
+        t.axes[0].init((det.x1 + det.x2) / 2, w);
+        t.axes[1].init((det.y1 + det.y2) / 2, h);
+        t.axes[2].init(w, w);
+        t.axes[3].init(h, h);
+        return t;
+    }
+};
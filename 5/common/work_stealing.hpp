@@ -0,0 +1,444 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "thread_placement.hpp"
+
+/*
+ * Chase-Lev 工作窃取双端队列（按 Lê 等人 2013 年给弱内存模型的版本）：
+ * 所有者在底部 push / pop，不加锁；其它线程从顶部 steal，只和所有者争最后一个元素时用一次 CAS
+ * 容量固定（2 的幂），满了 push 返回 false，由调用方自己执行；元素是指针，对象本身由调用方管理
+ */
+template <typename T>
+class chase_lev_deque {
+public:
+    enum class steal_result {
+        success,
+        empty,
+        lost_race, // 和所有者或其它窃取者抢同一个元素失败
+    };
+
+    explicit chase_lev_deque(std::size_t capacity)
+        : slots_(std::bit_ceil(std::max<std::size_t>(capacity, 2))), mask_(static_cast<int64_t>(slots_.size()) - 1)
+    {
+    }
+
+    /*只能由所有者调用*/
+    bool push(T *item)
+    {
+        const int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        const int64_t top = top_.load(std::memory_order_acquire);
+        if (bottom - top > mask_)
+            return false;
+        slots_[bottom & mask_].store(item, std::memory_order_relaxed);
+        // release：窃取者 acquire 读到新的 bottom 后一定能看到元素和它指向的对象
+        bottom_.store(bottom + 1, std::memory_order_release);
+        return true;
+    }
+
+    /*只能由所有者调用，后进先出，空了返回 nullptr*/
+    T *pop()
+    {
+        const int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = top_.load(std::memory_order_relaxed);
+        if (top > bottom) {
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        T *item = slots_[bottom & mask_].load(std::memory_order_relaxed);
+        if (top == bottom) {
+            // 最后一个元素，和窃取者抢
+            if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                item = nullptr;
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    /*任何线程都可以调用，先进先出*/
+    steal_result steal(T *&item)
+    {
+        int64_t top = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t bottom = bottom_.load(std::memory_order_acquire);
+        if (top >= bottom)
+            return steal_result::empty;
+        item = slots_[top & mask_].load(std::memory_order_relaxed);
+        if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return steal_result::lost_race;
+        return steal_result::success;
+    }
+
+    /*近似值，只用于统计*/
+    std::size_t size() const
+    {
+        const int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        const int64_t top = top_.load(std::memory_order_relaxed);
+        return static_cast<std::size_t>(std::max<int64_t>(bottom - top, 0));
+    }
+
+private:
+    // top 和 bottom 分别被窃取者和所有者频繁写，放在不同的缓存行
+    alignas(64) std::atomic<int64_t> top_{ 0 };
+    alignas(64) std::atomic<int64_t> bottom_{ 0 };
+    std::vector<std::atomic<T *> > slots_;
+    const int64_t mask_;
+};
+
+/*
+ * 每帧内部的短任务（分块颜色转换、裁剪缩放等）共用的 fork-join 执行器，代替各自开线程或者 OpenCV 的隐藏线程池
+ * - 每个工作线程一个 chase_lev_deque；工作线程里提交的任务放进自己的队列，其它线程（流水线阶段）提交的放进共享的外部队列
+ * - 空闲的工作线程依次找：自己的队列、外部队列、从其它工作线程的队列顶部窃取；都没有就睡眠，提交时唤醒
+ * - parallel_for 的调用方自己执行第一块，然后帮着执行队列里的任务，直到这一批全部完成才返回
+ * - 工作线程按 placement 的 CPU 掩码各固定在一个核上（线程数多于核数时轮流），调度策略和优先级照搬
+ * 实时优先级的阶段（NPU 送帧）调用时，交出去的任务按工作线程自己的优先级执行；调用方会先把能拿到的任务自己做掉
+ * 任务不能抛异常；worker_count 为 0 时 parallel_for 直接在调用线程里串行执行
+ */
+class task_executor {
+public:
+    struct worker_stats {
+        std::size_t executed;
+        std::size_t stolen;      // 从其它工作线程的队列窃取成功的次数
+        std::size_t lost_races;  // 窃取时和别人抢同一个任务失败的次数
+        std::size_t max_depth;   // 自己的队列最深
+        std::size_t depth;       // 当前队列深度
+    };
+    struct executor_stats {
+        std::size_t batches;        // parallel_for 调用次数
+        std::size_t tasks;          // 交出去的任务数（不含调用方自己执行的第一块）
+        std::size_t caller_executed; // 调用方帮忙执行的任务数（含第一块）
+        std::size_t inline_fallbacks; // 队列满了在调用方直接执行的任务数
+        std::size_t injected_max_depth;
+        std::size_t injected_depth;
+        std::vector<worker_stats> workers;
+    };
+
+    task_executor(std::string name, unsigned worker_count, const thread_placement &placement = {}, std::size_t queue_capacity = 256)
+        : name_(std::move(name)), injected_(std::bit_ceil(std::max<std::size_t>(queue_capacity, 2)))
+    {
+        std::vector<unsigned> cpus;
+        for (unsigned cpu = 0; cpu < 64; cpu++) {
+            if (placement.cpus & (uint64_t{ 1 } << cpu))
+                cpus.push_back(cpu);
+        }
+        for (unsigned i = 0; i < worker_count; i++)
+            workers_.emplace_back(queue_capacity);
+        for (unsigned i = 0; i < worker_count; i++) {
+            auto worker_placement = placement;
+            if (!cpus.empty())
+                worker_placement.cpus = uint64_t{ 1 } << cpus[i % cpus.size()];
+            workers_[i].thread = std::thread([this, i, worker_placement] {
+                apply_thread_placement(name_ + std::to_string(i), worker_placement);
+                run(i);
+            });
+        }
+    }
+    ~task_executor()
+    {
+        stopping_.store(true, std::memory_order_seq_cst);
+        epoch_.fetch_add(1, std::memory_order_seq_cst);
+        epoch_.notify_all();
+        for (auto &worker : workers_) {
+            if (worker.thread.joinable())
+                worker.thread.join();
+        }
+    }
+    task_executor(const task_executor &) = delete;
+    task_executor &operator=(const task_executor &) = delete;
+
+    unsigned worker_count() const
+    {
+        return static_cast<unsigned>(workers_.size());
+    }
+
+    /*
+     * fn(index) 对 [0, count) 每个下标调用一次，可以并发；全部完成后返回
+     * 超过 MAX_TASKS 时相邻的下标合成一个任务；可以在任务里再调用（嵌套的任务放进当前工作线程自己的队列）
+     */
+    template <typename F>
+    void parallel_for(std::size_t count, F &&fn)
+    {
+        if (count == 0)
+            return;
+        if (count == 1 || workers_.empty()) {
+            for (std::size_t i = 0; i < count; i++)
+                fn(i);
+            return;
+        }
+
+        const std::size_t chunks = std::min(count, MAX_TASKS);
+        std::array<task, MAX_TASKS> tasks;
+        std::atomic<std::size_t> pending{ chunks - 1 };
+        for (std::size_t c = 0; c < chunks; c++) {
+            tasks[c].invoke = [](void *context, std::size_t begin, std::size_t end) {
+                auto &body = *static_cast<std::remove_reference_t<F> *>(context);
+                for (std::size_t i = begin; i < end; i++)
+                    body(i);
+            };
+            tasks[c].context = const_cast<void *>(static_cast<const void *>(&fn));
+            tasks[c].begin = count * c / chunks;
+            tasks[c].end = count * (c + 1) / chunks;
+            tasks[c].pending = &pending;
+        }
+
+        batches_.fetch_add(1, std::memory_order_relaxed);
+        auto *self = current_worker();
+        std::size_t fallbacks = 0;
+        for (std::size_t c = 1; c < chunks; c++) {
+            bool queued = self != nullptr ? self->deque.push(&tasks[c]) : inject(&tasks[c]);
+            if (!queued) {
+                // 队列满了：直接在这里执行，不能丢
+                execute(tasks[c]);
+                fallbacks++;
+                continue;
+            }
+            if (self != nullptr)
+                update_max(self->max_depth, self->deque.size());
+        }
+        tasks_.fetch_add(chunks - 1 - fallbacks, std::memory_order_relaxed);
+        inline_fallbacks_.fetch_add(fallbacks, std::memory_order_relaxed);
+        wake();
+
+        // 第一块自己做，然后帮忙，直到这一批都做完
+        tasks[0].invoke(tasks[0].context, tasks[0].begin, tasks[0].end);
+        std::size_t helped = 1;
+        while (pending.load(std::memory_order_acquire) > 0) {
+            task *next = find_task(self);
+            if (next != nullptr) {
+                execute(*next);
+                helped++;
+                continue;
+            }
+            // 剩下的任务都在别的线程手上，等某一批完成时唤醒再看是不是自己这批
+            const auto done = done_epoch_.load(std::memory_order_seq_cst);
+            if (pending.load(std::memory_order_seq_cst) == 0)
+                break;
+            done_epoch_.wait(done, std::memory_order_seq_cst);
+        }
+        caller_executed_.fetch_add(helped, std::memory_order_relaxed);
+    }
+
+    executor_stats statistics() const
+    {
+        executor_stats stats{};
+        stats.batches = batches_.load(std::memory_order_relaxed);
+        stats.tasks = tasks_.load(std::memory_order_relaxed);
+        stats.caller_executed = caller_executed_.load(std::memory_order_relaxed);
+        stats.inline_fallbacks = inline_fallbacks_.load(std::memory_order_relaxed);
+        stats.injected_max_depth = injected_max_depth_.load(std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(injected_mutex_);
+            stats.injected_depth = injected_count_;
+        }
+        for (auto &worker : workers_) {
+            stats.workers.push_back({ worker.executed.load(std::memory_order_relaxed), worker.stolen.load(std::memory_order_relaxed),
+                                      worker.lost_races.load(std::memory_order_relaxed), worker.max_depth.load(std::memory_order_relaxed), worker.deque.size() });
+        }
+        return stats;
+    }
+
+    void report() const
+    {
+        auto stats = statistics();
+        std::cout << "任务执行器 " << name_ << ": " << stats.workers.size() << "个工作线程，" << stats.batches << "批，交出任务" << stats.tasks << "个，调用方执行"
+                  << stats.caller_executed << "个，队列满了直接执行" << stats.inline_fallbacks << "个，外部队列最深" << stats.injected_max_depth << std::endl;
+        for (std::size_t i = 0; i < stats.workers.size(); i++) {
+            auto &worker = stats.workers[i];
+            std::cout << "  工作线程" << i << ": 执行" << worker.executed << "个，窃取" << worker.stolen << "次（冲突" << worker.lost_races << "次），自己的队列最深"
+                      << worker.max_depth << std::endl;
+        }
+    }
+
+private:
+    static constexpr std::size_t MAX_TASKS = 64;
+
+    struct task {
+        void (*invoke)(void *context, std::size_t begin, std::size_t end);
+        void *context;
+        std::size_t begin;
+        std::size_t end;
+        std::atomic<std::size_t> *pending;
+    };
+
+    struct worker_state {
+        chase_lev_deque<task> deque;
+        std::thread thread;
+        std::atomic<std::size_t> executed{ 0 };
+        std::atomic<std::size_t> stolen{ 0 };
+        std::atomic<std::size_t> lost_races{ 0 };
+        std::atomic<std::size_t> max_depth{ 0 };
+
+        explicit worker_state(std::size_t capacity)
+            : deque(capacity)
+        {
+        }
+    };
+
+    const std::string name_;
+    std::deque<worker_state> workers_; // deque：工作线程持有元素的引用，地址不能变
+
+    // 外部线程提交的任务：定长环，加锁
+    mutable std::mutex injected_mutex_;
+    std::vector<task *> injected_;
+    std::size_t injected_head_ = 0;
+    std::size_t injected_count_ = 0;
+    std::atomic<std::size_t> injected_pending_{ 0 }; // 不加锁先看一眼是否为空
+
+    // 睡眠 / 唤醒：提交时 epoch 加一，睡眠的线程等 epoch 变化
+    std::atomic<uint32_t> epoch_{ 0 };
+    std::atomic<unsigned> sleepers_{ 0 };
+    // 每完成一批加一，等在 parallel_for 里的调用方被唤醒后检查自己那批的计数
+    std::atomic<uint32_t> done_epoch_{ 0 };
+    std::atomic<bool> stopping_{ false };
+
+    std::atomic<std::size_t> batches_{ 0 };
+    std::atomic<std::size_t> tasks_{ 0 };
+    std::atomic<std::size_t> caller_executed_{ 0 };
+    std::atomic<std::size_t> inline_fallbacks_{ 0 };
+    std::atomic<std::size_t> injected_max_depth_{ 0 };
+
+    struct worker_binding {
+        const task_executor *executor;
+        worker_state *worker;
+    };
+    static worker_binding &binding()
+    {
+        static thread_local worker_binding current{ nullptr, nullptr };
+        return current;
+    }
+    /*当前线程是这个执行器的工作线程时返回它的状态*/
+    worker_state *current_worker() const
+    {
+        auto &current = binding();
+        return current.executor == this ? current.worker : nullptr;
+    }
+
+    static void update_max(std::atomic<std::size_t> &max, std::size_t value)
+    {
+        auto seen = max.load(std::memory_order_relaxed);
+        while (value > seen && !max.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    void execute(task &t)
+    {
+        t.invoke(t.context, t.begin, t.end);
+        // 计数归零后调用方随时可能返回，t 和计数所在的栈帧就没了，所以唤醒用执行器自己的 done_epoch_
+        if (t.pending->fetch_sub(1, std::memory_order_seq_cst) == 1) {
+            done_epoch_.fetch_add(1, std::memory_order_seq_cst);
+            done_epoch_.notify_all();
+        }
+    }
+
+    bool inject(task *t)
+    {
+        std::lock_guard<std::mutex> lock(injected_mutex_);
+        if (injected_count_ == injected_.size())
+            return false;
+        injected_[(injected_head_ + injected_count_) % injected_.size()] = t;
+        injected_count_++;
+        injected_pending_.store(injected_count_, std::memory_order_release);
+        update_max(injected_max_depth_, injected_count_);
+        return true;
+    }
+
+    task *take_injected()
+    {
+        if (injected_pending_.load(std::memory_order_acquire) == 0)
+            return nullptr;
+        std::lock_guard<std::mutex> lock(injected_mutex_);
+        if (injected_count_ == 0)
+            return nullptr;
+        task *t = injected_[injected_head_];
+        injected_head_ = (injected_head_ + 1) % injected_.size();
+        injected_count_--;
+        injected_pending_.store(injected_count_, std::memory_order_release);
+        return t;
+    }
+
+    /*self 为空表示外部线程：只能从外部队列拿或者窃取*/
+    task *find_task(worker_state *self)
+    {
+        if (self != nullptr) {
+            if (task *t = self->deque.pop())
+                return t;
+        }
+        if (task *t = take_injected())
+            return t;
+        // 从下一个工作线程开始轮一圈，免得大家都去偷同一个
+        const std::size_t n = workers_.size();
+        const std::size_t start = self != nullptr ? static_cast<std::size_t>(self - &workers_[0]) : 0;
+        for (std::size_t k = 1; k <= n; k++) {
+            auto &victim = workers_[(start + k) % n];
+            if (&victim == self)
+                continue;
+            task *t = nullptr;
+            auto result = victim.deque.steal(t);
+            if (self != nullptr && result == chase_lev_deque<task>::steal_result::lost_race)
+                self->lost_races.fetch_add(1, std::memory_order_relaxed);
+            if (result == chase_lev_deque<task>::steal_result::success) {
+                if (self != nullptr)
+                    self->stolen.fetch_add(1, std::memory_order_relaxed);
+                return t;
+            }
+        }
+        return nullptr;
+    }
+
+    void wake()
+    {
+        epoch_.fetch_add(1, std::memory_order_seq_cst);
+        if (sleepers_.load(std::memory_order_seq_cst) > 0)
+            epoch_.notify_all();
+    }
+
+    void run(unsigned index)
+    {
+        auto &self = workers_[index];
+        binding() = { this, &self };
+        while (!stopping_.load(std::memory_order_acquire)) {
+            if (task *t = find_task(&self)) {
+                execute(*t);
+                self.executed.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            // 先记下 epoch 再登记睡眠、再找一遍：之后有人提交，epoch 一定变了，wait 不会睡下去
+            const auto epoch = epoch_.load(std::memory_order_seq_cst);
+            sleepers_.fetch_add(1, std::memory_order_seq_cst);
+            task *t = find_task(&self);
+            if (t == nullptr && !stopping_.load(std::memory_order_acquire))
+                epoch_.wait(epoch, std::memory_order_seq_cst);
+            sleepers_.fetch_sub(1, std::memory_order_seq_cst);
+            if (t != nullptr) {
+                execute(*t);
+                self.executed.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        binding() = { nullptr, nullptr };
+    }
+};
+
+/*executor 为空时串行执行，调用方不用区分是否启用了执行器*/
+template <typename F>
+inline void parallel_for(task_executor *executor, std::size_t count, F &&fn)
+{
+    if (executor != nullptr) {
+        executor->parallel_for(count, fn);
+        return;
+    }
+    for (std::size_t i = 0; i < count; i++)
+        fn(i);
+}
@@ -9,6 +9,11 @@
 
 #include "hailo/hailort.hpp"
 #include "opencv2/opencv.hpp"
+#include "buffer_pool.hpp"
+#include "hailo_nms.hpp"
+#include "overlay.hpp"
+#include "preprocess.hpp"
+#include "stage_metrics.hpp"
 #include <cstddef>
 #include <cstdint>
 #include <csignal>
@@ -34,9 +39,14 @@
 
 #define HEF_FILE ("/home/wjjsn/code/yolov8n.hef")
 constexpr auto video_path = "/home/wjjsn/test.mp4";
+// 预览分辨率，检测框画在缩小后的帧上
+constexpr int DISPLAY_WIDTH = 960;
+constexpr int DISPLAY_HEIGHT = 540;
 constexpr auto VIDEO_DEVICE = "/dev/video0";
 constexpr size_t MAX_LAYER_EDGES = 16;
 constexpr auto USE_V4L2 = true;
+// 是否弹窗预览；不预览时不缩小帧、不画框
+constexpr auto SHOW_PREVIEW = false;
 
 struct buffer {
     void *start;
@@ -82,12 +92,21 @@ std::condition_variable g_cv;
 
 int infer(Expected<std::vector<InputVStream> > input_vstreams, Expected<std::vector<OutputVStream> > output_vstreams)
 {
+    // NMS输出缓冲区只分配一次，每帧都 read 到同一块内存
+    nms_output_buffer<float> out;
+    // 标签字形只光栅化一次；display 是缩小到预览分辨率的帧，每帧复用
+    overlay_renderer overlay;
+    cv::Mat display;
+    buffer_pool input_pool(input_vstreams.value()[0].get_frame_size(), 2);
+    stage_metrics preprocess_metrics;
+
     std::size_t frame_count = 0;
     auto before_while = std::chrono::high_resolution_clock::now();
     while (true) {
         if (g_stop_requested) {
             std::cout << "\n收到 Ctrl+C 或推理结束，准备退出...\n";
             std::cout << "共推理" << frame_count << "帧。" << "平均一帧耗时:" << (std::chrono::high_resolution_clock::now() - before_while) / 1ms / frame_count << "ms" << std::endl;
+            preprocess_metrics.report("预处理");
             break;
         }
 
@@ -131,30 +150,27 @@ int infer(Expected<std::vector<InputVStream> > input_vstreams, Expected<std::vec
             std::cout << "End of video file" << std::endl;
             return 0;
         }
-        auto write_frame = [&frame, &all_start](InputVStream &input, hailo_status &status) {
+        auto write_frame = [&frame, &input_pool, &preprocess_metrics](InputVStream &input, hailo_status &status) {
             auto opencv_start = std::chrono::high_resolution_clock::now();
+            preprocess_metrics.begin_frame();
 
-            cv::Mat processed;
-            cv::resize(frame, processed, cv::Size(640, 640));
+            // 直接缩放进池里的输入缓冲区，不再经过中间 Mat 和 memcpy
+            auto buffer = input_pool.acquire();
+            if (resize_into(frame, buffer.data(), buffer.size(), cv::Size(640, 640), preprocess_metrics) == 0) {
+                std::cerr << "Mat数据大小不匹配" << std::endl;
+                status = HAILO_INVALID_OPERATION;
+                return;
+            }
             // cv::cvtColor(processed, processed, cv::COLOR_BGR2RGB);
             auto opencv_time = std::chrono::high_resolution_clock::now();
             auto write_time = opencv_time - opencv_start;
             std::cout << "OpenCV预处理耗时：" << write_time / 1ms << "ms" << std::endl;
-            std::vector<uint8_t>
-                data(input.get_frame_size());
-
-            // 检查 Mat 是否连续（通常是连续的）
-            if (!processed.isContinuous()) {
-                processed = processed.clone();
-            }
 
-            // 将 Mat 数据复制到 vector 中
-            std::memcpy(data.data(), processed.data, input.get_frame_size());
-
-            status = input.write(MemoryView(data.data(), data.size()));
+            status = input.write(MemoryView(buffer.data(), buffer.size()));
             if (HAILO_SUCCESS != status) {
                 return;
             }
+            preprocess_metrics.add_copy(buffer.size());
 
             // Flushing is not mandatory here
             status = input.flush();
@@ -163,77 +179,33 @@ int infer(Expected<std::vector<InputVStream> > input_vstreams, Expected<std::vec
                 return;
             }
             std::cout << "内存复制耗时：" << (std::chrono::high_resolution_clock::now() - opencv_time) / 1ms << "ms" << std::endl;
+            preprocess_metrics.end_frame();
+            preprocess_metrics.report_frame("预处理");
             status = HAILO_SUCCESS;
         };
-        auto read_output = [&frame](OutputVStream &output, hailo_status &status) {
+        auto read_output = [&frame, &out, &overlay, &display](OutputVStream &output, hailo_status &status) {
             // 1. 读取完整的数据 (160320 bytes)
             auto read_time = std::chrono::high_resolution_clock::now();
-            std::vector<float> out(output.get_frame_size() / sizeof(float));
-            status = output.read(MemoryView(out.data(), output.get_frame_size()));
+            if (output.get_frame_size() != out.size()) {
+                std::cerr << "NMS输出大小不匹配: " << output.get_frame_size() << std::endl;
+                status = HAILO_INVALID_OPERATION;
+                return;
+            }
+            status = output.read(MemoryView(out.data(), out.size()));
             std::cout << "NPU推理耗时：" << (std::chrono::high_resolution_clock::now() - read_time) / 1ms << "ms" << std::endl;
             auto opencv_start = std::chrono::high_resolution_clock::now();
             if (status != HAILO_SUCCESS)
                 return;
 
-            int width = frame.cols;
-            int height = frame.rows;
-
-            // 定义常量
-            const int NUM_CLASSES = 80;
-            const int MAX_BOXES_PER_CLASS = 100;
-            const int BOX_DIM = 5; // (ymin, xmin, ymax, xmax, score) 注意没有class_id，因为class_id由外层循环决定
-
-            // 每一个Class占用的 float 数量 = 1个计数器 + 100个框 * 5个数据
-            const int CLASS_STRIDE = 1 + (MAX_BOXES_PER_CLASS * BOX_DIM);
-
-            // 外层循环：遍历所有 80 个类别
-            for (int class_id = 0; class_id < NUM_CLASSES; class_id++) {
-                // 计算当前类别的起始位置
-                int class_offset = class_id * CLASS_STRIDE;
-
-                // 获取当前类别检测到的数量
-                int count = static_cast<int>(out[class_offset]);
-
-                // 如果这个类别没有检测到东西，直接跳过，处理下一个类别
-                if (count <= 0)
-                    continue;
-
-                // 内层循环：只读取有效数量的框
-                for (int i = 0; i < count; i++) {
-                    // 计算具体某个框的起始位置
-                    // class_offset + 1 (跳过计数器) + i * 5
-                    int box_idx = class_offset + 1 + i * BOX_DIM;
-
-                    float y_min_norm = out[box_idx + 0];
-                    float x_min_norm = out[box_idx + 1];
-                    float y_max_norm = out[box_idx + 2];
-                    float x_max_norm = out[box_idx + 3];
-                    float score = out[box_idx + 4];
-
-                    // 过滤低置信度 (Log里说阈值是0.2，这里可以再次过滤)
-                    if (score < 0.25f)
-                        continue;
-
-                    // 坐标还原 (反归一化)
-                    int x1 = (int)(x_min_norm * width);
-                    int y1 = (int)(y_min_norm * height);
-                    int x2 = (int)(x_max_norm * width);
-                    int y2 = (int)(y_max_norm * height);
-
-                    // 绘制矩形
-                    cv::rectangle(frame, cv::Point(x1, y1), cv::Point(x2, y2), cv::Scalar(0, 255, 0), 2);
-
-                    // 绘制标签
-                    // 这里可以直接用 class_id，比如 0 就是 Person
-                    std::string label = std::to_string(class_id) + " " + std::to_string(score).substr(0, 4);
-
-                    int text_y = y1 - 5;
-                    if (text_y < 20)
-                        text_y = y1 + 20;
-
-                    cv::putText(frame, label, cv::Point(x1, text_y),
-                                cv::FONT_HERSHEY_SIMPLEX, 0.6, cv::Scalar(0, 255, 0), 1);
+            if constexpr (SHOW_PREVIEW) {
+                // 只遍历非空类别里分数不低于阈值的框 (Log里说阈值是0.2，这里可以再次过滤)，先收集，显示时一次画完
+                overlay.clear();
+                for (const auto det : out.view(0.25f)) {
+                    overlay.add_box(det);
                 }
+                display.create(DISPLAY_HEIGHT, DISPLAY_WIDTH, frame.type());
+                cv::resize(frame, display, display.size());
+                overlay.render(display);
             }
             std::cout << "画框耗时：" << (std::chrono::high_resolution_clock::now() - opencv_start) / 1ms << "ms" << std::endl;
         };
@@ -245,9 +217,11 @@ int infer(Expected<std::vector<InputVStream> > input_vstreams, Expected<std::vec
         read_output(output_vstreams.value()[0], status);
 
         std::cout << "全过程耗时：" << (std::chrono::high_resolution_clock::now() - all_start) / 1ms << "ms" << std::endl;
-        // cv::imshow("frame", frame);
-        // if (cv::waitKey(1) == 'q')
-        //     break;
+        if constexpr (SHOW_PREVIEW) {
+            cv::imshow("frame", display);
+            if (cv::waitKey(1) == 'q')
+                break;
+        }
 
         std::cout << "从读入一帧到显示耗时：" << (std::chrono::high_resolution_clock::now() - all_start) / 1ms << "ms" << std::endl;
         if (HAILO_SUCCESS != status) {
@@ -9,6 +9,8 @@
 
 #include "hailo/hailort.hpp"
 #include "opencv2/opencv.hpp"
+#include "hailo_nms.hpp"
+#include "overlay.hpp"
 #include <cstddef>
 #include <cstdint>
 #include <csignal>
@@ -20,6 +22,9 @@
 
 #define HEF_FILE ("/home/wjjsn/code/yolov8n.hef")
 constexpr auto video_path = "/home/wjjsn/test.mp4";
+// 预览分辨率，检测框画在缩小后的帧上
+constexpr int DISPLAY_WIDTH = 960;
+constexpr int DISPLAY_HEIGHT = 540;
 constexpr size_t MAX_LAYER_EDGES = 16;
 
 using namespace hailort;
@@ -115,6 +120,12 @@ int main()
         return -1;
     }
 
+    // NMS输出缓冲区只分配一次，每帧都 read 到同一块内存
+    nms_output_buffer<float> out;
+    // 标签字形只光栅化一次；display 是缩小到预览分辨率的帧，每帧复用
+    overlay_renderer overlay;
+    cv::Mat display;
+
     using namespace std::chrono_literals;
     std::size_t frame_count = 0;
     auto before_while = std::chrono::high_resolution_clock::now();
@@ -170,74 +181,26 @@ int main()
             std::cout << "内存复制耗时：" << (std::chrono::high_resolution_clock::now() - opencv_time) / 1ms << "ms" << std::endl;
             status = HAILO_SUCCESS;
         };
-        auto read_output = [&frame](OutputVStream &output, hailo_status &status) {
+        auto read_output = [&frame, &out, &overlay, &display](OutputVStream &output, hailo_status &status) {
             // 1. 读取完整的数据 (160320 bytes)
             auto opencv_start = std::chrono::high_resolution_clock::now();
-            std::vector<float> out(output.get_frame_size() / sizeof(float));
-            status = output.read(MemoryView(out.data(), output.get_frame_size()));
+            if (output.get_frame_size() != out.size()) {
+                std::cerr << "NMS输出大小不匹配: " << output.get_frame_size() << std::endl;
+                status = HAILO_INVALID_OPERATION;
+                return;
+            }
+            status = output.read(MemoryView(out.data(), out.size()));
             if (status != HAILO_SUCCESS)
                 return;
 
-            int width = frame.cols;
-            int height = frame.rows;
-
-            // 定义常量
-            const int NUM_CLASSES = 80;
-            const int MAX_BOXES_PER_CLASS = 100;
-            const int BOX_DIM = 5; // (ymin, xmin, ymax, xmax, score) 注意没有class_id，因为class_id由外层循环决定
-
-            // 每一个Class占用的 float 数量 = 1个计数器 + 100个框 * 5个数据
-            const int CLASS_STRIDE = 1 + (MAX_BOXES_PER_CLASS * BOX_DIM);
-
-            // 外层循环：遍历所有 80 个类别
-            for (int class_id = 0; class_id < NUM_CLASSES; class_id++) {
-                // 计算当前类别的起始位置
-                int class_offset = class_id * CLASS_STRIDE;
-
-                // 获取当前类别检测到的数量
-                int count = static_cast<int>(out[class_offset]);
-
-                // 如果这个类别没有检测到东西，直接跳过，处理下一个类别
-                if (count <= 0)
-                    continue;
-
-                // 内层循环：只读取有效数量的框
-                for (int i = 0; i < count; i++) {
-                    // 计算具体某个框的起始位置
-                    // class_offset + 1 (跳过计数器) + i * 5
-                    int box_idx = class_offset + 1 + i * BOX_DIM;
-
-                    float y_min_norm = out[box_idx + 0];
-                    float x_min_norm = out[box_idx + 1];
-                    float y_max_norm = out[box_idx + 2];
-                    float x_max_norm = out[box_idx + 3];
-                    float score = out[box_idx + 4];
-
-                    // 过滤低置信度 (Log里说阈值是0.2，这里可以再次过滤)
-                    if (score < 0.25f)
-                        continue;
-
-                    // 坐标还原 (反归一化)
-                    int x1 = (int)(x_min_norm * width);
-                    int y1 = (int)(y_min_norm * height);
-                    int x2 = (int)(x_max_norm * width);
-                    int y2 = (int)(y_max_norm * height);
-
-                    // 绘制矩形
-                    cv::rectangle(frame, cv::Point(x1, y1), cv::Point(x2, y2), cv::Scalar(0, 255, 0), 2);
-
-                    // 绘制标签
-                    // 这里可以直接用 class_id，比如 0 就是 Person
-                    std::string label = std::to_string(class_id) + " " + std::to_string(score).substr(0, 4);
-
-                    int text_y = y1 - 5;
-                    if (text_y < 20)
-                        text_y = y1 + 20;
-
-                    cv::putText(frame, label, cv::Point(x1, text_y),
-                                cv::FONT_HERSHEY_SIMPLEX, 0.6, cv::Scalar(0, 255, 0), 1);
-                }
+            // 只遍历非空类别里分数不低于阈值的框 (Log里说阈值是0.2，这里可以再次过滤)，先收集，显示时一次画完
+            overlay.clear();
+            for (const auto det : out.view(0.25f)) {
+                overlay.add_box(det);
             }
+            display.create(DISPLAY_HEIGHT, DISPLAY_WIDTH, frame.type());
+            cv::resize(frame, display, display.size());
+            overlay.render(display);
             std::cout << "画框耗时：" << (std::chrono::high_resolution_clock::now() - opencv_start) / 1ms << "ms" << std::endl;
         };
 
@@ -248,7 +211,7 @@ int main()
         read_output(output_vstreams.value()[0], status);
 
         std::cout << "推理全过程耗时：" << (std::chrono::high_resolution_clock::now() - all_start) / 1ms << "ms" << std::endl;
-        cv::imshow("frame", frame);
+        cv::imshow("frame", display);
         if (cv::waitKey(1) == 'q')
             break;
 
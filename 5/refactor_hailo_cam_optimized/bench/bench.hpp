@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <sys/resource.h>
+
+/*
+ * 离线基准测试，和摄像头程序分开编译成 refactor_hailo_cam_optimized_bench，每个领域一个源文件：
+ *   bench_nms.cpp      nms
+ *   bench_infer.cpp    sched、dispatch、track
+ *   bench_output.cpp   overlay、stream、shm
+ *   bench_queue.cpp    queue、channel、reorder、deadline
+ *   bench_runtime.cpp  frames、rt、tasks、coro
+ * 参数从子命令之后开始数，用法见 main.cpp
+ */
+
+using bench_clock = std::chrono::steady_clock;
+using micros = std::chrono::duration<double, std::micro>;
+
+/*本进程到目前为止用掉的 CPU 时间（用户态 + 内核态）*/
+inline double process_cpu_ms()
+{
+    rusage usage{};
+    ::getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e3 + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e3;
+}
+
+int bench_nms(int argc, char *argv[]);
+int bench_sched(int argc, char *argv[]);
+int bench_dispatch(int argc, char *argv[]);
+int bench_track(int argc, char *argv[]);
+int bench_overlay();
+int bench_stream(int argc, char *argv[]);
+int bench_shm(int argc, char *argv[]);
+int bench_queue(int argc, char *argv[]);
+int bench_channel(int argc, char *argv[]);
+int bench_reorder(int argc, char *argv[]);
+int bench_deadline(int argc, char *argv[]);
+int bench_frames(int argc, char *argv[]);
+int bench_rt(int argc, char *argv[]);
+int bench_tasks(int argc, char *argv[]);
+int bench_coro(int argc, char *argv[]);
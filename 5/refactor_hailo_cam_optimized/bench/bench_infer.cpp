@@ -0,0 +1,363 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "opencv2/opencv.hpp"
+
+#include "bench.hpp"
+#include "classifier.hpp"
+#include "config.hpp"
+#include "detection_stream.hpp"
+#include "detector.hpp"
+#include "dispatcher.hpp"
+#include "frame_pool.hpp"
+#include "hailo_nms.hpp"
+#include "sim_backend.hpp"
+#include "tracker.hpp"
+
+/*推理调度：sim_device 上的多模型调度、检测后端分派、跟踪器隔帧推理*/
+
+/*
+ * 用 sim_device 离线验证多模型调度：每路摄像头 30fps 提交检测帧，再把随机个数的检测框裁剪后交给二级分类
+ * 检测和分类的参数直接取 config.hpp 里的 DETECTOR_MODEL / CLASSIFIER_MODEL
+ */
+int bench_sched(int argc, char *argv[])
+{
+    int cameras = argc >= 1 ? std::atoi(argv[0]) : 2;
+    int seconds = argc >= 2 ? std::atoi(argv[1]) : 5;
+
+    sim_device device;
+    auto &detector = device.add_model({ "detector", DETECTOR_MODEL, 640, 640, nms_by_class_view<uint16_t>::FRAME_SIZE,
+                                        std::chrono::microseconds(8000), std::chrono::microseconds(1500) });
+    auto &classifier = device.add_model({ "classifier", CLASSIFIER_MODEL, 224, 224, 1000 * sizeof(float),
+                                          std::chrono::microseconds(600), std::chrono::microseconds(1500) });
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+    std::vector<std::thread> threads;
+    for (int camera = 0; camera < cameras; camera++) {
+        threads.emplace_back([&, camera] {
+            std::mt19937 rng(camera);
+            std::uniform_int_distribution<int> box_count(0, 12);
+            std::uniform_real_distribution<float> coord(0.0f, 0.8f);
+
+            cv::Mat frame(VIDEO_HEIGHT, VIDEO_WIDTH, CV_8UC3, cv::Scalar(camera, 0, 0));
+            std::vector<uint8_t> input(detector.input_frame_size(), static_cast<uint8_t>(camera));
+            std::vector<uint8_t> output(detector.output_frame_size());
+            const uint8_t *input_ptr = input.data();
+            uint8_t *output_ptr = output.data();
+            crop_classifier crops(classifier, CLASSIFIER_SOURCE_CLASSES);
+            std::vector<nms_detection> dets;
+            std::vector<crop_result> results;
+
+            auto next_frame = std::chrono::steady_clock::now();
+            while (std::chrono::steady_clock::now() < deadline) {
+                if (detector.infer_batch(std::span(&input_ptr, 1), std::span(&output_ptr, 1)) != HAILO_SUCCESS)
+                    break;
+                dets.clear();
+                for (int i = box_count(rng); i > 0; i--) {
+                    float x = coord(rng), y = coord(rng);
+                    dets.push_back({ 0, 0.9f, x, y, x + 0.1f, y + 0.2f });
+                }
+                if (crops.classify(frame, dets, results) != HAILO_SUCCESS)
+                    break;
+                next_frame += std::chrono::microseconds(33333);
+                std::this_thread::sleep_until(next_frame);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (auto model : { &detector, &classifier }) {
+        auto stats = device.stats(*model);
+        if (stats.frames == 0)
+            continue;
+        std::cout << model->name() << ": " << stats.frames << "帧, " << stats.batches << "批, 平均批大小 "
+                  << static_cast<double>(stats.frames) / stats.batches << ", 切换 " << stats.switches << "次, "
+                  << "平均延迟 " << stats.total_latency.count() / stats.frames << "us, 最大延迟 " << stats.max_latency.count() << "us" << std::endl;
+    }
+    return 0;
+}
+
+/*用固定耗时模拟检测后端；fail_after 之后的 detect() 都返回失败，模拟 NPU 中途掉线*/
+class sim_detector : public detector {
+    std::string name_;
+    std::chrono::microseconds latency_;
+    std::size_t fail_after_;
+    std::size_t frames_ = 0;
+
+public:
+    sim_detector(std::string name, std::chrono::microseconds latency, std::size_t fail_after = SIZE_MAX)
+        : name_(std::move(name)), latency_(latency), fail_after_(fail_after)
+    {
+    }
+    const std::string &name() const override
+    {
+        return name_;
+    }
+    hailo_status detect(const cv::Mat &, std::vector<nms_detection> &dets) override
+    {
+        dets.clear();
+        if (frames_++ >= fail_after_)
+            return HAILO_STREAM_ABORT;
+        std::this_thread::sleep_for(latency_);
+        return HAILO_SUCCESS;
+    }
+};
+
+/*
+ * 验证异构调度：每路摄像头 30fps 提交，NPU 12ms/帧、CPU 90ms/帧
+ * 分别跑 只有NPU / NPU+CPU / 只有CPU（VDevice 创建失败）/ NPU 中途失败 四种情况，看总吞吐和每一路是否被饿死
+ */
+int bench_dispatch(int argc, char *argv[])
+{
+    int cameras = argc >= 1 ? std::atoi(argv[0]) : 4;
+    int seconds = argc >= 2 ? std::atoi(argv[1]) : 5;
+    constexpr auto NPU_LATENCY = std::chrono::microseconds(12000);
+    constexpr auto CPU_LATENCY = std::chrono::microseconds(90000);
+
+    struct scenario {
+        const char *name;
+        bool npu;
+        bool cpu;
+        std::size_t npu_fail_after;
+    };
+    const scenario scenarios[] = {
+        { "只有NPU", true, false, SIZE_MAX },
+        { "NPU+CPU", true, true, SIZE_MAX },
+        { "只有CPU", false, true, SIZE_MAX },
+        { "NPU中途失败", true, true, 100 },
+    };
+
+    for (auto &test : scenarios) {
+        sim_detector npu("npu", NPU_LATENCY, test.npu_fail_after);
+        sim_detector cpu("cpu", CPU_LATENCY);
+        inference_dispatcher dispatcher(cameras, DISPATCH_QUEUE_DEPTH, [](dispatch_result &) {});
+        if (test.npu)
+            dispatcher.add_backend(npu, dispatch_role::primary);
+        if (test.cpu)
+            dispatcher.add_backend(cpu, dispatch_role::fallback);
+        dispatcher.start();
+
+        // 各路错开提交时间，模拟互不同步的摄像头
+        video_frame frame(cv::Mat(VIDEO_HEIGHT, VIDEO_WIDTH, CV_8UC3, cv::Scalar(0, 0, 0)));
+        auto start = std::chrono::steady_clock::now();
+        auto deadline = start + std::chrono::seconds(seconds);
+        std::vector<std::thread> threads;
+        for (int camera = 0; camera < cameras; camera++) {
+            threads.emplace_back([&, camera] {
+                auto next_frame = start + std::chrono::microseconds(33333) * camera / cameras;
+                while (next_frame < deadline) {
+                    std::this_thread::sleep_until(next_frame);
+                    if (!dispatcher.submit(camera, frame))
+                        break;
+                    next_frame += std::chrono::microseconds(33333);
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        dispatcher.stop();
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::size_t total = 0;
+        std::size_t min_completed = SIZE_MAX;
+        std::size_t max_completed = 0;
+        for (int camera = 0; camera < cameras; camera++) {
+            auto stats = dispatcher.stats(camera);
+            total += stats.completed;
+            min_completed = std::min(min_completed, stats.completed);
+            max_completed = std::max(max_completed, stats.completed);
+        }
+        std::cout << "== " << test.name << ": 总吞吐 " << total / elapsed << "fps，单路完成帧数 " << min_completed << "~" << max_completed << std::endl;
+        dispatcher.report();
+    }
+    return 0;
+}
+
+/*回放用的一帧：给跟踪器的检测结果，和用来评价的参考框（truth_ids 为空表示参考框没有身份）*/
+struct replay_frame {
+    double time_s;
+    std::vector<track_box> dets;
+    std::vector<track_box> truth;
+    std::vector<int> truth_ids;
+};
+
+/*
+ * 合成场景：30fps 下若干目标匀速运动、随机加速、偶尔急转，碰到边界反弹，陆续进出画面；
+ * 检测器 = 真值加噪声，5% 漏检，10% 低分，偶尔有误检
+ */
+static std::vector<replay_frame> synthetic_replay(int frame_count)
+{
+    struct object {
+        int id, class_id;
+        float cx, cy, vx, vy, w, h;
+        int dies;
+    };
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    std::vector<object> objects;
+    int next_id = 0;
+    auto spawn = [&](int frame) {
+        float speed = 0.002f + 0.004f * uniform(rng), angle = 6.2832f * uniform(rng);
+        objects.push_back({ next_id++, static_cast<int>(uniform(rng) * 3), 0.1f + 0.8f * uniform(rng), 0.1f + 0.8f * uniform(rng),
+                            speed * std::cos(angle), speed * std::sin(angle), 0.05f + 0.15f * uniform(rng), 0.05f + 0.15f * uniform(rng),
+                            frame + 150 + static_cast<int>(450 * uniform(rng)) });
+    };
+    for (int i = 0; i < 6; i++)
+        spawn(0);
+
+    std::vector<replay_frame> frames(frame_count);
+    for (int f = 0; f < frame_count; f++) {
+        auto &frame = frames[f];
+        frame.time_s = f / 30.0;
+        std::erase_if(objects, [f](const object &o) { return o.dies <= f; });
+        if (uniform(rng) < 0.01f)
+            spawn(f);
+        for (auto &o : objects) {
+            if (uniform(rng) < 0.01f) {
+                float speed = 0.002f + 0.004f * uniform(rng), angle = 6.2832f * uniform(rng);
+                o.vx = speed * std::cos(angle);
+                o.vy = speed * std::sin(angle);
+            }
+            o.vx += 0.0002f * normal(rng);
+            o.vy += 0.0002f * normal(rng);
+            o.cx += o.vx;
+            o.cy += o.vy;
+            if (o.cx < o.w / 2 || o.cx > 1 - o.w / 2)
+                o.vx = -o.vx;
+            if (o.cy < o.h / 2 || o.cy > 1 - o.h / 2)
+                o.vy = -o.vy;
+
+            track_box truth{ o.cx - o.w / 2, o.cy - o.h / 2, o.cx + o.w / 2, o.cy + o.h / 2, 1.0f, o.class_id };
+            frame.truth.push_back(truth);
+            frame.truth_ids.push_back(o.id);
+            if (uniform(rng) < 0.05f)
+                continue;
+            float score = uniform(rng) < 0.1f ? 0.15f + 0.35f * uniform(rng) : 0.5f + 0.45f * uniform(rng);
+            frame.dets.push_back({ truth.x1 + 0.02f * o.w * normal(rng), truth.y1 + 0.02f * o.h * normal(rng), truth.x2 + 0.02f * o.w * normal(rng),
+                                   truth.y2 + 0.02f * o.h * normal(rng), score, o.class_id });
+        }
+        if (uniform(rng) < 0.05f) {
+            float x = 0.8f * uniform(rng), y = 0.8f * uniform(rng);
+            frame.dets.push_back({ x, y, x + 0.1f, y + 0.1f, 0.3f + 0.3f * uniform(rng), static_cast<int>(uniform(rng) * 3) });
+        }
+    }
+    return frames;
+}
+
+/*DETECTION_STREAM 录下的文件（每帧都推理），取第 0 路；参考框就是每帧的高分检测，没有身份*/
+static std::vector<replay_frame> recorded_replay(const char *path, float high_score)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::vector<std::byte> data;
+    data.resize(static_cast<std::size_t>(file.seekg(0, std::ios::end).tellg()));
+    file.seekg(0).read(reinterpret_cast<char *>(data.data()), static_cast<std::streamsize>(data.size()));
+
+    std::vector<replay_frame> frames;
+    detection_record_header header{};
+    std::vector<nms_detection> dets;
+    std::span<const std::byte> rest(data);
+    while (std::size_t used = decode_detection_record(rest, header, dets)) {
+        rest = rest.subspan(used);
+        if (header.camera_id != 0)
+            continue;
+        auto &frame = frames.emplace_back();
+        frame.time_s = header.capture_time_ns / 1e9;
+        for (const auto &det : dets) {
+            track_box box{ det.x_min, det.y_min, det.x_max, det.y_max, det.score, det.class_id };
+            frame.dets.push_back(box);
+            if (det.score >= high_score)
+                frame.truth.push_back(box);
+        }
+    }
+    return frames;
+}
+
+/*
+ * 跑一遍回放：fixed_stride > 0 时固定每 fixed_stride 帧推理一次，否则按跟踪器的自适应步长
+ * 每帧把输出框和参考框按类别、IoU >= 0.5 贪心匹配，统计召回、精确率、平均 IoU 和身份切换
+ */
+static void run_replay(std::string_view name, const std::vector<replay_frame> &frames, const tracker_params &params, int fixed_stride)
+{
+    multi_tracker tracker(params);
+    std::size_t inferences = 0, truths = 0, outputs = 0, hits = 0, id_switches = 0;
+    double iou_sum = 0;
+    std::vector<std::pair<track_box, uint32_t>> shown;
+    std::vector<uint8_t> used;
+    std::vector<uint32_t> last_track(4096, 0);
+    auto start = bench_clock::now();
+    for (std::size_t f = 0; f < frames.size(); f++) {
+        const auto &frame = frames[f];
+        bool infer = fixed_stride > 0 ? f % fixed_stride == 0 : tracker.should_infer();
+        if (infer) {
+            tracker.update(frame.time_s, frame.dets);
+            inferences++;
+        }
+        shown.clear();
+        tracker.for_each_visible(frame.time_s, [&](const multi_tracker::track &t, const track_box &box) { shown.push_back({ box, t.id }); });
+
+        outputs += shown.size();
+        truths += frame.truth.size();
+        used.assign(shown.size(), 0);
+        for (std::size_t i = 0; i < frame.truth.size(); i++) {
+            float best = 0.5f;
+            std::size_t best_j = shown.size();
+            for (std::size_t j = 0; j < shown.size(); j++) {
+                float iou = track_iou(frame.truth[i], shown[j].first);
+                if (!used[j] && shown[j].first.class_id == frame.truth[i].class_id && iou >= best) {
+                    best = iou;
+                    best_j = j;
+                }
+            }
+            if (best_j == shown.size())
+                continue;
+            used[best_j] = 1;
+            hits++;
+            iou_sum += best;
+            if (!frame.truth_ids.empty()) {
+                auto &last = last_track[frame.truth_ids[i] % last_track.size()];
+                if (last != 0 && last != shown[best_j].second)
+                    id_switches++;
+                last = shown[best_j].second;
+            }
+        }
+    }
+    auto elapsed = micros(bench_clock::now() - start).count();
+    std::cout << name << ": 推理" << inferences << "/" << frames.size() << "帧（少" << static_cast<double>(frames.size()) / std::max<std::size_t>(inferences, 1)
+              << "倍），召回 " << static_cast<double>(hits) / std::max<std::size_t>(truths, 1) << "，精确率 "
+              << static_cast<double>(hits) / std::max<std::size_t>(outputs, 1) << "，平均IoU " << iou_sum / std::max<std::size_t>(hits, 1)
+              << "，身份切换" << id_switches << "次，跟踪 " << elapsed / frames.size() << "us/帧" << std::endl;
+}
+
+/*每帧推理、固定隔帧推理、自适应步长三种方式在同一段回放上比较*/
+int bench_track(int argc, char *argv[])
+{
+    tracker_params params;
+    auto frames = argc >= 1 ? recorded_replay(argv[0], params.high_score) : synthetic_replay(1800);
+    if (frames.empty()) {
+        std::cerr << "没有可回放的帧" << std::endl;
+        return -1;
+    }
+    std::cout << (argc >= 1 ? argv[0] : "合成场景") << ": " << frames.size() << "帧" << std::endl;
+
+    auto every_frame = params;
+    every_frame.max_stride = 1;
+    run_replay("每帧推理", frames, every_frame, 0);
+    run_replay("固定每3帧推理", frames, params, 3);
+    run_replay("自适应步长(最多" + std::to_string(params.max_stride) + ")", frames, params, 0);
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "bench.hpp"
+#include "config.hpp"
+#include "hailo_nms.hpp"
+
+/*检测输出解析：HAILO_NMS_BY_CLASS 缓冲区上的视图和类别过滤*/
+
+/*改造前 read_output 的写法：每帧新分配 vector，手工推算 CLASS_STRIDE 偏移*/
+static std::size_t legacy_parse(const float *frame_data, std::size_t frame_size)
+{
+    std::vector<float> out(frame_data, frame_data + frame_size / sizeof(float));
+    const int CLASS_STRIDE = 1 + (NMS_MAX_BOXES_PER_CLASS * NMS_BOX_DIM);
+    std::size_t kept = 0;
+    for (int class_id = 0; class_id < NMS_NUM_CLASSES; class_id++) {
+        int class_offset = class_id * CLASS_STRIDE;
+        int count = static_cast<int>(out[class_offset]);
+        for (int i = 0; i < count; i++) {
+            int box_idx = class_offset + 1 + i * NMS_BOX_DIM;
+            if (out[box_idx + 4] < SCORE_THRESHOLD)
+                continue;
+            kept++;
+        }
+    }
+    return kept;
+}
+
+struct nms_dump {
+    nms_dump_header header;
+    std::vector<uint8_t> payload;
+};
+
+static bool load_nms_dump(const char *path, nms_dump &dump)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "无法打开 " << path << std::endl;
+        return false;
+    }
+    file.read(reinterpret_cast<char *>(&dump.header), sizeof(dump.header));
+    if (!file || std::string_view(dump.header.magic, 4) != "HNMS") {
+        std::cerr << path << " 不是NMS输出转储" << std::endl;
+        return false;
+    }
+    auto expected_size = dump.header.element_size == sizeof(float) ? nms_by_class_view<float>::FRAME_SIZE : nms_by_class_view<uint16_t>::FRAME_SIZE;
+    if (dump.header.payload_size != expected_size) {
+        std::cerr << path << " 大小不匹配: " << dump.header.payload_size << " != " << expected_size << std::endl;
+        return false;
+    }
+    dump.payload.resize(dump.header.payload_size);
+    file.read(reinterpret_cast<char *>(dump.payload.data()), dump.payload.size());
+    return static_cast<bool>(file);
+}
+
+/*类别掩码：80 类全看 vs 只看人和车（0、2），被屏蔽的类别连计数器都不读*/
+template <typename T>
+static void bench_class_mask(const char *path, const T *out, nms_quant quant, int iterations)
+{
+    constexpr auto ALL_CLASSES = nms_class_filter<>::all(SCORE_THRESHOLD);
+    constexpr std::array<std::pair<int, float>, 2> PERSON_AND_CAR{ { { 0, SCORE_THRESHOLD }, { 2, SCORE_THRESHOLD } } };
+    constexpr auto TWO_CLASSES = nms_class_filter<>::from(PERSON_AND_CAR, SCORE_THRESHOLD);
+
+    std::size_t all_kept = 0;
+    std::size_t two_kept = 0;
+    auto start = bench_clock::now();
+    for (int i = 0; i < iterations; i++)
+        nms_by_class_view<T>(out, ALL_CLASSES, quant).for_each([&all_kept](const nms_detection &) { all_kept++; });
+    auto all_time = micros(bench_clock::now() - start) / iterations;
+
+    start = bench_clock::now();
+    for (int i = 0; i < iterations; i++)
+        nms_by_class_view<T>(out, TWO_CLASSES, quant).for_each([&two_kept](const nms_detection &) { two_kept++; });
+    auto two_time = micros(bench_clock::now() - start) / iterations;
+
+    std::cout << path << " 80类: " << all_time.count() << "us/帧, 2类: " << two_time.count() << "us/帧, "
+              << "框数 " << all_kept / iterations << "/" << two_kept / iterations << std::endl;
+}
+
+int bench_nms(int argc, char *argv[])
+{
+    constexpr int ITERATIONS = 1000;
+
+    for (int arg = 0; arg < argc; arg++) {
+        nms_dump dump;
+        if (!load_nms_dump(argv[arg], dump))
+            continue;
+
+        std::size_t float_kept = 0;
+        std::size_t lazy_kept = 0;
+        auto count_float = [&float_kept](const nms_detection &) { float_kept++; };
+        auto count_lazy = [&lazy_kept](const nms_detection &) { lazy_kept++; };
+
+        if (dump.header.element_size == sizeof(float)) {
+            auto out = reinterpret_cast<const float *>(dump.payload.data());
+            std::size_t legacy_kept = 0;
+            auto start = bench_clock::now();
+            for (int i = 0; i < ITERATIONS; i++)
+                legacy_kept += legacy_parse(out, dump.payload.size());
+            auto legacy_time = micros(bench_clock::now() - start) / ITERATIONS;
+
+            start = bench_clock::now();
+            for (int i = 0; i < ITERATIONS; i++) {
+                for (const auto det : nms_by_class_view<float>(out, SCORE_THRESHOLD))
+                    count_float(det);
+            }
+            auto view_time = micros(bench_clock::now() - start) / ITERATIONS;
+            std::cout << argv[arg] << " [FLOAT32] 每帧分配+手工循环: " << legacy_time.count() << "us/帧, "
+                      << "预分配+视图迭代: " << view_time.count() << "us/帧, "
+                      << "框数 " << legacy_kept / ITERATIONS << "/" << float_kept / ITERATIONS << std::endl;
+            bench_class_mask(argv[arg], out, {}, ITERATIONS);
+            continue;
+        }
+
+        // 量化转储：对比 "整块反量化 + float 解析"（即 FLOAT32 输出路径）和 "量化域解析 + 按需反量化"
+        auto quantized = reinterpret_cast<const uint16_t *>(dump.payload.data());
+        std::vector<float> dequantized(dump.payload.size() / sizeof(uint16_t));
+
+        auto start = bench_clock::now();
+        for (int i = 0; i < ITERATIONS; i++) {
+            dequantize_nms_by_class(quantized, dequantized.data(), dump.header.quant);
+            nms_by_class_view<float>(dequantized.data(), SCORE_THRESHOLD).for_each(count_float);
+        }
+        auto float_time = micros(bench_clock::now() - start) / ITERATIONS;
+
+        start = bench_clock::now();
+        for (int i = 0; i < ITERATIONS; i++)
+            nms_by_class_view<uint16_t>(quantized, SCORE_THRESHOLD, dump.header.quant).for_each(count_lazy);
+        auto lazy_time = micros(bench_clock::now() - start) / ITERATIONS;
+
+        std::cout << argv[arg] << " 整块反量化: " << float_time.count() << "us/帧, "
+                  << "按需反量化: " << lazy_time.count() << "us/帧, "
+                  << "框数 " << float_kept / ITERATIONS << "/" << lazy_kept / ITERATIONS << std::endl;
+        bench_class_mask(argv[arg], quantized, dump.header.quant, ITERATIONS);
+    }
+    return 0;
+}
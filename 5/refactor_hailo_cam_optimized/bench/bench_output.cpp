@@ -0,0 +1,377 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "opencv2/opencv.hpp"
+
+#include "bench.hpp"
+#include "config.hpp"
+#include "detection_stream.hpp"
+#include "hailo_nms.hpp"
+#include "overlay.hpp"
+#include "shm_ring.hpp"
+
+/*结果输出：预览画框、检测记录流、共享内存环*/
+
+/*改造前 infer.cpp 的画法：原分辨率上逐框 cv::rectangle + cv::putText，每个框拼一个 std::string，imshow 时再缩放*/
+static void legacy_overlay(cv::Mat &frame, const std::vector<nms_detection> &dets, cv::Mat &display)
+{
+    for (const auto &det : dets) {
+        int x1 = (int)(det.x_min * frame.cols);
+        int y1 = (int)(det.y_min * frame.rows);
+        int x2 = (int)(det.x_max * frame.cols);
+        int y2 = (int)(det.y_max * frame.rows);
+        cv::rectangle(frame, cv::Point(x1, y1), cv::Point(x2, y2), cv::Scalar(0, 255, 0), 2);
+        std::string label = std::to_string(det.class_id) + " " + std::to_string(det.score).substr(0, 4);
+        int text_y = y1 - 5;
+        if (text_y < 20)
+            text_y = y1 + 20;
+        cv::putText(frame, label, cv::Point(x1, text_y), cv::FONT_HERSHEY_SIMPLEX, 0.6, cv::Scalar(0, 255, 0), 1);
+    }
+    cv::resize(frame, display, cv::Size(DISPLAY_WIDTH, DISPLAY_HEIGHT));
+}
+
+/*框数从 1 到 1000，对比两种画法每帧的耗时（都包含缩放到预览分辨率）*/
+int bench_overlay()
+{
+    constexpr int ITERATIONS = 50;
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> position(0.0f, 0.9f), size(0.02f, 0.1f), score(0.25f, 1.0f);
+    std::uniform_int_distribution<int> class_id(0, NMS_NUM_CLASSES - 1);
+
+    cv::Mat source(VIDEO_HEIGHT, VIDEO_WIDTH, CV_8UC3, cv::Scalar(40, 40, 40));
+    cv::Mat frame, display;
+    overlay_renderer overlay;
+    for (int count : { 1, 10, 100, 1000 }) {
+        std::vector<nms_detection> dets;
+        for (int i = 0; i < count; i++) {
+            float x = position(rng), y = position(rng);
+            dets.push_back({ class_id(rng), score(rng), x, y, x + size(rng), y + size(rng) });
+        }
+
+        auto legacy_time = micros::zero();
+        for (int i = 0; i < ITERATIONS; i++) {
+            source.copyTo(frame);
+            auto start = bench_clock::now();
+            legacy_overlay(frame, dets, display);
+            legacy_time += bench_clock::now() - start;
+        }
+
+        auto overlay_time = micros::zero();
+        for (int i = 0; i < ITERATIONS; i++) {
+            auto start = bench_clock::now();
+            overlay.clear();
+            for (const auto &det : dets)
+                overlay.add_box(det);
+            cv::resize(source, display, cv::Size(DISPLAY_WIDTH, DISPLAY_HEIGHT));
+            overlay.render(display);
+            overlay_time += bench_clock::now() - start;
+        }
+        std::cout << count << "个框: 原分辨率 rectangle+putText " << (legacy_time / ITERATIONS).count() << "us，预览分辨率字形图集 "
+                  << (overlay_time / ITERATIONS).count() << "us" << std::endl;
+    }
+    return 0;
+}
+
+/*
+ * 多路摄像头 30fps 的检测结果经 Unix 域套接字交给下游：另一个线程当下游，逐条解码并核对内容
+ * 对比同样内容按日志文本输出的字节数
+ */
+int bench_stream(int argc, char *argv[])
+{
+    int cameras = argc >= 1 ? std::atoi(argv[0]) : 8;
+    int frames = argc >= 2 ? std::atoi(argv[1]) : 3000;
+    if (cameras < 1 || frames < 1)
+        return -1;
+
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> position(0.0f, 0.9f), size(0.02f, 0.1f), score(0.25f, 1.0f);
+    std::uniform_int_distribution<int> class_id(0, NMS_NUM_CLASSES - 1), box_count(0, 30);
+    std::vector<std::vector<nms_detection>> samples(64);
+    for (auto &dets : samples) {
+        int count = box_count(rng);
+        for (int i = 0; i < count; i++) {
+            float x = position(rng), y = position(rng);
+            dets.push_back({ class_id(rng), score(rng), x, y, x + size(rng), y + size(rng) });
+        }
+    }
+
+    std::string path = "/tmp/hailo_det_bench." + std::to_string(::getpid()) + ".sock";
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::copy(path.begin(), path.end(), addr.sun_path);
+    ::unlink(path.c_str());
+    if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || ::listen(listener, 1) != 0) {
+        std::cerr << "创建 Unix 套接字失败 " << path << std::endl;
+        return -1;
+    }
+
+    // 下游：按 record_size 切记录，逐条解码，和发送的内容比较（坐标和分数允许量化误差）
+    std::size_t received = 0, mismatched = 0;
+    std::thread consumer([&] {
+        int fd = ::accept(listener, nullptr, nullptr);
+        std::vector<std::byte> buffer(1 << 20);
+        std::size_t filled = 0;
+        detection_record_header header{};
+        std::vector<nms_detection> dets;
+        for (ssize_t n; (n = ::read(fd, buffer.data() + filled, buffer.size() - filled)) > 0;) {
+            filled += static_cast<std::size_t>(n);
+            std::size_t offset = 0;
+            while (std::size_t used = decode_detection_record(std::span(buffer).subspan(offset, filled - offset), header, dets)) {
+                const auto &expected = samples[(header.sequence * cameras + header.camera_id) % samples.size()];
+                bool same = dets.size() == expected.size();
+                for (std::size_t i = 0; same && i < dets.size(); i++) {
+                    same = dets[i].class_id == expected[i].class_id && std::abs(dets[i].score - expected[i].score) < 1e-4f &&
+                           std::abs(dets[i].x_min - expected[i].x_min) < 1e-4f && std::abs(dets[i].y_max - expected[i].y_max) < 1e-4f;
+                }
+                mismatched += same ? 0 : 1;
+                received++;
+                offset += used;
+            }
+            std::memmove(buffer.data(), buffer.data() + offset, filled - offset);
+            filled -= offset;
+        }
+        ::close(fd);
+    });
+
+    std::size_t text_bytes = 0;
+    auto encode_time = micros::zero();
+    {
+        detection_stream_writer writer("unix:" + path, DETECTION_STREAM_BATCH, std::chrono::milliseconds(DETECTION_STREAM_MAX_DELAY_MS));
+        auto captured = std::chrono::system_clock::now();
+        for (int frame = 0; frame < frames; frame++) {
+            for (int camera = 0; camera < cameras; camera++) {
+                const auto &dets = samples[(static_cast<std::size_t>(frame) * cameras + camera) % samples.size()];
+                for (const auto &det : dets) {
+                    text_bytes += (std::to_string(det.class_id) + " " + std::to_string(det.score) + " " + std::to_string(det.x_min) + " " +
+                                   std::to_string(det.y_min) + " " + std::to_string(det.x_max) + " " + std::to_string(det.y_max) + "\n")
+                                      .size();
+                }
+                auto start = bench_clock::now();
+                writer.write(static_cast<uint32_t>(camera), static_cast<uint64_t>(frame), captured, dets);
+                encode_time += bench_clock::now() - start;
+            }
+            // 等发送端的非阻塞缓冲区腾出来，相当于按帧率节流
+            if (frame % 64 == 63)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        writer.flush();
+        writer.report();
+    }
+    consumer.join();
+    ::close(listener);
+    ::unlink(path.c_str());
+
+    const std::size_t records = static_cast<std::size_t>(frames) * cameras;
+    std::cout << cameras << "路 x " << frames << "帧: 每条记录编码+批量写出 " << (encode_time / records).count() << "us，下游收到 " << received
+              << "条，内容不一致 " << mismatched << "条，同样内容的文本日志 " << text_bytes / 1024 << "KB" << std::endl;
+    return mismatched == 0 ? 0 : -1;
+}
+
+/*消费者进程的统计，经管道交回父进程*/
+struct ipc_consumer_result {
+    double mean_us;
+    double p99_us;
+    double cpu_ms;
+    std::size_t frames;
+    std::size_t lost;
+};
+
+
+/*两种方式的消费者对每帧做同样的事：解析检测记录，读每行第一个像素*/
+static int ipc_touch(const detection_record_header &header, const cv::Mat &frame)
+{
+    int sum = static_cast<int>(header.sequence);
+    for (int y = 0; y < frame.rows; y++)
+        sum += frame.ptr<uint8_t>(y)[0];
+    return sum;
+}
+
+static ipc_consumer_result ipc_summary(std::vector<double> &latencies, double cpu_ms, std::size_t lost)
+{
+    ipc_consumer_result result{ 0, 0, cpu_ms, latencies.size(), lost };
+    if (latencies.empty())
+        return result;
+    std::sort(latencies.begin(), latencies.end());
+    for (double latency : latencies)
+        result.mean_us += latency;
+    result.mean_us /= latencies.size();
+    result.p99_us = latencies[latencies.size() * 99 / 100];
+    return result;
+}
+
+static double ipc_latency_us(const detection_record_header &header)
+{
+    auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    return (now - header.capture_time_ns) / 1e3;
+}
+
+/*
+ * 把 1080p 帧和检测记录交给多个消费者进程：共享内存环（只读映射，读共享内存里的那一份）对比每个消费者一条 Unix 流套接字（整帧写给每个消费者）
+ * 报告发布到消费者拿到的延迟、生产者和消费者每帧的 CPU 时间
+ */
+int bench_shm(int argc, char *argv[])
+{
+    int consumers = argc >= 1 ? std::atoi(argv[0]) : 2;
+    int frames = argc >= 2 ? std::atoi(argv[1]) : 120;
+    int fps = argc >= 3 ? std::atoi(argv[2]) : 30;
+    if (consumers < 1 || frames < 1 || fps < 1)
+        return -1;
+
+    cv::Mat frame(VIDEO_HEIGHT, VIDEO_WIDTH, CV_8UC3, cv::Scalar(40, 80, 120));
+    const std::size_t frame_bytes = static_cast<std::size_t>(VIDEO_WIDTH) * VIDEO_HEIGHT * 3;
+    std::vector<nms_detection> dets;
+    for (int i = 0; i < 20; i++)
+        dets.push_back({ i % NMS_NUM_CLASSES, 0.5f, 0.01f * i, 0.02f * i, 0.01f * i + 0.1f, 0.02f * i + 0.1f });
+
+    // 按帧率发布 frames 帧，publish 做一次发布，返回生产者这一帧用的时间
+    auto produce = [&](auto &&publish) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200)); // 等消费者准备好
+        double cpu_start = process_cpu_ms();
+        auto next = bench_clock::now();
+        for (int i = 0; i < frames; i++) {
+            std::this_thread::sleep_until(next);
+            next += std::chrono::microseconds(1000000 / fps);
+            publish(static_cast<uint64_t>(i), std::chrono::system_clock::now());
+        }
+        return (process_cpu_ms() - cpu_start) / frames;
+    };
+
+    // 子进程把结果写进 pipe_fd 后退出
+    auto report_consumer = [](int pipe_fd, const ipc_consumer_result &result) {
+        [[maybe_unused]] auto n = ::write(pipe_fd, &result, sizeof(result));
+        ::_exit(0);
+    };
+    auto collect = [&](std::string_view name, const std::vector<int> &pipes, double producer_cpu_ms) {
+        for (int pipe_fd : pipes) {
+            ipc_consumer_result result{};
+            if (::read(pipe_fd, &result, sizeof(result)) != sizeof(result))
+                std::cerr << name << " 消费者没有返回结果" << std::endl;
+            ::close(pipe_fd);
+            std::cout << name << " 消费者: 收到" << result.frames << "帧，丢" << result.lost << "帧，延迟平均 " << result.mean_us << "us，p99 "
+                      << result.p99_us << "us，CPU " << result.cpu_ms / std::max<std::size_t>(result.frames, 1) << "ms/帧" << std::endl;
+        }
+        while (::wait(nullptr) > 0) {
+        }
+        std::cout << name << " 生产者 CPU " << producer_cpu_ms << "ms/帧" << std::endl;
+    };
+
+    // 共享内存环：memfd，子进程继承 fd 后只读映射
+    {
+        shm_ring_writer ring("", SHM_RING_SLOTS, frame_bytes);
+        if (!ring.valid())
+            return -1;
+        std::vector<int> pipes;
+        for (int c = 0; c < consumers; c++) {
+            int fds[2];
+            if (::pipe(fds) != 0)
+                return -1;
+            if (::fork() == 0) {
+                ::close(fds[0]);
+                shm_ring_reader reader(ring.fd());
+                std::vector<double> latencies;
+                std::vector<nms_detection> received;
+                detection_record_header header{};
+                double cpu_start = process_cpu_ms();
+                uint64_t next = 0;
+                shm_ring_reader::view v;
+                volatile int sink = 0;
+                while (reader.valid() && reader.acquire(next, v, std::chrono::seconds(1))) {
+                    decode_detection_record(v.record, header, received);
+                    sink = sink + ipc_touch(header, v.frame);
+                    if (reader.validate(v))
+                        latencies.push_back(ipc_latency_us(header));
+                    next = v.index + 1;
+                    if (v.index + 1 == static_cast<uint64_t>(frames))
+                        break;
+                }
+                auto stats = reader.statistics();
+                report_consumer(fds[1], ipc_summary(latencies, process_cpu_ms() - cpu_start, stats.lost + stats.torn));
+            }
+            ::close(fds[1]);
+            pipes.push_back(fds[0]);
+        }
+        double producer_cpu = produce([&](uint64_t sequence, std::chrono::system_clock::time_point captured) {
+            ring.publish(0, sequence, captured, dets, frame);
+        });
+        collect("共享内存环", pipes, producer_cpu);
+    }
+
+    // 对照：每个消费者一条 Unix 流套接字，生产者把记录和整帧写给每一个（阻塞写，慢消费者会拖住生产者）
+    {
+        std::vector<int> pipes, sockets;
+        for (int c = 0; c < consumers; c++) {
+            int fds[2], pair[2];
+            if (::pipe(fds) != 0 || ::socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0)
+                return -1;
+            if (::fork() == 0) {
+                ::close(fds[0]);
+                ::close(pair[0]);
+                for (int fd : sockets)
+                    ::close(fd);
+                auto read_all = [&](void *dst, std::size_t size) {
+                    auto *p = static_cast<uint8_t *>(dst);
+                    for (std::size_t got = 0; got < size;) {
+                        ssize_t n = ::read(pair[1], p + got, size - got);
+                        if (n <= 0)
+                            return false;
+                        got += static_cast<std::size_t>(n);
+                    }
+                    return true;
+                };
+                std::vector<std::byte> record(detection_record_size(DETECTION_RECORD_MAX_BOXES));
+                cv::Mat received_frame(VIDEO_HEIGHT, VIDEO_WIDTH, CV_8UC3);
+                std::vector<double> latencies;
+                std::vector<nms_detection> received;
+                detection_record_header header{};
+                double cpu_start = process_cpu_ms();
+                volatile int sink = 0;
+                while (read_all(record.data(), sizeof(detection_record_header))) {
+                    std::memcpy(&header, record.data(), sizeof(header));
+                    if (!read_all(record.data() + sizeof(header), header.record_size - sizeof(header)) ||
+                        !read_all(received_frame.ptr<uint8_t>(0), frame_bytes))
+                        break;
+                    decode_detection_record(std::span(record).first(header.record_size), header, received);
+                    sink = sink + ipc_touch(header, received_frame);
+                    latencies.push_back(ipc_latency_us(header));
+                }
+                report_consumer(fds[1], ipc_summary(latencies, process_cpu_ms() - cpu_start, 0));
+            }
+            ::close(fds[1]);
+            ::close(pair[1]);
+            pipes.push_back(fds[0]);
+            sockets.push_back(pair[0]);
+        }
+        std::vector<std::byte> record(detection_record_size(dets.size()));
+        double producer_cpu = produce([&](uint64_t sequence, std::chrono::system_clock::time_point captured) {
+            auto size = encode_detection_record(0, sequence, captured, dets, record.data());
+            for (int fd : sockets) {
+                ::send(fd, record.data(), size, MSG_NOSIGNAL);
+                for (std::size_t sent = 0; sent < frame_bytes;) {
+                    ssize_t n = ::send(fd, frame.ptr<uint8_t>(0) + sent, frame_bytes - sent, MSG_NOSIGNAL);
+                    if (n <= 0)
+                        break;
+                    sent += static_cast<std::size_t>(n);
+                }
+            }
+        });
+        for (int fd : sockets)
+            ::close(fd);
+        collect("Unix 套接字", pipes, producer_cpu);
+    }
+    return 0;
+}
@@ -0,0 +1,361 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "bench.hpp"
+#include "channel.hpp"
+#include "config.hpp"
+#include "frame_deadline.hpp"
+#include "frame_pool.hpp"
+#include "pipeline.hpp"
+#include "reorder_buffer.hpp"
+#include "spsc_ring.hpp"
+#include "thread_safe_queue.hpp"
+
+/*阶段之间的队列和重排：无锁环、有界通道、按序号重排、处理期限*/
+
+/*
+ * thread_safe_queue、spsc_ring 和 bounded_channel 对比，元素是 shared_ptr（和 cv::Mat 一样带引用计数，复制要原子加减）
+ * 吞吐：生产者连续 push，消费者连续 pop；交接延迟：生产者每 50us 放一个，队列基本是空的，消费者要被叫醒
+ */
+int bench_queue(int argc, char *argv[])
+{
+    const int items = argc >= 1 ? std::atoi(argv[0]) : 1000000;
+    constexpr int LATENCY_ITEMS = 20000;
+    using item = std::shared_ptr<bench_clock::time_point>;
+
+    // push(item) / pop(item&) 包一层，两种队列共用下面的测试
+    auto throughput = [items](auto &&push, auto &&pop) {
+        auto start = bench_clock::now();
+        std::thread producer([&] {
+            auto payload = std::make_shared<bench_clock::time_point>();
+            for (int i = 0; i < items; i++)
+                push(item(payload));
+        });
+        item received;
+        for (int i = 0; i < items; i++)
+            pop(received);
+        producer.join();
+        return std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / items;
+    };
+    auto latency = [](auto &&push, auto &&pop) {
+        std::thread producer([&] {
+            for (int i = 0; i < LATENCY_ITEMS; i++) {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+                push(std::make_shared<bench_clock::time_point>(bench_clock::now()));
+            }
+        });
+        std::vector<double> latencies;
+        latencies.reserve(LATENCY_ITEMS);
+        item received;
+        for (int i = 0; i < LATENCY_ITEMS; i++) {
+            pop(received);
+            latencies.push_back(micros(bench_clock::now() - *received).count());
+        }
+        producer.join();
+        std::sort(latencies.begin(), latencies.end());
+        double sum = 0;
+        for (double l : latencies)
+            sum += l;
+        return std::pair{ sum / latencies.size(), latencies[latencies.size() * 99 / 100] };
+    };
+    auto report = [](std::string_view name, double ns, std::pair<double, double> lat) {
+        std::cout << name << ": 吞吐 " << ns << "ns/个，交接延迟平均 " << lat.first << "us，p99 " << lat.second << "us" << std::endl;
+    };
+
+    {
+        thread_safe_queue<item> queue;
+        auto push = [&queue](item value) { queue.push(value); };
+        auto pop = [&queue](item &value) { queue.front_pop(value); };
+        double ns = throughput(push, pop);
+        report("thread_safe_queue", ns, latency(push, pop));
+    }
+    {
+        spsc_ring<item> ring(CAPTURE_QUEUE_DEPTH * 256);
+        auto push = [&ring](item value) { ring.push(value); };
+        auto pop = [&ring](item &value) { ring.pop(value); };
+        double ns = throughput(push, pop);
+        report("spsc_ring(" + std::to_string(ring.capacity()) + ")", ns, latency(push, pop));
+    }
+    {
+        spsc_ring<item> ring(CAPTURE_QUEUE_DEPTH);
+        auto push = [&ring](item value) { ring.push(value); };
+        auto pop = [&ring](item &value) { ring.pop(value); };
+        double ns = throughput(push, pop);
+        report("spsc_ring(" + std::to_string(ring.capacity()) + ")", ns, latency(push, pop));
+    }
+    // 没声明线程数时两端各加一把锁；声明单生产者单消费者后两端都不加锁，应该和 spsc_ring 差不多
+    for (bool declared : { false, true }) {
+        bounded_channel<item, overflow_policy::block> channel("bench", CAPTURE_QUEUE_DEPTH * 256);
+        if (declared) {
+            channel.add_producers(1);
+            channel.add_consumers(1);
+        }
+        auto push = [&channel](item value) { channel.push(value); };
+        auto pop = [&channel](item &value) { channel.pop(value); };
+        double ns = throughput(push, pop);
+        report("bounded_channel<block>(" + std::to_string(channel.capacity()) + (declared ? "，单生产者单消费者" : "，两端加锁") + ")", ns, latency(push, pop));
+    }
+    return 0;
+}
+
+/*
+ * 过载时各种策略的表现：生产者每 1ms 一帧，消费者每帧处理 2.5ms，只能消化 40%
+ * 每帧带着生产时间，统计消费者拿到时的排队延迟、丢帧和最多积压；无界的 thread_safe_queue 作对照，积压和延迟一直涨
+ */
+int bench_channel(int argc, char *argv[])
+{
+    const int frames = argc >= 1 ? std::atoi(argv[0]) : 1000;
+    constexpr auto PRODUCE_INTERVAL = std::chrono::microseconds(1000);
+    constexpr auto CONSUME_TIME = std::chrono::microseconds(2500);
+    constexpr std::size_t CAPACITY = 8;
+
+    auto summary = [frames](std::string_view name, std::vector<double> &latencies, std::size_t dropped, std::size_t high_watermark) {
+        std::sort(latencies.begin(), latencies.end());
+        double sum = 0;
+        for (double l : latencies)
+            sum += l;
+        std::cout << name << ": 处理" << latencies.size() << "/" << frames << "帧，丢弃" << dropped << "帧，最多积压" << high_watermark;
+        if (!latencies.empty())
+            std::cout << "，排队延迟平均 " << sum / latencies.size() / 1000 << "ms，p99 " << latencies[latencies.size() * 99 / 100] / 1000
+                      << "ms，最大 " << latencies.back() / 1000 << "ms";
+        std::cout << std::endl;
+    };
+
+    // 生产者按固定节奏放帧（不追赶），block 策略下被卡住的时间也算进延迟
+    auto run = [&]<overflow_policy Policy>(std::string_view name) {
+        bounded_channel<bench_clock::time_point, Policy> channel(std::string(name), CAPACITY);
+        channel.add_producers(1);
+        channel.add_consumers(1);
+        std::thread producer([&] {
+            auto next = bench_clock::now();
+            for (int i = 0; i < frames; i++) {
+                std::this_thread::sleep_until(next);
+                next += PRODUCE_INTERVAL;
+                auto stamp = bench_clock::now();
+                channel.push(stamp);
+            }
+            channel.close();
+        });
+        std::vector<double> latencies;
+        latencies.reserve(frames);
+        bench_clock::time_point stamp;
+        while (channel.pop(stamp)) {
+            latencies.push_back(micros(bench_clock::now() - stamp).count());
+            std::this_thread::sleep_for(CONSUME_TIME);
+        }
+        producer.join();
+        auto stats = channel.statistics();
+        summary(name, latencies, stats.dropped, stats.high_watermark);
+    };
+    run.template operator()<overflow_policy::block>("block");
+    run.template operator()<overflow_policy::drop_oldest>("drop_oldest");
+    run.template operator()<overflow_policy::drop_newest>("drop_newest");
+    run.template operator()<overflow_policy::sample>("sample");
+
+    {
+        thread_safe_queue<bench_clock::time_point> queue;
+        std::atomic<std::size_t> produced{ 0 };
+        std::thread producer([&] {
+            auto next = bench_clock::now();
+            for (int i = 0; i < frames; i++) {
+                std::this_thread::sleep_until(next);
+                next += PRODUCE_INTERVAL;
+                queue.push(bench_clock::now());
+                produced++;
+            }
+            // 默认构造的时间点当结束标记
+            queue.push(bench_clock::time_point{});
+        });
+        std::vector<double> latencies;
+        latencies.reserve(frames);
+        std::size_t high_watermark = 0;
+        bench_clock::time_point stamp;
+        for (;;) {
+            queue.front_pop(stamp);
+            if (stamp == bench_clock::time_point{})
+                break;
+            latencies.push_back(micros(bench_clock::now() - stamp).count());
+            // 取这一帧之前的积压 = 已经放进去的 - 之前取走的
+            high_watermark = std::max(high_watermark, produced.load() - (latencies.size() - 1));
+            std::this_thread::sleep_for(CONSUME_TIME);
+        }
+        producer.join();
+        summary("thread_safe_queue(无界)", latencies, 0, high_watermark);
+    }
+    return 0;
+}
+
+/*
+ * 两个后端并行完成时的输出顺序：帧按固定节奏到达，NPU 接三分之二、每帧固定耗时，CPU 接剩下的、耗时抖动大；
+ * 少数帧在分派时被丢掉（知道不会来，skip），极少数帧后端丢了没有任何通知（只能等超时）
+ * 对比直接按完成顺序输出（预览会时间倒退）和经过 reorder_buffer 重排（不倒退，代价是等慢帧的附加延迟）
+ */
+int bench_reorder(int argc, char *argv[])
+{
+    const int frames = argc >= 1 ? std::atoi(argv[0]) : 1000;
+    constexpr auto PERIOD = std::chrono::milliseconds(5);
+    constexpr auto NPU_TIME = std::chrono::milliseconds(4);
+    constexpr std::size_t WINDOW = 16;
+
+    struct outcome {
+        std::mutex mutex;
+        std::vector<bench_clock::time_point> completed;
+        std::vector<double> delays; // 完成到输出的附加延迟
+        std::size_t shown = 0;
+        std::size_t backwards = 0;
+        uint64_t last = 0;
+    };
+    auto record = [](outcome &o, uint64_t sequence) {
+        std::lock_guard<std::mutex> lock(o.mutex);
+        if (o.shown > 0 && sequence < o.last)
+            o.backwards++;
+        o.last = sequence;
+        o.shown++;
+        o.delays.push_back(micros(bench_clock::now() - o.completed[sequence]).count());
+    };
+
+    // 0 = 正常完成，1 = 分派时丢掉（skip），2 = 后端丢了没有通知
+    std::mt19937 rng(42);
+    std::vector<int> fate(frames);
+    std::vector<std::chrono::microseconds> cpu_time(frames);
+    for (int i = 0; i < frames; i++) {
+        auto r = rng() % 100;
+        fate[i] = r < 2 ? 1 : r < 3 ? 2 : 0;
+        cpu_time[i] = std::chrono::microseconds(6000 + rng() % 8000);
+    }
+
+    auto run = [&](std::string_view name, std::chrono::milliseconds max_wait, bool reorder) {
+        outcome o;
+        o.completed.resize(frames);
+        o.delays.reserve(frames);
+        reorder_buffer<uint64_t> buffer("等" + std::to_string(max_wait.count()) + "ms", WINDOW, max_wait, [&o, &record](uint64_t &sequence) { record(o, sequence); });
+        auto start = bench_clock::now();
+        auto backend = [&](bool npu) {
+            for (int i = 0; i < frames; i++) {
+                if ((i % 3 == 2) == npu)
+                    continue;
+                auto arrived = start + PERIOD * i;
+                std::this_thread::sleep_until(std::max(arrived, bench_clock::now()) + (npu ? std::chrono::microseconds(NPU_TIME) : cpu_time[i]));
+                if (fate[i] == 2)
+                    continue;
+                uint64_t sequence = static_cast<uint64_t>(i);
+                if (fate[i] == 1) {
+                    if (reorder)
+                        buffer.skip(sequence);
+                    continue;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(o.mutex);
+                    o.completed[i] = bench_clock::now();
+                }
+                if (reorder)
+                    buffer.push(sequence, sequence);
+                else
+                    record(o, sequence);
+            }
+        };
+        std::thread npu(backend, true);
+        std::thread cpu(backend, false);
+        npu.join();
+        cpu.join();
+        buffer.drain();
+
+        std::sort(o.delays.begin(), o.delays.end());
+        double sum = 0;
+        for (double d : o.delays)
+            sum += d;
+        std::cout << name << ": 输出" << o.shown << "/" << frames << "帧，时间倒退" << o.backwards << "次";
+        if (!o.delays.empty())
+            std::cout << "，附加延迟平均 " << sum / o.delays.size() / 1000 << "ms，p99 " << o.delays[o.delays.size() * 99 / 100] / 1000 << "ms，最大 "
+                      << o.delays.back() / 1000 << "ms";
+        std::cout << std::endl;
+        if (reorder)
+            buffer.report();
+    };
+    run("按完成顺序", std::chrono::milliseconds(0), false);
+    run("重排，缺帧等10ms", std::chrono::milliseconds(10), true);
+    run("重排，缺帧等40ms", std::chrono::milliseconds(40), true);
+    return 0;
+}
+
+/*
+ * 过载时的处理期限：采集按固定节奏出帧，推理比帧间隔慢；采集通道挤掉最旧的帧，解码和推理之间的通道满了等
+ * 对比不设期限（排在通道里的旧帧照样解码、推理）和设了期限（解码、推理之前检查，做完也赶不上的帧直接丢掉）时推理结果的端到端延迟
+ */
+int bench_deadline(int argc, char *argv[])
+{
+    const int frames = argc >= 1 ? std::atoi(argv[0]) : 300;
+    constexpr auto PERIOD = std::chrono::milliseconds(10);
+    constexpr auto DECODE_TIME = std::chrono::milliseconds(6);
+    constexpr auto INFER_TIME = std::chrono::milliseconds(14);
+    constexpr auto BUDGET = std::chrono::milliseconds(50);
+
+    auto run = [&](std::string_view name, bool deadlines) {
+        pipeline graph{ std::string(name) };
+        auto &raw = graph.make_channel<frame_info, overflow_policy::drop_oldest>("采集", 4);
+        auto &decoded = graph.make_channel<frame_info>("解码", 2);
+        deadline_gate decode_late("解码");
+        deadline_gate infer_late("推理");
+        std::vector<double> latencies;
+        latencies.reserve(frames);
+        std::size_t over_budget = 0;
+
+        uint64_t produced = 0;
+        auto next = bench_clock::now();
+        graph.add_source("采集", raw, [&](frame_info &info) {
+            if (produced == static_cast<uint64_t>(frames))
+                return false;
+            std::this_thread::sleep_until(next);
+            next += PERIOD;
+            info = { 0, produced++, std::chrono::system_clock::now(), {}, deadlines ? bench_clock::now() + BUDGET : bench_clock::time_point{} };
+            return true;
+        });
+        graph.add_stage("解码", raw, decoded, [&](frame_info &in, frame_info &out) {
+            if (decode_late.expired(in, DECODE_TIME))
+                return false;
+            std::this_thread::sleep_for(DECODE_TIME);
+            out = in;
+            return true;
+        });
+        graph.add_sink("推理", decoded, [&](frame_info &info) {
+            if (infer_late.expired(info, INFER_TIME))
+                return;
+            std::this_thread::sleep_for(INFER_TIME);
+            auto latency = std::chrono::system_clock::now() - info.captured;
+            latencies.push_back(micros(latency).count());
+            if (latency > BUDGET)
+                over_budget++;
+        });
+        graph.start();
+        graph.wait();
+
+        std::sort(latencies.begin(), latencies.end());
+        double sum = 0;
+        for (double l : latencies)
+            sum += l;
+        std::cout << name << ": 推理" << latencies.size() << "/" << frames << "帧，超出" << BUDGET.count() << "ms预算的" << over_budget << "帧";
+        if (!latencies.empty())
+            std::cout << "，端到端延迟平均 " << sum / latencies.size() / 1000 << "ms，p99 " << latencies[latencies.size() * 99 / 100] / 1000 << "ms，最大 "
+                      << latencies.back() / 1000 << "ms";
+        std::cout << std::endl;
+        if (deadlines) {
+            decode_late.report();
+            infer_late.report();
+        }
+    };
+    run("不设期限", false);
+    run("设期限", true);
+    return 0;
+}
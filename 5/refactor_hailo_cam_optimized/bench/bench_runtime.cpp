@@ -0,0 +1,446 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "opencv2/opencv.hpp"
+
+#include "bench.hpp"
+#include "capture.hpp"
+#include "channel.hpp"
+#include "coro.hpp"
+#include "config.hpp"
+#include "frame_pool.hpp"
+#include "pipeline.hpp"
+#include "thread_placement.hpp"
+#include "thread_safe_queue.hpp"
+#include "work_stealing.hpp"
+
+/*运行时：帧缓冲区池、实时调度、工作窃取执行器、协程调度器*/
+
+static long minor_faults()
+{
+    rusage usage{};
+    ::getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+/*
+ * 采集 -> 推理线程 -> 预览缩小，一帧 1080p 在两种写法下的开销：
+ * 原来的写法：每帧新 Mat 接 VideoCapture 的输出，cvtColor 原地转换，按值进 thread_safe_queue，resize 到新 Mat
+ * 帧池：VideoCapture 输出复用同一块内存，cvtColor 写进池里借的帧，帧在通道里交换，resize 到预先分配的预览图
+ * 新分配的大块内存第一次写时会缺页，每帧的缺页次数就是每帧新分配了多少像素内存（6MB 一帧约 1500 页）
+ */
+int bench_frames(int argc, char *argv[])
+{
+    const int frames = argc >= 1 ? std::atoi(argv[0]) : 300;
+    // 摄像头给的 NV12：Y 平面加交错的 UV 平面
+    cv::Mat nv12(VIDEO_HEIGHT * 3 / 2, VIDEO_WIDTH, CV_8UC1);
+    cv::randu(nv12, 0, 255);
+    const cv::Size display_size(DISPLAY_WIDTH, DISPLAY_HEIGHT);
+    volatile int sink = 0;
+
+    auto report = [frames](std::string_view name, bench_clock::duration elapsed, long faults) {
+        std::cout << name << ": 每帧 " << micros(elapsed).count() / 1000 / frames << "ms，缺页 " << static_cast<double>(faults) / frames << "次" << std::endl;
+    };
+
+    {
+        thread_safe_queue<cv::Mat> queue;
+        long faults = minor_faults();
+        auto start = bench_clock::now();
+        std::thread producer([&] {
+            for (int i = 0; i < frames; i++) {
+                cv::Mat frame;
+                nv12.copyTo(frame);
+                cv::cvtColor(frame, frame, cv::COLOR_YUV2BGR_NV12);
+                queue.push(frame);
+            }
+            queue.push(cv::Mat());
+        });
+        for (;;) {
+            cv::Mat frame;
+            queue.front_pop(frame);
+            if (frame.empty())
+                break;
+            cv::Mat display;
+            cv::resize(frame, display, display_size);
+            sink = sink + display.data[0];
+        }
+        producer.join();
+        report("原来的写法", bench_clock::now() - start, minor_faults() - faults);
+    }
+    {
+        frame_pool pool(cv::Size(VIDEO_WIDTH, VIDEO_HEIGHT), CV_8UC3, FRAME_POOL_SIZE, FRAME_POOL_HUGE_PAGES);
+        bounded_channel<video_frame, overflow_policy::block> channel("bench", CAPTURE_QUEUE_DEPTH);
+        channel.add_producers(1);
+        channel.add_consumers(1);
+        cv::Mat display(display_size, CV_8UC3);
+        // 先把池里每块缓冲区都写一遍，和运行一段时间后的稳态一样
+        {
+            std::vector<video_frame> warm;
+            for (unsigned i = 0; i < FRAME_POOL_SIZE; i++) {
+                warm.push_back(pool.acquire());
+                warm.back().mat().setTo(0);
+            }
+        }
+        long faults = minor_faults();
+        auto start = bench_clock::now();
+        std::thread producer([&] {
+            cv::Mat raw;
+            for (int i = 0; i < frames; i++) {
+                auto frame = pool.acquire(std::chrono::milliseconds(100));
+                nv12.copyTo(raw);
+                cv::cvtColor(raw, frame.mat(), cv::COLOR_YUV2BGR_NV12);
+                frame.info().sequence = i;
+                channel.push(frame);
+            }
+            channel.close();
+        });
+        video_frame frame;
+        while (channel.pop(frame)) {
+            cv::resize(frame.mat(), display, display_size);
+            sink = sink + display.data[0];
+            frame.reset();
+        }
+        producer.join();
+        report("帧池", bench_clock::now() - start, minor_faults() - faults);
+        pool.report();
+    }
+    return 0;
+}
+
+/*
+ * 线程放置对抖动的影响：一个线程按 2ms 的周期醒来（模拟采集 / 送帧），每次复制 1MB（一帧 MJPEG 码流的量级）
+ * 统计醒来延迟（实际醒来 - 计划时间）和完成延迟（计划时间到复制完）的 p50 / p99 / 最大值，完成时已经过了下一个周期算错过
+ * 压力负载：默认每个核 2 个普通优先级的线程不停地读写 8MB 缓冲区，同时抢 CPU 和内存带宽
+ * 依次测空载、压力下不设置、压力下按 CAPTURE_PLACEMENT、压力下按 NPU_FEED_PLACEMENT；实时策略没有权限时只有亲和性生效
+ */
+int bench_rt(int argc, char *argv[])
+{
+    const int seconds = argc >= 1 ? std::atoi(argv[0]) : 5;
+    const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    const unsigned stress_threads = argc >= 2 ? static_cast<unsigned>(std::atoi(argv[1])) : cores * 2;
+    constexpr auto PERIOD = std::chrono::microseconds(2000);
+    constexpr std::size_t COPY_BYTES = 1 << 20;
+    constexpr std::size_t STRESS_BYTES = 8 << 20;
+
+    std::cout << cores << "个核，压力线程" << stress_threads << "个，每种情况" << seconds << "秒" << std::endl;
+
+    auto measure = [&](std::string_view name, const thread_placement *placement, bool stress) {
+        std::atomic<bool> stop{ false };
+        std::vector<std::thread> load;
+        for (unsigned i = 0; stress && i < stress_threads; i++) {
+            load.emplace_back([&stop] {
+                std::vector<uint8_t> buffer(STRESS_BYTES);
+                uint8_t value = 0;
+                while (!stop.load(std::memory_order_relaxed)) {
+                    for (std::size_t offset = 0; offset < buffer.size(); offset += 64)
+                        buffer[offset] = static_cast<uint8_t>(buffer[offset] + value++);
+                }
+                volatile uint8_t sink = buffer[0];
+                (void)sink;
+            });
+        }
+
+        std::vector<double> wake, done;
+        std::size_t missed = 0;
+        std::thread worker([&] {
+            if (placement != nullptr)
+                apply_thread_placement("rt_bench", *placement);
+            std::vector<uint8_t> src(COPY_BYTES, 1), dst(COPY_BYTES);
+            const auto periods = static_cast<std::size_t>(std::chrono::seconds(seconds) / PERIOD);
+            wake.reserve(periods);
+            done.reserve(periods);
+            auto next = bench_clock::now() + PERIOD;
+            const auto end = next + std::chrono::seconds(seconds);
+            while (next < end) {
+                std::this_thread::sleep_until(next);
+                auto woke = bench_clock::now();
+                std::memcpy(dst.data(), src.data(), COPY_BYTES);
+                auto finished = bench_clock::now();
+                wake.push_back(micros(woke - next).count());
+                done.push_back(micros(finished - next).count());
+                // 落后了不追赶，和采集丢帧一样直接等下一个周期
+                next += PERIOD;
+                while (next < finished) {
+                    next += PERIOD;
+                    missed++;
+                }
+            }
+        });
+        worker.join();
+        stop = true;
+        for (auto &thread : load)
+            thread.join();
+
+        auto line = [](std::vector<double> &latencies) {
+            std::sort(latencies.begin(), latencies.end());
+            if (latencies.empty())
+                return std::string("-");
+            auto ms = [](double us) { return std::to_string(us / 1000).substr(0, 6); };
+            return "p50 " + ms(latencies[latencies.size() / 2]) + "ms，p99 " + ms(latencies[latencies.size() * 99 / 100]) + "ms，最大 " + ms(latencies.back()) + "ms";
+        };
+        std::cout << name << (placement != nullptr ? "（" + describe(*placement) + "）" : std::string()) << ": " << wake.size() << "个周期，错过" << missed << "个" << std::endl;
+        std::cout << "  醒来延迟 " << line(wake) << std::endl;
+        std::cout << "  完成延迟 " << line(done) << std::endl;
+    };
+    measure("空载", nullptr, false);
+    measure("压力，不设置", nullptr, true);
+    measure("压力，采集", &CAPTURE_PLACEMENT, true);
+    measure("压力，NPU送帧", &NPU_FEED_PLACEMENT, true);
+    return 0;
+}
+
+/*
+ * 工作窃取执行器：
+ * 1. fork-join 本身的开销：一批 EXECUTOR_THREADS x 4 个空任务，对比每个任务开一个 std::thread 再 join
+ * 2. 解码阶段的 NV12 -> BGR（capture_source::convert，1080p）：OpenCV 单线程、OpenCV 自己的线程池、执行器按 CONVERT_TILES 分块
+ */
+int bench_tasks(int argc, char *argv[])
+{
+    const int frames = argc >= 1 ? std::atoi(argv[0]) : 200;
+    const unsigned workers = std::max(EXECUTOR_THREADS, 1u);
+    std::cout << std::thread::hardware_concurrency() << "个核，执行器" << workers << "个工作线程" << std::endl;
+
+    {
+        constexpr int BATCHES = 2000;
+        const std::size_t count = workers * 4;
+        std::atomic<std::size_t> sink{ 0 };
+        task_executor executor("bench", workers, EXECUTOR_PLACEMENT);
+        auto start = bench_clock::now();
+        for (int b = 0; b < BATCHES; b++)
+            executor.parallel_for(count, [&](std::size_t i) { sink.fetch_add(i, std::memory_order_relaxed); });
+        auto pooled = micros(bench_clock::now() - start).count() / BATCHES;
+
+        start = bench_clock::now();
+        for (int b = 0; b < BATCHES / 10; b++) {
+            std::vector<std::thread> threads;
+            for (std::size_t i = 0; i < count; i++)
+                threads.emplace_back([&sink, i] { sink.fetch_add(i, std::memory_order_relaxed); });
+            for (auto &thread : threads)
+                thread.join();
+        }
+        auto spawned = micros(bench_clock::now() - start).count() / (BATCHES / 10);
+        std::cout << count << "个空任务一批: 执行器 " << pooled << "us，每个任务开线程 " << spawned << "us" << std::endl;
+        executor.report();
+    }
+
+    if (FROM_FILE || USE_V4L2) {
+        std::cout << "FROM_FILE / USE_V4L2 时解码阶段不做 NV12 转换，跳过" << std::endl;
+        return 0;
+    }
+    frame_pool raw_pool(cv::Size(VIDEO_WIDTH, VIDEO_HEIGHT * 3 / 2), CV_8UC1, 4);
+    frame_pool frames_pool(cv::Size(VIDEO_WIDTH, VIDEO_HEIGHT), CV_8UC3, 4);
+    const int default_threads = cv::getNumThreads();
+    auto convert = [&](std::string_view name, task_executor *executor, int opencv_threads) {
+        cv::setNumThreads(opencv_threads);
+        capture_source source(raw_pool, frames_pool, executor);
+        video_frame raw, frame;
+        bench_clock::duration elapsed{};
+        for (int i = 0; i < frames; i++) {
+            raw = raw_pool.acquire();
+            cv::randu(raw.mat(), 0, 255);
+            auto start = bench_clock::now();
+            source.convert(raw, frame);
+            elapsed += bench_clock::now() - start;
+            frame.reset();
+        }
+        std::cout << name << ": 每帧 " << micros(elapsed).count() / 1000 / frames << "ms" << std::endl;
+    };
+    convert("OpenCV 单线程", nullptr, 0);
+    convert("OpenCV 线程池", nullptr, default_threads);
+    {
+        task_executor executor("bench", workers, EXECUTOR_PLACEMENT);
+        convert("执行器分块", &executor, 0);
+        executor.report();
+    }
+    cv::setNumThreads(default_threads);
+    return 0;
+}
+
+/*按绝对时间每 period 触发一次的 timerfd，当作一路摄像头：可读就是来了一帧，读出来的是这期间到了几帧*/
+static int open_fake_camera(bench_clock::time_point start, std::chrono::nanoseconds period, bool nonblocking)
+{
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | (nonblocking ? TFD_NONBLOCK : 0));
+    auto first = std::chrono::duration_cast<std::chrono::nanoseconds>((start + period).time_since_epoch()).count();
+    itimerspec spec{};
+    spec.it_interval = { static_cast<time_t>(period.count() / 1000000000), static_cast<long>(period.count() % 1000000000) };
+    spec.it_value = { static_cast<time_t>(first / 1000000000), static_cast<long>(first % 1000000000) };
+    timerfd_settime(fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+    return fd;
+}
+
+static long context_switches()
+{
+    rusage usage{};
+    ::getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+static int thread_count()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("Threads:", 0) == 0)
+            return std::atoi(line.c_str() + 8);
+    }
+    return 0;
+}
+
+/*
+ * 多路摄像头：每路 30fps（timerfd 模拟 V4L2 的 poll 就绪），采集 -> 解码（忙等 1ms）-> 汇总到一个结果通道 -> 一个消费者
+ * 每个阶段一个线程（pipeline.hpp，每路 2 个线程）对比几个线程上的协程（coro.hpp，等 fd 和通道时不占线程）
+ * 统计线程数、上下文切换次数、CPU 时间，和从帧到达（timerfd 的触发时间）到消费者拿到的延迟
+ */
+int bench_coro(int argc, char *argv[])
+{
+    const int cameras = argc >= 1 ? std::atoi(argv[0]) : 8;
+    const int seconds = argc >= 2 ? std::atoi(argv[1]) : 5;
+    const unsigned coro_threads = argc >= 3 ? static_cast<unsigned>(std::atoi(argv[2])) : 2;
+    static constexpr auto PERIOD = std::chrono::nanoseconds(1000000000 / 30);
+    static constexpr auto DECODE_TIME = std::chrono::microseconds(1000);
+
+    struct fake_frame {
+        int camera = 0;
+        bench_clock::time_point arrived; // 最新一帧的 timerfd 触发时间
+    };
+    auto decode = [](fake_frame &) {
+        auto until = bench_clock::now() + DECODE_TIME;
+        while (bench_clock::now() < until) {
+        }
+    };
+    // 读出到了几帧，推算最新一帧的到达时间
+    auto grab = [](int fd, bench_clock::time_point start, uint64_t &frames, fake_frame &frame) {
+        uint64_t ticks = 0;
+        if (::read(fd, &ticks, sizeof(ticks)) != sizeof(ticks))
+            return false;
+        frames += ticks;
+        frame.arrived = start + PERIOD * static_cast<int64_t>(frames);
+        return true;
+    };
+
+    struct run_result {
+        int threads;
+        long switches;
+        double cpu_ms;
+        std::vector<double> latencies;
+    };
+    auto summary = [&](std::string_view name, run_result &result) {
+        std::sort(result.latencies.begin(), result.latencies.end());
+        const auto expected = static_cast<double>(cameras) * seconds * 30;
+        std::cout << name << ": 线程" << result.threads << "个，上下文切换" << result.switches << "次（每帧" << result.switches / expected << "），CPU "
+                  << result.cpu_ms / seconds << "ms/s，收到" << result.latencies.size() << "/" << static_cast<long>(expected) << "帧";
+        if (!result.latencies.empty())
+            std::cout << "，延迟 p50 " << result.latencies[result.latencies.size() / 2] / 1000 << "ms，p99 "
+                      << result.latencies[result.latencies.size() * 99 / 100] / 1000 << "ms";
+        std::cout << std::endl;
+    };
+
+    std::cout << cameras << "路摄像头，每路 30fps，解码 1ms/帧，每种跑" << seconds << "秒" << std::endl;
+
+    {
+        run_result result{};
+        result.latencies.reserve(static_cast<std::size_t>(cameras) * seconds * 30);
+        const auto start = bench_clock::now();
+        std::vector<int> fds;
+        std::vector<uint64_t> frames(cameras, 0);
+        pipeline graph("每阶段一个线程");
+        auto &results = graph.make_channel<fake_frame, overflow_policy::drop_oldest>("结果", 8);
+        for (int cam = 0; cam < cameras; cam++) {
+            fds.push_back(open_fake_camera(start, PERIOD, false));
+            auto &raw = graph.make_channel<fake_frame, overflow_policy::drop_oldest>("采集" + std::to_string(cam), 2);
+            graph.add_source("采集" + std::to_string(cam), raw, [&, cam](fake_frame &frame) {
+                frame.camera = cam;
+                return grab(fds[cam], start, frames[cam], frame);
+            });
+            graph.add_stage("解码" + std::to_string(cam), raw, results, [&](fake_frame &in, fake_frame &out) {
+                decode(in);
+                out = in;
+                return true;
+            });
+        }
+        graph.add_sink("消费", results, [&](fake_frame &frame) { result.latencies.push_back(micros(bench_clock::now() - frame.arrived).count()); });
+
+        const long switches = context_switches();
+        const double cpu = process_cpu_ms();
+        graph.start();
+        std::this_thread::sleep_until(start + std::chrono::seconds(seconds));
+        result.threads = thread_count();
+        result.switches = context_switches() - switches;
+        result.cpu_ms = process_cpu_ms() - cpu;
+        // 采集线程阻塞在 read 上，下一帧到了才能看到停止请求
+        graph.stop();
+        for (int fd : fds)
+            ::close(fd);
+        summary("每阶段一个线程", result);
+    }
+
+    {
+        run_result result{};
+        result.latencies.reserve(static_cast<std::size_t>(cameras) * seconds * 30);
+        coro_scheduler scheduler("coro", coro_threads);
+        const auto start = bench_clock::now();
+        const auto end = start + std::chrono::seconds(seconds);
+        std::vector<int> fds;
+        std::vector<uint64_t> frames(cameras, 0);
+        std::deque<bounded_channel<fake_frame, overflow_policy::drop_oldest> > raw_channels;
+        bounded_channel<fake_frame, overflow_policy::drop_oldest> results("结果", 8);
+        std::atomic<int> decoders{ cameras };
+
+        const long switches = context_switches();
+        const double cpu = process_cpu_ms();
+        for (int cam = 0; cam < cameras; cam++) {
+            fds.push_back(open_fake_camera(start, PERIOD, true));
+            auto &raw = raw_channels.emplace_back("采集" + std::to_string(cam), 2);
+            scheduler.spawn([](coro_scheduler &scheduler, auto &grab, int fd, int cam, bench_clock::time_point start, bench_clock::time_point end, uint64_t &frames,
+                               bounded_channel<fake_frame, overflow_policy::drop_oldest> &out) -> task<> {
+                fake_frame frame;
+                frame.camera = cam;
+                while (bench_clock::now() < end) {
+                    if (co_await scheduler.readable(fd, std::chrono::milliseconds(100)) && grab(fd, start, frames, frame))
+                        out.push(frame);
+                }
+                out.close();
+            }(scheduler, grab, fds[cam], cam, start, end, frames[cam], raw));
+            scheduler.spawn([](coro_scheduler &scheduler, auto &decode, bounded_channel<fake_frame, overflow_policy::drop_oldest> &in,
+                               bounded_channel<fake_frame, overflow_policy::drop_oldest> &out, std::atomic<int> &decoders) -> task<> {
+                fake_frame frame;
+                while (co_await async_pop(scheduler, in, frame)) {
+                    decode(frame);
+                    out.push(frame);
+                }
+                if (decoders.fetch_sub(1) == 1)
+                    out.close();
+            }(scheduler, decode, raw, results, decoders));
+        }
+        scheduler.spawn([](coro_scheduler &scheduler, bounded_channel<fake_frame, overflow_policy::drop_oldest> &in, std::vector<double> &latencies) -> task<> {
+            fake_frame frame;
+            while (co_await async_pop(scheduler, in, frame))
+                latencies.push_back(micros(bench_clock::now() - frame.arrived).count());
+        }(scheduler, results, result.latencies));
+
+        std::this_thread::sleep_until(end);
+        result.threads = thread_count();
+        result.switches = context_switches() - switches;
+        result.cpu_ms = process_cpu_ms() - cpu;
+        scheduler.wait_idle();
+        for (int fd : fds) {
+            scheduler.forget(fd);
+            ::close(fd);
+        }
+        summary("协程，" + std::to_string(coro_threads) + "个线程", result);
+        scheduler.report();
+    }
+    return 0;
+}
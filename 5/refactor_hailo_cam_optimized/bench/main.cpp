@@ -0,0 +1,64 @@
+#include <iostream>
+#include <string_view>
+
+#include "bench.hpp"
+
+/*
+ * 离线基准测试，用法：
+ *   refactor_hailo_cam_optimized_bench nms <out_0.bin> [out_1.bin ...]
+ *   refactor_hailo_cam_optimized_bench sched [摄像头数=2] [秒数=5]
+ *   refactor_hailo_cam_optimized_bench dispatch [摄像头数=4] [秒数=5]
+ *   refactor_hailo_cam_optimized_bench overlay
+ *   refactor_hailo_cam_optimized_bench stream [摄像头数=8] [帧数=3000]
+ *   refactor_hailo_cam_optimized_bench shm [消费者数=2] [帧数=120] [帧率=30]
+ *   refactor_hailo_cam_optimized_bench track [DETECTION_STREAM 录下的记录文件]
+ *   refactor_hailo_cam_optimized_bench queue [元素数=1000000]
+ *   refactor_hailo_cam_optimized_bench channel [帧数=1000]
+ *   refactor_hailo_cam_optimized_bench frames [帧数=300]
+ *   refactor_hailo_cam_optimized_bench rt [秒数=5] [压力线程数=核数x2]
+ *   refactor_hailo_cam_optimized_bench tasks [帧数=200]
+ *   refactor_hailo_cam_optimized_bench coro [摄像头数=8] [秒数=5] [协程线程数=2]
+ *   refactor_hailo_cam_optimized_bench reorder [帧数=1000]
+ *   refactor_hailo_cam_optimized_bench deadline [帧数=300]
+ * 转储文件由 infer.cpp 在 OUTPUT_DUMP_DIR 非空时写出
+ */
+
+int main(int argc, char *argv[])
+{
+    // 跳过程序名，argv[0] 是子命令
+    argc--;
+    argv++;
+    if (argc >= 1 && std::string_view(argv[0]) == "nms")
+        return bench_nms(argc - 1, argv + 1);
+    if (argc >= 1 && std::string_view(argv[0]) == "sched")
+        return bench_sched(argc - 1, argv + 1);
+    if (argc >= 1 && std::string_view(argv[0]) == "dispatch")
+        return bench_dispatch(argc - 1, argv + 1);
+    if (argc >= 1 && std::string_view(argv[0]) == "overlay")
+        return bench_overlay();
+    if (argc >= 1 && std::string_view(argv[0]) == "stream")
+        return bench_stream(argc - 1, argv + 1);
+    if (argc >= 1 && std::string_view(argv[0]) == "shm")
+        return bench_shm(argc - 1, argv + 1);
+    if (argc >= 1 && std::string_view(argv[0]) == "track")
+        return bench_track(argc - 1, argv + 1);
+    if (argc >= 1 && std::string_view(argv[0]) == "queue")
+        return bench_queue(argc - 1, argv + 1);
+    if (argc >= 1 && std::string_view(argv[0]) == "channel")
+        return bench_channel(argc - 1, argv + 1);
+    if (argc >= 1 && std::string_view(argv[0]) == "frames")
+        return bench_frames(argc - 1, argv + 1);
+    if (argc >= 1 && std::string_view(argv[0]) == "rt")
+        return bench_rt(argc - 1, argv + 1);
+    if (argc >= 1 && std::string_view(argv[0]) == "tasks")
+        return bench_tasks(argc - 1, argv + 1);
+    if (argc >= 1 && std::string_view(argv[0]) == "coro")
+        return bench_coro(argc - 1, argv + 1);
+    if (argc >= 1 && std::string_view(argv[0]) == "reorder")
+        return bench_reorder(argc - 1, argv + 1);
+    if (argc >= 1 && std::string_view(argv[0]) == "deadline")
+        return bench_deadline(argc - 1, argv + 1);
+
+    std::cerr << "用法: refactor_hailo_cam_optimized_bench nms <转储文件...> | sched [摄像头数] [秒数] | dispatch [摄像头数] [秒数] | overlay | stream [摄像头数] [帧数] | shm [消费者数] [帧数] [帧率] | track [记录文件] | queue [元素数] | channel [帧数] | frames [帧数] | rt [秒数] [压力线程数] | tasks [帧数] | coro [摄像头数] [秒数] [协程线程数] | reorder [帧数] | deadline [帧数]" << std::endl;
+    return 1;
+}
@@ -1,194 +1,323 @@
-#include "thread_safe_queue.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <iostream>
 #include "opencv2/opencv.hpp"
 
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <linux/videodev2.h>
 
+#include "capture.hpp"
 #include "config.hpp"
 
-extern thread_safe_queue<cv::Mat> g_capture_queue;
+using namespace std::chrono_literals;
 
-extern std::atomic<bool> g_stop_requested;
-extern std::atomic<bool> g_v4l2_requeue;
+capture_source::capture_source(frame_pool &raw_pool, frame_pool &frames, task_executor *executor)
+    : raw_pool_(raw_pool), frame_pool_(frames), executor_(executor)
+{
+}
 
-using namespace std::chrono_literals;
+/*rows 行按 CONVERT_TILES 切成横条交给执行器，fn(begin, end) 转换一条；条的起始行是 align 的倍数（NV12 两行 Y 共用一行 UV）*/
+template <typename F>
+static void for_each_band(task_executor *executor, int rows, int align, F &&fn)
+{
+    const int bands = std::max(static_cast<int>(CONVERT_TILES), 1);
+    const int band_rows = ((rows + bands - 1) / bands + align - 1) / align * align;
+    const int count = (rows + band_rows - 1) / band_rows;
+    parallel_for(executor, static_cast<std::size_t>(count), [&](std::size_t band) {
+        const int begin = static_cast<int>(band) * band_rows;
+        fn(begin, std::min(rows, begin + band_rows));
+    });
+}
+
+/*帧的处理期限从取到帧的时刻开始算，FRAME_BUDGET_MS 为 0 时不设期限*/
+static std::chrono::steady_clock::time_point frame_deadline()
+{
+    if (FRAME_BUDGET_MS <= 0)
+        return {};
+    return std::chrono::steady_clock::now() + std::chrono::milliseconds(FRAME_BUDGET_MS);
+}
 
-struct buffer {
-    void *start;
-    size_t length;
-};
+capture_source::~capture_source()
+{
+    close_v4l2();
+    cap_.release();
+}
 
-void capture_thread()
+bool capture_source::open()
 {
-    if (USE_V4L2) {
-        int fd = open(VIDEO_DEVICE, O_RDWR);
-        if (fd < 0) {
-            perror("open");
-            exit(-1);
-        }
+    if (USE_V4L2)
+        return open_v4l2();
 
-        // -------------------------------
-        // 查询设备能力
-        struct v4l2_capability cap;
-        if (ioctl(fd, VIDIOC_QUERYCAP, &cap) < 0) {
-            perror("VIDIOC_QUERYCAP");
-            exit(-1);
-        }
-        printf("Driver: %s\n", cap.driver);
+    if constexpr (FROM_FILE) {
+        cap_ = cv::VideoCapture(VIDEO_PATH);
+    } else {
+        // cap_ = cv::VideoCapture(VIDEO_DEVICE);
+        // 读超时让 grab 能定期检查停止请求，不会一直阻塞在 appsink 上
+        cap_ = cv::VideoCapture("libcamerasrc ! video/x-raw,width=1920,height=1080,framerate=30/1,format=NV12 "
+                                "! appsink max-buffers=1 drop=true sync=false",
+                                cv::CAP_GSTREAMER, { cv::CAP_PROP_READ_TIMEOUT_MSEC, CAPTURE_READ_TIMEOUT_MS });
+        // cap_.set(cv::CAP_PROP_FRAME_WIDTH, 1920);
+        // cap_.set(cv::CAP_PROP_FRAME_HEIGHT, 1080);
+        // cap_.set(cv::CAP_PROP_FPS, 30);
+        // cap_.set(cv::CAP_PROP_BUFFERSIZE, 10);
+    }
+    if (!cap_.isOpened()) {
+        std::cerr << "Failed to open camera " << std::endl;
+        return false;
+    }
+    return true;
+}
 
-        // -------------------------------
-        // 设置视频格式
-        struct v4l2_format fmt {};
-
-        fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        fmt.fmt.pix.width = 1920;
-        fmt.fmt.pix.height = 1080;
-        fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_MJPEG; // 常用格式
-        fmt.fmt.pix.field = V4L2_FIELD_INTERLACED;
-
-        if (ioctl(fd, VIDIOC_S_FMT, &fmt) < 0) {
-            perror("VIDIOC_S_FMT");
-            exit(-1);
-        }
+bool capture_source::open_v4l2()
+{
+    // 非阻塞打开：等帧用 poll，和唤醒用的 eventfd 一起等，停止时不会卡在 DQBUF 里
+    fd_ = ::open(VIDEO_DEVICE, O_RDWR | O_NONBLOCK);
+    if (fd_ < 0) {
+        perror("open");
+        return false;
+    }
+    wake_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+        perror("eventfd");
+        return false;
+    }
 
-        // -------------------------------
-        // 请求缓冲区（mmap）
-        struct v4l2_requestbuffers req {};
+    // -------------------------------
+    // 查询设备能力
+    struct v4l2_capability cap;
+    if (ioctl(fd_, VIDIOC_QUERYCAP, &cap) < 0) {
+        perror("VIDIOC_QUERYCAP");
+        return false;
+    }
+    printf("Driver: %s\n", cap.driver);
 
-        req.count = 4;
-        req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        req.memory = V4L2_MEMORY_MMAP;
+    // -------------------------------
+    // 设置视频格式
+    struct v4l2_format fmt {};
 
-        if (ioctl(fd, VIDIOC_REQBUFS, &req) < 0) {
-            perror("VIDIOC_REQBUFS");
-            exit(-1);
-        }
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    fmt.fmt.pix.width = 1920;
+    fmt.fmt.pix.height = 1080;
+    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_MJPEG; // 常用格式
+    fmt.fmt.pix.field = V4L2_FIELD_INTERLACED;
 
-        auto buffers = new struct buffer[req.count];
+    if (ioctl(fd_, VIDIOC_S_FMT, &fmt) < 0) {
+        perror("VIDIOC_S_FMT");
+        return false;
+    }
 
-        // mmap 每个 buffer
-        for (size_t i = 0; i < req.count; i++) {
-            struct v4l2_buffer buf {};
+    // -------------------------------
+    // 请求缓冲区（mmap）
+    struct v4l2_requestbuffers req {};
 
-            buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-            buf.memory = V4L2_MEMORY_MMAP;
-            buf.index = i;
+    req.count = 4;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
 
-            if (ioctl(fd, VIDIOC_QUERYBUF, &buf) < 0) {
-                perror("VIDIOC_QUERYBUF");
-                exit(-1);
-            }
+    if (ioctl(fd_, VIDIOC_REQBUFS, &req) < 0) {
+        perror("VIDIOC_REQBUFS");
+        return false;
+    }
 
-            buffers[i].length = buf.length;
-            buffers[i].start = mmap(NULL, buf.length,
-                                    PROT_READ | PROT_WRITE,
-                                    MAP_SHARED,
-                                    fd, buf.m.offset);
+    // mmap 每个 buffer
+    for (size_t i = 0; i < req.count; i++) {
+        struct v4l2_buffer buf {};
 
-            if (buffers[i].start == MAP_FAILED) {
-                perror("mmap");
-                exit(-1);
-            }
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
 
-            // 将 buffer 放入队列
-            if (ioctl(fd, VIDIOC_QBUF, &buf) < 0) {
-                perror("VIDIOC_QBUF");
-                exit(-1);
-            }
+        if (ioctl(fd_, VIDIOC_QUERYBUF, &buf) < 0) {
+            perror("VIDIOC_QUERYBUF");
+            return false;
         }
 
-        // -------------------------------
-        // 开始流
-        enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        if (ioctl(fd, VIDIOC_STREAMON, &type) < 0) {
-            perror("VIDIOC_STREAMON");
-            exit(-1);
+        void *start = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, buf.m.offset);
+        if (start == MAP_FAILED) {
+            perror("mmap");
+            return false;
         }
+        buffers_.push_back({ start, buf.length });
 
-        printf("=== Start capturing ===\n");
+        // 将 buffer 放入队列
+        if (ioctl(fd_, VIDIOC_QBUF, &buf) < 0) {
+            perror("VIDIOC_QBUF");
+            return false;
+        }
+    }
 
-        // -------------------------------
-        // 主循环
-        while (!g_stop_requested) {
-            struct v4l2_buffer buf {};
+    // -------------------------------
+    // 开始流
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (ioctl(fd_, VIDIOC_STREAMON, &type) < 0) {
+        perror("VIDIOC_STREAMON");
+        return false;
+    }
+    streaming_ = true;
 
-            buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-            buf.memory = V4L2_MEMORY_MMAP;
-
-            // 取出一个 buffer
-            auto cap_start = std::chrono::system_clock::now();
-            if (ioctl(fd, VIDIOC_DQBUF, &buf) < 0) {
-                perror("VIDIOC_DQBUF");
-                exit(-1);
-            }
-            auto cap_time = std::chrono::system_clock::now();
-
-            cv::Mat frame(1, buffers[buf.index].length, CV_8UC1, buffers[buf.index].start);
-            frame = cv::imdecode(frame, cv::IMREAD_COLOR);
-            cv::cvtColor(frame, frame, cv::COLOR_BGR2RGB);
-            g_capture_queue.push(frame);
-            std::cout << "从V4L2设备取帧耗时" << (cap_time - cap_start) / 1ms << "ms" << "\n";
-            g_v4l2_requeue.store(false);
-            g_v4l2_requeue.wait(false);
-            // 放回队列
-            if (ioctl(fd, VIDIOC_QBUF, &buf) < 0) {
-                perror("VIDIOC_QBUF");
-                exit(-1);
-            }
-        }
+    printf("=== Start capturing ===\n");
+    return true;
+}
 
+void capture_source::close_v4l2()
+{
+    if (streaming_) {
         // -------------------------------
         // 停止流
-        if (ioctl(fd, VIDIOC_STREAMOFF, &type) < 0) {
+        enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        if (ioctl(fd_, VIDIOC_STREAMOFF, &type) < 0)
             perror("VIDIOC_STREAMOFF");
-            exit(-1);
-        }
+        streaming_ = false;
+    }
+    // 释放缓冲区
+    for (auto &buffer : buffers_)
+        munmap(buffer.start, buffer.length);
+    buffers_.clear();
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    if (wake_fd_ >= 0) {
+        ::close(wake_fd_);
+        wake_fd_ = -1;
+    }
+}
 
-        // 释放缓冲区
-        for (size_t i = 0; i < req.count; i++) {
-            munmap(buffers[i].start, buffers[i].length);
+bool capture_source::grab(video_frame &raw, std::stop_token stop)
+{
+    if (USE_V4L2) {
+        struct v4l2_buffer buf {};
+
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+
+        // 等设备出帧；停止请求在发起停止的线程里写 eventfd，把这里的 poll 唤醒（已经停止时注册就立即执行）
+        std::stop_callback wake(stop, [this] {
+            uint64_t one = 1;
+            if (::write(wake_fd_, &one, sizeof(one)) < 0)
+                perror("eventfd write");
+        });
+        auto cap_start = std::chrono::system_clock::now();
+        while (true) {
+            pollfd fds[2] = { { fd_, POLLIN, 0 }, { wake_fd_, POLLIN, 0 } };
+            int ready = ::poll(fds, 2, CAPTURE_TIMEOUT_MS);
+            if (stop.stop_requested())
+                return false;
+            if (ready < 0 && errno == EINTR)
+                continue;
+            if (ready < 0) {
+                perror("poll");
+                return false;
+            }
+            if (ready == 0) {
+                std::cerr << "V4L2设备" << CAPTURE_TIMEOUT_MS << "ms没有出帧，当作设备出错" << std::endl;
+                return false;
+            }
+            // 取出一个 buffer；非阻塞，poll 之后偶尔还没有可取的 buffer 时接着等
+            if (ioctl(fd_, VIDIOC_DQBUF, &buf) == 0)
+                break;
+            if (errno != EAGAIN) {
+                perror("VIDIOC_DQBUF");
+                return false;
+            }
+        }
+        auto cap_time = std::chrono::system_clock::now();
+
+        // JPEG 码流复制进池里的缓冲区后马上放回队列，解码在解码阶段做，不再占着驱动的缓冲区
+        raw = raw_pool_.acquire();
+        cv::Mat jpeg(1, static_cast<int>(buf.bytesused), CV_8UC1, buffers_[buf.index].start);
+        if (buf.bytesused <= raw.mat().total() * raw.mat().elemSize())
+            raw.mat() = cv::Mat(1, static_cast<int>(buf.bytesused), CV_8UC1, raw.mat().data);
+        jpeg.copyTo(raw.mat());
+        raw.info() = { 0, sequence_++, cap_time, {}, frame_deadline() };
+
+        // 放回队列
+        if (ioctl(fd_, VIDIOC_QBUF, &buf) < 0) {
+            perror("VIDIOC_QBUF");
+            return false;
         }
-        free(buffers);
-        close(fd);
+        std::cout << "从V4L2设备取帧耗时" << (cap_time - cap_start) / 1ms << "ms" << "\n";
+        return true;
+    }
 
+    if constexpr (FROM_FILE) {
+        // 文件解码出来已经是 BGR，尺寸和池一致时直接写进帧池借的帧，convert 只是交换
+        raw = frame_pool_.acquire();
+        cap_ >> raw.mat();
+        if (raw.empty()) {
+            std::cout << "End of video file" << std::endl;
+            return false;
+        }
     } else {
-        cv::VideoCapture cap{};
-
-        if constexpr (FROM_FILE) {
-            cap = cv::VideoCapture(VIDEO_PATH);
-        } else {
-            // cap = cv::VideoCapture(VIDEO_DEVICE);
-            cap = cv::VideoCapture("libcamerasrc ! video/x-raw,width=1920,height=1080,framerate=30/1,format=NV12 "
-                                   "! appsink max-buffers=1 drop=true sync=false",
-                                   cv::CAP_GSTREAMER);
-            // cap.set(cv::CAP_PROP_FRAME_WIDTH, 1920);
-            // cap.set(cv::CAP_PROP_FRAME_HEIGHT, 1080);
-            // cap.set(cv::CAP_PROP_FPS, 30);
-            // cap.set(cv::CAP_PROP_BUFFERSIZE, 10);
+        // 摄像头给的 NV12，VideoCapture 复制进原始帧池借的缓冲区；读超时返回空帧，检查过停止请求接着等
+        raw = raw_pool_.acquire();
+        auto cap_start = std::chrono::steady_clock::now();
+        while (!cap_.read(raw.mat())) {
+            if (stop.stop_requested())
+                return false;
+            if (std::chrono::steady_clock::now() - cap_start >= std::chrono::milliseconds(CAPTURE_TIMEOUT_MS)) {
+                std::cerr << "摄像头" << CAPTURE_TIMEOUT_MS << "ms没有出帧，当作设备出错" << std::endl;
+                return false;
+            }
+            // 读失败时 OpenCV 放掉了 Mat 头，重新借一块，下一次照样读进池里的缓冲区
+            raw = raw_pool_.acquire();
         }
+    }
+    auto captured = std::chrono::system_clock::now();
+    raw.info() = { 0, sequence_++, captured, {}, frame_deadline() };
+    return true;
+}
 
-        if (!cap.isOpened()) {
-            std::cerr << "Failed to open camera " << std::endl;
-            g_stop_requested = true;
+bool capture_source::convert(video_frame &raw, video_frame &frame) const
+{
+    const frame_info info = raw.info();
+    if (USE_V4L2) {
+        // JPEG 解码的目标每个线程一块，尺寸不变时 imdecode 复用；转成 RGB 时直接写进池里借的帧
+        // （cvtColor 原地转换会先把源图整个复制一份）
+        thread_local cv::Mat decoded;
+        cv::imdecode(raw.mat(), cv::IMREAD_COLOR, &decoded);
+        if (decoded.empty()) {
+            raw.reset();
+            return false;
         }
-        while (!g_stop_requested) {
-            cv::Mat frame;
-            cap >> frame;
-            cv::cvtColor(frame, frame, cv::COLOR_YUV2BGR_NV12);
-            if (frame.empty()) {
-                std::cout << "End of video file" << std::endl;
-                g_stop_requested = true;
-                break;
-            }
-            // cv::cvtColor(frame, frame, cv::COLOR_BGR2RGB);
-            g_capture_queue.push(frame);
-            std::cout << "cap队列" << g_capture_queue.queue_.size() << std::endl;
+        frame = frame_pool_.acquire();
+        if (executor_ == nullptr || frame.mat().size() != decoded.size() || frame.mat().type() != decoded.type()) {
+            cv::cvtColor(decoded, frame.mat(), cv::COLOR_BGR2RGB);
+        } else {
+            // decoded 是 thread_local，任务在工作线程上执行，要先取好这个线程的引用
+            const cv::Mat &source = decoded;
+            for_each_band(executor_, source.rows, 1, [&](int begin, int end) {
+                cv::Mat band = frame.mat().rowRange(begin, end);
+                cv::cvtColor(source.rowRange(begin, end), band, cv::COLOR_BGR2RGB);
+            });
+        }
+    } else if constexpr (FROM_FILE) {
+        frame.swap(raw);
+    } else {
+        frame = frame_pool_.acquire();
+        const cv::Mat &nv12 = raw.mat();
+        const int rows = nv12.rows * 2 / 3;
+        if (executor_ == nullptr || rows % 2 != 0 || nv12.cols % 2 != 0 || frame.mat().size() != cv::Size(nv12.cols, rows) || frame.mat().type() != CV_8UC3) {
+            cv::cvtColor(nv12, frame.mat(), cv::COLOR_YUV2BGR_NV12);
+        } else {
+            // 每条取对应行的 Y 和一半行数的交错 UV，各条写 BGR 帧里不重叠的行
+            for_each_band(executor_, rows, 2, [&](int begin, int end) {
+                cv::Mat band = frame.mat().rowRange(begin, end);
+                cv::cvtColorTwoPlane(nv12.rowRange(begin, end), nv12.rowRange(rows + begin / 2, rows + end / 2).reshape(2), band, cv::COLOR_YUV2BGR_NV12);
+            });
         }
-        cap.release();
     }
-}
\ No newline at end of file
+    frame.info() = info;
+    frame.info().ready = std::chrono::steady_clock::now();
+    // 原始数据用完马上还给池
+    raw.reset();
+    return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stop_token>
+#include <vector>
+#include "opencv2/opencv.hpp"
+
+#include "frame_pool.hpp"
+#include "work_stealing.hpp"
+
+/*
+ * 采集源（V4L2 MJPEG、libcamera GStreamer 管线或视频文件，由 USE_V4L2 / FROM_FILE 决定），拆成两步放进流水线：
+ * grab 在源阶段里只从设备取原始数据（JPEG 码流、NV12 或者文件解码出的 BGR）写进 raw_pool 借的缓冲区，马上把设备缓冲区还回去；
+ * convert 在解码阶段里把原始数据转成 BGR 帧写进 frames 池，可以多个线程并行；
+ * 颜色转换按 CONVERT_TILES 切成横条交给 executor 并行（executor 为空时在解码线程里整帧转换）
+ */
+class capture_source {
+public:
+    capture_source(frame_pool &raw_pool, frame_pool &frames, task_executor *executor);
+    ~capture_source();
+    capture_source(const capture_source &) = delete;
+    capture_source &operator=(const capture_source &) = delete;
+
+    /*打开设备或文件，失败返回 false*/
+    bool open();
+
+    /*
+     * 只能在一个线程里调用；设备出错、文件读完或者 stop 触发时返回 false
+     * V4L2 等帧时能被 stop 唤醒；GStreamer 每 CAPTURE_READ_TIMEOUT_MS 读超时一次，之间检查 stop；
+     * 摄像头超过 CAPTURE_TIMEOUT_MS 没有出帧当作设备出错；文件读一帧的过程中不能打断
+     */
+    bool grab(video_frame &raw, std::stop_token stop = {});
+
+    /*raw 是 grab 的输出，元数据原样带到 frame；可以并发调用*/
+    bool convert(video_frame &raw, video_frame &frame) const;
+
+private:
+    struct mapped_buffer {
+        void *start;
+        std::size_t length;
+    };
+
+    frame_pool &raw_pool_;
+    frame_pool &frame_pool_;
+    task_executor *executor_;
+    uint64_t sequence_ = 0;
+
+    // V4L2
+    int fd_ = -1;
+    int wake_fd_ = -1; // eventfd，停止时唤醒等帧的 poll
+    std::vector<mapped_buffer> buffers_;
+    bool streaming_ = false;
+
+    // GStreamer / 文件
+    cv::VideoCapture cap_;
+
+    bool open_v4l2();
+    void close_v4l2();
+};
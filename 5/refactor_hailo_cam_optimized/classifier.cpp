@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include "preprocess.hpp"
+
+#include "classifier.hpp"
+
+crop_classifier::crop_classifier(model_backend &backend, std::span<const int> source_classes, task_executor *executor)
+    : backend_(backend),
+      executor_(executor),
+      batch_(std::max<std::size_t>(backend.max_batch(), 1)),
+      input_pool_(backend.input_frame_size(), batch_),
+      outputs_(backend.output_frame_size() * batch_)
+{
+    for (auto class_id : source_classes) {
+        if (class_id >= 0 && class_id < NMS_NUM_CLASSES)
+            enabled_[class_id] = true;
+    }
+    inputs_.reserve(batch_);
+    input_ptrs_.reserve(batch_);
+    output_ptrs_.reserve(batch_);
+    batch_index_.reserve(batch_);
+    crops_.reserve(batch_);
+    for (std::size_t i = 0; i < batch_; i++) {
+        output_ptrs_.push_back(outputs_.data() + i * backend.output_frame_size());
+    }
+}
+
+hailo_status crop_classifier::classify(const cv::Mat &frame, std::span<const nms_detection> dets, std::vector<crop_result> &results)
+{
+    results.clear();
+    metrics_.begin_frame();
+
+    cv::Rect bounds(0, 0, frame.cols, frame.rows);
+    auto status = HAILO_SUCCESS;
+    for (std::size_t i = 0; i < dets.size() && HAILO_SUCCESS == status; i++) {
+        auto &det = dets[i];
+        if (!enabled_[det.class_id])
+            continue;
+
+        cv::Rect box(static_cast<int>(det.x_min * frame.cols), static_cast<int>(det.y_min * frame.rows),
+                     static_cast<int>((det.x_max - det.x_min) * frame.cols), static_cast<int>((det.y_max - det.y_min) * frame.rows));
+        box &= bounds;
+        if (box.empty())
+            continue;
+
+        crops_.push_back(box);
+        batch_index_.push_back(static_cast<int>(i));
+
+        if (crops_.size() == batch_)
+            status = flush(frame, results);
+    }
+
+    // 中途失败也要走到 end_frame，否则这一帧的计时和拷贝计数会并进下一帧
+    if (HAILO_SUCCESS == status)
+        status = flush(frame, results);
+    metrics_.end_frame();
+    return status;
+}
+
+hailo_status crop_classifier::flush(const cv::Mat &frame, std::vector<crop_result> &results)
+{
+    if (crops_.empty())
+        return HAILO_SUCCESS;
+
+    auto n = crops_.size();
+    for (std::size_t i = 0; i < n; i++) {
+        inputs_.push_back(input_pool_.acquire());
+        input_ptrs_.push_back(inputs_.back().data());
+    }
+
+    // 各个框写各自的输入缓冲区，可以并行；metrics_ 不是线程安全的，拷贝和写入量在下面串行记
+    cv::Size input_size(backend_.input_width(), backend_.input_height());
+    std::atomic<bool> mismatch{ false };
+    parallel_for(executor_, n, [&](std::size_t i) {
+        stage_metrics scratch;
+        if (resize_into(frame(crops_[i]), inputs_[i].data(), inputs_[i].size(), input_size, scratch) == 0)
+            mismatch.store(true, std::memory_order_relaxed);
+    });
+    auto status = HAILO_SUCCESS;
+    if (mismatch.load(std::memory_order_relaxed)) {
+        std::cerr << backend_.name() << " 输入大小不匹配" << std::endl;
+        status = HAILO_INVALID_OPERATION;
+    } else {
+        const auto bytes = static_cast<std::size_t>(input_size.area()) * 3;
+        for (auto &crop : crops_) {
+            if (crop.size() == input_size)
+                metrics_.add_copy(bytes);
+            else
+                metrics_.add_write(bytes);
+        }
+        status = backend_.infer_batch(std::span(input_ptrs_.data(), n), std::span(output_ptrs_.data(), n));
+    }
+    if (HAILO_SUCCESS == status) {
+        auto classes = backend_.output_frame_size() / sizeof(float);
+        for (std::size_t i = 0; i < n; i++) {
+            auto scores = reinterpret_cast<const float *>(output_ptrs_[i]);
+            auto best = std::max_element(scores, scores + classes);
+            results.push_back({ batch_index_[i], static_cast<int>(best - scores), *best });
+        }
+    }
+
+    inputs_.clear();
+    input_ptrs_.clear();
+    batch_index_.clear();
+    crops_.clear();
+    return status;
+}
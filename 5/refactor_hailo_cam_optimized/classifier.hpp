@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "opencv2/opencv.hpp"
+
+#include "buffer_pool.hpp"
+#include "hailo_nms.hpp"
+#include "model_backend.hpp"
+#include "stage_metrics.hpp"
+#include "work_stealing.hpp"
+
+struct crop_result {
+    int detection_index; // 在传入的 dets 中的下标
+    int attribute;       // 二级模型输出的 argmax
+    float score;
+};
+
+/*
+ * 二级分类：把检测框裁剪、缩放到分类模型的输入尺寸，攒成一批送进同一个 VDevice 上的第二个模型
+ * 输入/输出缓冲区在构造时按 max_batch 分配，之后每帧复用；一批里各个框的裁剪缩放交给 executor 并行（为空时串行）
+ */
+class crop_classifier {
+public:
+    crop_classifier(model_backend &backend, std::span<const int> source_classes, task_executor *executor = nullptr);
+
+    /*results 会被清空后填入每个被分类的框；frame 是检测用的原图，坐标按归一化框换算*/
+    hailo_status classify(const cv::Mat &frame, std::span<const nms_detection> dets, std::vector<crop_result> &results);
+
+    const stage_metrics &metrics() const
+    {
+        return metrics_;
+    }
+
+private:
+    model_backend &backend_;
+    task_executor *executor_;
+    std::array<bool, NMS_NUM_CLASSES> enabled_{};
+    std::size_t batch_;
+    buffer_pool input_pool_;
+    std::vector<buffer_pool::handle> inputs_;
+    std::vector<const uint8_t *> input_ptrs_;
+    std::vector<uint8_t> outputs_;
+    std::vector<uint8_t *> output_ptrs_;
+    std::vector<int> batch_index_;
+    std::vector<cv::Rect> crops_;
+    stage_metrics metrics_;
+
+    hailo_status flush(const cv::Mat &frame, std::vector<crop_result> &results);
+};
@@ -1,5 +1,11 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
+
+#include "channel.hpp"
+#include "thread_placement.hpp"
+
 inline constexpr auto FROM_FILE = false;
 
 inline constexpr auto HEF_FILE = "/home/wjjsn/code/yolov8n.hef";
@@ -7,8 +13,169 @@ inline constexpr auto VIDEO_PATH = "/home/wjjsn/test.mp4";
 
 inline constexpr auto VIDEO_DEVICE = "/dev/video0";
 inline constexpr auto USE_V4L2 = false;
+/*
+ * 摄像头超过 CAPTURE_TIMEOUT_MS 没有出帧就当作出错，采集阶段结束、流水线排空退出，交给看门狗重启
+ * GStreamer 管线每次最多读 CAPTURE_READ_TIMEOUT_MS（OpenCV 的 CAP_PROP_READ_TIMEOUT_MSEC），超时后检查停止请求再接着读，
+ * 卡住的 libcamerasrc 不会拖住 drain_for / stop；V4L2 等帧时直接被停止请求唤醒，不用这个
+ */
+inline constexpr auto CAPTURE_TIMEOUT_MS = 2000;
+inline constexpr auto CAPTURE_READ_TIMEOUT_MS = 100;
 
 inline constexpr auto VIDEO_WIDTH = 1920;
 inline constexpr auto VIDEO_HEIGHT = 1080;
 
+/*NPU输出保持量化格式（UINT16），只对通过阈值的框反量化；false 时由 libhailort 整块反量化为 FLOAT32*/
+inline constexpr auto QUANTIZED_OUTPUT = true;
+inline constexpr auto SCORE_THRESHOLD = 0.25f;
+
+/*
+ * 只解码这些类别，每类一个阈值，例如只看人和车：{ { { 0, 0.35f }, { 2, 0.3f }, { 5, 0.3f }, { 7, 0.3f } } }
+ * 为空则 80 类全部解码，统一用 SCORE_THRESHOLD；没启用的类别在 NPU 输出和 CPU 后备输出里都不会被读取
+ */
+struct class_threshold {
+    int class_id;
+    float threshold;
+};
+inline constexpr std::array<class_threshold, 0> DETECTION_CLASSES{};
+
+/*非空时把前 OUTPUT_DUMP_FRAMES 帧的原始输出写到该目录，供 refactor_hailo_cam_optimized_bench nms 使用*/
+inline constexpr auto OUTPUT_DUMP_DIR = "";
+inline constexpr auto OUTPUT_DUMP_FRAMES = 100u;
+
+/*
+ * 模型调度：检测模型和二级分类模型共享一个 VDevice，由 HailoRT model scheduler 切换
+ * priority 越大越优先（HAILO_SCHEDULER_PRIORITY_NORMAL = 16）；threshold 是调度器切换到该模型前攒的帧数，
+ * 攒不够时最多等 timeout_ms；batch 同时是 vstream 队列深度和一次提交的最大帧数
+ */
+struct model_config {
+    uint8_t priority;
+    uint32_t timeout_ms;
+    uint32_t threshold;
+    uint32_t batch;
+};
+inline constexpr model_config DETECTOR_MODEL{ 20, 0, 1, 1 };
+
+/*二级分类模型（属性、车牌等）。为空且 HEF_FILE 只有一个网络组时不启用；HEF_FILE 有两个网络组时第二个就是分类模型*/
+inline constexpr auto CLASSIFIER_HEF_FILE = "";
+inline constexpr model_config CLASSIFIER_MODEL{ 16, 50, 8, 8 };
+/*只对这些检测类别裁剪后做二级分类（COCO: 0 = person, 2 = car）*/
+inline constexpr std::array CLASSIFIER_SOURCE_CLASSES{ 0, 2 };
+
+/*
+ * CPU 后备检测（ONNX Runtime 跑同一个 yolov8n），只在编译时找到 onnxruntime 才可用，路径为空则不启用
+ * VDevice 创建失败时全部帧走 CPU；NPU 正常时只接 NPU 排不过来的帧
+ */
+inline constexpr auto ONNX_MODEL_FILE = "/home/wjjsn/yolov8n.onnx";
+inline constexpr auto ONNX_THREADS = 2;
+inline constexpr auto NMS_IOU_THRESHOLD = 0.45f;
+
+/*预览窗口的分辨率，显示阶段把帧缩小到这个尺寸再画检测框和标签；OVERLAY_TIMESTAMP 时左上角加上本地时间*/
+inline constexpr auto DISPLAY_WIDTH = 960;
+inline constexpr auto DISPLAY_HEIGHT = 540;
+inline constexpr auto OVERLAY_TIMESTAMP = false;
+
+/*
+ * 检测结果的二进制记录流（格式见 common/detection_stream.hpp），为空不输出
+ * "unix:/run/hailo_det.sock" 连下游的 Unix 域套接字，已存在的 FIFO 当管道写，其它路径追加到文件
+ * 攒够 DETECTION_STREAM_BATCH 帧或最早一帧等了 DETECTION_STREAM_MAX_DELAY_MS 就写一次
+ */
+inline constexpr auto DETECTION_STREAM = "";
+inline constexpr auto DETECTION_STREAM_BATCH = 8u;
+inline constexpr auto DETECTION_STREAM_MAX_DELAY_MS = 100;
+
+/*
+ * 共享内存环（common/shm_ring.hpp），给录像、分析、界面等其它进程读帧和检测结果，为空不启用
+ * 名字以 '/' 开头，消费者用同一个名字 shm_open；SHM_RING_FRAMES 为 false 时只发布检测结果
+ */
+inline constexpr auto SHM_RING_NAME = "";
+inline constexpr auto SHM_RING_SLOTS = 4u;
+inline constexpr auto SHM_RING_FRAMES = true;
+
+/*
+ * 多目标跟踪（common/tracker.hpp）：检测结果喂给 Kalman + IoU 跟踪器，跟踪稳定时隔几帧才推理一次，
+ * 跳过的帧显示跟踪器外推的框；步长在 1 到 TRACKER_MAX_STRIDE 之间自适应，1 = 每帧都推理，不启用跟踪
+ */
+inline constexpr auto TRACKER_MAX_STRIDE = 4;
+
+/*每路摄像头等待推理的帧数上限，满了丢掉该路最旧的一帧*/
+inline constexpr auto DISPATCH_QUEUE_DEPTH = 2u;
+/*推理完等后处理的结果个数上限，满了推理后端等后处理线程取走（结果都要写进记录流，不丢）*/
+inline constexpr auto POSTPROCESS_QUEUE_DEPTH = 2u;
+
+/*
+ * 流水线（common/pipeline.hpp）：采集 -> 解码 / 颜色转换 -> 调度（跟踪或交给推理后端）
+ * 采集和解码之间的通道：实时摄像头满了挤掉最旧的一帧，下游总是拿到最新的；文件回放满了等下游取走，一帧都不丢
+ * 解码和调度之间的通道满了等调度阶段取走（调度只是把帧交给分派器，分派器自己按 DISPATCH_QUEUE_DEPTH 丢帧）
+ * DECODE_THREADS 是解码阶段的线程数，MJPEG 解码跟不上时加大；大于 1 时帧可能乱序
+ */
+inline constexpr auto CAPTURE_QUEUE_DEPTH = 4u;
+inline constexpr auto CAPTURE_OVERFLOW = FROM_FILE ? overflow_policy::block : overflow_policy::drop_oldest;
+inline constexpr auto DECODE_QUEUE_DEPTH = 2u;
+inline constexpr auto DECODE_THREADS = 1u;
+/*
+ * Ctrl+C / SIGTERM / q 之后先排空：源不再出帧，在途的帧照常解码、推理、显示完，最多等 SHUTDOWN_DRAIN_MS，
+ * 超时就丢掉剩下的帧立即退出；0 = 不排空，直接丢掉（看门狗频繁重启时退出最快）
+ */
+inline constexpr auto SHUTDOWN_DRAIN_MS = 500;
+
+/*
+ * 按采集序号重排（common/reorder_buffer.hpp）：多个解码线程、NPU 和 CPU 后端并行时帧会乱序完成，
+ * 调度阶段之前和交给预览之前各有一个重排缓冲区，下游看到的帧时间总是往前走
+ * 最多攒 REORDER_WINDOW 帧；队头缺的帧等 REORDER_MAX_WAIT_MS 还没来就跳过，之后才到的直接丢掉
+ * 上游确定不会来的帧（采集通道挤掉的、解码失败的、分派队列丢掉的）当场跳过，不用等
+ * 预览要等最慢的后端：CPU 后备比 NPU 慢的时候，等待上限就是预览多出来的延迟
+ */
+inline constexpr auto REORDER_WINDOW = 4u;
+inline constexpr auto REORDER_MAX_WAIT_MS = 100;
+/*调度阶段等帧超过这么久时检查一次解码重排的超时，队头缺口最多比 REORDER_MAX_WAIT_MS 多等这么久*/
+inline constexpr auto REORDER_POLL_MS = 20;
+
+/*
+ * 帧的处理期限（common/frame_deadline.hpp）：采集时记下 取到帧的时刻 + FRAME_BUDGET_MS，
+ * 解码、调度、推理后端取帧、二级分类、预览画框之前各检查一次，已经过期的帧直接丢掉（推理后端按自己的平均耗时估计，做完才过期的也不做），
+ * 过载时 CPU / NPU 只花在新帧上
+ * 各阶段的"过期跳过"计数见退出时的报告；预算要比正常的端到端延迟（解码 + 排队 + 推理 + 重排等待）宽裕，否则正常的帧也会被丢
+ * 文件回放一帧都不丢，不设期限；0 = 不启用
+ */
+inline constexpr auto FRAME_BUDGET_MS = FROM_FILE ? 0 : 250;
+
+/*
+ * 线程放置（common/thread_placement.hpp）：每个阶段的线程启动时设置 CPU 亲和性和调度策略，退出时的流水线报告里有各阶段的 p99
+ * 按 Pi 5 的 4 个核安排：采集独占 CPU 0、NPU 送帧独占 CPU 1，都跑 SCHED_FIFO，不会被 OpenCV 的工作线程抢占；
+ * 解码、CPU 后备推理和预览放在 CPU 2、3，它们创建的 OpenCV / ONNX Runtime 工作线程继承同样的亲和性
+ * NPU 送帧线程只送帧、取结果，推理完的结果交给普通优先级的后处理线程（写记录、跟踪器更新、二级分类、交给预览），
+ * 免得后处理在实时优先级上占住 CPU 1，饿死同核的调度阶段
+ * 两个实时线程大部分时间阻塞在设备读写上，不会饿死同核的线程；内核默认的 sched_rt_runtime_us 另外给普通线程留 5%
+ * 实时策略需要 root、CAP_SYS_NICE 或者 limits.conf 里的 rtprio，没有权限时打印警告，只设亲和性
+ * 全部改成 {} 就回到由内核随意调度
+ */
+inline constexpr thread_placement CAPTURE_PLACEMENT{ cpu_mask({ 0 }), SCHED_FIFO, 60 };
+inline constexpr thread_placement DECODE_PLACEMENT{ cpu_mask({ 2, 3 }), SCHED_OTHER, 0 };
+inline constexpr thread_placement SCHEDULE_PLACEMENT{ cpu_mask({ 1 }), SCHED_OTHER, 0 };
+inline constexpr thread_placement NPU_FEED_PLACEMENT{ cpu_mask({ 1 }), SCHED_FIFO, 50 };
+inline constexpr thread_placement CPU_FALLBACK_PLACEMENT{ cpu_mask({ 2, 3 }), SCHED_OTHER, 0 };
+inline constexpr thread_placement POSTPROCESS_PLACEMENT{ cpu_mask({ 2, 3 }), SCHED_OTHER, 0 };
+inline constexpr thread_placement DISPLAY_PLACEMENT{ cpu_mask({ 2, 3 }), SCHED_OTHER, 0 };
+
+/*
+ * 每帧内部的并行任务（common/work_stealing.hpp）：解码阶段的颜色转换按 CONVERT_TILES 切成横条、二级分类一批里的各个框，
+ * 都交给同一个工作窃取执行器做 fork-join，调用的阶段线程自己也参与执行
+ * EXECUTOR_THREADS 个工作线程，各固定在 EXECUTOR_PLACEMENT 的一个核上，和解码阶段共用 CPU 2、3；0 = 不启用，全部在阶段线程里串行
+ * 启用时关掉 OpenCV 自己的线程池（cv::setNumThreads(0)），免得两套线程抢同样的核
+ */
+inline constexpr auto EXECUTOR_THREADS = 2u;
+inline constexpr thread_placement EXECUTOR_PLACEMENT{ cpu_mask({ 2, 3 }), SCHED_OTHER, 0 };
+inline constexpr auto CONVERT_TILES = 8u;
+
+/*
+ * 帧缓冲区池（common/frame_pool.hpp），稳态下采集、推理、预览都不再分配像素；借空了临时分配并计数，见退出时的报告
+ * 原始帧池（NV12 或 JPEG 码流）同时在用：采集通道 + 采集线程 1 + 每个解码线程 1
+ * 帧池（VIDEO_WIDTH x VIDEO_HEIGHT 的 BGR）同时在用：每个解码线程 1 + 解码通道 + 调度线程 1 + 分派队列 2 + 每个后端 1
+ * + 预览通道和显示线程各 1 + 推理的预览槽位 1 + 两个重排缓冲区各最多 REORDER_WINDOW，20 块留了余量
+ * FRAME_POOL_HUGE_PAGES 需要先在 /proc/sys/vm/nr_hugepages 预留大页
+ */
+inline constexpr auto RAW_POOL_SIZE = CAPTURE_QUEUE_DEPTH + DECODE_THREADS + 2;
+inline constexpr auto FRAME_POOL_SIZE = 20u;
+inline constexpr auto FRAME_POOL_HUGE_PAGES = false;
+
 static_assert(!(FROM_FILE && USE_V4L2), "V4L2 cannot be used with video file");
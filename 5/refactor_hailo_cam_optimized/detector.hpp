@@ -0,0 +1,39 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "hailo/hailort.hpp"
+#include "opencv2/opencv.hpp"
+
+#include "config.hpp"
+#include "hailo_nms.hpp"
+
+/*由 DETECTION_CLASSES 生成，NPU 和 CPU 后端共用*/
+inline constexpr auto DETECTION_FILTER = nms_class_filter<>::from(DETECTION_CLASSES, SCORE_THRESHOLD);
+
+/*
+ * 一帧进、检测框出的检测后端。NPU 上是 YOLOv8 HEF（hailo_detector），
+ * NPU 不可用或排队过长时由 ONNX Runtime 在 CPU 上跑同一个 yolov8n（onnx_detector）
+ * 同一个实例只会被一个线程调用；输出统一成归一化坐标的 nms_detection，后处理不用关心来自哪个后端
+ */
+class detector {
+public:
+    virtual ~detector() = default;
+
+    virtual const std::string &name() const = 0;
+
+    /*dets 会被清空后填入 DETECTION_FILTER 启用的类别里分数不低于该类阈值的框；frame 是采集线程给的 BGR 原图*/
+    virtual hailo_status detect(const cv::Mat &frame, std::vector<nms_detection> &dets) = 0;
+
+    /*退出时打印各自的统计（预处理拷贝次数等）*/
+    virtual void report() const
+    {
+    }
+};
+
+/*按 DETECTOR_MODEL 创建检测模型的 vstream（输入 NHWC/AUTO，输出 NMS_BY_CLASS，格式由 QUANTIZED_OUTPUT 决定）*/
+hailort::Expected<std::unique_ptr<detector> > create_hailo_detector(std::shared_ptr<hailort::ConfiguredNetworkGroup> network_group);
+
+/*只在找到 onnxruntime 时编译（WITH_ONNXRUNTIME），模型路径见 ONNX_MODEL_FILE*/
+hailort::Expected<std::unique_ptr<detector> > create_onnx_detector(const std::string &model_path);
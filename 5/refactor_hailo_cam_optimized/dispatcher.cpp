@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <iostream>
+
+#include "dispatcher.hpp"
+
+/*滑动平均的权重，越大越快跟上 NPU 被其它模型抢占、CPU 降频这类变化*/
+static constexpr double LATENCY_EWMA_ALPHA = 0.2;
+
+inference_dispatcher::inference_dispatcher(std::size_t stream_count, std::size_t queue_depth, completion on_done, drop_handler on_drop)
+    : queue_depth_(std::max<std::size_t>(queue_depth, 1)), on_done_(std::move(on_done)), on_drop_(std::move(on_drop)), streams_(std::max<std::size_t>(stream_count, 1))
+{
+    for (auto &stream : streams_)
+        stream.queue.slots.resize(queue_depth_ + 1);
+}
+
+inference_dispatcher::~inference_dispatcher()
+{
+    stop();
+}
+
+void inference_dispatcher::add_backend(detector &backend, dispatch_role role, const thread_placement &placement)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (started_)
+        return;
+    auto &state = backends_.emplace_back();
+    state.backend = &backend;
+    state.role = role;
+    state.placement = placement;
+}
+
+void inference_dispatcher::start()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (started_)
+        return;
+    started_ = true;
+    for (auto &backend : backends_) {
+        backend.worker = std::thread(&inference_dispatcher::run, this, std::ref(backend));
+    }
+}
+
+bool inference_dispatcher::submit(std::size_t stream, video_frame frame)
+{
+    video_frame dropped;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_ || !alive() || stream >= streams_.size())
+            return false;
+
+        auto &state = streams_[stream];
+        if (state.queue.size() >= queue_depth_) {
+            dropped = std::move(state.queue.front());
+            state.queue.pop_front();
+            state.stats.dropped++;
+            pending_--;
+        }
+        state.queue.push_back(std::move(frame));
+        state.stats.submitted++;
+        pending_++;
+    }
+    // 只有部分后端满足取帧条件，所以要全部唤醒
+    work_cv_.notify_all();
+    if (!dropped.empty() && on_drop_)
+        on_drop_(stream, dropped);
+    return true;
+}
+
+void inference_dispatcher::stop(bool discard)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        if (discard) {
+            for (auto &stream : streams_) {
+                stream.stats.dropped += stream.queue.size();
+                while (!stream.queue.empty())
+                    stream.queue.pop_front();
+            }
+            pending_ = 0;
+        }
+    }
+    work_cv_.notify_all();
+    for (auto &backend : backends_) {
+        if (backend.worker.joinable())
+            backend.worker.join();
+    }
+}
+
+bool inference_dispatcher::alive() const
+{
+    return std::any_of(backends_.begin(), backends_.end(), [](const backend_state &backend) { return !backend.failed; });
+}
+
+bool inference_dispatcher::should_take(const backend_state &backend) const
+{
+    if (backend.role == dispatch_role::primary)
+        return true;
+
+    std::size_t primaries = 0;
+    std::size_t idle_primaries = 0;
+    double primary_ms = 0.0;
+    for (auto &other : backends_) {
+        if (other.role != dispatch_role::primary || other.failed)
+            continue;
+        primaries++;
+        idle_primaries += other.busy ? 0 : 1;
+        if (other.average_ms > 0.0 && (primary_ms == 0.0 || other.average_ms < primary_ms))
+            primary_ms = other.average_ms;
+    }
+    if (primaries == 0)
+        return true;
+    // 主后端空着就留给它，它会马上取走
+    if (idle_primaries > 0)
+        return false;
+
+    // 某一路已经排满，再不取就要丢帧
+    for (auto &stream : streams_) {
+        if (stream.queue.size() >= queue_depth_)
+            return true;
+    }
+
+    // 队头这一帧交给主后端的预计完成时间：等手上的帧做完，再排在前面的帧后面
+    if (primary_ms == 0.0)
+        return false;
+    auto wait_ms = primary_ms * (1.0 + static_cast<double>(pending_ - 1) / primaries);
+    return wait_ms > backend.average_ms;
+}
+
+bool inference_dispatcher::pop_next(std::size_t &stream, video_frame &frame)
+{
+    for (std::size_t n = 0; n < streams_.size(); n++) {
+        auto index = (next_stream_ + n) % streams_.size();
+        auto &queue = streams_[index].queue;
+        if (queue.empty())
+            continue;
+        stream = index;
+        frame = std::move(queue.front());
+        queue.pop_front();
+        pending_--;
+        next_stream_ = (index + 1) % streams_.size();
+        return true;
+    }
+    return false;
+}
+
+void inference_dispatcher::run(backend_state &backend)
+{
+    apply_thread_placement(backend.backend->name(), backend.placement);
+    dispatch_result result{};
+    result.dets.reserve(NMS_NUM_CLASSES * NMS_MAX_BOXES_PER_CLASS);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        work_cv_.wait(lock, [this, &backend] { return (stopping_ && pending_ == 0) || (pending_ > 0 && should_take(backend)); });
+        video_frame frame;
+        if (!pop_next(result.stream, frame))
+            break;
+        // 按这个后端的平均耗时推理完也赶不上期限的帧（多半是在队列里等久了）不再占用后端，锁外释放并通知调用方
+        const auto expected = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::milli>(backend.average_ms));
+        if (frame.info().past_deadline(clock::now() + expected)) {
+            backend.late++;
+            streams_[result.stream].stats.dropped++;
+            lock.unlock();
+            if (on_drop_)
+                on_drop_(result.stream, frame);
+            frame.reset();
+            // 可能是最后一帧，等着退出的其它后端要重新判断
+            work_cv_.notify_all();
+            lock.lock();
+            continue;
+        }
+        backend.busy = true;
+        lock.unlock();
+
+        auto start = clock::now();
+        auto status = backend.backend->detect(frame.mat(), result.dets);
+        result.latency = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start);
+
+        lock.lock();
+        backend.busy = false;
+        if (HAILO_SUCCESS != status) {
+            std::cerr << backend.backend->name() << " 推理失败 " << status << "，之后的帧交给其它后端" << std::endl;
+            backend.failed = true;
+            streams_[result.stream].queue.push_front(std::move(frame));
+            pending_++;
+            work_cv_.notify_all();
+            break;
+        }
+
+        auto ms = result.latency.count() / 1000.0;
+        backend.average_ms = backend.average_ms == 0.0 ? ms : backend.average_ms * (1.0 - LATENCY_EWMA_ALPHA) + ms * LATENCY_EWMA_ALPHA;
+        backend.max_ms = std::max(backend.max_ms, ms);
+        backend.frames++;
+        streams_[result.stream].stats.completed++;
+        lock.unlock();
+        // 主后端空出来了，后备后端需要重新判断
+        work_cv_.notify_all();
+
+        // on_done 可能把 result 换走，每帧都重新填
+        result.backend = backend.backend;
+        result.sequence = frame.info().sequence;
+        result.captured = frame.info().captured;
+        result.frame = std::move(frame);
+        on_done_(result);
+
+        lock.lock();
+    }
+}
+
+std::vector<inference_dispatcher::backend_stats> inference_dispatcher::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<backend_stats> result;
+    for (auto &backend : backends_) {
+        result.push_back({ backend.backend->name(), backend.role, backend.failed, backend.frames, backend.average_ms, backend.max_ms, backend.late });
+    }
+    return result;
+}
+
+inference_dispatcher::stream_stats inference_dispatcher::stats(std::size_t stream) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stream < streams_.size() ? streams_[stream].stats : stream_stats{};
+}
+
+void inference_dispatcher::report() const
+{
+    for (auto &backend : stats()) {
+        std::cout << "[" << (backend.role == dispatch_role::primary ? "主" : "后备") << "] " << backend.name
+                  << (backend.failed ? "（已停用）" : "") << " 推理" << backend.frames << "帧，平均耗时" << backend.average_ms
+                  << "ms，最大" << backend.max_ms << "ms，过期跳过" << backend.late << "帧" << std::endl;
+    }
+    for (std::size_t stream = 0; stream < streams_.size(); stream++) {
+        auto s = stats(stream);
+        std::cout << "第" << stream << "路: 提交" << s.submitted << "帧，完成" << s.completed << "帧，丢弃" << s.dropped << "帧" << std::endl;
+    }
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "opencv2/opencv.hpp"
+
+#include "detector.hpp"
+#include "frame_pool.hpp"
+#include "thread_placement.hpp"
+
+/*主后端（NPU）总是接帧；后备后端（CPU）只接主后端排不过来的帧，主后端全部不可用时接全部帧*/
+enum class dispatch_role {
+    primary,
+    fallback,
+};
+
+struct dispatch_result {
+    std::size_t stream;
+    std::size_t sequence; // 帧元数据里的采集序号，和检测流、共享内存里的记录对得上；不同后端并行时完成顺序可能和序号不一致
+    std::chrono::system_clock::time_point captured; // 帧元数据里的采集时间
+    video_frame frame;
+    std::vector<nms_detection> dets;
+    const detector *backend;
+    std::chrono::microseconds latency; // 只算 detect() 本身
+};
+
+/*
+ * 把多路摄像头的帧分给多个检测后端，每个后端一个工作线程：
+ * - 每路一个有界队列，满了丢该路最旧的帧；后端取帧时从上次服务的下一路开始轮询，任何一路都不会饿死
+ * - 每个后端的 detect() 耗时做指数滑动平均。后备后端取帧的条件是：按主后端的平均耗时，
+ *   排在队里的帧加上主后端手上的帧要等的时间超过后备后端自己处理一帧的时间
+ * - 后端 detect() 失败后不再给它派帧，失败的那一帧放回队头交给其它后端
+ * - 后端取到的帧按它的平均耗时推理完也会超过处理期限（frame_info::deadline）时不推理，记进该后端的过期跳过和该路的丢弃，和队列满了丢掉的帧一样交给 on_drop
+ * - 每路的队列是定长的环，帧在队列、后端和 on_done 之间只移动引用，稳态下不分配内存
+ * on_done 在后端的工作线程里调用，多个后端时会并发调用；可以把 result 的内容整个换走（例如换进通道交给别的线程），换回来的空壳下一帧照常复用；
+ * on_drop 在锁外调用，帧被丢掉前最后看一眼（例如告诉重排缓冲区不用等它）：队列满了挤掉的帧在 submit 的线程里，
+ * 过期不推理的帧在取到它的后端工作线程里（NPU 送帧是实时优先级的线程），所以 on_drop 要快、不能阻塞，多个线程会并发调用
+ */
+class inference_dispatcher {
+public:
+    using completion = std::function<void(dispatch_result &)>;
+    using drop_handler = std::function<void(std::size_t stream, video_frame &)>;
+
+    struct backend_stats {
+        std::string name;
+        dispatch_role role;
+        bool failed;
+        std::size_t frames;
+        double average_ms; // 滑动平均
+        double max_ms;
+        std::size_t late; // 取到时已经赶不上期限、没有推理的帧
+    };
+    struct stream_stats {
+        std::size_t submitted;
+        std::size_t dropped; // 队列满了挤掉的、stop(discard) 丢掉的和后端取到时已经过期没推理的
+        std::size_t completed;
+    };
+
+    inference_dispatcher(std::size_t stream_count, std::size_t queue_depth, completion on_done, drop_handler on_drop = {});
+    ~inference_dispatcher();
+    inference_dispatcher(const inference_dispatcher &) = delete;
+    inference_dispatcher &operator=(const inference_dispatcher &) = delete;
+
+    /*在 start() 之前添加，detector 的生命周期由调用方保证；placement 在后端的工作线程启动时设置*/
+    void add_backend(detector &backend, dispatch_role role, const thread_placement &placement = {});
+    void start();
+
+    /*返回 false 表示已经没有可用的后端，帧没有入队*/
+    bool submit(std::size_t stream, video_frame frame);
+
+    /*已入队的帧全部处理完后停止工作线程；discard 时丢掉还在排队的帧（记进 dropped），只等后端手上正在推理的那一帧*/
+    void stop(bool discard = false);
+
+    std::vector<backend_stats> stats() const;
+    stream_stats stats(std::size_t stream) const;
+    void report() const;
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    /*容量 queue_depth + 1：满了先丢最旧的再入队，失败的帧放回队头时可能多出一帧*/
+    struct frame_queue {
+        std::vector<video_frame> slots;
+        std::size_t head = 0;
+        std::size_t count = 0;
+
+        bool empty() const
+        {
+            return count == 0;
+        }
+        std::size_t size() const
+        {
+            return count;
+        }
+        video_frame &front()
+        {
+            return slots[head];
+        }
+        void pop_front()
+        {
+            slots[head].reset();
+            head = (head + 1) % slots.size();
+            count--;
+        }
+        void push_back(video_frame &&frame)
+        {
+            slots[(head + count) % slots.size()] = std::move(frame);
+            count++;
+        }
+        void push_front(video_frame &&frame)
+        {
+            head = (head + slots.size() - 1) % slots.size();
+            slots[head] = std::move(frame);
+            count++;
+        }
+    };
+    struct stream_state {
+        frame_queue queue;
+        stream_stats stats{};
+    };
+    struct backend_state {
+        detector *backend = nullptr;
+        dispatch_role role = dispatch_role::primary;
+        thread_placement placement;
+        bool busy = false;
+        bool failed = false;
+        std::size_t frames = 0;
+        double average_ms = 0.0; // 0 表示还没有测量值
+        double max_ms = 0.0;
+        std::size_t late = 0;
+        std::thread worker;
+    };
+
+    std::size_t queue_depth_;
+    completion on_done_;
+    drop_handler on_drop_;
+    mutable std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::vector<stream_state> streams_;
+    std::deque<backend_state> backends_;
+    std::size_t pending_ = 0;
+    std::size_t next_stream_ = 0;
+    bool started_ = false;
+    bool stopping_ = false;
+
+    bool alive() const;
+    bool should_take(const backend_state &backend) const;
+    bool pop_next(std::size_t &stream, video_frame &frame);
+    void run(backend_state &backend);
+};
@@ -0,0 +1,59 @@
+#include <iostream>
+
+#include "config.hpp"
+#include "display.hpp"
+
+using namespace std::chrono_literals;
+
+display_stage::display_stage(cv::Size size, const overlay_style &style)
+    : size_(size), overlay_(style), channel_("预览", 1), display_(size, CV_8UC3)
+{
+}
+
+void display_stage::publish(display_frame &item)
+{
+    channel_.push(item);
+    // 被挤掉的旧帧在锁外释放像素
+    item.frame.reset();
+}
+
+bool display_stage::render_latest(cv::Mat &out, std::chrono::milliseconds timeout)
+{
+    if (!channel_.pop_for(current_, timeout))
+        return false;
+    if (current_.frame.empty())
+        return false;
+    if (late_.expired(current_.frame.info())) {
+        current_.frame.reset();
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    cv::resize(current_.frame.mat(), display_, size_);
+    current_.frame.reset();
+
+    overlay_.clear();
+    for (std::size_t i = 0; i < current_.dets.size(); i++) {
+        overlay_.add_box(current_.dets[i], i < current_.attributes.size() ? current_.attributes[i] : overlay_renderer::NO_ATTRIBUTE);
+    }
+    if (OVERLAY_TIMESTAMP)
+        overlay_.add_timestamp(10, 30, std::chrono::system_clock::now());
+    overlay_.render(display_);
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    render_time_ += elapsed;
+    shown_++;
+    std::cout << "第" << current_.sequence << "帧 缩小+画框耗时：" << elapsed / 1ms << "ms" << std::endl;
+    out = display_;
+    return true;
+}
+
+void display_stage::report() const
+{
+    auto stats = channel_.statistics();
+    std::cout << "预览: 收到" << stats.pushed << "帧，显示" << shown_ << "帧，被新帧替换" << stats.dropped << "帧";
+    if (shown_ > 0)
+        std::cout << "，平均缩小+画框 " << std::chrono::duration<double, std::milli>(render_time_).count() / shown_ << "ms";
+    std::cout << std::endl;
+    late_.report();
+}
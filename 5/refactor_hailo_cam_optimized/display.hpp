@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+#include "opencv2/opencv.hpp"
+
+#include "channel.hpp"
+#include "frame_deadline.hpp"
+#include "frame_pool.hpp"
+#include "hailo_nms.hpp"
+#include "overlay.hpp"
+
+/*推理线程交给显示阶段的一帧：原分辨率的帧（引用池里的缓冲区，不复制像素）和这一帧的检测结果*/
+struct display_frame {
+    video_frame frame;
+    std::vector<nms_detection> dets;
+    std::vector<int> attributes; // 和 dets 一一对应，没有二级分类结果的是 overlay_renderer::NO_ATTRIBUTE
+    std::size_t sequence = 0;
+};
+
+/*
+ * 预览阶段，和推理线程解耦：推理线程只 publish 原始帧和检测列表，不碰像素；
+ * 显示线程 render_latest 时缩小到窗口大小一次，在缩小后的帧上画叠加层，imshow 不用再缩放
+ * 只显示最新的一帧：中间是容量为 1 的 drop_oldest 通道，显示跟不上时，还没显示的帧直接被新帧挤掉
+ * 通道两端都是交换槽位，dets 等 vector 的容量一直沿用，稳态下不分配内存
+ * 过了处理期限的帧直接丢掉，不占显示线程
+ */
+class display_stage {
+public:
+    explicit display_stage(cv::Size size, const overlay_style &style = {});
+
+    /*item 和待显示的槽位交换：返回时 item 里是被替换掉的旧帧（或空槽位），调用方可以接着复用它的容量*/
+    void publish(display_frame &item);
+
+    /*等到有新帧（最多 timeout），缩小并画好叠加层后返回 true；out 指向内部缓冲区，下次调用前有效*/
+    bool render_latest(cv::Mat &out, std::chrono::milliseconds timeout);
+
+    void report() const;
+
+private:
+    cv::Size size_;
+    overlay_renderer overlay_;
+
+    bounded_channel<display_frame, overflow_policy::drop_oldest> channel_;
+
+    // 以下只有显示线程访问
+    display_frame current_;
+    cv::Mat display_;
+    std::size_t shown_ = 0;
+    std::chrono::steady_clock::duration render_time_{};
+    // 等到显示线程取走时已经过期的帧不缩小、不画框
+    deadline_gate late_{ "预览" };
+};
@@ -0,0 +1,193 @@
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+#include "hailo/hailort.hpp"
+#include "opencv2/opencv.hpp"
+
+#include "config.hpp"
+#include "buffer_pool.hpp"
+#include "detector.hpp"
+#include "hailo_nms.hpp"
+#include "model_backend.hpp"
+#include "preprocess.hpp"
+#include "stage_metrics.hpp"
+
+using namespace hailort;
+using namespace std::chrono_literals;
+
+/*NPU输出的元素类型，由 QUANTIZED_OUTPUT 决定，和 create_hailo_detector 中的 output_format_type 对应*/
+using output_t = std::conditional_t<QUANTIZED_OUTPUT, uint16_t, float>;
+
+template <typename Buffer>
+static void dump_output(const Buffer &out, nms_quant quant, std::size_t frame_index)
+{
+    nms_dump_header header{};
+    header.element_size = sizeof(output_t);
+    header.quant = quant;
+    header.payload_size = out.size();
+
+    auto path = std::string(OUTPUT_DUMP_DIR) + "/out_" + std::to_string(frame_index) + ".bin";
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "无法写入输出转储 " << path << std::endl;
+        return;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(out.data()), header.payload_size);
+}
+
+class hailo_detector : public detector {
+    std::shared_ptr<ConfiguredNetworkGroup> network_group_;
+    std::vector<InputVStream> inputs_;
+    std::vector<OutputVStream> outputs_;
+    std::string name_;
+    nms_quant quant_;
+    // 输出缓冲区只在这里分配一次，每帧都 read 到同一块内存
+    nms_output_buffer<output_t> out_;
+    // 输入缓冲区池，大小按 vstream 的帧大小分配；预处理直接把像素写进借出的缓冲区
+    buffer_pool input_pool_;
+    stage_metrics preprocess_metrics_;
+    std::size_t frame_index_ = 0;
+
+public:
+    hailo_detector(std::shared_ptr<ConfiguredNetworkGroup> network_group, std::vector<InputVStream> inputs,
+                   std::vector<OutputVStream> outputs, nms_quant quant)
+        : network_group_(std::move(network_group)), inputs_(std::move(inputs)), outputs_(std::move(outputs)),
+          name_("hailo:" + network_group_->name()), quant_(quant), input_pool_(inputs_[0].get_frame_size(), 2)
+    {
+    }
+
+    const std::string &name() const override
+    {
+        return name_;
+    }
+
+    hailo_status detect(const cv::Mat &frame, std::vector<nms_detection> &dets) override
+    {
+        auto opencv_start = std::chrono::high_resolution_clock::now();
+        preprocess_metrics_.begin_frame();
+
+        // 直接缩放进池里的输入缓冲区，解码后的像素到 InputVStream::write 之间只被写一次
+        auto buffer = input_pool_.acquire();
+        auto &input_info = inputs_[0].get_info();
+        cv::Size input_size(static_cast<int>(input_info.shape.width), static_cast<int>(input_info.shape.height));
+        if (resize_into(frame, buffer.data(), buffer.size(), input_size, preprocess_metrics_) == 0) {
+            std::cerr << "Mat数据大小不匹配" << std::endl;
+            return HAILO_INVALID_OPERATION;
+        }
+        auto opencv_time = std::chrono::high_resolution_clock::now();
+        std::cout << "OpenCV预处理耗时：" << (opencv_time - opencv_start) / 1ms << "ms" << std::endl;
+
+        auto status = inputs_[0].write(MemoryView(buffer.data(), buffer.size()));
+        if (HAILO_SUCCESS != status) {
+            std::cerr << "Failed writing to input vstream: " << status << std::endl;
+            return status;
+        }
+        // libhailort 会把用户缓冲区拷进自己的管线缓冲区
+        preprocess_metrics_.add_copy(buffer.size());
+
+        // Flushing is not mandatory here - removed to prevent timeout issues
+        status = inputs_[0].flush();
+        if (HAILO_SUCCESS != status) {
+            std::cerr << "Failed flushing input vstream" << std::endl;
+            return status;
+        }
+        std::cout << "内存复制耗时：" << (std::chrono::high_resolution_clock::now() - opencv_time) / 1ms << "ms" << std::endl;
+        preprocess_metrics_.end_frame();
+        preprocess_metrics_.report_frame("预处理");
+
+        // 读取完整的数据 (FLOAT32 160320 bytes，UINT16 80160 bytes)
+        auto read_time = std::chrono::high_resolution_clock::now();
+        status = outputs_[0].read(MemoryView(out_.data(), out_.size()));
+        std::cout << "NPU推理耗时：" << (std::chrono::high_resolution_clock::now() - read_time) / 1ms << "ms" << std::endl;
+        if (HAILO_SUCCESS != status) {
+            std::cerr << "Failed reading output vstream: " << status << std::endl;
+            return status;
+        }
+
+        if (OUTPUT_DUMP_DIR[0] != '\0' && frame_index_ < OUTPUT_DUMP_FRAMES) {
+            dump_output(out_, quant_, frame_index_);
+        }
+        frame_index_++;
+
+        // 只遍历启用的非空类别里分数不低于该类阈值的框（量化输出时也只对这些框反量化）
+        dets.clear();
+        for (const auto det : out_.view(DETECTION_FILTER, quant_)) {
+            dets.push_back(det);
+        }
+        return HAILO_SUCCESS;
+    }
+
+    void report() const override
+    {
+        preprocess_metrics_.report("预处理");
+    }
+};
+
+Expected<std::unique_ptr<detector> > create_hailo_detector(std::shared_ptr<ConfiguredNetworkGroup> network_group)
+{
+    auto status = apply_scheduler_params(*network_group, DETECTOR_MODEL);
+    if (HAILO_SUCCESS != status) {
+        return make_unexpected(status);
+    }
+
+    // Set input format type to auto - libhailort will not scale the data before writing to the HW
+    auto input_vstream_params = network_group->make_input_vstream_params({}, HAILO_FORMAT_TYPE_AUTO, HAILO_DEFAULT_VSTREAM_TIMEOUT_MS,
+                                                                          HAILO_DEFAULT_VSTREAM_QUEUE_SIZE);
+    if (!input_vstream_params) {
+        std::cerr << "Failed creating input vstreams params " << input_vstream_params.status() << std::endl;
+        return make_unexpected(input_vstream_params.status());
+    }
+
+    /* The input format order in the example HEF is NHWC in the user-side (may be seen using 'hailortcli parse-hef <HEF_PATH>).
+	   Here we override the user-side format order to be NCHW */
+    for (auto &params_pair : *input_vstream_params) {
+        params_pair.second.user_buffer_format.order = HAILO_FORMAT_ORDER_NHWC;
+    }
+
+    auto input_vstreams = VStreamsBuilder::create_input_vstreams(*network_group, *input_vstream_params);
+    if (!input_vstreams) {
+        std::cerr << "Failed creating input vstreams " << input_vstreams.status() << std::endl;
+        return make_unexpected(input_vstreams.status());
+    }
+
+    // Set output format type to float32 - libhailort will de-quantize the data after reading from the HW
+    // Note: this process might affect the overall performance
+    // QUANTIZED_OUTPUT 时保持 NMS 的原生 UINT16 格式，只对通过阈值的框反量化
+    constexpr auto output_format_type = QUANTIZED_OUTPUT ? HAILO_FORMAT_TYPE_UINT16 : HAILO_FORMAT_TYPE_FLOAT32;
+    auto output_vstream_params = network_group->make_output_vstream_params({}, output_format_type, HAILO_DEFAULT_VSTREAM_TIMEOUT_MS,
+                                                                           HAILO_DEFAULT_VSTREAM_QUEUE_SIZE);
+    if (!output_vstream_params) {
+        std::cerr << "Failed creating output vstreams params " << output_vstream_params.status() << std::endl;
+        return make_unexpected(output_vstream_params.status());
+    }
+    auto output_vstreams = VStreamsBuilder::create_output_vstreams(*network_group, *output_vstream_params);
+    if (!output_vstreams) {
+        std::cerr << "Failed creating output vstreams " << output_vstreams.status() << std::endl;
+        return make_unexpected(output_vstreams.status());
+    }
+
+    if (input_vstreams->size() != 1 || output_vstreams->size() != 1) {
+        std::cerr << network_group->name() << " must have exactly one input and one output vstream" << std::endl;
+        return make_unexpected(HAILO_INVALID_OPERATION);
+    }
+
+    nms_quant quant{};
+    if constexpr (QUANTIZED_OUTPUT) {
+        auto quant_infos = output_vstreams.value()[0].get_quant_infos();
+        if (quant_infos.empty()) {
+            std::cerr << "输出vstream没有量化参数" << std::endl;
+            return make_unexpected(HAILO_INVALID_OPERATION);
+        }
+        quant = { quant_infos[0].qp_zp, quant_infos[0].qp_scale };
+        std::cout << "输出量化参数 zp=" << quant.zp << " scale=" << quant.scale << std::endl;
+    }
+
+    if (output_vstreams.value()[0].get_frame_size() != nms_output_buffer<output_t>::FRAME_SIZE) {
+        std::cerr << "NMS输出大小不匹配: " << output_vstreams.value()[0].get_frame_size() << " != " << nms_output_buffer<output_t>::FRAME_SIZE << std::endl;
+        return make_unexpected(HAILO_INVALID_OPERATION);
+    }
+
+    return std::unique_ptr<detector>(new hailo_detector(std::move(network_group), input_vstreams.release(),
+                                                        output_vstreams.release(), quant));
+}
@@ -1,11 +1,16 @@
+#include <algorithm>
 #include <iostream>
 #include <string_view>
 #include <tuple>
 #include "hailo/hailort.hpp"
 
+#include "config.hpp"
+#include "model_backend.hpp"
+
 using namespace hailort;
 
-Expected<std::shared_ptr<ConfiguredNetworkGroup> > configure_network_group(VDevice &vdevice, std::string hef_path)
+/*把 HEF 里的全部网络组配置到 vdevice 上；同一个 vdevice 可以多次调用，由 model scheduler 在网络组之间切换*/
+Expected<ConfiguredNetworkGroupVector> configure_network_groups(VDevice &vdevice, std::string hef_path)
 {
     auto hef = Hef::create(hef_path);
     if (!hef) {
@@ -22,6 +27,21 @@ Expected<std::shared_ptr<ConfiguredNetworkGroup> > configure_network_group(VDevi
         return make_unexpected(network_groups.status());
     }
 
+    if (network_groups->empty()) {
+        std::cerr << "Invalid amount of network groups" << std::endl;
+        return make_unexpected(HAILO_INTERNAL_FAILURE);
+    }
+
+    return network_groups.release();
+}
+
+Expected<std::shared_ptr<ConfiguredNetworkGroup> > configure_network_group(VDevice &vdevice, std::string hef_path)
+{
+    auto network_groups = configure_network_groups(vdevice, hef_path);
+    if (!network_groups) {
+        return make_unexpected(network_groups.status());
+    }
+
     if (1 != network_groups->size()) {
         std::cerr << "Invalid amount of network groups" << std::endl;
         return make_unexpected(HAILO_INTERNAL_FAILURE);
@@ -30,6 +50,135 @@ Expected<std::shared_ptr<ConfiguredNetworkGroup> > configure_network_group(VDevi
     return std::move(network_groups->at(0));
 }
 
+hailo_status apply_scheduler_params(ConfiguredNetworkGroup &network_group, const model_config &config)
+{
+    auto status = network_group.set_scheduler_priority(config.priority);
+    if (HAILO_SUCCESS != status) {
+        std::cerr << "Failed setting scheduler priority " << status << std::endl;
+        return status;
+    }
+    // threshold 为 1 时保持 HailoRT 的默认行为，不需要 timeout
+    if (config.threshold > 1) {
+        status = network_group.set_scheduler_threshold(config.threshold);
+        if (HAILO_SUCCESS != status) {
+            std::cerr << "Failed setting scheduler threshold " << status << std::endl;
+            return status;
+        }
+        status = network_group.set_scheduler_timeout(std::chrono::milliseconds(config.timeout_ms));
+        if (HAILO_SUCCESS != status) {
+            std::cerr << "Failed setting scheduler timeout " << status << std::endl;
+            return status;
+        }
+    }
+    return HAILO_SUCCESS;
+}
+
+class vstream_backend : public model_backend {
+    std::shared_ptr<ConfiguredNetworkGroup> network_group_;
+    std::vector<InputVStream> inputs_;
+    std::vector<OutputVStream> outputs_;
+    std::string name_;
+    std::size_t batch_;
+
+public:
+    vstream_backend(std::shared_ptr<ConfiguredNetworkGroup> network_group, std::vector<InputVStream> inputs,
+                    std::vector<OutputVStream> outputs, std::size_t batch)
+        : network_group_(std::move(network_group)), inputs_(std::move(inputs)), outputs_(std::move(outputs)),
+          name_(network_group_->name()), batch_(batch)
+    {
+    }
+
+    const std::string &name() const override
+    {
+        return name_;
+    }
+    std::size_t input_frame_size() const override
+    {
+        return inputs_[0].get_frame_size();
+    }
+    std::size_t output_frame_size() const override
+    {
+        return outputs_[0].get_frame_size();
+    }
+    int input_width() const override
+    {
+        return static_cast<int>(inputs_[0].get_info().shape.width);
+    }
+    int input_height() const override
+    {
+        return static_cast<int>(inputs_[0].get_info().shape.height);
+    }
+    std::size_t max_batch() const override
+    {
+        return batch_;
+    }
+
+    hailo_status infer_batch(std::span<const uint8_t *const> inputs, std::span<uint8_t *const> outputs) override
+    {
+        // 每次最多写 batch_ 帧再读回，不超过 vstream 队列深度，避免写满后和读端互相等待
+        for (std::size_t begin = 0; begin < inputs.size(); begin += batch_) {
+            auto end = std::min(inputs.size(), begin + batch_);
+            for (auto i = begin; i < end; i++) {
+                auto status = inputs_[0].write(MemoryView(const_cast<uint8_t *>(inputs[i]), input_frame_size()));
+                if (HAILO_SUCCESS != status) {
+                    std::cerr << name_ << " failed writing to input vstream: " << status << std::endl;
+                    return status;
+                }
+            }
+            for (auto i = begin; i < end; i++) {
+                auto status = outputs_[0].read(MemoryView(outputs[i], output_frame_size()));
+                if (HAILO_SUCCESS != status) {
+                    std::cerr << name_ << " failed reading output vstream: " << status << std::endl;
+                    return status;
+                }
+            }
+        }
+        return HAILO_SUCCESS;
+    }
+};
+
+Expected<std::unique_ptr<model_backend> > create_vstream_backend(std::shared_ptr<ConfiguredNetworkGroup> network_group, const model_config &config)
+{
+    auto status = apply_scheduler_params(*network_group, config);
+    if (HAILO_SUCCESS != status) {
+        return make_unexpected(status);
+    }
+
+    auto input_vstream_params = network_group->make_input_vstream_params({}, HAILO_FORMAT_TYPE_AUTO, HAILO_DEFAULT_VSTREAM_TIMEOUT_MS, config.batch);
+    if (!input_vstream_params) {
+        std::cerr << "Failed creating input vstreams params " << input_vstream_params.status() << std::endl;
+        return make_unexpected(input_vstream_params.status());
+    }
+    for (auto &params_pair : *input_vstream_params) {
+        params_pair.second.user_buffer_format.order = HAILO_FORMAT_ORDER_NHWC;
+    }
+    auto input_vstreams = VStreamsBuilder::create_input_vstreams(*network_group, *input_vstream_params);
+    if (!input_vstreams) {
+        std::cerr << "Failed creating input vstreams " << input_vstreams.status() << std::endl;
+        return make_unexpected(input_vstreams.status());
+    }
+
+    // 分类输出很小，直接让 libhailort 反量化成 FLOAT32
+    auto output_vstream_params = network_group->make_output_vstream_params({}, HAILO_FORMAT_TYPE_FLOAT32, HAILO_DEFAULT_VSTREAM_TIMEOUT_MS, config.batch);
+    if (!output_vstream_params) {
+        std::cerr << "Failed creating output vstreams params " << output_vstream_params.status() << std::endl;
+        return make_unexpected(output_vstream_params.status());
+    }
+    auto output_vstreams = VStreamsBuilder::create_output_vstreams(*network_group, *output_vstream_params);
+    if (!output_vstreams) {
+        std::cerr << "Failed creating output vstreams " << output_vstreams.status() << std::endl;
+        return make_unexpected(output_vstreams.status());
+    }
+
+    if (input_vstreams->size() != 1 || output_vstreams->size() != 1) {
+        std::cerr << network_group->name() << " must have exactly one input and one output vstream" << std::endl;
+        return make_unexpected(HAILO_INVALID_OPERATION);
+    }
+
+    return std::unique_ptr<model_backend>(new vstream_backend(std::move(network_group), input_vstreams.release(),
+                                                              output_vstreams.release(), config.batch));
+}
+
 auto hailo_vdevice_init(const std::string_view hef_path, std::size_t max_layer_edges = 16) -> std::tuple<Expected<std::vector<InputVStream> >, Expected<std::vector<OutputVStream> > >
 {
     auto vdevice = VDevice::create();
@@ -65,7 +214,9 @@ auto hailo_vdevice_init(const std::string_view hef_path, std::size_t max_layer_e
 
     // Set output format type to float32 - libhailort will de-quantize the data after reading from the HW
     // Note: this process might affect the overall performance
-    auto output_vstream_params = network_group.value()->make_output_vstream_params({}, HAILO_FORMAT_TYPE_FLOAT32, HAILO_DEFAULT_VSTREAM_TIMEOUT_MS,
+    // QUANTIZED_OUTPUT 时保持 NMS 的原生 UINT16 格式，由 hailo_detector 只对通过阈值的框反量化
+    constexpr auto output_format_type = QUANTIZED_OUTPUT ? HAILO_FORMAT_TYPE_UINT16 : HAILO_FORMAT_TYPE_FLOAT32;
+    auto output_vstream_params = network_group.value()->make_output_vstream_params({}, output_format_type, HAILO_DEFAULT_VSTREAM_TIMEOUT_MS,
                                                                                    HAILO_DEFAULT_VSTREAM_QUEUE_SIZE);
     if (!output_vstream_params) {
         std::cerr << "Failed creating output vstreams params " << output_vstream_params.status() << std::endl;
@@ -1,175 +1,235 @@
 #include "hailo/hailort.hpp"
-#include "thread_safe_queue.hpp"
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
+#include <mutex>
+#include <optional>
 #include <opencv2/imgcodecs.hpp>
 #include "opencv2/opencv.hpp"
 
+#include "config.hpp"
+#include "hailo_nms.hpp"
+#include "infer.hpp"
+
 using namespace hailort;
 using namespace std::chrono_literals;
 
-extern std::atomic<bool> g_stop_requested;
-extern thread_safe_queue<cv::Mat> g_capture_queue;
-extern thread_safe_queue<cv::Mat> g_imshow_queue;
+static double seconds(std::chrono::system_clock::time_point tp)
+{
+    return std::chrono::duration<double>(tp.time_since_epoch()).count();
+}
+
+inference_stage::inference_stage(detector *npu_detector, detector *cpu_detector, model_backend *classifier_backend, display_stage *display, task_executor *executor)
+    : npu_detector_(npu_detector), cpu_detector_(cpu_detector), display_(display),
+      preview_order_("预览", REORDER_WINDOW, std::chrono::milliseconds(REORDER_MAX_WAIT_MS),
+                     [this](display_frame &item) {
+                         if (display_ != nullptr)
+                             display_->publish(item);
+                     }),
+      results_("后处理", POSTPROCESS_QUEUE_DEPTH),
+      // 目前只有一路摄像头；推理完的结果换进后处理通道就返回，分派队列满了丢掉的帧不会再有结果，重排时不用等
+      dispatcher_(1, DISPATCH_QUEUE_DEPTH, [this](dispatch_result &result) { results_.push(result); },
+                  [this](std::size_t, video_frame &frame) { skip(frame.info().sequence); })
+{
+    attributes_.reserve(NMS_NUM_CLASSES * NMS_MAX_BOXES_PER_CLASS);
+    if (classifier_backend != nullptr) {
+        classifier_.emplace(*classifier_backend, CLASSIFIER_SOURCE_CLASSES, executor);
+    }
+
+    if (DETECTION_STREAM[0] != '\0')
+        result_stream_.emplace(DETECTION_STREAM, DETECTION_STREAM_BATCH, std::chrono::milliseconds(DETECTION_STREAM_MAX_DELAY_MS));
+
+    if (SHM_RING_NAME[0] != '\0') {
+        shm_ring_.emplace(SHM_RING_NAME, SHM_RING_SLOTS, SHM_RING_FRAMES ? VIDEO_WIDTH * VIDEO_HEIGHT * 3 : 0);
+        if (!shm_ring_->valid())
+            shm_ring_.reset();
+    }
+
+    if (TRACKER_MAX_STRIDE > 1) {
+        tracker_params params;
+        params.max_stride = TRACKER_MAX_STRIDE;
+        tracker_.emplace(params);
+        track_input_.reserve(NMS_NUM_CLASSES * NMS_MAX_BOXES_PER_CLASS);
+    }
 
-void infer_thread(Expected<std::vector<InputVStream> > input_vstreams, Expected<std::vector<OutputVStream> > output_vstreams)
+    // 每个后端的线程各 push 一路，只有一个后端时两端都不加锁
+    results_.add_producers((npu_detector_ != nullptr ? 1 : 0) + (cpu_detector_ != nullptr ? 1 : 0));
+    results_.add_consumers(1);
+    postprocess_thread_ = std::thread(&inference_stage::run_postprocess, this);
+    // NPU 为主，CPU 只接 NPU 排不过来的帧
+    if (npu_detector_ != nullptr)
+        dispatcher_.add_backend(*npu_detector_, dispatch_role::primary, NPU_FEED_PLACEMENT);
+    if (cpu_detector_ != nullptr)
+        dispatcher_.add_backend(*cpu_detector_, dispatch_role::fallback, CPU_FALLBACK_PLACEMENT);
+    dispatcher_.start();
+}
+
+inference_stage::~inference_stage()
 {
-    auto status = HAILO_SUCCESS;
-    std::size_t frame_count = 0;
-    auto before_while = std::chrono::high_resolution_clock::now();
-    while (true) {
-        if (g_stop_requested) {
-            std::cout << "\n收到 Ctrl+C 或推理结束，准备退出...\n";
-            std::cout << "共推理" << --frame_count << "帧。" << "平均一帧耗时:" << (std::chrono::high_resolution_clock::now() - before_while) / 1ms / frame_count << "ms" << std::endl;
-            break;
-        }
+    finish();
+}
 
-        std::cout << "第" << frame_count++ << "帧" << std::endl;
-        auto all_start = std::chrono::high_resolution_clock::now();
+void inference_stage::run_postprocess()
+{
+    apply_thread_placement("后处理", POSTPROCESS_PLACEMENT);
+    dispatch_result result{};
+    while (results_.pop(result)) {
+        if (discard_.load(std::memory_order_relaxed))
+            skip(result.sequence);
+        else
+            postprocess(result);
+        // 空壳换回通道前先把帧还给池
+        result.frame.reset();
+    }
+}
 
-        auto get_frame_start = std::chrono::high_resolution_clock::now();
+void inference_stage::postprocess(dispatch_result &result)
+{
+    auto &frame = result.frame;
+    auto &dets = result.dets;
+    std::cout << "第" << result.sequence << "帧 " << result.backend->name() << " 检测耗时：" << result.latency / 1ms << "ms" << std::endl;
+
+    // 直接从检测结果编码进批缓冲区，不经过中间对象
+    if (result_stream_)
+        result_stream_->write(static_cast<uint32_t>(result.stream), result.sequence, result.captured, dets);
+    if (shm_ring_) {
+        shm_ring_->publish(static_cast<uint32_t>(result.stream), result.sequence, result.captured, dets, SHM_RING_FRAMES ? frame.mat() : cv::Mat());
+        if (SHM_RING_FRAMES)
+            frame_pool::count_copy(frame.mat().total() * frame.mat().elemSize());
+    }
 
-        cv::Mat frame;
-        g_capture_queue.front_pop(frame);
-        cv::imwrite("test.jpg", frame);
-        std::cout << "获取一帧耗时：" << (std::chrono::high_resolution_clock::now() - get_frame_start) / 1ms << "ms" << std::endl;
+    // 跟踪器按采集时间更新，后端并行时先到的新结果会让晚到的旧结果被忽略
+    if (tracker_) {
+        track_input_.clear();
+        for (const auto &det : dets)
+            track_input_.push_back({ det.x_min, det.y_min, det.x_max, det.y_max, det.score, det.class_id });
+        std::lock_guard<std::mutex> tracker_lock(tracker_mutex_);
+        tracker_->update(seconds(result.captured), track_input_);
+    }
 
-        if (frame.empty()) {
-            std::cout << "End of video file" << std::endl;
-            g_stop_requested = true;
-            continue;
-        }
-        auto write_frame = [&frame, &all_start](InputVStream &input, hailo_status &status) {
-            auto opencv_start = std::chrono::high_resolution_clock::now();
-
-            cv::Mat processed;
-            cv::resize(frame, processed, cv::Size(640, 640));
-            // cv::cvtColor(processed, processed, cv::COLOR_BGR2RGB);
-            auto opencv_time = std::chrono::high_resolution_clock::now();
-            auto write_time = opencv_time - opencv_start;
-            std::cout << "OpenCV预处理耗时：" << write_time / 1ms << "ms" << std::endl;
-
-            // 检查 Mat 是否连续（通常是连续的）
-            if (!processed.isContinuous()) {
-                processed = processed.clone();
-            }
-
-            // 将 Mat 数据复制到 vector 中
-            // std::cout << "processed.size" << processed.total() * processed.elemSize() << std::endl;
-            // std::cout << "input.get_frame_size()" << input.get_frame_size() << std::endl;
-            // std::memcpy(data.data(), processed.data, input.get_frame_size());
-            if (processed.total() * processed.elemSize() != input.get_frame_size()) {
-                g_stop_requested = true;
-                std::cerr << "Mat数据大小不匹配" << std::endl;
-                return;
-            }
-            status = input.write(MemoryView(processed.data, input.get_frame_size()));
-            if (HAILO_SUCCESS != status) {
-                std::cerr << "Failed writing to input vstream: " << status << std::endl;
-                return;
-            }
-
-            // Flushing is not mandatory here - removed to prevent timeout issues
-            status = input.flush();
-            if (HAILO_SUCCESS != status) {
-                std::cerr << "Failed flushing input vstream" << std::endl;
-                return;
-            }
-            std::cout << "内存复制耗时：" << (std::chrono::high_resolution_clock::now() - opencv_time) / 1ms << "ms" << std::endl;
-            status = HAILO_SUCCESS;
-        };
-        auto read_output = [&frame](OutputVStream &output, hailo_status &status) {
-            // 1. 读取完整的数据 (160320 bytes)
-            auto read_time = std::chrono::high_resolution_clock::now();
-            std::vector<float> out(output.get_frame_size() / sizeof(float));
-            status = output.read(MemoryView(out.data(), output.get_frame_size()));
-            std::cout << "NPU推理耗时：" << (std::chrono::high_resolution_clock::now() - read_time) / 1ms << "ms" << std::endl;
-            auto opencv_start = std::chrono::high_resolution_clock::now();
-            if (status != HAILO_SUCCESS)
-                return;
-
-            int width = frame.cols;
-            int height = frame.rows;
-
-            // 定义常量
-            const int NUM_CLASSES = 80;
-            const int MAX_BOXES_PER_CLASS = 100;
-            const int BOX_DIM = 5; // (ymin, xmin, ymax, xmax, score) 注意没有class_id，因为class_id由外层循环决定
-
-            // 每一个Class占用的 float 数量 = 1个计数器 + 100个框 * 5个数据
-            const int CLASS_STRIDE = 1 + (MAX_BOXES_PER_CLASS * BOX_DIM);
-
-            // 外层循环：遍历所有 80 个类别
-            for (int class_id = 0; class_id < NUM_CLASSES; class_id++) {
-                // 计算当前类别的起始位置
-                int class_offset = class_id * CLASS_STRIDE;
-
-                // 获取当前类别检测到的数量
-                int count = static_cast<int>(out[class_offset]);
-
-                // 如果这个类别没有检测到东西，直接跳过，处理下一个类别
-                if (count <= 0)
-                    continue;
-
-                // 内层循环：只读取有效数量的框
-                for (int i = 0; i < count; i++) {
-                    // 计算具体某个框的起始位置
-                    // class_offset + 1 (跳过计数器) + i * 5
-                    int box_idx = class_offset + 1 + i * BOX_DIM;
-
-                    float y_min_norm = out[box_idx + 0];
-                    float x_min_norm = out[box_idx + 1];
-                    float y_max_norm = out[box_idx + 2];
-                    float x_max_norm = out[box_idx + 3];
-                    float score = out[box_idx + 4];
-
-                    // 过滤低置信度 (Log里说阈值是0.2，这里可以再次过滤)
-                    if (score < 0.25f)
-                        continue;
-
-                    // 坐标还原 (反归一化)
-                    int x1 = (int)(x_min_norm * width);
-                    int y1 = (int)(y_min_norm * height);
-                    int x2 = (int)(x_max_norm * width);
-                    int y2 = (int)(y_max_norm * height);
-
-                    // 绘制矩形
-                    cv::rectangle(frame, cv::Point(x1, y1), cv::Point(x2, y2), cv::Scalar(0, 255, 0), 2);
-
-                    // 绘制标签
-                    // 这里可以直接用 class_id，比如 0 就是 Person
-                    std::string label = std::to_string(class_id) + " " + std::to_string(score).substr(0, 4);
-
-                    int text_y = y1 - 5;
-                    if (text_y < 20)
-                        text_y = y1 + 20;
-
-                    cv::putText(frame, label, cv::Point(x1, text_y),
-                                cv::FONT_HERSHEY_SIMPLEX, 0.6, cv::Scalar(0, 255, 0), 1);
-
-                    // auto tp = std::chrono::system_clock::now();
-                    // auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(tp.time_since_epoch()) % 1000;
-                    // std::time_t t = std::chrono::system_clock::to_time_t(tp);
-                    // cv::putText(frame, (std::stringstream{} << std::put_time(std::localtime(&t), "%Y-%m-%d %H:%M:%S") << '.' << std::setw(3) << std::setfill('0') << ms.count()).str(),
-                    //             { 10, 30 }, cv::FONT_HERSHEY_SIMPLEX, 1.0, { 0, 255, 0 }, 2);
-                }
-            }
-            std::cout << "画框耗时：" << (std::chrono::high_resolution_clock::now() - opencv_start) / 1ms << "ms" << std::endl;
-            g_imshow_queue.push(std::move(frame));
-        };
-
-        /*向NPU写入数据*/
-        write_frame(input_vstreams.value()[0], status);
-
-        /*从NPU读取数据*/
-        read_output(output_vstreams.value()[0], status);
-
-        std::cout << "全过程耗时：" << (std::chrono::high_resolution_clock::now() - all_start) / 1ms << "ms" << std::endl;
-
-        if (HAILO_SUCCESS != status) {
-            std::cerr << "Inference failed " << status << std::endl;
-            g_stop_requested = true;
-            break;
+    // 检测结果照常记录；已经过期的帧不值得再分类、画框
+    if (postprocess_late_.expired(frame.info())) {
+        skip(frame.info().sequence);
+        frame.reset();
+        return;
+    }
+
+    // 二级分类：裁剪检测框成批送入同一个 VDevice 上的分类模型，裁剪用的是原分辨率的帧
+    attributes_.clear();
+    if (classifier_) {
+        auto classify_start = std::chrono::high_resolution_clock::now();
+        auto status = classifier_->classify(frame.mat(), dets, attributes_);
+        std::cout << "二级分类" << attributes_.size() << "个框耗时：" << (std::chrono::high_resolution_clock::now() - classify_start) / 1ms << "ms" << std::endl;
+        if (status != HAILO_SUCCESS) {
+            std::cerr << "二级分类失败 " << status << std::endl;
+            attributes_.clear();
         }
     }
-}
\ No newline at end of file
+    if (display_ == nullptr)
+        return;
+
+    // 推理线程上不画框，只把帧和检测列表交给显示阶段
+    const auto sequence = frame.info().sequence;
+    preview_.frame = std::move(frame);
+    preview_.dets.assign(dets.begin(), dets.end());
+    // attributes 按检测框顺序生成，对应的框带上二级分类结果
+    preview_.attributes.assign(dets.size(), overlay_renderer::NO_ATTRIBUTE);
+    for (const auto &attribute : attributes_)
+        preview_.attributes[attribute.detection_index] = attribute.attribute;
+    preview_.sequence = sequence;
+    publish_preview(preview_, sequence);
+}
+
+void inference_stage::publish_preview(display_frame &slot, uint64_t sequence)
+{
+    // 按采集序号排好再交给预览；已经被跳过的帧（等超时了）不再显示
+    if (!preview_order_.push(sequence, slot))
+        slot.frame.reset();
+}
+
+void inference_stage::skip(uint64_t sequence)
+{
+    preview_order_.skip(sequence);
+}
+
+bool inference_stage::extrapolate(std::chrono::system_clock::time_point captured)
+{
+    std::lock_guard<std::mutex> lock(tracker_mutex_);
+    if (tracker_->should_infer())
+        return false;
+    tracked_preview_.dets.clear();
+    tracker_->for_each_visible(seconds(captured), [this](const multi_tracker::track &, const track_box &box) {
+        tracked_preview_.dets.push_back({ box.class_id, box.score, box.x1, box.y1, box.x2, box.y2 });
+    });
+    return true;
+}
+
+bool inference_stage::schedule(video_frame &frame)
+{
+    const auto captured = frame.info().captured;
+
+    // 在解码、重排里耽误太久的帧不再推理也不再外推
+    if (schedule_late_.expired(frame.info())) {
+        skip(frame.info().sequence);
+        frame.reset();
+        return true;
+    }
+
+    // 不推理的帧直接把跟踪器外推到这一帧的框交给预览；锁只包住跟踪器本身，交给预览在锁外
+    if (tracker_ && extrapolate(captured)) {
+        tracked_preview_.attributes.assign(tracked_preview_.dets.size(), overlay_renderer::NO_ATTRIBUTE);
+        const auto sequence = frame.info().sequence;
+        tracked_preview_.frame = std::move(frame);
+        tracked_preview_.sequence = sequence;
+        if (display_ != nullptr)
+            publish_preview(tracked_preview_, sequence);
+        else
+            tracked_preview_.frame.reset();
+        tracked_count_++;
+        return true;
+    }
+    if (!dispatcher_.submit(0, std::move(frame))) {
+        std::cerr << "没有可用的推理后端" << std::endl;
+        return false;
+    }
+    frame_count_++;
+    return true;
+}
+
+void inference_stage::finish(bool discard)
+{
+    if (finished_)
+        return;
+    finished_ = true;
+    dispatcher_.stop(discard);
+    // 后端都停了，不会再有新结果；后处理线程取完通道里剩下的才退出
+    discard_.store(discard, std::memory_order_relaxed);
+    results_.close();
+    if (postprocess_thread_.joinable())
+        postprocess_thread_.join();
+    // 后处理也结束了，缺的帧不会再来
+    preview_order_.drain();
+    std::cout << "\n收到 Ctrl+C 或推理结束，准备退出...\n";
+    std::cout << "共提交" << frame_count_ << "帧。" << "平均一帧耗时:" << (std::chrono::high_resolution_clock::now() - start_) / 1ms / std::max<std::size_t>(frame_count_, 1) << "ms" << std::endl;
+    dispatcher_.report();
+    results_.report();
+    if (display_ != nullptr)
+        preview_order_.report();
+    schedule_late_.report();
+    postprocess_late_.report();
+    if (tracker_) {
+        auto &stats = tracker_->statistics();
+        std::cout << "跟踪器: " << stats.frames << "帧中推理" << stats.inferences << "帧，外推" << tracked_count_ << "帧，新建轨迹" << stats.created
+                  << "条，丢弃过时结果" << stats.stale << "次" << std::endl;
+    }
+    if (npu_detector_ != nullptr)
+        npu_detector_->report();
+    if (cpu_detector_ != nullptr)
+        cpu_detector_->report();
+    if (classifier_)
+        classifier_->metrics().report("二级分类预处理");
+    if (result_stream_) {
+        result_stream_->flush();
+        result_stream_->report();
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "channel.hpp"
+#include "classifier.hpp"
+#include "detection_stream.hpp"
+#include "detector.hpp"
+#include "dispatcher.hpp"
+#include "display.hpp"
+#include "frame_deadline.hpp"
+#include "frame_pool.hpp"
+#include "model_backend.hpp"
+#include "reorder_buffer.hpp"
+#include "shm_ring.hpp"
+#include "tracker.hpp"
+#include "work_stealing.hpp"
+
+/*
+ * 流水线的调度阶段和推理后处理：
+ * schedule 在调度阶段的线程里逐帧调用，跟踪器决定这一帧推理还是外推；推理的帧交给 inference_dispatcher 分到 NPU / CPU 后端
+ * 后端完成后把结果交给一个普通优先级的后处理线程：写检测记录流和共享内存环、更新跟踪器、二级分类、交给预览；
+ * NPU 送帧线程是实时优先级，后处理不放在它上面
+ * 外推的帧马上就有结果，推理的帧要等后端，两个后端之间也会乱序，所以交给预览之前按采集序号重排
+ * 过了处理期限的帧在调度时直接丢掉；推理完才过期的帧照常写记录、更新跟踪器，但不再做二级分类、不交给预览
+ */
+class inference_stage {
+public:
+    /*后端、显示阶段和执行器的生命周期由调用方保证；没有 NPU 后端时 npu_detector 为空，不需要预览时 display 为空，executor 为空时二级分类串行裁剪*/
+    inference_stage(detector *npu_detector, detector *cpu_detector, model_backend *classifier_backend, display_stage *display, task_executor *executor);
+    ~inference_stage();
+    inference_stage(const inference_stage &) = delete;
+    inference_stage &operator=(const inference_stage &) = delete;
+
+    /*只能在一个线程里调用；返回 false 表示已经没有可用的推理后端*/
+    bool schedule(video_frame &frame);
+
+    /*采集序号为 sequence 的帧不会 schedule 了（上游丢掉或者解码失败），预览不用等它；任何线程都可以调用*/
+    void skip(uint64_t sequence);
+
+    /*等已提交的帧全部处理完（discard 时丢掉还在排队的帧，只等正在推理的），打印统计；之后不能再 schedule*/
+    void finish(bool discard = false);
+
+private:
+    detector *npu_detector_;
+    detector *cpu_detector_;
+    display_stage *display_;
+
+    // 二级分类结果，容量预留一次，之后每帧 clear 复用
+    std::vector<crop_result> attributes_;
+    std::optional<crop_classifier> classifier_;
+    // 检测结果的二进制记录流，给下游服务
+    std::optional<detection_stream_writer> result_stream_;
+    // 给其它进程的共享内存环，帧在这里复制一次，之后消费者直接读共享内存
+    std::optional<shm_ring_writer> shm_ring_;
+    // 多目标跟踪：跟踪稳定时隔几帧才推理一次，跳过的帧显示外推的框
+    std::optional<multi_tracker> tracker_;
+    std::vector<track_box> track_input_;
+    // 交给显示阶段的槽位，经过重排缓冲区和 display_stage 内部的槽位来回交换，容量一直沿用
+    // 后处理线程用 preview_，调度阶段外推的帧用 tracked_preview_，两边互不等待
+    display_frame preview_;
+    display_frame tracked_preview_;
+    // 按采集序号重排后才交给预览
+    reorder_buffer<display_frame> preview_order_;
+    // 各自统计过期跳过的帧
+    deadline_gate schedule_late_{ "调度" };
+    deadline_gate postprocess_late_{ "二级分类和预览" };
+
+    // 跟踪器单独一把锁，只包住 should_infer / for_each_visible / update：调度阶段不用等后处理的分类、复制和写流
+    std::mutex tracker_mutex_;
+
+    std::size_t frame_count_ = 0;
+    std::size_t tracked_count_ = 0;
+    std::chrono::high_resolution_clock::time_point start_ = std::chrono::high_resolution_clock::now();
+    bool finished_ = false;
+
+    // NPU 和 CPU 后端推理完的结果（和 dispatch_result 交换，dets 的容量循环使用），由一个后处理线程串行处理，分类器等不用加锁
+    bounded_channel<dispatch_result, overflow_policy::block> results_;
+    // finish(discard) 时置位：后处理线程把剩下的结果直接跳过
+    std::atomic<bool> discard_{ false };
+    std::thread postprocess_thread_;
+
+    // 最后构造、最先析构：工作线程会用到上面所有成员
+    inference_dispatcher dispatcher_;
+
+    /*后处理线程：取完 results_ 里的结果才退出*/
+    void run_postprocess();
+    void postprocess(dispatch_result &result);
+    /*跟踪器决定这一帧不推理时，把外推到 captured 的框填进 tracked_preview_ 并返回 true；只在调度线程上调用*/
+    bool extrapolate(std::chrono::system_clock::time_point captured);
+    /*slot 交给重排缓冲区，换回来的空槽位留在 slot 里；preview_ 只在后处理线程上调用，tracked_preview_ 只在调度线程上调用*/
+    void publish_preview(display_frame &slot, uint64_t sequence);
+};
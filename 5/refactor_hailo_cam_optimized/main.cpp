@@ -2,106 +2,226 @@
 #include <csignal>
 #include <atomic>
 #include <iostream>
+#include <optional>
+#include <stop_token>
+#include <string_view>
 #include <thread>
 #include "hailo/hailort.hpp"
 #include "opencv2/opencv.hpp"
 
+#include "capture.hpp"
+#include "channel.hpp"
 #include "config.hpp"
-#include "thread_safe_queue.hpp"
+#include "detector.hpp"
+#include "display.hpp"
+#include "frame_deadline.hpp"
+#include "frame_pool.hpp"
+#include "infer.hpp"
+#include "model_backend.hpp"
+#include "pipeline.hpp"
+#include "reorder_buffer.hpp"
+#include "thread_placement.hpp"
+#include "work_stealing.hpp"
 
 using namespace hailort;
 using namespace std::chrono_literals;
 
-std::atomic<bool> g_stop_requested{ false };
-std::atomic<bool> g_v4l2_requeue{ true };
-thread_safe_queue<cv::Mat> g_capture_queue{};
-thread_safe_queue<cv::Mat> g_imshow_queue{};
+static std::atomic<bool> g_stop_requested{ false };
 
-extern Expected<std::shared_ptr<ConfiguredNetworkGroup> > configure_network_group(VDevice &vdevice, std::string hef_path);
+extern Expected<ConfiguredNetworkGroupVector> configure_network_groups(VDevice &vdevice, std::string hef_path);
 extern auto hailo_vdevice_init(const std::string_view hef_path, std::size_t max_layer_edges = 16) -> std::tuple<Expected<std::vector<InputVStream> >, Expected<std::vector<OutputVStream> > >;
-extern void infer_thread(Expected<std::vector<InputVStream> > input_vstreams, Expected<std::vector<OutputVStream> > output_vstreams);
-extern void capture_thread();
 
-int main()
+/*在 vdevice 上配置检测模型和（可选的）二级分类模型，VDevice 默认开启 model scheduler，多个网络组（同一个 HEF 或多个 HEF）共享 NPU*/
+static hailo_status init_hailo_models(VDevice &vdevice, std::unique_ptr<detector> &npu_detector, std::unique_ptr<model_backend> &classifier_backend)
 {
-    std::signal(SIGINT, [](int signal) {
-        if (signal == SIGINT) {
-            g_stop_requested = true;
+    auto network_groups = configure_network_groups(vdevice, HEF_FILE);
+    if (!network_groups) {
+        std::cerr << "Failed to configure network group " << HEF_FILE << std::endl;
+        return network_groups.status();
+    }
+    auto detector = create_hailo_detector(network_groups->at(0));
+    if (!detector) {
+        std::cerr << "Failed creating detector " << detector.status() << std::endl;
+        return detector.status();
+    }
+    npu_detector = detector.release();
+
+    /*二级分类模型：HEF_FILE 的第二个网络组，或者 CLASSIFIER_HEF_FILE 的第一个网络组*/
+    if (network_groups->size() > 1 || CLASSIFIER_HEF_FILE[0] != '\0') {
+        std::shared_ptr<ConfiguredNetworkGroup> classifier_group;
+        if (network_groups->size() > 1) {
+            classifier_group = network_groups->at(1);
+        } else {
+            auto classifier_groups = configure_network_groups(vdevice, CLASSIFIER_HEF_FILE);
+            if (!classifier_groups) {
+                std::cerr << "Failed to configure network group " << CLASSIFIER_HEF_FILE << std::endl;
+                return classifier_groups.status();
+            }
+            classifier_group = classifier_groups->at(0);
         }
-    });
+        auto backend = create_vstream_backend(classifier_group, CLASSIFIER_MODEL);
+        if (!backend) {
+            std::cerr << "Failed creating classifier backend " << backend.status() << std::endl;
+            return backend.status();
+        }
+        classifier_backend = backend.release();
+        std::cout << "二级分类模型: " << classifier_backend->name() << std::endl;
+    }
+    return HAILO_SUCCESS;
+}
 
-    /*采集线程*/
-    auto cap_handle = std::thread(capture_thread);
-    // cap_handle.detach();
+int main()
+{
+    // Ctrl+C 和看门狗 / systemd 发的 SIGTERM 一样处理：显示循环看到后按 SHUTDOWN_DRAIN_MS 排空退出
+    auto on_signal = [](int) { g_stop_requested = true; };
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
 
-    /*初始化Vdevice*/
+    /*CPU 后备检测：NPU 不可用时接全部帧，NPU 正常时只接它排不过来的帧*/
+    std::unique_ptr<detector> cpu_detector;
+#ifdef WITH_ONNXRUNTIME
+    if (ONNX_MODEL_FILE[0] != '\0') {
+        auto onnx = create_onnx_detector(ONNX_MODEL_FILE);
+        if (onnx) {
+            cpu_detector = onnx.release();
+        } else {
+            std::cerr << "CPU后备检测不可用 " << onnx.status() << std::endl;
+        }
+    }
+#endif
+
+    /*初始化Vdevice，失败时有 CPU 后备就继续跑*/
     auto vdevice = VDevice::create();
+    // 声明在 vdevice 之后，保证先于 vdevice 析构
+    std::unique_ptr<detector> npu_detector;
+    std::unique_ptr<model_backend> classifier_backend;
     if (!vdevice) {
         std::cerr << "Failed create vdevice, status = " << vdevice.status() << std::endl;
-        return vdevice.status();
+        if (!cpu_detector)
+            return vdevice.status();
+        std::cerr << "只用CPU推理" << std::endl;
+    } else {
+        auto status = init_hailo_models(*vdevice.value(), npu_detector, classifier_backend);
+        if (HAILO_SUCCESS != status) {
+            if (!cpu_detector)
+                return status;
+            std::cerr << "NPU模型初始化失败，只用CPU推理" << std::endl;
+            npu_detector.reset();
+            classifier_backend.reset();
+        }
     }
 
-    auto network_group = configure_network_group(*vdevice.value(), HEF_FILE);
-    if (!network_group) {
-        std::cerr << "Failed to configure network group " << HEF_FILE << std::endl;
-        return network_group.status();
-    }
+    /*
+     * 帧池先于流水线构造、后于它析构，通道里剩下的帧析构时还能还给池
+     * 原始帧池放 NV12（1.5 字节 / 像素）或 JPEG 码流，帧池放转换后的 BGR
+     */
+    frame_pool raw_pool(cv::Size(VIDEO_WIDTH, VIDEO_HEIGHT * 3 / 2), CV_8UC1, RAW_POOL_SIZE, FRAME_POOL_HUGE_PAGES);
+    frame_pool frames(cv::Size(VIDEO_WIDTH, VIDEO_HEIGHT), CV_8UC3, FRAME_POOL_SIZE, FRAME_POOL_HUGE_PAGES);
 
-    // Set input format type to auto - libhailort will not scale the data before writing to the HW
-    auto input_vstream_params = network_group.value()->make_input_vstream_params({}, HAILO_FORMAT_TYPE_AUTO, HAILO_DEFAULT_VSTREAM_TIMEOUT_MS,
-                                                                                 HAILO_DEFAULT_VSTREAM_QUEUE_SIZE);
-    if (!input_vstream_params) {
-        std::cerr << "Failed creating input vstreams params " << input_vstream_params.status() << std::endl;
-        return input_vstream_params.status();
+    /*并行任务执行器：解码的分块颜色转换和二级分类的裁剪缩放共用，替代 OpenCV 的线程池*/
+    std::optional<task_executor> executor;
+    if (EXECUTOR_THREADS > 0) {
+        cv::setNumThreads(0);
+        executor.emplace("并行", EXECUTOR_THREADS, EXECUTOR_PLACEMENT);
     }
+    task_executor *tasks = executor ? &*executor : nullptr;
 
-    /* The input format order in the example HEF is NHWC in the user-side (may be seen using 'hailortcli parse-hef <HEF_PATH>).
-	   Here we override the user-side format order to be NCHW */
-    for (auto &params_pair : *input_vstream_params) {
-        params_pair.second.user_buffer_format.order = HAILO_FORMAT_ORDER_NHWC;
-    }
+    capture_source camera(raw_pool, frames, tasks);
+    if (!camera.open())
+        return -1;
 
-    auto input_vstreams = VStreamsBuilder::create_input_vstreams(*network_group.value(), *input_vstream_params);
-    if (!input_vstreams) {
-        std::cerr << "Failed creating input vstreams " << input_vstreams.status() << std::endl;
-        return input_vstreams.status();
-    }
+    /*预览：推理线程只交帧和检测结果，缩小和画框都在这个（主）线程上做*/
+    display_stage display(cv::Size(DISPLAY_WIDTH, DISPLAY_HEIGHT));
+    inference_stage inference(npu_detector.get(), cpu_detector.get(), classifier_backend.get(), &display, tasks);
 
-    // Set output format type to float32 - libhailort will de-quantize the data after reading from the HW
-    // Note: this process might affect the overall performance
-    auto output_vstream_params = network_group.value()->make_output_vstream_params({}, HAILO_FORMAT_TYPE_FLOAT32, HAILO_DEFAULT_VSTREAM_TIMEOUT_MS,
-                                                                                   HAILO_DEFAULT_VSTREAM_QUEUE_SIZE);
-    if (!output_vstream_params) {
-        std::cerr << "Failed creating output vstreams params " << output_vstream_params.status() << std::endl;
-        return output_vstream_params.status();
-    }
-    auto output_vstreams = VStreamsBuilder::create_output_vstreams(*network_group.value(), *output_vstream_params);
-    if (!output_vstreams) {
-        std::cerr << "Failed creating output vstreams " << output_vstreams.status() << std::endl;
-        return output_vstreams.status();
-    }
-
-    const std::size_t MAX_LAYER_EDGES = 16;
-    if (input_vstreams->size() > MAX_LAYER_EDGES || output_vstreams->size() > MAX_LAYER_EDGES) {
-        std::cerr << "Trying to infer network with too many input/output virtual streams, Maximum amount is " << MAX_LAYER_EDGES << " (either change HEF or change the definition of MAX_LAYER_EDGES)" << std::endl;
-        return HAILO_INVALID_OPERATION;
-    }
-    auto infer_handle = std::thread(infer_thread, std::move(input_vstreams), std::move(output_vstreams));
-    // infer_handle.detach();
+    /*采集 -> 解码 / 颜色转换 -> 调度（跟踪或交给推理后端），后端完成后在自己的线程里做后处理并交给预览*/
+    pipeline graph("hailo_cam");
+    auto &raw_channel = graph.make_channel<video_frame, CAPTURE_OVERFLOW>("采集", CAPTURE_QUEUE_DEPTH);
+    auto &frame_channel = graph.make_channel<video_frame>("解码", DECODE_QUEUE_DEPTH);
+    /*
+     * 多个解码线程完成顺序不固定，调度（跟踪器按采集时间外推）之前按采集序号排好；确定不会来的帧当场跳过，预览那边也不再等它
+     * emit（inference.schedule）只在调度线程上调用：采集通道挤掉的帧由 push 换回到采集线程手里（下一次 grab 之前还没释放），
+     * 采集线程只 defer_skip 登记；解码失败、过期的帧由解码线程放一个只带序号的空帧进通道，调度线程收到后 skip
+     * 调度线程等帧超过 REORDER_POLL_MS 时 poll 一次，解码线程卡住时队头的缺口照样按 REORDER_MAX_WAIT_MS 跳过
+     */
+    reorder_buffer<video_frame> decode_order(
+        "解码", REORDER_WINDOW, std::chrono::milliseconds(REORDER_MAX_WAIT_MS),
+        [&inference, &graph](video_frame &frame) {
+            if (!inference.schedule(frame))
+                graph.request_stop();
+        },
+        [&inference](uint64_t sequence) { inference.skip(sequence); });
+    // 停止时 stop 把等帧的采集线程唤醒
+    graph.add_source("采集", raw_channel, [&camera, &decode_order](video_frame &raw, std::stop_token stop) {
+        if (!raw.empty())
+            decode_order.defer_skip(raw.info().sequence);
+        return camera.grab(raw, stop);
+    });
+    // 在采集通道里排得太久、已经过期的帧不解码，同样跳过
+    deadline_gate decode_late("解码");
+    graph.add_stage("解码", raw_channel, frame_channel, [&camera, &decode_late](video_frame &raw, video_frame &frame) {
+        if (!decode_late.expired(raw.info()) && camera.convert(raw, frame))
+            return true;
+        frame.reset();
+        frame.info() = raw.info();
+        raw.reset();
+        return true;
+    }, DECODE_THREADS);
+    graph.add_sink("调度", frame_channel, [&decode_order](video_frame &frame) {
+        // 只带序号的空帧：解码线程跳过了这一帧
+        if (frame.empty()) {
+            decode_order.skip(frame.info().sequence);
+            return;
+        }
+        // 已经超时跳过的帧才到，丢掉
+        if (!decode_order.push(frame.info().sequence, frame))
+            frame.reset();
+    }, std::chrono::milliseconds(REORDER_POLL_MS), [&decode_order] { decode_order.poll(); });
+    graph.place("采集", CAPTURE_PLACEMENT);
+    graph.place("解码", DECODE_PLACEMENT);
+    graph.place("调度", SCHEDULE_PLACEMENT);
+    graph.start();
 
-    /*显示线程*/
-    while (!g_stop_requested) {
+    /*
+     * 显示线程（主线程）：在所有工作线程都创建之后才设置，之后主线程创建的线程（窗口、OpenCV 的工作线程等）继承同样的亲和性
+     * 主线程的线程名就是进程名，所以沿用 hailo_cam
+     */
+    apply_thread_placement("hailo_cam", DISPLAY_PLACEMENT);
+    while (!g_stop_requested && graph.running()) {
         cv::Mat img;
-        g_imshow_queue.front_pop(img);
-        std::cout << "imshow_queue size: " << g_imshow_queue.queue_.size() << std::endl;
-        cv::imshow("hailo_cam", img);
+        // 等新帧时带超时，流水线停了也能退出循环
+        if (display.render_latest(img, 100ms))
+            cv::imshow("hailo_cam", img);
         if (cv::waitKey(1) == 'q')
             g_stop_requested = true;
-        // g_v4l2_requeue.store(true);
-        // g_v4l2_requeue.notify_one();
     }
-    cap_handle.join();
-    infer_handle.join();
+    /*
+     * Ctrl+C / SIGTERM / q：源不再出帧，在途的帧最多再处理 SHUTDOWN_DRAIN_MS，超时（或者不排空）就丢掉还在排队的帧，
+     * 包括重排缓冲区和分派队列里等着的；文件读完时流水线已经排空
+     * 排空了的话重排缓冲区里剩下的按序交给调度，推理阶段等分派队列里的帧做完
+     */
+    const auto shutdown_start = std::chrono::steady_clock::now();
+    bool drained = true;
+    if (g_stop_requested) {
+        drained = SHUTDOWN_DRAIN_MS > 0 && graph.drain_for(std::chrono::milliseconds(SHUTDOWN_DRAIN_MS));
+        if (!drained)
+            graph.stop();
+    } else {
+        graph.wait();
+    }
+    if (drained)
+        decode_order.drain();
+    inference.finish(!drained);
+    std::cout << (drained ? "在途的帧已处理完" : "丢掉了没处理完的帧") << "，退出耗时"
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - shutdown_start).count() << "ms" << std::endl;
+    graph.report();
+    decode_order.report();
+    decode_late.report();
+    display.report();
+    raw_pool.report();
+    frames.report();
+    if (executor)
+        executor->report();
 
     return 0;
 }
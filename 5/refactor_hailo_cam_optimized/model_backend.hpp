@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include "hailo/hailort.hpp"
+
+#include "config.hpp"
+
+/*
+ * 单个模型的推理后端。真实设备上是一组 vstream（vstream_backend），
+ * 离线测试时用 sim_device 模拟 HailoRT model scheduler 的调度行为
+ */
+class model_backend {
+public:
+    virtual ~model_backend() = default;
+
+    virtual const std::string &name() const = 0;
+    virtual std::size_t input_frame_size() const = 0;
+    virtual std::size_t output_frame_size() const = 0;
+    virtual int input_width() const = 0;
+    virtual int input_height() const = 0;
+    virtual std::size_t max_batch() const = 0;
+
+    /*inputs 和 outputs 一一对应，每块大小分别是 input_frame_size() 和 output_frame_size()，调用返回时整批已完成*/
+    virtual hailo_status infer_batch(std::span<const uint8_t *const> inputs, std::span<uint8_t *const> outputs) = 0;
+};
+
+/*给网络组设置调度参数，并按 config.batch 创建 vstream（输入 NHWC/AUTO，输出 FLOAT32）*/
+hailort::Expected<std::unique_ptr<model_backend> > create_vstream_backend(std::shared_ptr<hailort::ConfiguredNetworkGroup> network_group, const model_config &config);
+
+hailo_status apply_scheduler_params(hailort::ConfiguredNetworkGroup &network_group, const model_config &config);
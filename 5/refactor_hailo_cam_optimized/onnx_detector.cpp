@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <iostream>
+#include <onnxruntime_cxx_api.h>
+#include "opencv2/opencv.hpp"
+
+#include "config.hpp"
+#include "detector.hpp"
+
+using namespace hailort;
+using namespace std::chrono_literals;
+
+/*
+ * ONNX Runtime 版 yolov8n，输出 (1, 4 + 类别数, 锚点数)，前 4 行是 cx/cy/w/h（输入像素），之后每行一个类别的概率
+ * YOLOv8 没有 objectness，每个锚点的分数就是最大类别概率；NMS 按类别做，和 HEF 里的 NMS 行为一致
+ * 输入输出张量在构造时分配，每帧复用
+ */
+class onnx_detector : public detector {
+    std::string name_;
+    Ort::Env env_;
+    Ort::Session session_{ nullptr };
+    Ort::AllocatedStringPtr input_name_{ nullptr, Ort::detail::AllocatedFree(nullptr) };
+    Ort::AllocatedStringPtr output_name_{ nullptr, Ort::detail::AllocatedFree(nullptr) };
+    Ort::MemoryInfo memory_info_{ nullptr };
+    int input_width_ = 640;
+    int input_height_ = 640;
+    int rows_ = 0;
+    int anchors_ = 0;
+
+    cv::Mat blob_;
+    std::vector<int64_t> input_shape_;
+    Ort::Value input_tensor_{ nullptr };
+    std::vector<float> output_;
+    std::vector<int64_t> output_shape_;
+    Ort::Value output_tensor_{ nullptr };
+
+    // NMS 的中间结果，每帧 clear 复用
+    std::vector<cv::Rect2d> boxes_;
+    std::vector<float> scores_;
+    std::vector<nms_detection> candidates_;
+    std::vector<int> keep_;
+
+public:
+    onnx_detector(const std::string &model_path)
+        : name_("onnx:" + model_path), env_(ORT_LOGGING_LEVEL_WARNING, "hailo_cam_fallback")
+    {
+        Ort::SessionOptions options;
+        options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_EXTENDED);
+        options.SetIntraOpNumThreads(ONNX_THREADS);
+        session_ = Ort::Session(env_, model_path.c_str(), options);
+
+        Ort::AllocatorWithDefaultOptions allocator;
+        input_name_ = session_.GetInputNameAllocated(0, allocator);
+        output_name_ = session_.GetOutputNameAllocated(0, allocator);
+
+        // 动态维度（-1）按 640x640 处理
+        auto input_dims = session_.GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+        if (input_dims.size() == 4 && input_dims[2] > 0 && input_dims[3] > 0) {
+            input_height_ = static_cast<int>(input_dims[2]);
+            input_width_ = static_cast<int>(input_dims[3]);
+        }
+        auto output_dims = session_.GetOutputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+        if (output_dims.size() != 3 || output_dims[1] <= 4 || output_dims[2] <= 0) {
+            throw std::runtime_error("unexpected yolov8 output shape");
+        }
+        rows_ = static_cast<int>(output_dims[1]);
+        anchors_ = static_cast<int>(output_dims[2]);
+
+        memory_info_ = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeCPU);
+        int blob_dims[] = { 1, 3, input_height_, input_width_ };
+        blob_.create(4, blob_dims, CV_32F);
+        input_shape_ = { 1, 3, input_height_, input_width_ };
+        input_tensor_ = Ort::Value::CreateTensor<float>(memory_info_, blob_.ptr<float>(), blob_.total(), input_shape_.data(), input_shape_.size());
+
+        output_.resize(static_cast<std::size_t>(rows_) * anchors_);
+        output_shape_ = { 1, rows_, anchors_ };
+        output_tensor_ = Ort::Value::CreateTensor<float>(memory_info_, output_.data(), output_.size(), output_shape_.data(), output_shape_.size());
+
+        boxes_.reserve(anchors_);
+        scores_.reserve(anchors_);
+        candidates_.reserve(anchors_);
+        keep_.reserve(anchors_);
+    }
+
+    const std::string &name() const override
+    {
+        return name_;
+    }
+
+    hailo_status detect(const cv::Mat &frame, std::vector<nms_detection> &dets) override
+    {
+        dets.clear();
+
+        // resize -> RGB -> /255 -> NCHW 一步完成，目标 Mat 尺寸不变时不会重新分配
+        auto opencv_start = std::chrono::high_resolution_clock::now();
+        auto blob_data = blob_.data;
+        cv::dnn::blobFromImage(frame, blob_, 1.0 / 255.0, cv::Size(input_width_, input_height_), cv::Scalar(), true, false, CV_32F);
+        if (blob_.data != blob_data) {
+            std::cerr << name_ << " 输入张量被重新分配" << std::endl;
+            return HAILO_INVALID_OPERATION;
+        }
+        std::cout << "ONNX预处理耗时：" << (std::chrono::high_resolution_clock::now() - opencv_start) / 1ms << "ms" << std::endl;
+
+        auto run_start = std::chrono::high_resolution_clock::now();
+        const char *input_names[] = { input_name_.get() };
+        const char *output_names[] = { output_name_.get() };
+        try {
+            session_.Run(Ort::RunOptions{ nullptr }, input_names, &input_tensor_, 1, output_names, &output_tensor_, 1);
+        } catch (const Ort::Exception &e) {
+            std::cerr << name_ << " 推理失败: " << e.what() << std::endl;
+            return HAILO_INTERNAL_FAILURE;
+        }
+        std::cout << "CPU推理耗时：" << (std::chrono::high_resolution_clock::now() - run_start) / 1ms << "ms" << std::endl;
+
+        decode();
+
+        // 不同类别的框平移到互不重叠的位置，一次 NMSBoxes 就等价于逐类别 NMS
+        // 分数阈值已经在 decode 里按类别过滤过了
+        keep_.clear();
+        cv::dnn::NMSBoxes(boxes_, scores_, 0.0f, NMS_IOU_THRESHOLD, keep_);
+        for (auto index : keep_) {
+            dets.push_back(candidates_[index]);
+        }
+        return HAILO_SUCCESS;
+    }
+
+private:
+    void decode()
+    {
+        boxes_.clear();
+        scores_.clear();
+        candidates_.clear();
+
+        const float *data = output_.data();
+        const int N = anchors_;
+        const float scale_x = 1.0f / input_width_;
+        const float scale_y = 1.0f / input_height_;
+        // 只比较 DETECTION_FILTER 启用的类别行，其它类别不读
+        const auto &filter = DETECTION_FILTER;
+        int class_count = 0;
+        while (class_count < filter.class_count && filter.classes[class_count] < rows_ - 4)
+            class_count++;
+        if (class_count == 0)
+            return;
+        const float *class_rows = data + 4 * N;
+        for (int i = 0; i < N; ++i) {
+            int best_class = filter.classes[0];
+            float best_score = class_rows[best_class * N + i];
+            for (int k = 1; k < class_count; ++k) {
+                int c = filter.classes[k];
+                float score = class_rows[c * N + i];
+                if (score > best_score) {
+                    best_score = score;
+                    best_class = c;
+                }
+            }
+            if (best_score < filter.thresholds[best_class])
+                continue;
+
+            float cx = data[0 * N + i] * scale_x;
+            float cy = data[1 * N + i] * scale_y;
+            float w = data[2 * N + i] * scale_x;
+            float h = data[3 * N + i] * scale_y;
+            nms_detection det{ best_class, best_score,
+                               std::clamp(cx - w / 2.0f, 0.0f, 1.0f), std::clamp(cy - h / 2.0f, 0.0f, 1.0f),
+                               std::clamp(cx + w / 2.0f, 0.0f, 1.0f), std::clamp(cy + h / 2.0f, 0.0f, 1.0f) };
+
+            double offset = best_class * 2.0;
+            boxes_.emplace_back(det.x_min + offset, det.y_min, det.x_max - det.x_min, det.y_max - det.y_min);
+            scores_.push_back(best_score);
+            candidates_.push_back(det);
+        }
+    }
+};
+
+Expected<std::unique_ptr<detector> > create_onnx_detector(const std::string &model_path)
+{
+    try {
+        return std::unique_ptr<detector>(new onnx_detector(model_path));
+    } catch (const std::exception &e) {
+        std::cerr << "Failed creating onnx session " << model_path << ": " << e.what() << std::endl;
+        return make_unexpected(HAILO_NOT_AVAILABLE);
+    }
+}
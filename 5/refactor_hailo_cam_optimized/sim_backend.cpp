@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <cstring>
+#include "sim_backend.hpp"
+
+class sim_device::sim_model : public model_backend {
+public:
+    sim_device *device_;
+    sim_model_params params_;
+    std::size_t index_;
+    std::deque<pending_frame> pending_;
+    model_stats stats_;
+
+    sim_model(sim_device *device, sim_model_params params, std::size_t index)
+        : device_(device), params_(std::move(params)), index_(index)
+    {
+    }
+
+    const std::string &name() const override
+    {
+        return params_.name;
+    }
+    std::size_t input_frame_size() const override
+    {
+        return static_cast<std::size_t>(params_.input_width) * params_.input_height * 3;
+    }
+    std::size_t output_frame_size() const override
+    {
+        return params_.output_frame_size;
+    }
+    int input_width() const override
+    {
+        return params_.input_width;
+    }
+    int input_height() const override
+    {
+        return params_.input_height;
+    }
+    std::size_t max_batch() const override
+    {
+        return params_.config.batch;
+    }
+    hailo_status infer_batch(std::span<const uint8_t *const> inputs, std::span<uint8_t *const> outputs) override
+    {
+        return device_->submit(*this, inputs, outputs);
+    }
+};
+
+sim_device::sim_device()
+    : worker_(&sim_device::run, this)
+{
+}
+
+sim_device::~sim_device()
+{
+    stop();
+}
+
+model_backend &sim_device::add_model(sim_model_params params)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    models_.push_back(std::make_unique<sim_model>(this, std::move(params), models_.size()));
+    return *models_.back();
+}
+
+sim_device::model_stats sim_device::stats(const model_backend &model) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &m : models_) {
+        if (m.get() == &model)
+            return m->stats_;
+    }
+    return {};
+}
+
+void sim_device::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    work_cv_.notify_all();
+    if (worker_.joinable())
+        worker_.join();
+}
+
+hailo_status sim_device::submit(sim_model &model, std::span<const uint8_t *const> inputs, std::span<uint8_t *const> outputs)
+{
+    if (inputs.size() != outputs.size())
+        return HAILO_INVALID_ARGUMENT;
+
+    std::size_t remaining = inputs.size();
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (stop_)
+        return HAILO_STREAM_ABORT;
+
+    auto now = clock::now();
+    for (std::size_t i = 0; i < inputs.size(); i++) {
+        model.pending_.push_back({ inputs[i], outputs[i], now, &remaining });
+    }
+    work_cv_.notify_one();
+
+    // worker 退出前会清空所有队列，所以 stop_ 之后不会再有人访问 remaining
+    done_cv_.wait(lock, [this, &remaining] { return remaining == 0 || (stop_ && worker_exited_); });
+    return remaining == 0 ? HAILO_SUCCESS : HAILO_STREAM_ABORT;
+}
+
+sim_device::sim_model *sim_device::pick_ready(clock::time_point now, clock::time_point &next_deadline)
+{
+    sim_model *best = nullptr;
+    auto count = models_.size();
+    // 从上一次运行的模型的下一个开始找，同优先级时就是轮询
+    auto first = has_last_model_ ? (last_model_ + 1) % count : 0;
+    for (std::size_t n = 0; n < count; n++) {
+        auto &model = *models_[(first + n) % count];
+        if (model.pending_.empty())
+            continue;
+
+        auto &config = model.params_.config;
+        auto threshold = std::min<std::size_t>(std::max<uint32_t>(config.threshold, 1), std::max<uint32_t>(config.batch, 1));
+        auto deadline = model.pending_.front().enqueued + std::chrono::milliseconds(config.timeout_ms);
+        bool ready = model.pending_.size() >= threshold || now >= deadline;
+        if (!ready) {
+            next_deadline = std::min(next_deadline, deadline);
+            continue;
+        }
+        if (best == nullptr || config.priority > best->params_.config.priority)
+            best = &model;
+    }
+    return best;
+}
+
+void sim_device::run()
+{
+    std::vector<pending_frame> batch;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+        if (models_.empty()) {
+            work_cv_.wait(lock);
+            continue;
+        }
+
+        auto next_deadline = clock::time_point::max();
+        auto model = pick_ready(clock::now(), next_deadline);
+        if (model == nullptr) {
+            if (next_deadline == clock::time_point::max())
+                work_cv_.wait(lock);
+            else
+                work_cv_.wait_until(lock, next_deadline);
+            continue;
+        }
+
+        auto n = std::min<std::size_t>(model->pending_.size(), std::max<uint32_t>(model->params_.config.batch, 1));
+        batch.assign(model->pending_.begin(), model->pending_.begin() + n);
+        model->pending_.erase(model->pending_.begin(), model->pending_.begin() + n);
+        bool switched = has_last_model_ && last_model_ != model->index_;
+        last_model_ = model->index_;
+        has_last_model_ = true;
+        auto cost = model->params_.frame_latency * static_cast<int64_t>(n) + (switched ? model->params_.switch_cost : std::chrono::microseconds(0));
+        auto output_size = model->params_.output_frame_size;
+        lock.unlock();
+
+        std::this_thread::sleep_for(cost);
+        // 假输出：FLOAT32 的 one-hot，下标由输入第一个字节决定，方便调用方校验结果没有串帧
+        auto classes = std::max<std::size_t>(output_size / sizeof(float), 1);
+        for (auto &frame : batch) {
+            std::memset(frame.output, 0, output_size);
+            float one = 1.0f;
+            std::memcpy(frame.output + (frame.input[0] % classes) * sizeof(float), &one, sizeof(float));
+        }
+
+        lock.lock();
+        auto done = clock::now();
+        auto &stats = model->stats_;
+        stats.frames += n;
+        stats.batches++;
+        stats.switches += switched ? 1 : 0;
+        for (auto &frame : batch) {
+            auto latency = std::chrono::duration_cast<std::chrono::microseconds>(done - frame.enqueued);
+            stats.total_latency += latency;
+            stats.max_latency = std::max(stats.max_latency, latency);
+            --*frame.remaining;
+        }
+        done_cv_.notify_all();
+    }
+
+    for (auto &model : models_) {
+        model->pending_.clear();
+    }
+    worker_exited_ = true;
+    done_cv_.notify_all();
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "model_backend.hpp"
+
+/*
+ * 模拟一块被多个模型共享的 NPU，调度规则和 HailoRT model scheduler 一致：
+ * 1. 模型攒够 threshold 帧，或者最早的一帧已经等了 timeout，才算就绪
+ * 2. 就绪模型里 priority 最大的先跑，同优先级轮询
+ * 3. 一次最多跑 max_batch 帧；换到另一个模型要额外付出 switch_cost
+ * 只用来在没有设备的机器上验证调度逻辑，输出内容是确定的假数据
+ */
+struct sim_model_params {
+    std::string name;
+    model_config config;
+    int input_width;
+    int input_height;
+    std::size_t output_frame_size;
+    std::chrono::microseconds frame_latency;
+    std::chrono::microseconds switch_cost;
+};
+
+class sim_device {
+public:
+    struct model_stats {
+        std::size_t frames = 0;
+        std::size_t batches = 0;
+        std::size_t switches = 0;
+        std::chrono::microseconds total_latency{ 0 };
+        std::chrono::microseconds max_latency{ 0 };
+    };
+
+    sim_device();
+    ~sim_device();
+    sim_device(const sim_device &) = delete;
+    sim_device &operator=(const sim_device &) = delete;
+
+    /*在第一次 infer_batch 之前添加*/
+    model_backend &add_model(sim_model_params params);
+    model_stats stats(const model_backend &model) const;
+    void stop();
+
+private:
+    using clock = std::chrono::steady_clock;
+    class sim_model;
+
+    struct pending_frame {
+        const uint8_t *input;
+        uint8_t *output;
+        clock::time_point enqueued;
+        std::size_t *remaining;
+    };
+
+    mutable std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    std::vector<std::unique_ptr<sim_model> > models_;
+    std::size_t last_model_ = 0;
+    bool has_last_model_ = false;
+    bool stop_ = false;
+    bool worker_exited_ = false;
+    std::thread worker_;
+
+    hailo_status submit(sim_model &model, std::span<const uint8_t *const> inputs, std::span<uint8_t *const> outputs);
+    sim_model *pick_ready(clock::time_point now, clock::time_point &next_deadline);
+    void run();
+};
@@ -0,0 +1,271 @@
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include "channel.hpp"
+#include "check.hpp"
+
+/*
+ * bounded_channel：block / drop_newest 走 spsc_channel（声明了单线程的一端不加锁），drop_oldest / sample 走单锁实现
+ * 每个元素一个序号，消费者检查不丢、不重复，单生产者时还要求顺序不变
+ */
+
+using namespace std::chrono_literals;
+using test_clock = std::chrono::steady_clock;
+
+/*producers 个线程各 push per_producer 个元素，consumers 个线程 pop 到关闭；返回每个序号被取到的次数*/
+template <overflow_policy Policy>
+static std::vector<int> run_threads(bounded_channel<int, Policy> &channel, unsigned producers, unsigned consumers, int per_producer, bool &ordered)
+{
+    std::vector<std::atomic<int> > seen(producers * per_producer);
+    std::atomic<unsigned> remaining{ producers };
+    std::atomic<bool> in_order{ true };
+    std::vector<std::thread> threads;
+    for (unsigned p = 0; p < producers; p++) {
+        threads.emplace_back([&, p] {
+            for (int i = 0; i < per_producer; i++) {
+                int value = static_cast<int>(p) * per_producer + i;
+                channel.push(value);
+            }
+            if (remaining.fetch_sub(1) == 1)
+                channel.close();
+        });
+    }
+    for (unsigned c = 0; c < consumers; c++) {
+        threads.emplace_back([&] {
+            int value = 0;
+            int last = -1;
+            while (channel.pop(value)) {
+                if (value < last)
+                    in_order = false;
+                last = value;
+                seen[value]++;
+            }
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    ordered = in_order;
+    std::vector<int> counts;
+    for (auto &count : seen)
+        counts.push_back(count.load());
+    return counts;
+}
+
+static bool each_once(const std::vector<int> &counts)
+{
+    for (int count : counts) {
+        if (count != 1)
+            return false;
+    }
+    return true;
+}
+
+/*block：声明单生产者单消费者（两端不加锁）、多生产者、多消费者、不声明，都不丢不重复*/
+static void test_block_endpoints()
+{
+    struct setup {
+        unsigned producers, consumers;
+        bool declare;
+    };
+    for (auto [producers, consumers, declare] : { setup{ 1, 1, true }, setup{ 3, 1, true }, setup{ 1, 3, true }, setup{ 2, 2, true }, setup{ 2, 2, false } }) {
+        bounded_channel<int, overflow_policy::block> channel("block", 3);
+        if (declare) {
+            channel.add_producers(producers);
+            channel.add_consumers(consumers);
+        }
+        bool ordered = false;
+        auto counts = run_threads(channel, producers, consumers, 20000, ordered);
+        CHECK(each_once(counts));
+        if (producers == 1 && consumers == 1)
+            CHECK(ordered);
+        auto stats = channel.statistics();
+        CHECK_EQ(stats.pushed, counts.size());
+        CHECK_EQ(stats.popped, counts.size());
+        CHECK_EQ(stats.dropped, 0u);
+        CHECK(stats.high_watermark <= 3);
+    }
+}
+
+/*push / pop 和槽位交换：push 之后 item 里是消费者换进去的空壳，容量在两端之间循环*/
+static void test_swap()
+{
+    bounded_channel<std::vector<int>, overflow_policy::block> channel("swap", 2);
+    channel.add_producers(1);
+    channel.add_consumers(1);
+    std::vector<int> out;
+    out.reserve(100);
+    out.push_back(1);
+    CHECK(channel.push(out));
+    CHECK(out.empty());
+
+    std::vector<int> in;
+    in.reserve(50);
+    const auto *consumer_buffer = in.data();
+    CHECK(channel.pop(in));
+    CHECK_EQ(in.size(), 1u);
+    CHECK_EQ(in.capacity(), 100u);
+
+    // 容量 2：再 push 两个，第二个落在第一个槽位上，换回来的是消费者刚留下的空壳
+    std::vector<int> second{ 2 };
+    CHECK(channel.push(second));
+    std::vector<int> third{ 3 };
+    CHECK(channel.push(third));
+    CHECK(third.empty());
+    CHECK(third.data() == consumer_buffer);
+    CHECK_EQ(third.capacity(), 50u);
+}
+
+/*drop_newest：满了丢新来的，已经排队的不受影响；容量不取整*/
+static void test_drop_newest()
+{
+    bounded_channel<int, overflow_policy::drop_newest> channel("drop_newest", 3);
+    channel.add_producers(1);
+    channel.add_consumers(1);
+    CHECK_EQ(channel.capacity(), 3u);
+    for (int i = 0; i < 5; i++) {
+        int value = i;
+        CHECK(channel.push(value));
+    }
+    CHECK_EQ(channel.size(), 3u);
+    int value = -1;
+    for (int i = 0; i < 3; i++) {
+        CHECK(channel.try_pop(value));
+        CHECK_EQ(value, i);
+    }
+    CHECK(!channel.try_pop(value));
+    auto stats = channel.statistics();
+    CHECK_EQ(stats.pushed, 3u);
+    CHECK_EQ(stats.dropped, 2u);
+    CHECK_EQ(stats.overflows, 2u);
+    CHECK_EQ(stats.high_watermark, 3u);
+}
+
+/*drop_oldest 仍然是单锁实现：满了挤掉最旧的，被挤掉的换回到 item 里*/
+static void test_drop_oldest()
+{
+    bounded_channel<int, overflow_policy::drop_oldest> channel("drop_oldest", 2);
+    for (int i = 0; i < 4; i++) {
+        int value = i;
+        CHECK(channel.push(value));
+        if (i >= 2)
+            CHECK_EQ(value, i - 2);
+    }
+    int value = -1;
+    CHECK(channel.pop(value));
+    CHECK_EQ(value, 2);
+    CHECK(channel.pop(value));
+    CHECK_EQ(value, 3);
+    CHECK_EQ(channel.statistics().dropped, 2u);
+}
+
+/*pop_for 超时返回 false；close 叫醒睡着的生产者和消费者，取完剩下的才失败*/
+static void test_timeout_and_close()
+{
+    bounded_channel<int, overflow_policy::block> channel("close", 1);
+    channel.add_producers(1);
+    channel.add_consumers(1);
+    int value = 0;
+    auto start = test_clock::now();
+    CHECK(!channel.pop_for(value, 50ms));
+    auto elapsed = test_clock::now() - start;
+    CHECK(elapsed >= 50ms);
+    CHECK(elapsed < 2000ms);
+
+    // 通道满了，生产者睡在 push 里，close 之后返回 false
+    value = 1;
+    CHECK(channel.push(value));
+    std::atomic<int> pushed{ -1 };
+    std::thread producer([&] {
+        int next = 2;
+        pushed = channel.push(next) ? 1 : 0;
+    });
+    std::this_thread::sleep_for(50ms);
+    CHECK_EQ(pushed.load(), -1);
+    channel.close();
+    producer.join();
+    CHECK_EQ(pushed.load(), 0);
+
+    // 关闭前放进去的元素还能取到，之后 pop / pop_for 马上失败
+    CHECK(channel.pop(value));
+    CHECK_EQ(value, 1);
+    start = test_clock::now();
+    CHECK(!channel.pop(value));
+    CHECK(!channel.pop_for(value, 1000ms));
+    CHECK(test_clock::now() - start < 500ms);
+
+    // 消费者睡在 pop 里，close 叫醒它
+    bounded_channel<int, overflow_policy::block> empty("empty", 2);
+    std::thread consumer([&] {
+        int item = 0;
+        CHECK(!empty.pop(item));
+    });
+    std::this_thread::sleep_for(50ms);
+    empty.close();
+    consumer.join();
+}
+
+/*异步消费者：登记后每来一个元素 notify 一次；notify 之后再 try_pop_or_wait，直到关闭，不丢元素也不重复叫醒*/
+struct counting_waiter : channel_waiter {
+    std::atomic<int> notified{ 0 };
+    void notify() override
+    {
+        notified++;
+        notified.notify_one();
+    }
+};
+
+static void test_async_waiter()
+{
+    constexpr int ITEMS = 20000;
+    bounded_channel<int, overflow_policy::block> channel("async", 2);
+    channel.add_producers(1);
+    channel.add_consumers(1);
+    std::thread producer([&] {
+        for (int i = 0; i < ITEMS; i++) {
+            int value = i;
+            channel.push(value);
+        }
+        channel.close();
+    });
+
+    counting_waiter waiter;
+    int expected = 0;
+    int waits = 0;
+    int value = 0;
+    bool in_order = true;
+    while (true) {
+        const int before = waiter.notified.load();
+        auto result = channel.try_pop_or_wait(value, waiter);
+        if (result == pop_result::closed)
+            break;
+        if (result == pop_result::popped) {
+            in_order = in_order && value == expected;
+            expected++;
+            continue;
+        }
+        // 登记了就一定会被叫醒一次（有元素进来或者关闭）
+        waits++;
+        waiter.notified.wait(before);
+        CHECK_EQ(waiter.notified.load(), before + 1);
+    }
+    producer.join();
+    CHECK(in_order);
+    CHECK_EQ(expected, ITEMS);
+    CHECK_EQ(waiter.notified.load(), waits);
+}
+
+int main()
+{
+    test_block_endpoints();
+    test_swap();
+    test_drop_newest();
+    test_drop_oldest();
+    test_timeout_and_close();
+    test_async_waiter();
+    if (check_failures == 0)
+        std::cout << "channel_test: 全部通过" << std::endl;
+    return check_failures == 0 ? 0 : 1;
+}
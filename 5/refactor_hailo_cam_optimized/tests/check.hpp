@@ -0,0 +1,24 @@
+#pragma once
+
+#include <iostream>
+
+/*测试用的断言：失败时打印位置和表达式，计入 check_failures，main 最后返回 check_failures != 0*/
+inline int check_failures = 0;
+
+#define CHECK(expr)                                                                          \
+    do {                                                                                     \
+        if (!(expr)) {                                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #expr ") 失败" << std::endl; \
+            check_failures++;                                                                \
+        }                                                                                    \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                                                                          \
+    do {                                                                                                                        \
+        const auto &check_a = (a);                                                                                              \
+        const auto &check_b = (b);                                                                                              \
+        if (!(check_a == check_b)) {                                                                                            \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_EQ(" #a ", " #b ") 失败: " << check_a << " != " << check_b << std::endl; \
+            check_failures++;                                                                                                   \
+        }                                                                                                                       \
+    } while (0)
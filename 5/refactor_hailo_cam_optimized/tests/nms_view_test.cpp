@@ -0,0 +1,178 @@
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "check.hpp"
+#include "hailo_nms.hpp"
+
+/*nms_by_class_view / nms_class_filter：迭代器和 for_each 一致、计数器越界截断、空类别、量化域比较和浮点路径一致*/
+
+template <typename View>
+static std::vector<nms_detection> iterate(const View &view)
+{
+    std::vector<nms_detection> dets;
+    for (auto det : view)
+        dets.push_back(det);
+    return dets;
+}
+
+template <typename View>
+static std::vector<nms_detection> callback(const View &view)
+{
+    std::vector<nms_detection> dets;
+    view.for_each([&dets](const nms_detection &det) { dets.push_back(det); });
+    return dets;
+}
+
+static bool same(const std::vector<nms_detection> &a, const std::vector<nms_detection> &b, float tolerance = 0.0f)
+{
+    if (a.size() != b.size())
+        return false;
+    auto near = [tolerance](float x, float y) { return x - y <= tolerance && y - x <= tolerance; };
+    for (std::size_t i = 0; i < a.size(); i++) {
+        if (a[i].class_id != b[i].class_id || !near(a[i].score, b[i].score) || !near(a[i].x_min, b[i].x_min) || !near(a[i].y_min, b[i].y_min) ||
+            !near(a[i].x_max, b[i].x_max) || !near(a[i].y_max, b[i].y_max))
+            return false;
+    }
+    return true;
+}
+
+/*按布局随机填一帧：每类 0..MAX_BOXES 个框（每三类留一个空类别），各个值在 0..max_value 之间均匀分布*/
+template <typename T, int NUM_CLASSES, int MAX_BOXES>
+static std::vector<T> random_frame(std::mt19937 &rng, T max_value)
+{
+    using view = nms_by_class_view<T, NUM_CLASSES, MAX_BOXES>;
+    std::vector<T> out(view::ELEMENT_COUNT);
+    std::uniform_int_distribution<int> count(0, MAX_BOXES);
+    std::uniform_real_distribution<float> value(0.0f, static_cast<float>(max_value));
+    for (int class_id = 0; class_id < NUM_CLASSES; class_id++) {
+        T *counter = out.data() + class_id * view::CLASS_STRIDE;
+        int n = class_id % 3 == 1 ? 0 : count(rng);
+        *counter = static_cast<T>(n);
+        for (int i = 0; i < n * NMS_BOX_DIM; i++)
+            counter[1 + i] = static_cast<T>(value(rng));
+    }
+    return out;
+}
+
+static void test_iterator_matches_for_each()
+{
+    std::mt19937 rng(1);
+    for (int round = 0; round < 20; round++) {
+        auto out = random_frame<float, 12, 6>(rng, 1.0f);
+        using view = nms_by_class_view<float, 12, 6>;
+        auto all = view(out.data(), 0.3f);
+        CHECK(same(iterate(all), callback(all)));
+
+        // 只启用部分类别、各自的阈值；没启用的类别即使有框也不出现
+        std::pair<int, float> entries[] = { { 7, 0.6f }, { 0, 0.2f }, { 4, 0.9f }, { 7, 0.5f } };
+        auto filter = view::filter_type::from(entries, 0.3f);
+        CHECK_EQ(filter.class_count, 3);
+        auto some = view(out.data(), filter);
+        auto dets = iterate(some);
+        CHECK(same(dets, callback(some)));
+        for (auto &det : dets) {
+            CHECK(det.class_id == 0 || det.class_id == 4 || det.class_id == 7);
+            CHECK(det.score >= filter.thresholds[det.class_id]);
+        }
+    }
+}
+
+static void test_count_clamped()
+{
+    using view = nms_by_class_view<float, 3, 4>;
+    std::vector<float> out(view::ELEMENT_COUNT, 0.0f);
+    // 类别 0 的计数器超过 MAX_BOXES，框全部通过阈值；后面类别 1 的内存里也是能通过阈值的数，不能被读成类别 0 的框
+    out[0] = 4 + 50;
+    for (int i = 1; i < view::CLASS_STRIDE; i++)
+        out[i] = 0.9f;
+    out[view::CLASS_STRIDE] = 0;
+    for (int i = 1; i < view::CLASS_STRIDE; i++)
+        out[view::CLASS_STRIDE + i] = 0.9f;
+    // 类别 2 的计数器是负数（损坏的输出）当作空
+    out[2 * view::CLASS_STRIDE] = -3;
+
+    auto v = view(out.data(), 0.5f);
+    CHECK_EQ(v.count(0), 4);
+    CHECK_EQ(v.count(1), 0);
+    CHECK_EQ(v.count(2), 0);
+    auto dets = iterate(v);
+    CHECK_EQ(dets.size(), 4u);
+    CHECK(same(dets, callback(v)));
+    for (auto &det : dets)
+        CHECK_EQ(det.class_id, 0);
+
+    // 量化输出的计数器同样截断
+    using qview = nms_by_class_view<uint16_t, 3, 4>;
+    std::vector<uint16_t> q(qview::ELEMENT_COUNT, 200);
+    q[0] = 60000;
+    q[qview::CLASS_STRIDE] = 0;
+    q[2 * qview::CLASS_STRIDE] = 0;
+    CHECK_EQ(qview(q.data(), 0.5f, { 0.0f, 1.0f / 255 }).count(0), 4);
+    CHECK_EQ(iterate(qview(q.data(), 0.5f, { 0.0f, 1.0f / 255 })).size(), 4u);
+}
+
+static void test_empty_classes()
+{
+    using view = nms_by_class_view<float, 5, 4>;
+    std::vector<float> out(view::ELEMENT_COUNT, 0.9f);
+    for (int class_id = 0; class_id < 5; class_id++)
+        out[class_id * view::CLASS_STRIDE] = 0;
+    auto v = view(out.data(), 0.1f);
+    CHECK(v.begin() == v.end());
+    CHECK(callback(v).empty());
+
+    // 空类别夹在有框的类别中间，迭代器跳过它们时不丢、不重复
+    out[1 * view::CLASS_STRIDE] = 2;
+    out[4 * view::CLASS_STRIDE] = 1;
+    auto dets = iterate(view(out.data(), 0.1f));
+    CHECK_EQ(dets.size(), 3u);
+    CHECK(same(dets, callback(view(out.data(), 0.1f))));
+    if (dets.size() == 3) {
+        CHECK_EQ(dets[0].class_id, 1);
+        CHECK_EQ(dets[1].class_id, 1);
+        CHECK_EQ(dets[2].class_id, 4);
+    }
+
+    // 有框但一个都没过阈值的类别也等于空
+    auto none = view(out.data(), 0.95f);
+    CHECK(none.begin() == none.end());
+}
+
+/*量化输出在量化域里比较阈值，结果要和整块反量化后走浮点路径一样*/
+static void test_quantized_matches_float()
+{
+    constexpr int CLASSES = NMS_NUM_CLASSES;
+    constexpr int BOXES = 8;
+    using qview = nms_by_class_view<uint16_t, CLASSES, BOXES>;
+    using fview = nms_by_class_view<float, CLASSES, BOXES>;
+    const nms_quant quant{ 3.0f, 1.0f / 255 };
+    std::mt19937 rng(2);
+    for (int round = 0; round < 20; round++) {
+        auto q = random_frame<uint16_t, CLASSES, BOXES>(rng, 258);
+        std::vector<float> f(fview::ELEMENT_COUNT);
+        dequantize_nms_by_class<CLASSES, BOXES>(q.data(), f.data(), quant);
+
+        // 阈值都不落在量化格点上，两条路径对边界上的框不会有分歧
+        for (float threshold : { 0.137f, 0.5021f, 0.803f }) {
+            auto quantized = iterate(qview(q.data(), threshold, quant));
+            CHECK(same(quantized, iterate(fview(f.data(), threshold)), 1e-6f));
+            CHECK(same(quantized, callback(qview(q.data(), threshold, quant))));
+        }
+        std::pair<int, float> entries[] = { { 0, 0.41f }, { 2, 0.7013f }, { 79, 0.2f } };
+        auto filter = nms_class_filter<CLASSES>::from(entries, 0.5f);
+        CHECK(same(iterate(qview(q.data(), filter, quant)), iterate(fview(f.data(), filter)), 1e-6f));
+    }
+}
+
+int main()
+{
+    test_iterator_matches_for_each();
+    test_count_clamped();
+    test_empty_classes();
+    test_quantized_matches_float();
+    if (check_failures == 0)
+        std::cout << "nms_view_test: 全部通过" << std::endl;
+    return check_failures == 0 ? 0 : 1;
+}
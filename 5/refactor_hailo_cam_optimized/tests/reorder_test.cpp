@@ -0,0 +1,103 @@
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "check.hpp"
+#include "reorder_buffer.hpp"
+
+/*reorder_buffer：按序号输出、skip 当场跳过、defer_skip 只登记不输出、poll 推进超时*/
+
+using namespace std::chrono_literals;
+
+struct recorder {
+    std::vector<int> emitted;
+    std::vector<uint64_t> skipped;
+    std::vector<std::thread::id> threads; // 每次 emit 所在的线程
+};
+
+static reorder_buffer<int> make_buffer(recorder &r, std::chrono::milliseconds max_wait)
+{
+    return reorder_buffer<int>(
+        "test", 4, max_wait,
+        [&r](int &item) {
+            r.emitted.push_back(item);
+            r.threads.push_back(std::this_thread::get_id());
+        },
+        [&r](uint64_t sequence) { r.skipped.push_back(sequence); });
+}
+
+static void test_order_and_skip()
+{
+    recorder r;
+    auto order = make_buffer(r, 1000ms);
+    int item = 2;
+    CHECK(order.push(2, item));
+    item = 0;
+    CHECK(order.push(0, item));
+    CHECK_EQ(r.emitted.size(), 1u);
+    order.skip(1);
+    CHECK_EQ(r.emitted.size(), 2u);
+    CHECK_EQ(r.skipped.size(), 1u);
+    item = 1;
+    CHECK(!order.push(1, item));
+    CHECK_EQ(order.statistics().late, 1u);
+}
+
+/*别的线程 defer_skip 不输出任何东西，下一次 push / poll 时在调用线程上输出*/
+static void test_defer_skip()
+{
+    recorder r;
+    auto order = make_buffer(r, 1000ms);
+    int item = 1;
+    CHECK(order.push(1, item));
+    item = 2;
+    CHECK(order.push(2, item));
+    std::thread other([&order] {
+        order.defer_skip(0);
+        // 超出窗口的序号也只登记
+        order.defer_skip(9);
+    });
+    other.join();
+    CHECK(r.emitted.empty());
+
+    order.poll();
+    CHECK_EQ(r.emitted.size(), 2u);
+    for (auto id : r.threads)
+        CHECK(id == std::this_thread::get_id());
+
+    // 9 落进窗口时 3..5 按窗口满跳过；6 到了直接输出，之后 3 算迟到
+    CHECK_EQ(order.statistics().skipped_window, 3u);
+    item = 6;
+    CHECK(order.push(6, item));
+    CHECK_EQ(r.emitted.size(), 3u);
+    if (r.emitted.size() == 3)
+        CHECK_EQ(r.emitted[2], 6);
+    item = 3;
+    CHECK(!order.push(3, item));
+}
+
+/*队头缺口等满 max_wait 后由 poll 跳过，不用等下一个元素*/
+static void test_poll_timeout()
+{
+    recorder r;
+    auto order = make_buffer(r, 50ms);
+    int item = 1;
+    CHECK(order.push(1, item));
+    order.poll();
+    CHECK(r.emitted.empty());
+    std::this_thread::sleep_for(80ms);
+    order.poll();
+    CHECK_EQ(r.emitted.size(), 1u);
+    CHECK_EQ(order.statistics().skipped_late, 1u);
+}
+
+int main()
+{
+    test_order_and_skip();
+    test_defer_skip();
+    test_poll_timeout();
+    if (check_failures == 0)
+        std::cout << "reorder_test: 全部通过" << std::endl;
+    return check_failures == 0 ? 0 : 1;
+}
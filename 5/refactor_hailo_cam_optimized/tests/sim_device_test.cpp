@@ -0,0 +1,181 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "check.hpp"
+#include "classifier.hpp"
+#include "sim_backend.hpp"
+
+/*
+ * sim_device 的调度规则（见 sim_backend.hpp）和 crop_classifier 出错时的收尾
+ * 时间都放得很宽，单核、负载高的机器上也不会误报
+ */
+
+using namespace std::chrono_literals;
+using test_clock = std::chrono::steady_clock;
+
+static sim_model_params model(std::string name, model_config config, std::chrono::microseconds frame_latency)
+{
+    return { std::move(name), config, 8, 8, sizeof(float) * 4, frame_latency, 0us };
+}
+
+/*在新线程里给 backend 提交一帧，返回后按完成先后记下名次*/
+struct submitter {
+    std::atomic<int> &finished;
+    int order = -1;
+    hailo_status status = HAILO_INTERNAL_FAILURE;
+    std::vector<uint8_t> input;
+    std::vector<uint8_t> output;
+    std::thread thread;
+
+    submitter(model_backend &backend, std::atomic<int> &counter) : finished(counter), input(backend.input_frame_size()), output(backend.output_frame_size())
+    {
+        thread = std::thread([this, &backend] {
+            const uint8_t *in = input.data();
+            uint8_t *out = output.data();
+            status = backend.infer_batch(std::span(&in, 1), std::span(&out, 1));
+            order = finished.fetch_add(1);
+        });
+    }
+    ~submitter()
+    {
+        if (thread.joinable())
+            thread.join();
+    }
+};
+
+/*攒够 threshold 帧才一起跑，之前先到的帧在等*/
+static void test_threshold()
+{
+    sim_device device;
+    auto &backend = device.add_model(model("threshold", { 10, 5000, 4, 4 }, 1ms));
+    std::atomic<int> finished{ 0 };
+    std::vector<std::unique_ptr<submitter> > frames;
+    for (int i = 0; i < 3; i++)
+        frames.push_back(std::make_unique<submitter>(backend, finished));
+    std::this_thread::sleep_for(200ms);
+    CHECK_EQ(finished.load(), 0);
+
+    frames.push_back(std::make_unique<submitter>(backend, finished));
+    frames.clear();
+    CHECK_EQ(finished.load(), 4);
+    auto stats = device.stats(backend);
+    CHECK_EQ(stats.frames, 4u);
+    CHECK_EQ(stats.batches, 1u);
+}
+
+/*不够 threshold 时，最早一帧等满 timeout 也会跑，批里只有已经到的帧*/
+static void test_timeout()
+{
+    sim_device device;
+    auto &backend = device.add_model(model("timeout", { 10, 100, 8, 8 }, 1ms));
+    std::atomic<int> finished{ 0 };
+    auto start = test_clock::now();
+    {
+        submitter frame(backend, finished);
+    }
+    auto elapsed = test_clock::now() - start;
+    CHECK(elapsed >= 100ms);
+    CHECK(elapsed < 2000ms);
+    auto stats = device.stats(backend);
+    CHECK_EQ(stats.frames, 1u);
+    CHECK_EQ(stats.batches, 1u);
+}
+
+/*
+ * 设备被 blocker 占着的时候 first、second 先后到达，都已就绪；blocker 跑完后下一个是谁：
+ * 优先级不同时高的先跑，和到达顺序、轮询位置无关；优先级相同时从 blocker 的下一个模型开始轮询
+ */
+static void test_order(uint8_t first_priority, uint8_t second_priority, bool first_added_later, bool expect_first)
+{
+    sim_device device;
+    auto &blocker = device.add_model(model("blocker", { 0, 0, 1, 1 }, 300ms));
+    auto *first = &device.add_model(model("first", { first_priority, 0, 1, 1 }, 100ms));
+    auto *second = &device.add_model(model("second", { second_priority, 0, 1, 1 }, 100ms));
+    if (first_added_later)
+        std::swap(first, second);
+
+    std::atomic<int> finished{ 0 };
+    submitter busy(blocker, finished);
+    std::this_thread::sleep_for(100ms);
+    submitter a(*first, finished);
+    std::this_thread::sleep_for(20ms);
+    submitter b(*second, finished);
+    busy.thread.join();
+    a.thread.join();
+    b.thread.join();
+    CHECK_EQ(busy.order, 0);
+    CHECK_EQ(a.status, HAILO_SUCCESS);
+    CHECK_EQ(b.status, HAILO_SUCCESS);
+    CHECK_EQ(a.order < b.order, expect_first);
+}
+
+/*每次 infer_batch 都失败的分类模型*/
+class failing_backend : public model_backend {
+    std::string name_ = "failing";
+
+public:
+    const std::string &name() const override
+    {
+        return name_;
+    }
+    std::size_t input_frame_size() const override
+    {
+        return 8 * 8 * 3;
+    }
+    std::size_t output_frame_size() const override
+    {
+        return sizeof(float) * 4;
+    }
+    int input_width() const override
+    {
+        return 8;
+    }
+    int input_height() const override
+    {
+        return 8;
+    }
+    std::size_t max_batch() const override
+    {
+        return 2;
+    }
+    hailo_status infer_batch(std::span<const uint8_t *const>, std::span<uint8_t *const>) override
+    {
+        return HAILO_INTERNAL_FAILURE;
+    }
+};
+
+/*一批中途失败也要结束这一帧的统计，不然拷贝计数会并进下一帧*/
+static void test_classifier_failure()
+{
+    failing_backend backend;
+    const int classes[] = { 0 };
+    crop_classifier classifier(backend, classes);
+    cv::Mat frame(64, 64, CV_8UC3, cv::Scalar(0, 0, 0));
+    std::vector<nms_detection> dets(3, { 0, 0.9f, 0.1f, 0.1f, 0.5f, 0.5f });
+    std::vector<crop_result> results;
+    for (std::size_t n = 1; n <= 2; n++) {
+        CHECK(classifier.classify(frame, dets, results) != HAILO_SUCCESS);
+        CHECK(results.empty());
+        CHECK_EQ(classifier.metrics().frames, n);
+    }
+}
+
+int main()
+{
+    test_threshold();
+    test_timeout();
+    // first 先到、轮询也先轮到它，但 second 优先级高
+    test_order(1, 5, false, false);
+    // 优先级相同：second 先加进设备、紧跟在 blocker 后面，后到也先跑
+    test_order(1, 1, true, false);
+    // 优先级相同，轮询位置和到达顺序都是 first 在前
+    test_order(1, 1, false, true);
+    test_classifier_failure();
+    if (check_failures == 0)
+        std::cout << "sim_device_test: 全部通过" << std::endl;
+    return check_failures == 0 ? 0 : 1;
+}